@@ -0,0 +1,176 @@
+//*****************************************************************************
+// FXOS8700CQ FIFO sampling engine
+//*****************************************************************************
+
+#include <string.h>
+#include "fifo_sampler.h"
+
+// Hybrid mode output data rates per sensor in mHz, indexed by FXOS_DR_*
+static const uint32_t g_pui32HybridODRmHz[8] =
+{
+    400000, 200000, 100000, 50000, 25000, 6250, 3125, 781
+};
+
+int AGSamplerInit(tAGSampler *psSampler, tI2CBus *psBus, uint8_t ui8Addr,
+                  uint8_t ui8DataRate, uint8_t ui8Range, uint8_t ui8Watermark)
+{
+    uint8_t ui8WhoAmI = 0;
+    int iErr = 0;
+
+    memset(psSampler, 0, sizeof(*psSampler));
+    psSampler->psBus = psBus;
+    psSampler->ui8Addr = ui8Addr;
+
+    if (ui8Watermark == 0 || ui8Watermark > FXOS_FIFO_DEPTH)
+    {
+        ui8Watermark = FXOS_FIFO_DEPTH / 2;
+    }
+    psSampler->ui8Watermark = ui8Watermark;
+    psSampler->ui64PeriodNs = 1000000000000ULL / g_pui32HybridODRmHz[ui8DataRate & 7];
+
+    if (I2CBusReadReg(psBus, ui8Addr, FXOS_WHO_AM_I, &ui8WhoAmI) || ui8WhoAmI != FXOS_WHO_AM_I_VALUE)
+    {
+        return -1;
+    }
+
+    // Standby before touching the configuration
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_CTRL_REG1, 0);
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_XYZ_DATA_CFG, ui8Range & FXOS_FS_MASK);
+
+    // Hybrid mode, no magnetometer oversampling so it keeps up at 400 Hz.
+    // Hybrid auto-increment stays off: the FIFO burst has to wrap at
+    // OUT_Z_LSB, and the magnetometer is read on its own after it
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_M_CTRL_REG1, FXOS_M_HMS_HYBRID);
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_M_CTRL_REG2, 0);
+
+    // Circular FIFO so an overrun keeps the newest samples
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_F_SETUP, FXOS_F_MODE_CIRCULAR | ui8Watermark);
+
+    // Watermark interrupt on INT1, open-drain active low into the board's
+    // pull-up, so the host can block on the pin instead of a timer
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_CTRL_REG3, FXOS_PP_OD);
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_CTRL_REG4, FXOS_INT_FIFO);
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_CTRL_REG5, FXOS_INT_FIFO);
+
+    // Low-noise is only valid up to ±4 g
+    iErr |= I2CBusWriteReg(psBus, ui8Addr, FXOS_CTRL_REG1,
+                           (uint8_t)(((ui8DataRate & 7) << FXOS_DR_SHIFT)
+                                     | (ui8Range == FXOS_FS_8G ? 0 : FXOS_LNOISE)
+                                     | FXOS_ACTIVE));
+
+    psSampler->ui64StartNs = psBus->pfnNow(psBus);
+    psSampler->ui64LastDrainNs = psSampler->ui64StartNs;
+
+    return iErr ? -1 : 0;
+}
+
+uint64_t AGSamplerWaitNs(const tAGSampler *psSampler)
+{
+    uint64_t ui64Now = psSampler->psBus->pfnNow(psSampler->psBus);
+    uint64_t ui64Due;
+
+    if (psSampler->ui32Backlog >= psSampler->ui8Watermark)
+    {
+        return 0;
+    }
+
+    ui64Due = psSampler->ui64LastDrainNs
+              + psSampler->ui64PeriodNs * (psSampler->ui8Watermark - psSampler->ui32Backlog);
+
+    return ui64Due > ui64Now ? ui64Due - ui64Now : 0;
+}
+
+int AGSamplerDrain(tAGSampler *psSampler, tAGSample *psSamples, uint32_t ui32Max)
+{
+    // F_STATUS followed by up to a full FIFO; with the FIFO on, the burst
+    // wraps OUT_Z_LSB back to OUT_X_MSB and pops one sample per 6 bytes
+    uint8_t pui8Burst[1 + 6 * FXOS_FIFO_DEPTH];
+    uint8_t pui8Mag[6];
+    uint32_t ui32Burst;
+    uint32_t ui32Count;
+    uint32_t ui32Idx;
+    uint64_t ui64Now;
+    int16_t pi16Mag[3];
+
+    // Read the watermark's worth we expect; anything beyond it stays in
+    // the FIFO for the next batch rather than costing a second transaction
+    ui32Burst = psSampler->ui8Watermark;
+    if (ui32Burst > ui32Max)
+    {
+        ui32Burst = ui32Max;
+    }
+
+    if (I2CBusRead(psSampler->psBus, psSampler->ui8Addr, FXOS_STATUS, pui8Burst, 1 + 6 * ui32Burst))
+    {
+        return -1;
+    }
+    ui64Now = psSampler->psBus->pfnNow(psSampler->psBus);
+
+    if (pui8Burst[0] & FXOS_F_OVF)
+    {
+        psSampler->ui64Overflows++;
+    }
+
+    // f_cnt is latched when the status byte is read, so only that many of
+    // the burst's samples are real
+    ui32Count = pui8Burst[0] & FXOS_F_CNT_MASK;
+    psSampler->ui32Backlog = 0;
+    if (ui32Count > ui32Burst)
+    {
+        psSampler->ui32Backlog = ui32Count - ui32Burst;
+        ui32Count = ui32Burst;
+    }
+
+    if (I2CBusRead(psSampler->psBus, psSampler->ui8Addr, FXOS_M_OUT_X_MSB, pui8Mag, sizeof(pui8Mag)))
+    {
+        return -1;
+    }
+
+    for (ui32Idx = 0; ui32Idx < 3; ui32Idx++)
+    {
+        pi16Mag[ui32Idx] = (int16_t)((pui8Mag[2 * ui32Idx] << 8) | pui8Mag[2 * ui32Idx + 1]);
+    }
+
+    for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++)
+    {
+        const uint8_t *pui8Sample = pui8Burst + 1 + 6 * ui32Idx;
+        tAGSample *psOut = &psSamples[ui32Idx];
+        uint32_t ui32Axis;
+
+        // The newest sample in the FIFO was taken about now; anything we
+        // left behind is newer than what we read
+        psOut->ui64TimeNs = ui64Now - (uint64_t)(psSampler->ui32Backlog + ui32Count - 1 - ui32Idx)
+                                      * psSampler->ui64PeriodNs;
+
+        for (ui32Axis = 0; ui32Axis < 3; ui32Axis++)
+        {
+            // 14-bit left-justified two's complement
+            psOut->pi16Accel[ui32Axis] =
+                (int16_t)((int16_t)((pui8Sample[2 * ui32Axis] << 8) | pui8Sample[2 * ui32Axis + 1]) >> 2);
+            psOut->pi16Mag[ui32Axis] = pi16Mag[ui32Axis];
+        }
+    }
+
+    psSampler->ui64Samples += ui32Count;
+    psSampler->ui64Batches++;
+    psSampler->ui64LastDrainNs = ui64Now;
+
+    return (int)ui32Count;
+}
+
+double AGSamplerRate(const tAGSampler *psSampler)
+{
+    uint64_t ui64Elapsed = psSampler->ui64LastDrainNs - psSampler->ui64StartNs;
+
+    if (ui64Elapsed == 0)
+    {
+        return 0.0;
+    }
+
+    return (double)psSampler->ui64Samples * 1e9 / (double)ui64Elapsed;
+}
+
+double AGSamplerBusUtilization(const tAGSampler *psSampler)
+{
+    return I2CBusUtilization(psSampler->psBus, psSampler->ui64LastDrainNs - psSampler->ui64StartNs);
+}
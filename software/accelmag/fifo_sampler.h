@@ -0,0 +1,67 @@
+//*****************************************************************************
+// FXOS8700CQ FIFO sampling engine
+//
+// Runs the sensor in hybrid mode at a high output data rate with the
+// accelerometer FIFO enabled, and drains a whole watermark's worth of
+// samples with one auto-increment burst read per batch.
+//*****************************************************************************
+
+#ifndef FIFO_SAMPLER_H
+#define FIFO_SAMPLER_H
+
+#include <stdint.h>
+#include "../common/i2c_bus.h"
+#include "../common/fxos8700cq_regs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint64_t ui64TimeNs;
+    int16_t pi16Accel[3];       // 14-bit counts
+    int16_t pi16Mag[3];         // 16-bit counts, latest value at drain time
+} tAGSample;
+
+typedef struct
+{
+    tI2CBus *psBus;
+    uint8_t ui8Addr;
+    uint8_t ui8Watermark;
+    uint64_t ui64PeriodNs;      // accelerometer sample period
+
+    uint64_t ui64StartNs;
+    uint64_t ui64LastDrainNs;
+    uint32_t ui32Backlog;       // samples left in the FIFO by the last drain
+
+    uint64_t ui64Samples;
+    uint64_t ui64Batches;
+    uint64_t ui64Overflows;
+} tAGSampler;
+
+// Puts the part in standby, configures hybrid mode at ui8DataRate
+// (FXOS_DR_*), ±2/4/8 g range ui8Range (FXOS_FS_*), circular FIFO with the
+// given watermark (1..32), the watermark interrupt routed to INT1
+// (open-drain, active low) and activates it.  Returns 0 on success, -1 if
+// the bus fails or WHO_AM_I doesn't match.
+extern int AGSamplerInit(tAGSampler *psSampler, tI2CBus *psBus, uint8_t ui8Addr,
+                         uint8_t ui8DataRate, uint8_t ui8Range, uint8_t ui8Watermark);
+
+// Time until the FIFO is expected to reach the watermark again
+extern uint64_t AGSamplerWaitNs(const tAGSampler *psSampler);
+
+// Reads F_STATUS and up to ui32Max samples in one burst, then the latest
+// magnetometer values.  Returns the number of samples stored, -1 on error.
+extern int AGSamplerDrain(tAGSampler *psSampler, tAGSample *psSamples, uint32_t ui32Max);
+
+// Achieved accelerometer sample rate since init
+extern double AGSamplerRate(const tAGSampler *psSampler);
+
+extern double AGSamplerBusUtilization(const tAGSampler *psSampler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FIFO_SAMPLER_H
@@ -20,27 +20,88 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <linux/i2c-dev.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include "ag/fxos8700cq_proc.h"
-#include "ag/fxos8700cq.h" 
+#include <string.h>
+#include <time.h>
+#include "fifo_sampler.h"
+#include "../common/i2c_sim.h"
+#include "../common/irq_source.h"
+#include "../common/fxos8700cq_sim.h"
+#include "../common/fxos8700cq_i2c.h"
 
 // Define FXOS8700CQ I2C address, determined by PCB layout with pins SA0=1, SA1=0
 #define AG_SLAVE_ADDR       0x1D
 
+// Low-speed expansion I2C0 on the Dragonboard 410c, run in fast mode
+#define AG_I2C_ADAPTER      0
+#define AG_I2C_HZ           400000
 
-tRawData g_tAccelData;      // Accelerometer data
-tRawData g_tMagData;        // Magnetometer data
+// FXOS8700CQ INT1 as wired to the low-speed expansion header (GPIO-A);
+// match board wiring, or override with -g chip:line
+#define AG_INT_CHIP         "/dev/gpiochip0"
+#define AG_INT_LINE         36
 
-//*****************************************************************************
-// I2C Functions
-//*****************************************************************************
+tAGSample g_psSamples[FXOS_FIFO_DEPTH];     // One FIFO batch
 
-// see fxas8700cq.c for accelerometer and magnetometer functions
+tI2CBus g_sBus;
+tI2CSim g_sSim;
+tFXOSSim g_sFXOSSim;
+tIrqSource g_sIrq;
 
-int main()
+static void SleepNs(uint64_t ui64Ns)
 {
+    struct timespec sTs;
+
+    sTs.tv_sec = (time_t)(ui64Ns / 1000000000ULL);
+    sTs.tv_nsec = (long)(ui64Ns % 1000000000ULL);
+    nanosleep(&sTs, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    int iOpt;
+    int bSimulate = 0;
+    int bPoll = 0;
+    uint8_t ui8DataRate = FXOS_DR_800HZ;
+    uint8_t ui8Watermark = 16;
+    uint8_t ui8Data[1];
+    char pcChip[64] = AG_INT_CHIP;
+    uint32_t ui32Line = AG_INT_LINE;
+    tAGSampler sSampler;
+    uint64_t ui64NextReport;
+    char *pcColon;
+
+    while ((iOpt = getopt(argc, argv, "sr:w:g:p")) != -1)
+    {
+        switch (iOpt)
+        {
+            case 's':
+                bSimulate = 1;
+                break;
+            case 'r':
+                ui8DataRate = (uint8_t)atoi(optarg);
+                break;
+            case 'w':
+                ui8Watermark = (uint8_t)atoi(optarg);
+                break;
+            case 'g':
+                pcColon = strchr(optarg, ':');
+                if (pcColon)
+                {
+                    snprintf(pcChip, sizeof(pcChip), "%.*s", (int)(pcColon - optarg), optarg);
+                    ui32Line = (uint32_t)atoi(pcColon + 1);
+                }
+                break;
+            case 'p':
+                bPoll = 1;
+                break;
+            default:
+                printf("usage: %s [-s] [-r data-rate-code] [-w watermark] [-g gpiochip:line] [-p]\r\n", argv[0]);
+                return 1;
+        }
+    }
 
     //*****************************************************************************
     // Main Code
@@ -50,71 +111,99 @@ int main()
     printf("\033[2J\033[;H");
     printf("Verifying connection ");
 
-    uint8_t ui32Data[1];
-
-    // Get WHO_AM_I register, return should be 0xC7
-    I2CAGReceive(AG_SLAVE_ADDR, AG_WHO_AM_I, ui32Data, sizeof(ui32Data));
-    if ( 0xC7 == ui32Data[0] )
+    // -s swaps the hardware for a register-level model of the part
+    if (bSimulate)
     {
-        printf("\r\n... FXOS8700CQ is alive!!!");
+        I2CSimInit(&g_sSim, &g_sBus, AG_I2C_HZ);
+        FXOSSimInit(&g_sFXOSSim, AG_SLAVE_ADDR, 0, 0);
+        I2CSimAddDevice(&g_sSim, &g_sFXOSSim.sDevice);
     }
-    else
+    else if (I2CBusOpenLinux(&g_sBus, AG_I2C_ADAPTER, AG_I2C_HZ))
     {
-        printf("\r\n... FXOS8700CQ is NOT alive.");
+        printf("\r\n... cannot open /dev/i2c-%d", AG_I2C_ADAPTER);
         printf("\r\n");
         return 0;
     }
+    I2CAGBind(&g_sBus);
 
-    // ***********************Print register values for testing feedback
-    I2CAGReceive(AG_SLAVE_ADDR, AG_CTRL_REG1, ui32Data, sizeof(ui32Data));
-    printf("\r\nAG_CTRL_REG1    = 0x%02x",ui32Data[0]);
-
-    I2CAGReceive(AG_SLAVE_ADDR, AG_XYZ_DATA_CFG, ui32Data, sizeof(ui32Data));
-    printf("\r\nAG_XYZ_DATA_CFG = 0x%02x",ui32Data[0]);
+    // Checks WHO_AM_I (0xC7), then configures hybrid mode with the FIFO on
+    if (AGSamplerInit(&sSampler, &g_sBus, AG_SLAVE_ADDR, ui8DataRate, FXOS_FS_2G, ui8Watermark))
+    {
+        printf("\r\n... FXOS8700CQ is NOT alive.");
+        printf("\r\n");
+        return 0;
+    }
+    printf("\r\n... FXOS8700CQ is alive!!!");
 
-    I2CAGReceive(AG_SLAVE_ADDR, AG_M_CTRL_REG1, ui32Data, sizeof(ui32Data));
-    printf("\r\nAG_M_CTRL_REG1  = 0x%02x",ui32Data[0]);
     // ***********************Print register values for testing feedback
+    I2CAGReceive(AG_SLAVE_ADDR, FXOS_CTRL_REG1, ui8Data, sizeof(ui8Data));
+    printf("\r\nAG_CTRL_REG1    = 0x%02x", ui8Data[0]);
 
-    // Put the device into standby before changing register values
-    AGStandby(AG_SLAVE_ADDR);
-
-    // Choose the range of the accelerometer (±2G,±4G,±8G)
-    AGAccelRange(AG_SLAVE_ADDR, AFSR_2G);
-
-    // Choose the output data rate (800 Hz, 400 Hz, 200 Hz, 100 Hz,
-    //  50 Hz, 12.5 Hz, 6.25 Hz, 1.56 Hz). Rate is cut in half when
-    //  running in hybrid mode (accelerometer and magnetometer active)
-    AGOutputDataRate(AG_SLAVE_ADDR, ODR_1_56HZ);
-
-    // Choose if both the acclerometer and magnetometer will both be used
-    //  IF BOTH ARE USED THAN OUTPUT DATA RATE IS SHARED.
-    //  E.G. 100 HZ ODR MEANS ACCELEROMETER WILL SAMPLE AT 50 HZ
-    //    AND MAGNETOMETER WILL SAMPLE AT 50 HZ
-    AGHybridMode(AG_SLAVE_ADDR, ACCEL_AND_MAG);
-
-    // Activate the data device
-    AGActive(AG_SLAVE_ADDR);
+    I2CAGReceive(AG_SLAVE_ADDR, FXOS_XYZ_DATA_CFG, ui8Data, sizeof(ui8Data));
+    printf("\r\nAG_XYZ_DATA_CFG = 0x%02x", ui8Data[0]);
 
+    I2CAGReceive(AG_SLAVE_ADDR, FXOS_M_CTRL_REG1, ui8Data, sizeof(ui8Data));
+    printf("\r\nAG_M_CTRL_REG1  = 0x%02x", ui8Data[0]);
     // ***********************Print register values for testing feedback
-    I2CAGReceive(AG_SLAVE_ADDR, AG_CTRL_REG1, ui32Data, sizeof(ui32Data));
-    printf("\r\nAG_CTRL_REG1    = 0x%02x",ui32Data[0]);
 
-    I2CAGReceive(AG_SLAVE_ADDR, AG_XYZ_DATA_CFG, ui32Data, sizeof(ui32Data));
-    printf("\r\nAG_XYZ_DATA_CFG = 0x%02x",ui32Data[0]);
+    // Block on INT1 rather than guessing when the watermark is reached;
+    // -p keeps the timer for boards without the line wired up
+    if (!bPoll)
+    {
+        int iErr = bSimulate ? IrqOpenSim(&g_sIrq, &g_sBus, &g_sFXOSSim.sDevice, 1)
+                             : IrqOpenGpio(&g_sIrq, pcChip, ui32Line, 1);
+        if (iErr)
+        {
+            printf("\r\n... cannot wait on %s line %u, polling instead", pcChip, ui32Line);
+            bPoll = 1;
+        }
+    }
 
-    I2CAGReceive(AG_SLAVE_ADDR, AG_M_CTRL_REG1, ui32Data, sizeof(ui32Data));
-    printf("\r\nAG_M_CTRL_REG1  = 0x%02x",ui32Data[0]);
-    // ***********************Print register values for testing feedback
+    ui64NextReport = g_sBus.pfnNow(&g_sBus) + 1000000000ULL;
 
     while(1)
     {
-        AGGetData(AG_SLAVE_ADDR, ACCEL_DATA, &g_tAccelData );
-        AGGetData(AG_SLAVE_ADDR, MAG_DATA, &g_tMagData );
-
-        printf("\r\nACCEL X:%6d Y:%6d Z:%6d  MAG X:%6d Y:%6d Z:%6d",
-                   g_tAccelData.x,g_tAccelData.y,g_tAccelData.z,
-                   g_tMagData.x,g_tMagData.y,g_tMagData.z);
-        sleep(1);
+        int iCount;
+
+        // Wait for the watermark interrupt, then take the whole batch in
+        // one burst.  The timeout covers a missed edge: two batches late,
+        // the FIFO is drained anyway.
+        if (bPoll)
+        {
+            SleepNs(AGSamplerWaitNs(&sSampler));
+        }
+        else
+        {
+            uint64_t ui64IrqNs;
+
+            if (IrqWait(&g_sIrq, 2 * sSampler.ui64PeriodNs * sSampler.ui8Watermark, &ui64IrqNs) < 0)
+            {
+                printf("\r\nGPIO wait failed");
+                bPoll = 1;
+            }
+        }
+
+        iCount = AGSamplerDrain(&sSampler, g_psSamples, FXOS_FIFO_DEPTH);
+        if (iCount < 0)
+        {
+            printf("\r\nI2C read failed");
+            continue;
+        }
+
+        if (iCount > 0 && g_sBus.pfnNow(&g_sBus) >= ui64NextReport)
+        {
+            tAGSample *psLast = &g_psSamples[iCount - 1];
+
+            printf("\r\nACCEL X:%6d Y:%6d Z:%6d  MAG X:%6d Y:%6d Z:%6d  %7.1f Hz  bus %5.1f%%  ovf %llu  irq %llu/%llu",
+                   psLast->pi16Accel[0], psLast->pi16Accel[1], psLast->pi16Accel[2],
+                   psLast->pi16Mag[0], psLast->pi16Mag[1], psLast->pi16Mag[2],
+                   AGSamplerRate(&sSampler),
+                   AGSamplerBusUtilization(&sSampler) * 100.0,
+                   (unsigned long long)sSampler.ui64Overflows,
+                   (unsigned long long)g_sIrq.ui64Events,
+                   (unsigned long long)g_sIrq.ui64Timeouts);
+            fflush(stdout);
+            ui64NextReport += 1000000000ULL;
+        }
     }
 }
@@ -0,0 +1,335 @@
+#include <cmath>
+#include "ahrs.h"
+
+namespace sevun {
+
+    // longer bursts share one correction between too many gyro steps; at
+    // 800 Hz four still track as well as single samples (visor-ahrs-bench)
+    static constexpr size_t max_burst = 4;
+
+    static constexpr int32_t one_q30 = 1 << 30;
+
+    static inline float inv_sqrt(float x) {
+        return 1.0f / std::sqrt(x);
+    }
+
+    static inline int32_t mul_q30(int64_t a, int64_t b) {
+        return static_cast<int32_t>((a * b) >> 30);
+    }
+
+    static uint64_t isqrt64(uint64_t n) {
+        if (n < 2)
+            return n;
+        // start above the root and let Newton's method come down to it
+        auto x = 1ULL << ((64 - __builtin_clzll(n) + 1) / 2);
+        for (;;) {
+            auto y = (x + n / x) >> 1;
+            if (y >= x)
+                return x;
+            x = y;
+        }
+    }
+
+    // scales v to unit length in Q30; false for a zero vector
+    static bool normalize_q30(const int64_t* v, int32_t* out) {
+        auto n = static_cast<uint64_t>(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (n == 0)
+            return false;
+        auto r = static_cast<int64_t>(isqrt64(n));
+        for (int i = 0; i < 3; i++)
+            out[i] = static_cast<int32_t>((v[i] << 30) / r);
+        return true;
+    }
+
+    float angle_between(const quaternion_t& a, const quaternion_t& b) {
+        auto d = std::fabs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+        return 2.0f * std::acos(d > 1.0f ? 1.0f : d);
+    }
+
+    ahrs_float::ahrs_float(
+            const ahrs_config_t& config,
+            const imu_scale_t& scale) : _config(config),
+                                        _rad_per_count(scale.gyro_dps * static_cast<float>(M_PI / 180.0)) {
+    }
+
+    void ahrs_float::reset() {
+        _q[0] = 1.0f;
+        _q[1] = _q[2] = _q[3] = 0.0f;
+        _integral[0] = _integral[1] = _integral[2] = 0.0f;
+        _feedback[0] = _feedback[1] = _feedback[2] = 0.0f;
+    }
+
+    void ahrs_float::correct(
+            const float* accel,
+            const int16_t* mag,
+            float dt,
+            float* feedback) {
+        feedback[0] = _integral[0];
+        feedback[1] = _integral[1];
+        feedback[2] = _integral[2];
+
+        auto ax = accel[0], ay = accel[1], az = accel[2];
+        auto an = ax * ax + ay * ay + az * az;
+        if (an == 0.0f)
+            return;
+        auto r = inv_sqrt(an);
+        ax *= r;
+        ay *= r;
+        az *= r;
+
+        auto q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+
+        // gravity as the current estimate sees it, halved
+        auto vx = q1 * q3 - q0 * q2;
+        auto vy = q0 * q1 + q2 * q3;
+        auto vz = q0 * q0 - 0.5f + q3 * q3;
+
+        auto ex = ay * vz - az * vy;
+        auto ey = az * vx - ax * vz;
+        auto ez = ax * vy - ay * vx;
+
+        float mx = mag[0], my = mag[1], mz = mag[2];
+        auto mn = mx * mx + my * my + mz * mz;
+        if (mn != 0.0f) {
+            r = inv_sqrt(mn);
+            mx *= r;
+            my *= r;
+            mz *= r;
+
+            // earth field in the earth frame, folded onto the x-z plane,
+            // then back into the sensor frame (halved)
+            auto hx = 2.0f * (mx * (0.5f - q2 * q2 - q3 * q3) + my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+            auto hy = 2.0f * (mx * (q1 * q2 + q0 * q3) + my * (0.5f - q1 * q1 - q3 * q3) + mz * (q2 * q3 - q0 * q1));
+            auto bx = std::sqrt(hx * hx + hy * hy);
+            auto bz = 2.0f * (mx * (q1 * q3 - q0 * q2) + my * (q2 * q3 + q0 * q1) + mz * (0.5f - q1 * q1 - q2 * q2));
+
+            auto wx = bx * (0.5f - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2);
+            auto wy = bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3);
+            auto wz = bx * (q0 * q2 + q1 * q3) + bz * (0.5f - q1 * q1 - q2 * q2);
+
+            ex += my * wz - mz * wy;
+            ey += mz * wx - mx * wz;
+            ez += mx * wy - my * wx;
+        }
+
+        if (_config.ki > 0.0f) {
+            _integral[0] += 2.0f * _config.ki * ex * dt;
+            _integral[1] += 2.0f * _config.ki * ey * dt;
+            _integral[2] += 2.0f * _config.ki * ez * dt;
+        }
+
+        feedback[0] = _integral[0] + 2.0f * _config.kp * ex;
+        feedback[1] = _integral[1] + 2.0f * _config.kp * ey;
+        feedback[2] = _integral[2] + 2.0f * _config.kp * ez;
+    }
+
+    void ahrs_float::integrate(
+            const int16_t* gyro,
+            const float* feedback,
+            float dt) {
+        auto half_dt = 0.5f * dt;
+        auto gx = (gyro[0] * _rad_per_count + feedback[0]) * half_dt;
+        auto gy = (gyro[1] * _rad_per_count + feedback[1]) * half_dt;
+        auto gz = (gyro[2] * _rad_per_count + feedback[2]) * half_dt;
+
+        auto q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+        q0 += -q1 * gx - q2 * gy - q3 * gz;
+        q1 += _q[0] * gx + q2 * gz - q3 * gy;
+        q2 += _q[0] * gy - _q[1] * gz + q3 * gx;
+        q3 += _q[0] * gz + _q[1] * gy - _q[2] * gx;
+
+        auto r = inv_sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        _q[0] = q0 * r;
+        _q[1] = q1 * r;
+        _q[2] = q2 * r;
+        _q[3] = q3 * r;
+    }
+
+    void ahrs_float::update(const imu_sample_t& sample, float dt) {
+        float accel[3] {
+            static_cast<float>(sample.accel[0]),
+            static_cast<float>(sample.accel[1]),
+            static_cast<float>(sample.accel[2])
+        };
+        correct(accel, sample.mag, dt, _feedback);
+        integrate(sample.gyro, _feedback, dt);
+    }
+
+    void ahrs_float::update(
+            const imu_sample_t* samples,
+            size_t count,
+            float dt) {
+        while (count > 0) {
+            auto n = count < max_burst ? count : max_burst;
+
+            float accel[3] {};
+            for (size_t i = 0; i < n; i++) {
+                accel[0] += samples[i].accel[0];
+                accel[1] += samples[i].accel[1];
+                accel[2] += samples[i].accel[2];
+            }
+
+            // the mean acceleration belongs to the middle of the burst, so
+            // the correction is worked out there: the first half runs on the
+            // previous burst's feedback, the second on the new one
+            auto half = n / 2;
+            for (size_t i = 0; i < half; i++)
+                integrate(samples[i].gyro, _feedback, dt);
+            correct(accel, samples[n - 1].mag, dt * n, _feedback);
+            for (size_t i = half; i < n; i++)
+                integrate(samples[i].gyro, _feedback, dt);
+
+            samples += n;
+            count -= n;
+        }
+    }
+
+    ahrs_fixed::ahrs_fixed(
+            const ahrs_config_t& config,
+            const imu_scale_t& scale) : _config(config),
+                                        _rad_per_count(scale.gyro_dps * static_cast<float>(M_PI / 180.0)) {
+    }
+
+    void ahrs_fixed::reset() {
+        _q[0] = one_q30;
+        _q[1] = _q[2] = _q[3] = 0;
+        _integral[0] = _integral[1] = _integral[2] = 0;
+        _feedback[0] = _feedback[1] = _feedback[2] = 0;
+    }
+
+    quaternion_t ahrs_fixed::orientation() const {
+        return quaternion_t {
+            _q[0] / static_cast<float>(one_q30),
+            _q[1] / static_cast<float>(one_q30),
+            _q[2] / static_cast<float>(one_q30),
+            _q[3] / static_cast<float>(one_q30)
+        };
+    }
+
+    void ahrs_fixed::set_dt(float dt) {
+        // the multipliers only change with the sample period, which is
+        // fixed for a given ODR
+        if (dt == _dt)
+            return;
+        _dt = dt;
+        _gyro_k = std::llround(_rad_per_count * 0.5 * dt * 1099511627776.0);
+        _kp_dt = static_cast<int32_t>(std::lround(_config.kp * dt * one_q30));
+        _ki_dt = static_cast<int32_t>(std::lround(2.0 * _config.ki * dt * one_q30));
+        _half_dt = static_cast<int32_t>(std::lround(0.5 * dt * one_q30));
+    }
+
+    void ahrs_fixed::correct(
+            const int32_t* accel,
+            const int16_t* mag,
+            int32_t ki_dt,
+            int32_t* feedback) {
+        // feedback is in half-angle increments per sample, like the gyro
+        // after _gyro_k
+        for (int i = 0; i < 3; i++)
+            feedback[i] = mul_q30(_integral[i], _half_dt);
+
+        int64_t a_raw[3] {accel[0], accel[1], accel[2]};
+        int32_t a[3];
+        if (!normalize_q30(a_raw, a))
+            return;
+
+        int64_t q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+        auto q0q0 = mul_q30(q0, q0), q0q1 = mul_q30(q0, q1), q0q2 = mul_q30(q0, q2), q0q3 = mul_q30(q0, q3);
+        auto q1q1 = mul_q30(q1, q1), q1q2 = mul_q30(q1, q2), q1q3 = mul_q30(q1, q3);
+        auto q2q2 = mul_q30(q2, q2), q2q3 = mul_q30(q2, q3), q3q3 = mul_q30(q3, q3);
+        int32_t half = one_q30 / 2;
+
+        int64_t vx = q1q3 - q0q2;
+        int64_t vy = q0q1 + q2q3;
+        int64_t vz = q0q0 - half + q3q3;
+
+        int64_t ex = mul_q30(a[1], vz) - mul_q30(a[2], vy);
+        int64_t ey = mul_q30(a[2], vx) - mul_q30(a[0], vz);
+        int64_t ez = mul_q30(a[0], vy) - mul_q30(a[1], vx);
+
+        int64_t m_raw[3] {mag[0], mag[1], mag[2]};
+        int32_t m[3];
+        if (normalize_q30(m_raw, m)) {
+            // h and b are kept at half scale so their squares fit in 64 bits
+            int64_t hx = mul_q30(m[0], half - q2q2 - q3q3) + mul_q30(m[1], q1q2 - q0q3) + mul_q30(m[2], q1q3 + q0q2);
+            int64_t hy = mul_q30(m[0], q1q2 + q0q3) + mul_q30(m[1], half - q1q1 - q3q3) + mul_q30(m[2], q2q3 - q0q1);
+            auto bx = static_cast<int64_t>(isqrt64(static_cast<uint64_t>(hx * hx + hy * hy)));
+            int64_t bz = mul_q30(m[0], q1q3 - q0q2) + mul_q30(m[1], q2q3 + q0q1) + mul_q30(m[2], half - q1q1 - q2q2);
+
+            int64_t wx = 2 * (mul_q30(bx, half - q2q2 - q3q3) + mul_q30(bz, q1q3 - q0q2));
+            int64_t wy = 2 * (mul_q30(bx, q1q2 - q0q3) + mul_q30(bz, q0q1 + q2q3));
+            int64_t wz = 2 * (mul_q30(bx, q0q2 + q1q3) + mul_q30(bz, half - q1q1 - q2q2));
+
+            ex += mul_q30(m[1], wz) - mul_q30(m[2], wy);
+            ey += mul_q30(m[2], wx) - mul_q30(m[0], wz);
+            ez += mul_q30(m[0], wy) - mul_q30(m[1], wx);
+        }
+
+        int64_t e[3] {ex, ey, ez};
+        for (int i = 0; i < 3; i++) {
+            if (ki_dt != 0) {
+                _integral[i] += mul_q30(e[i], ki_dt);
+                feedback[i] = mul_q30(_integral[i], _half_dt);
+            }
+            feedback[i] += mul_q30(e[i], _kp_dt);
+        }
+    }
+
+    void ahrs_fixed::integrate(
+            const int16_t* gyro,
+            const int32_t* feedback) {
+        int64_t gx = ((gyro[0] * _gyro_k) >> 10) + feedback[0];
+        int64_t gy = ((gyro[1] * _gyro_k) >> 10) + feedback[1];
+        int64_t gz = ((gyro[2] * _gyro_k) >> 10) + feedback[2];
+
+        int64_t q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+        int64_t n[4] {
+            q0 + ((-q1 * gx - q2 * gy - q3 * gz) >> 30),
+            q1 + ((q0 * gx + q2 * gz - q3 * gy) >> 30),
+            q2 + ((q0 * gy - q1 * gz + q3 * gx) >> 30),
+            q3 + ((q0 * gz + q1 * gy - q2 * gx) >> 30)
+        };
+
+        auto sum = static_cast<uint64_t>(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] + n[3] * n[3]);
+        auto r = static_cast<int64_t>(isqrt64(sum));
+        for (int i = 0; i < 4; i++)
+            _q[i] = static_cast<int32_t>((n[i] << 30) / r);
+    }
+
+    void ahrs_fixed::update(const imu_sample_t& sample, float dt) {
+        set_dt(dt);
+        int32_t accel[3] {sample.accel[0], sample.accel[1], sample.accel[2]};
+        correct(accel, sample.mag, _ki_dt, _feedback);
+        integrate(sample.gyro, _feedback);
+    }
+
+    void ahrs_fixed::update(
+            const imu_sample_t* samples,
+            size_t count,
+            float dt) {
+        while (count > 0) {
+            auto n = count < max_burst ? count : max_burst;
+
+            set_dt(dt);
+
+            int32_t accel[3] {};
+            for (size_t i = 0; i < n; i++) {
+                accel[0] += samples[i].accel[0];
+                accel[1] += samples[i].accel[1];
+                accel[2] += samples[i].accel[2];
+            }
+
+            // the correction is worked out mid-burst, as for ahrs_float
+            auto half = n / 2;
+            for (size_t i = 0; i < half; i++)
+                integrate(samples[i].gyro, _feedback);
+            correct(accel, samples[n - 1].mag, _ki_dt * static_cast<int32_t>(n), _feedback);
+            for (size_t i = half; i < n; i++)
+                integrate(samples[i].gyro, _feedback);
+
+            samples += n;
+            count -= n;
+        }
+    }
+
+};
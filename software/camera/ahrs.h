@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "imu.h"
+
+namespace sevun {
+
+    struct quaternion_t {
+        float w;
+        float x;
+        float y;
+        float z;
+    };
+
+    struct ahrs_config_t {
+        float kp = 0.5f;        // proportional gain on the accel/mag error
+        float ki = 0.0f;        // integral gain; leave at 0 when the gyro bias is calibrated out
+    };
+
+    // Mahony complementary filter on the 9-axis stream.  the quaternion
+    // maps sensor to earth frame (z up, x towards magnetic north).
+    //
+    // both variants take a single sample or a FIFO burst.  a burst is
+    // taken four samples at a time: each group gets one accel/mag
+    // correction from its mean acceleration, worked out at the group's
+    // midpoint, and the gyro is integrated per sample around it.  that
+    // saves two normalizations and the reference-direction math on three
+    // samples in four and tracks as well as per-sample updates.
+    //
+    // this is the one to use: the fixed-point variant below is 2.5x slower
+    // wherever there is an FPU, which includes the Dragonboard's A53s.
+    class ahrs_float {
+    public:
+        ahrs_float(const ahrs_config_t& config, const imu_scale_t& scale);
+
+        void update(const imu_sample_t& sample, float dt);
+
+        void update(const imu_sample_t* samples, size_t count, float dt);
+
+        inline quaternion_t orientation() const {
+            return quaternion_t {_q[0], _q[1], _q[2], _q[3]};
+        }
+
+        void reset();
+
+    private:
+        void correct(const float* accel, const int16_t* mag, float dt, float* feedback);
+
+        void integrate(const int16_t* gyro, const float* feedback, float dt);
+
+    private:
+        ahrs_config_t _config;
+        float _rad_per_count;
+        float _q[4] {1.0f, 0.0f, 0.0f, 0.0f};
+        float _integral[3] {};
+        float _feedback[3] {};      // rad/s, from the last correction
+    };
+
+    // the same filter in Q2.30 integer arithmetic, only for cores without
+    // an FPU; everywhere else ahrs_float is faster.  vectors are normalized with an integer square root;
+    // gyro counts go straight to half-angle increments through one fixed
+    // multiplier, so nothing converts to float on the update path.
+    class ahrs_fixed {
+    public:
+        ahrs_fixed(const ahrs_config_t& config, const imu_scale_t& scale);
+
+        void update(const imu_sample_t& sample, float dt);
+
+        void update(const imu_sample_t* samples, size_t count, float dt);
+
+        quaternion_t orientation() const;
+
+        void reset();
+
+    private:
+        void set_dt(float dt);
+
+        void correct(const int32_t* accel, const int16_t* mag, int32_t ki_dt, int32_t* feedback);
+
+        void integrate(const int16_t* gyro, const int32_t* feedback);
+
+    private:
+        ahrs_config_t _config;
+        float _rad_per_count;
+        float _dt = 0.0f;
+        int64_t _gyro_k = 0;        // counts to half-angle increment, Q40
+        int32_t _kp_dt = 0;         // Kp·dt, Q30
+        int32_t _ki_dt = 0;         // 2·Ki·dt, Q30
+        int32_t _half_dt = 0;       // dt/2, Q30
+        int32_t _q[4] {1 << 30, 0, 0, 0};
+        int32_t _integral[3] {};    // rad/s, Q30
+        int32_t _feedback[3] {};    // half-angle increment per sample, Q30
+    };
+
+    // angle between two orientations, radians
+    float angle_between(const quaternion_t& a, const quaternion_t& b);
+
+};
@@ -0,0 +1,389 @@
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "calibration.h"
+
+namespace sevun {
+
+    // raw magnetometer counts are 0.1 uT; the fit works in 10 uT units so
+    // the quadratic terms stay near 1
+    static constexpr double mag_unit = 100.0;
+
+    struct calibration_file_t {
+        static constexpr uint32_t magic_value = 0x53564331;   // 'SVC1'
+        static constexpr uint32_t version_value = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        calibration_t data;
+        uint32_t checksum;
+    };
+
+    static uint32_t fnv1a(const void* data, size_t length) {
+        auto p = static_cast<const uint8_t*>(data);
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            h ^= p[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static bool invert3(const double* m, double* out) {
+        auto det = m[0] * (m[4] * m[8] - m[5] * m[7])
+                 - m[1] * (m[3] * m[8] - m[5] * m[6])
+                 + m[2] * (m[3] * m[7] - m[4] * m[6]);
+        if (std::fabs(det) < 1e-12)
+            return false;
+        auto r = 1.0 / det;
+        out[0] = (m[4] * m[8] - m[5] * m[7]) * r;
+        out[1] = (m[2] * m[7] - m[1] * m[8]) * r;
+        out[2] = (m[1] * m[5] - m[2] * m[4]) * r;
+        out[3] = (m[5] * m[6] - m[3] * m[8]) * r;
+        out[4] = (m[0] * m[8] - m[2] * m[6]) * r;
+        out[5] = (m[2] * m[3] - m[0] * m[5]) * r;
+        out[6] = (m[3] * m[7] - m[4] * m[6]) * r;
+        out[7] = (m[1] * m[6] - m[0] * m[7]) * r;
+        out[8] = (m[0] * m[4] - m[1] * m[3]) * r;
+        return true;
+    }
+
+    // cyclic Jacobi on a symmetric 3x3: a becomes diagonal (eigenvalues),
+    // v collects the eigenvectors as columns
+    static void jacobi3(double* a, double* v) {
+        for (int i = 0; i < 9; i++)
+            v[i] = (i % 4 == 0) ? 1.0 : 0.0;
+
+        for (int sweep = 0; sweep < 16; sweep++) {
+            auto off = a[1] * a[1] + a[2] * a[2] + a[5] * a[5];
+            if (off < 1e-24)
+                return;
+
+            static const int pairs[3][2] {{0, 1}, {0, 2}, {1, 2}};
+            for (const auto& pq : pairs) {
+                auto p = pq[0], q = pq[1];
+                auto apq = a[3 * p + q];
+                if (std::fabs(apq) < 1e-30)
+                    continue;
+
+                auto theta = (a[3 * q + q] - a[3 * p + p]) / (2.0 * apq);
+                auto t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                auto c = 1.0 / std::sqrt(t * t + 1.0);
+                auto s = t * c;
+
+                for (int k = 0; k < 3; k++) {
+                    auto akp = a[3 * k + p], akq = a[3 * k + q];
+                    a[3 * k + p] = c * akp - s * akq;
+                    a[3 * k + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++) {
+                    auto apk = a[3 * p + k], aqk = a[3 * q + k];
+                    a[3 * p + k] = c * apk - s * aqk;
+                    a[3 * q + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++) {
+                    auto vkp = v[3 * k + p], vkq = v[3 * k + q];
+                    v[3 * k + p] = c * vkp - s * vkq;
+                    v[3 * k + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    gyro_bias_estimator::gyro_bias_estimator(
+            const calibration_config_t& config,
+            const imu_scale_t& scale) : _config(config) {
+        auto gyro_counts = config.still_gyro_dps / scale.gyro_dps;
+        auto accel_counts = config.still_accel_g / scale.accel_g;
+        _gyro_var_limit = static_cast<double>(gyro_counts) * gyro_counts;
+        _accel_var_limit = static_cast<double>(accel_counts) * accel_counts;
+    }
+
+    void gyro_bias_estimator::set(const float* bias) {
+        memcpy(_bias, bias, sizeof(_bias));
+        _valid = true;
+    }
+
+    bool gyro_bias_estimator::push(const imu_sample_t& sample) {
+        for (int axis = 0; axis < 3; axis++) {
+            double g = sample.gyro[axis];
+            _gyro_sum[axis] += g;
+            _gyro_sum2[axis] += g * g;
+        }
+        double ax = sample.accel[0], ay = sample.accel[1], az = sample.accel[2];
+        auto a = std::sqrt(ax * ax + ay * ay + az * az);
+        _accel_sum += a;
+        _accel_sum2 += a * a;
+
+        if (++_n < _config.still_block)
+            return false;
+
+        double n = _n;
+        double mean[3];
+        auto still = true;
+        for (int axis = 0; axis < 3; axis++) {
+            mean[axis] = _gyro_sum[axis] / n;
+            if (_gyro_sum2[axis] / n - mean[axis] * mean[axis] > _gyro_var_limit)
+                still = false;
+        }
+        auto accel_mean = _accel_sum / n;
+        if (_accel_sum2 / n - accel_mean * accel_mean > _accel_var_limit)
+            still = false;
+
+        _n = 0;
+        memset(_gyro_sum, 0, sizeof(_gyro_sum));
+        memset(_gyro_sum2, 0, sizeof(_gyro_sum2));
+        _accel_sum = 0.0;
+        _accel_sum2 = 0.0;
+
+        if (!still)
+            return false;
+
+        // the first still block is the best estimate there is; after that
+        // move slowly so one block of slow drift doesn't yank the bias
+        auto w = _valid ? _config.bias_weight : 1.0f;
+        for (int axis = 0; axis < 3; axis++)
+            _bias[axis] += w * (static_cast<float>(mean[axis]) - _bias[axis]);
+        _valid = true;
+        _still_blocks++;
+
+        return true;
+    }
+
+    mag_calibrator::mag_calibrator(const calibration_config_t& config) : _config(config),
+                                                                        _min_cos(std::cos(config.mag_min_angle_deg * M_PI / 180.0)) {
+        for (int i = 0; i < parameters; i++)
+            _p[i][i] = 1000.0;
+    }
+
+    void mag_calibrator::set(const float* offset, const float* matrix) {
+        memcpy(_offset, offset, sizeof(_offset));
+        memcpy(_matrix, matrix, sizeof(_matrix));
+        _valid = true;
+    }
+
+    bool mag_calibrator::push(const imu_sample_t& sample) {
+        float m[3] {
+            static_cast<float>(sample.mag[0]),
+            static_cast<float>(sample.mag[1]),
+            static_cast<float>(sample.mag[2])
+        };
+        auto n = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+        if (n == 0.0f)
+            return false;
+
+        if (_have_last) {
+            auto ln = std::sqrt(_last[0] * _last[0] + _last[1] * _last[1] + _last[2] * _last[2]);
+            auto c = (m[0] * _last[0] + m[1] * _last[1] + m[2] * _last[2]) / (n * ln);
+            if (c > _min_cos)
+                return false;
+        }
+        memcpy(_last, m, sizeof(_last));
+        _have_last = true;
+
+        auto x = m[0] / mag_unit, y = m[1] / mag_unit, z = m[2] / mag_unit;
+        double phi[parameters] {x * x, y * y, z * z, 2 * x * y, 2 * x * z, 2 * y * z, 2 * x, 2 * y, 2 * z};
+
+        // k = P φ / (λ + φᵀ P φ),  θ += k (1 - φᵀ θ),  P = (P - k φᵀ P) / λ
+        double p_phi[parameters];
+        double denom = _config.mag_forgetting;
+        double predicted = 0.0;
+        for (int i = 0; i < parameters; i++) {
+            double sum = 0.0;
+            for (int j = 0; j < parameters; j++)
+                sum += _p[i][j] * phi[j];
+            p_phi[i] = sum;
+            denom += phi[i] * sum;
+            predicted += phi[i] * _theta[i];
+        }
+
+        auto error = 1.0 - predicted;
+        for (int i = 0; i < parameters; i++)
+            _theta[i] += p_phi[i] / denom * error;
+
+        // P is symmetric, so φᵀP is p_phi transposed
+        for (int i = 0; i < parameters; i++) {
+            for (int j = 0; j < parameters; j++)
+                _p[i][j] = (_p[i][j] - p_phi[i] * p_phi[j] / denom) / _config.mag_forgetting;
+        }
+
+        _accepted++;
+        if (_accepted < _config.mag_min_samples || _accepted % _config.mag_solve_every != 0)
+            return false;
+
+        return solve();
+    }
+
+    bool mag_calibrator::solve() {
+        double a[9] {
+            _theta[0], _theta[3], _theta[4],
+            _theta[3], _theta[1], _theta[5],
+            _theta[4], _theta[5], _theta[2]
+        };
+        double inverse[9];
+        if (!invert3(a, inverse))
+            return false;
+
+        double v[3] {_theta[6], _theta[7], _theta[8]};
+        double center[3];
+        for (int i = 0; i < 3; i++)
+            center[i] = -(inverse[3 * i] * v[0] + inverse[3 * i + 1] * v[1] + inverse[3 * i + 2] * v[2]);
+
+        // (m - c)ᵀ A (m - c) = 1 + cᵀ A c
+        double k = 1.0;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                k += center[i] * a[3 * i + j] * center[j];
+        if (k <= 0.0)
+            return false;
+
+        double e[9], vec[9];
+        for (int i = 0; i < 9; i++)
+            e[i] = a[i] / k;
+        jacobi3(e, vec);
+
+        double lambda[3] {e[0], e[4], e[8]};
+        if (lambda[0] <= 0.0 || lambda[1] <= 0.0 || lambda[2] <= 0.0)
+            return false;
+
+        // the symmetric root keeps the sensor axes where they are, which
+        // matters because the field direction feeds the orientation filter;
+        // scaling by the mean radius keeps the output in counts
+        auto radius = std::cbrt(1.0 / std::sqrt(lambda[0] * lambda[1] * lambda[2]));
+        double root[3];
+        for (int i = 0; i < 3; i++)
+            root[i] = std::sqrt(lambda[i]) * radius;
+
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                double sum = 0.0;
+                for (int l = 0; l < 3; l++)
+                    sum += vec[3 * i + l] * root[l] * vec[3 * j + l];
+                _matrix[3 * i + j] = static_cast<float>(sum);
+            }
+            _offset[i] = static_cast<float>(center[i] * mag_unit);
+        }
+        _valid = true;
+
+        return true;
+    }
+
+    imu_calibration::imu_calibration(
+            const calibration_config_t& config,
+            const imu_scale_t& scale) : _gyro(config, scale),
+                                        _mag(config) {
+    }
+
+    void imu_calibration::push(const imu_sample_t& sample) {
+        if (_gyro.push(sample))
+            _dirty = true;
+        if (_mag.push(sample))
+            _dirty = true;
+    }
+
+    static inline int16_t saturate(float value) {
+        if (value > 32767.0f)
+            return 32767;
+        if (value < -32768.0f)
+            return -32768;
+        return static_cast<int16_t>(std::lround(value));
+    }
+
+    void imu_calibration::apply(imu_sample_t& sample) const {
+        if (_gyro.valid()) {
+            auto bias = _gyro.bias();
+            for (int axis = 0; axis < 3; axis++)
+                sample.gyro[axis] = saturate(sample.gyro[axis] - bias[axis]);
+        }
+
+        if (_mag.valid()) {
+            auto offset = _mag.offset();
+            auto w = _mag.matrix();
+            float d[3];
+            for (int axis = 0; axis < 3; axis++)
+                d[axis] = sample.mag[axis] - offset[axis];
+            for (int axis = 0; axis < 3; axis++)
+                sample.mag[axis] = saturate(w[3 * axis] * d[0] + w[3 * axis + 1] * d[1] + w[3 * axis + 2] * d[2]);
+        }
+    }
+
+    calibration_t imu_calibration::coefficients() const {
+        calibration_t c {};
+        memcpy(c.gyro_bias, _gyro.bias(), sizeof(c.gyro_bias));
+        memcpy(c.mag_offset, _mag.offset(), sizeof(c.mag_offset));
+        memcpy(c.mag_matrix, _mag.matrix(), sizeof(c.mag_matrix));
+        c.gyro_valid = _gyro.valid();
+        c.mag_valid = _mag.valid();
+        return c;
+    }
+
+    bool imu_calibration::load(
+            sevun::result& result,
+            const std::string& path) {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            result.add_message(codes::calibration_load_failed, path, os_error {errno});
+            return false;
+        }
+
+        calibration_file_t file {};
+        auto n = read(fd, &file, sizeof(file));
+        ::close(fd);
+
+        if (n != static_cast<ssize_t>(sizeof(file))
+        ||  file.magic != calibration_file_t::magic_value
+        ||  file.version != calibration_file_t::version_value
+        ||  file.checksum != fnv1a(&file, offsetof(calibration_file_t, checksum))) {
+            result.add_message(codes::calibration_bad_file, path);
+            return false;
+        }
+
+        if (file.data.gyro_valid)
+            _gyro.set(file.data.gyro_bias);
+        if (file.data.mag_valid)
+            _mag.set(file.data.mag_offset, file.data.mag_matrix);
+        _dirty = false;
+
+        return true;
+    }
+
+    bool imu_calibration::save(
+            sevun::result& result,
+            const std::string& path) {
+        calibration_file_t file {};
+        file.magic = calibration_file_t::magic_value;
+        file.version = calibration_file_t::version_value;
+        file.data = coefficients();
+        file.checksum = fnv1a(&file, offsetof(calibration_file_t, checksum));
+
+        // write-then-rename so a power cut leaves either the old or the new
+        // coefficients, never half of each
+        auto temp = path + ".tmp";
+        auto fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            result.add_message(codes::calibration_save_failed, path, os_error {errno});
+            return false;
+        }
+
+        auto ok = write(fd, &file, sizeof(file)) == static_cast<ssize_t>(sizeof(file))
+               && fsync(fd) == 0;
+        auto err = errno;
+        ::close(fd);
+
+        if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+            if (ok)
+                err = errno;
+            unlink(temp.c_str());
+            result.add_message(codes::calibration_save_failed, path, os_error {err});
+            return false;
+        }
+
+        _dirty = false;
+        return true;
+    }
+
+};
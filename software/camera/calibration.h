@@ -0,0 +1,159 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "result.h"
+#include "imu.h"
+
+namespace sevun {
+
+    struct calibration_config_t {
+        uint32_t still_block = 400;             // samples per stillness test, 0.5 s at 800 Hz
+        float still_gyro_dps = 0.5f;            // per-axis standard deviation allowed while still
+        float still_accel_g = 0.01f;
+        float bias_weight = 0.1f;               // how far each still block moves the bias
+        float mag_min_angle_deg = 5.0f;         // field must turn this far before the next fit update
+        uint32_t mag_min_samples = 300;         // accepted samples before a fit is trusted
+        uint32_t mag_solve_every = 64;
+        double mag_forgetting = 0.9995;
+    };
+
+    struct calibration_t {
+        float gyro_bias[3];         // counts
+        float mag_offset[3];        // hard iron, counts
+        float mag_matrix[9];        // soft iron, row-major, applied after the offset
+        bool gyro_valid;
+        bool mag_valid;
+    };
+
+    // gyro bias from the mean rate over blocks where the head is still.
+    // each sample only adds to running sums; the variance test and bias
+    // update run once per block.
+    class gyro_bias_estimator {
+    public:
+        gyro_bias_estimator(const calibration_config_t& config, const imu_scale_t& scale);
+
+        // true when a still block just updated the bias.
+        bool push(const imu_sample_t& sample);
+
+        inline const float* bias() const {
+            return _bias;
+        }
+
+        inline bool valid() const {
+            return _valid;
+        }
+
+        void set(const float* bias);
+
+        inline uint64_t still_blocks() const {
+            return _still_blocks;
+        }
+
+    private:
+        calibration_config_t _config;
+        double _gyro_var_limit;
+        double _accel_var_limit;
+
+        uint32_t _n = 0;
+        double _gyro_sum[3] {};
+        double _gyro_sum2[3] {};
+        double _accel_sum = 0.0;
+        double _accel_sum2 = 0.0;
+
+        float _bias[3] {};
+        bool _valid = false;
+        uint64_t _still_blocks = 0;
+    };
+
+    // hard- and soft-iron correction from a recursive least-squares fit of
+    //   a x² + b y² + c z² + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+    // to the raw field.  each accepted sample is a fixed 9x9 update; the
+    // centre and the symmetric square root of the shape matrix are only
+    // extracted every few dozen samples.  samples are accepted once the
+    // field has turned a few degrees, so a stationary head doesn't pile
+    // the same point into the fit.
+    class mag_calibrator {
+    public:
+        static constexpr int parameters = 9;
+
+        explicit mag_calibrator(const calibration_config_t& config);
+
+        // true when a new fit was solved and accepted.
+        bool push(const imu_sample_t& sample);
+
+        inline const float* offset() const {
+            return _offset;
+        }
+
+        inline const float* matrix() const {
+            return _matrix;
+        }
+
+        inline bool valid() const {
+            return _valid;
+        }
+
+        void set(const float* offset, const float* matrix);
+
+        inline uint64_t accepted() const {
+            return _accepted;
+        }
+
+    private:
+        bool solve();
+
+    private:
+        calibration_config_t _config;
+        double _min_cos;
+
+        double _theta[parameters] {};
+        double _p[parameters][parameters] {};
+
+        float _last[3] {};
+        bool _have_last = false;
+        uint64_t _accepted = 0;
+
+        float _offset[3] {};
+        float _matrix[9] {1, 0, 0, 0, 1, 0, 0, 0, 1};
+        bool _valid = false;
+    };
+
+    // both calibrators, the correction itself, and persistence so a boot
+    // starts from the last session's coefficients instead of raw counts.
+    class imu_calibration {
+    public:
+        imu_calibration(const calibration_config_t& config, const imu_scale_t& scale);
+
+        // feeds the estimators with the raw sample.
+        void push(const imu_sample_t& sample);
+
+        // raw counts in, corrected counts out.
+        void apply(imu_sample_t& sample) const;
+
+        calibration_t coefficients() const;
+
+        // true if anything changed since the last save().
+        inline bool dirty() const {
+            return _dirty;
+        }
+
+        bool load(sevun::result& result, const std::string& path);
+
+        bool save(sevun::result& result, const std::string& path);
+
+        inline const gyro_bias_estimator& gyro() const {
+            return _gyro;
+        }
+
+        inline const mag_calibrator& mag() const {
+            return _mag;
+        }
+
+    private:
+        gyro_bias_estimator _gyro;
+        mag_calibrator _mag;
+        bool _dirty = false;
+    };
+
+};
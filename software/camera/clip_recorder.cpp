@@ -0,0 +1,344 @@
+#include <ctime>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fmt/format.h>
+#include "clip_recorder.h"
+#include "trace.h"
+
+namespace sevun {
+
+    clip_recorder::~clip_recorder() {
+        close();
+    }
+
+    bool clip_recorder::open(
+            sevun::result& result,
+            const clip_config_t& config) {
+        close();
+        _config = config;
+
+        if (access(_config.directory.c_str(), W_OK) != 0) {
+            result.add_message(codes::clip_directory_failed, _config.directory, os_error {errno});
+            return false;
+        }
+
+        // populated up front so the capture thread never takes a page fault
+        // filling it
+        auto addr = mmap(
+            nullptr,
+            _config.arena_bytes,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+            -1,
+            0);
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::clip_arena_failed, static_cast<uint64_t>(_config.arena_bytes), os_error {errno});
+            return false;
+        }
+
+        _arena = static_cast<uint8_t*>(addr);
+        _capacity = _config.arena_bytes;
+        _frames = new frame_ref_t[std::max<uint32_t>(_config.max_frames, 1)];
+        _head = 0;
+        _frames_first = 0;
+        _frames_next = 0;
+        _recording = false;
+        _queued_end = 0;
+        _begins = 0;
+        _floor = 0;
+        _written_end.store(0, std::memory_order_relaxed);
+        _begun.store(0, std::memory_order_relaxed);
+        _trigger_ns.store(0, std::memory_order_relaxed);
+        _sequence = 0;
+
+        start_writer();
+        return true;
+    }
+
+    void clip_recorder::set_format(
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline) {
+        auto changed = _format.width != width
+            || _format.height != height
+            || _format.pixelformat != pixelformat
+            || _format.bytesperline != bytesperline;
+
+        // the writer reads the format for every clip it starts, so it has
+        // to be done with the queue before the format moves under it
+        if (changed && _arena != nullptr && _frames_next > 0) {
+            stop_writer();
+            _frames_first = _frames_next;
+            start_writer();
+        }
+
+        _format.width = width;
+        _format.height = height;
+        _format.pixelformat = pixelformat;
+        _format.bytesperline = bytesperline;
+    }
+
+    void clip_recorder::close() {
+        if (_arena == nullptr)
+            return;
+
+        stop_writer();
+
+        munmap(_arena, _capacity);
+        _arena = nullptr;
+        _capacity = 0;
+        delete[] _frames;
+        _frames = nullptr;
+    }
+
+    void clip_recorder::start_writer() {
+        _running.store(true, std::memory_order_release);
+        _writer = std::thread(&clip_recorder::write_loop, this);
+    }
+
+    // finishes a clip in progress and waits for the writer to empty the
+    // queue
+    void clip_recorder::stop_writer() {
+        // the end marker always has room; enqueue() keeps a slot for it
+        if (_recording) {
+            _queue.push(item_t {item_kind::end, 0, 0, _clip_end_ns});
+            _recording = false;
+        }
+
+        _running.store(false, std::memory_order_release);
+        if (_writer.joinable())
+            _writer.join();
+    }
+
+    bool clip_recorder::enqueue(const item_t& item) {
+        // one slot stays free for the clip's end marker
+        if (item.kind != item_kind::end && _queue.size() + 2 > queue_t::capacity)
+            return false;
+        if (!_queue.push(item))
+            return false;
+        if (item.kind == item_kind::frame)
+            _queued_end = item.position + item.length;
+        return true;
+    }
+
+    void clip_recorder::start_clip(uint64_t event_ns) {
+        auto from_ns = event_ns > _config.pre_roll_ns ? event_ns - _config.pre_roll_ns : 0;
+        auto max_frames = std::max<uint32_t>(_config.max_frames, 1);
+
+        auto first = _frames_first;
+        while (first < _frames_next && _frames[first % max_frames].timestamp_ns < from_ns)
+            first++;
+
+        // an idle writer has nothing to protect; from here on it owns the
+        // pre-roll frames until it has written them
+        auto floor = first < _frames_next ? _frames[first % max_frames].position : _head;
+        if (_written_end.load(std::memory_order_acquire) >= _queued_end) {
+            _written_end.store(floor, std::memory_order_release);
+            _queued_end = floor;
+        }
+
+        // a writer still busy with the last clip is past some of these
+        // already, so its progress says nothing about them; push() holds
+        // the floor until the writer reaches this clip
+        if (!enqueue(item_t {item_kind::begin, floor, 0, event_ns}))
+            return;
+        _begins++;
+        _floor = floor;
+
+        _clips_started.fetch_add(1, std::memory_order_relaxed);
+        _recording = true;
+        _clip_end_ns = event_ns + _config.post_roll_ns;
+
+        for (; first < _frames_next; first++) {
+            const auto& f = _frames[first % max_frames];
+            if (!enqueue(item_t {item_kind::frame, f.position, f.length, f.timestamp_ns}))
+                _frames_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void clip_recorder::push(
+            const uint8_t* data,
+            size_t length,
+            uint64_t timestamp_ns) {
+        if (_arena == nullptr)
+            return;
+
+        _frame_count.fetch_add(1, std::memory_order_relaxed);
+
+        auto event_ns = _trigger_ns.exchange(0, std::memory_order_acq_rel);
+        if (event_ns != 0) {
+            if (_recording)
+                _clip_end_ns = std::max(_clip_end_ns, event_ns + _config.post_roll_ns);
+            else
+                start_clip(event_ns);
+        }
+
+        // frames never straddle the end of the arena; a frame that doesn't
+        // fit in what's left starts over at the beginning
+        auto position = _head;
+        auto offset = position % _capacity;
+        if (offset + length > _capacity)
+            position += _capacity - offset;
+        auto end = position + length;
+
+        // bytes the writer hasn't reached yet are off limits, and so is a
+        // new clip's pre-roll while the writer is still on the clip before
+        auto begun = _begun.load(std::memory_order_acquire);
+        auto written = _written_end.load(std::memory_order_acquire);
+        if (begun < _begins)
+            written = std::min(written, _floor);
+        auto blocked = written < _queued_end && end - written > _capacity;
+
+        if (length <= _capacity && !blocked) {
+            memcpy(_arena + position % _capacity, data, length);
+            _head = end;
+
+            auto max_frames = std::max<uint32_t>(_config.max_frames, 1);
+            while (_frames_first < _frames_next
+               && (_frames[_frames_first % max_frames].position + _capacity < end
+               ||  _frames_next - _frames_first >= max_frames))
+                _frames_first++;
+            _frames[_frames_next % max_frames] = frame_ref_t {position, static_cast<uint32_t>(length), timestamp_ns};
+            _frames_next++;
+
+            if (_recording && !enqueue(item_t {item_kind::frame, position, static_cast<uint32_t>(length), timestamp_ns}))
+                _frames_dropped.fetch_add(1, std::memory_order_relaxed);
+        } else if (_recording) {
+            _frames_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (_recording && timestamp_ns >= _clip_end_ns) {
+            enqueue(item_t {item_kind::end, 0, 0, timestamp_ns});
+            _recording = false;
+        }
+    }
+
+    bool clip_recorder::write_all(int fd, const void* data, size_t length) {
+        auto p = static_cast<const uint8_t*>(data);
+        while (length > 0) {
+            auto n = write(fd, p, length);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void clip_recorder::write_loop() {
+        int fd = -1;
+        bool ok = false;
+        std::string path;
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+
+        for (;;) {
+            item_t item;
+            if (!_queue.pop(item)) {
+                if (!_running.load(std::memory_order_acquire) && _queue.size() == 0)
+                    break;
+                usleep(2000);
+                continue;
+            }
+
+            switch (item.kind) {
+                case item_kind::begin: {
+                    SEVUN_TRACE_SCOPE(write);
+
+                    // name the clip after the wall-clock time of the impact
+                    auto mono_ns = trace::now_ns();
+                    auto age_s = static_cast<time_t>((mono_ns - std::min<uint64_t>(mono_ns, item.timestamp_ns)) / 1000000000ULL);
+                    auto real_s = time(nullptr) - age_s;
+                    tm t {};
+                    gmtime_r(&real_s, &t);
+                    char stamp[32];
+                    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &t);
+
+                    _sequence++;
+                    path = fmt::format("{}/clip-{}-{:04}.svv", _config.directory, stamp, _sequence);
+                    fd = ::open((path + ".part").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                    ok = fd >= 0;
+
+                    auto header = _format;
+                    header.magic = clip_file_header_t::magic_value;
+                    header.version = clip_file_header_t::version_value;
+                    header.sequence = _sequence;
+                    header.event_ns = item.timestamp_ns;
+                    header.pre_roll_ns = _config.pre_roll_ns;
+                    header.post_roll_ns = _config.post_roll_ns;
+                    ok = ok && write_all(fd, &header, sizeof(header));
+                    frames = 0;
+                    bytes = sizeof(header);
+
+                    // progress from here is through this clip's frames,
+                    // which start at or before the ones still queued
+                    _written_end.store(item.position, std::memory_order_release);
+                    _begun.fetch_add(1, std::memory_order_release);
+                    break;
+                }
+
+                case item_kind::frame: {
+                    if (ok) {
+                        SEVUN_TRACE_SCOPE(write);
+                        clip_frame_header_t frame {item.timestamp_ns, item.length, 0};
+                        ok = write_all(fd, &frame, sizeof(frame))
+                          && write_all(fd, _arena + item.position % _capacity, item.length);
+                        frames++;
+                        bytes += sizeof(frame) + item.length;
+                    }
+                    _written_end.store(item.position + item.length, std::memory_order_release);
+                    break;
+                }
+
+                case item_kind::end: {
+                    if (fd >= 0) {
+                        auto part = path + ".part";
+                        ok = ok && (!_config.sync || fdatasync(fd) == 0);
+                        ok = ::close(fd) == 0 && ok;
+                        ok = ok && rename(part.c_str(), path.c_str()) == 0;
+                        if (!ok)
+                            unlink(part.c_str());
+                        fd = -1;
+                    }
+
+                    if (ok) {
+                        _clips_written.fetch_add(1, std::memory_order_relaxed);
+                        _frames_written.fetch_add(frames, std::memory_order_relaxed);
+                        _bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+                    } else {
+                        _write_errors.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    _last_flush_ns.store(trace::now_ns() - item.timestamp_ns, std::memory_order_relaxed);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    clip_stats_t clip_recorder::stats() const {
+        clip_stats_t s {};
+        s.frames = _frame_count.load(std::memory_order_relaxed);
+        s.clips_started = _clips_started.load(std::memory_order_relaxed);
+        s.clips_written = _clips_written.load(std::memory_order_relaxed);
+        s.frames_written = _frames_written.load(std::memory_order_relaxed);
+        s.bytes_written = _bytes_written.load(std::memory_order_relaxed);
+        s.frames_dropped = _frames_dropped.load(std::memory_order_relaxed);
+        s.write_errors = _write_errors.load(std::memory_order_relaxed);
+        s.last_flush_ns = _last_flush_ns.load(std::memory_order_relaxed);
+        return s;
+    }
+
+};
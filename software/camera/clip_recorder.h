@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include "result.h"
+#include "spsc_queue.h"
+
+namespace sevun {
+
+    struct clip_config_t {
+        std::string directory = ".";
+        uint64_t pre_roll_ns = 2000000000ULL;
+        uint64_t post_roll_ns = 3000000000ULL;
+        size_t arena_bytes = 128u << 20;        // pre-roll plus whatever the writer hasn't caught up on
+        uint32_t max_frames = 1024;             // frame descriptors kept for the pre-roll
+        bool sync = true;                       // fdatasync each clip before it's renamed into place
+    };
+
+    // clip file: clip_file_header_t, then per frame a clip_frame_header_t
+    // followed by the frame bytes exactly as captured.
+    struct clip_file_header_t {
+        static constexpr uint32_t magic_value = 0x53565631;   // 'SVV1'
+        static constexpr uint32_t version_value = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t pixelformat;
+        uint32_t bytesperline;
+        uint64_t sequence;
+        uint64_t event_ns;          // CLOCK_MONOTONIC of the impact
+        uint64_t pre_roll_ns;
+        uint64_t post_roll_ns;
+    };
+
+    struct clip_frame_header_t {
+        uint64_t timestamp_ns;
+        uint32_t length;
+        uint32_t reserved;
+    };
+
+    struct clip_stats_t {
+        uint64_t frames;                // pushed by the capture thread
+        uint64_t clips_started;
+        uint64_t clips_written;
+        uint64_t frames_written;
+        uint64_t bytes_written;
+        uint64_t frames_dropped;        // clip frames lost because the writer fell an arena behind
+        uint64_t write_errors;
+        uint64_t last_flush_ns;         // end of post-roll to clip on disk, last clip
+    };
+
+    // keeps the last few seconds of frames in a preallocated byte arena.
+    // trigger() marks an impact; the capture thread then hands the
+    // pre-roll and every frame up to the end of the post-roll to a writer
+    // thread, which writes them straight out of the arena.  frames the
+    // writer still needs are never overwritten: if it falls a whole arena
+    // behind, new frames are dropped from the clip instead, so capture
+    // never waits on the disk.
+    class clip_recorder {
+    public:
+        clip_recorder() = default;
+
+        virtual ~clip_recorder();
+
+        clip_recorder(const clip_recorder&) = delete;
+
+        clip_recorder& operator=(const clip_recorder&) = delete;
+
+        bool open(sevun::result& result, const clip_config_t& config);
+
+        // capture thread only.  a different format once frames have come
+        // in finishes the clip in progress, waits for the writer and
+        // forgets the pre-roll, so no clip mixes two formats.
+        void set_format(
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline);
+
+        // finishes a clip in progress, waits for the writer, frees the arena
+        void close();
+
+        inline bool enabled() const {
+            return _arena != nullptr;
+        }
+
+        // capture thread only.
+        void push(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        // any thread.  an impact while a clip is recording extends its
+        // post-roll instead of starting another one.
+        inline void trigger(uint64_t event_ns) {
+            _trigger_ns.store(event_ns, std::memory_order_release);
+        }
+
+        clip_stats_t stats() const;
+
+    private:
+        enum class item_kind : uint8_t {
+            begin,
+            frame,
+            end
+        };
+
+        struct item_t {
+            item_kind kind;
+            uint64_t position;          // arena position of a frame, or the clip's first for begin
+            uint32_t length;
+            uint64_t timestamp_ns;      // frame time, or the event for begin
+        };
+
+        struct frame_ref_t {
+            uint64_t position;
+            uint32_t length;
+            uint64_t timestamp_ns;
+        };
+
+        using queue_t = spsc_queue<item_t, 4096>;
+
+        void start_clip(uint64_t event_ns);
+
+        bool enqueue(const item_t& item);
+
+        void start_writer();
+
+        void stop_writer();
+
+        void write_loop();
+
+        bool write_all(int fd, const void* data, size_t length);
+
+    private:
+        clip_config_t _config;
+        uint8_t* _arena = nullptr;
+        size_t _capacity = 0;
+        clip_file_header_t _format {};
+
+        // capture thread
+        uint64_t _head = 0;                 // arena position of the next frame
+        frame_ref_t* _frames = nullptr;     // pre-roll ring of descriptors
+        uint64_t _frames_first = 0;
+        uint64_t _frames_next = 0;
+        bool _recording = false;
+        uint64_t _clip_end_ns = 0;
+        uint64_t _queued_end = 0;           // arena end of the last frame handed to the writer
+        uint64_t _begins = 0;               // begin markers queued
+        uint64_t _floor = 0;                // first frame of the newest clip, protected until the writer gets to it
+
+        std::atomic<uint64_t> _trigger_ns {0};
+        std::atomic<uint64_t> _written_end {0};
+        std::atomic<uint64_t> _begun {0};   // begin markers the writer has reached
+        std::atomic<bool> _running {false};
+        queue_t _queue;
+        std::thread _writer;
+        uint64_t _sequence = 0;             // writer thread, clips named so far
+
+        std::atomic<uint64_t> _frame_count {0};
+        std::atomic<uint64_t> _clips_started {0};
+        std::atomic<uint64_t> _clips_written {0};
+        std::atomic<uint64_t> _frames_written {0};
+        std::atomic<uint64_t> _bytes_written {0};
+        std::atomic<uint64_t> _frames_dropped {0};
+        std::atomic<uint64_t> _write_errors {0};
+        std::atomic<uint64_t> _last_flush_ns {0};
+    };
+
+};
@@ -2,11 +2,15 @@
 #include <string>
 #include <fcntl.h>
 #include <fstream>
+#include <sched.h>
+#include <pthread.h>
 #include <cstdint>
 #include <cstring>
 #include <libv4l2.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <fmt/format.h>
@@ -14,6 +18,7 @@
 #include <sys/sysmacros.h>
 #include <linux/videodev2.h>
 #include "device.h"
+#include "trace.h"
 #include "buffers.h"
 #include "hex_formatter.h"
 
@@ -27,6 +32,7 @@ namespace sevun {
             int width,
             int height,
             int pix_order) {
+        SEVUN_TRACE_SCOPE(convert);
         int i, j;
         uint8_t tmp;
 
@@ -45,6 +51,7 @@ namespace sevun {
             uint8_t* pyuv,
             int width,
             int height) {
+        SEVUN_TRACE_SCOPE(convert);
         int i = 0;
         for (i = 0; i < (width * height * 3); i = i + 6) {
             /* y */
@@ -71,6 +78,7 @@ namespace sevun {
             int width,
             int height,
             int shift) {
+        SEVUN_TRACE_SCOPE(convert);
         for (auto i = 0; i < height; i++) {
             for (auto j = 0; j < width / 2; j++) {
                 auto temp = static_cast<uint8_t>(*inbuf++ >> shift);
@@ -395,9 +403,135 @@ namespace sevun {
         return 0;
     }
 
+    void device::apply_capture_options(sevun::result& result) {
+        // -1 leaves affinity alone; anything else has to fit in a cpu_set_t
+        if (_options.cpu < -1 || _options.cpu >= CPU_SETSIZE) {
+            result.add_message(codes::pin_cpu_failed, _options.cpu, os_error {EINVAL});
+        } else if (_options.cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(_options.cpu, &set);
+            auto rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (rc != 0)
+                result.add_message(codes::pin_cpu_failed, _options.cpu, os_error {rc});
+        }
+
+        if (_options.rt_priority > 0) {
+            struct sched_param param {};
+            param.sched_priority = _options.rt_priority;
+            auto rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (rc != 0)
+                result.add_message(codes::sched_fifo_failed, _options.rt_priority, os_error {rc});
+        }
+
+        if (_options.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+            result.add_message(codes::mlock_failed, os_error {errno});
+
+        if (_schedstat_fd < 0)
+            _schedstat_fd = ::open("/proc/thread-self/schedstat", O_RDONLY | O_CLOEXEC);
+    }
+
+    void device::publish_sched_metrics() {
+        uint64_t run_delay = 0;
+
+        // schedstat is "<on-cpu ns> <runqueue wait ns> <timeslices>"; the
+        // wait is exactly the scheduling latency the capture thread suffered.
+        if (_schedstat_fd >= 0) {
+            char text[96];
+            auto len = pread(_schedstat_fd, text, sizeof(text) - 1, 0);
+            if (len > 0) {
+                text[len] = '\0';
+                unsigned long long on_cpu = 0, wait = 0;
+                if (sscanf(text, "%llu %llu", &on_cpu, &wait) == 2)
+                    run_delay = wait;
+            }
+        }
+
+        struct rusage usage {};
+        getrusage(RUSAGE_THREAD, &usage);
+
+        auto& m = _metrics.begin_update();
+        m.run_delay_ns = run_delay;
+        m.involuntary_switches = static_cast<uint64_t>(usage.ru_nivcsw);
+        _metrics.end_update(trace::now_ns());
+    }
+
+    // driver timestamps are only comparable with our clock when they are
+    // taken from CLOCK_MONOTONIC; 0 otherwise
+    static uint64_t capture_time_ns(const struct v4l2_buffer &buf) {
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+            return 0;
+        return static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000000ULL
+             + static_cast<uint64_t>(buf.timestamp.tv_usec) * 1000ULL;
+    }
+
+    void device::publish_dequeue_metrics(
+            const struct v4l2_buffer &buf,
+            uint32_t buffer_errors) {
+        auto now = trace::now_ns();
+        auto& m = _metrics.begin_update();
+
+        m.frames++;
+        m.buffer_errors += buffer_errors;
+        m.queue_depth = _queued;
+
+        if (_have_sequence && buf.sequence > _last_sequence + 1)
+            m.drops += buf.sequence - _last_sequence - 1;
+        _last_sequence = buf.sequence;
+        _have_sequence = true;
+
+        auto captured = capture_time_ns(buf);
+        if (captured != 0 && now > captured)
+            m.dequeue_latency.add(now - captured);
+
+        _metrics.end_update(now);
+    }
+
+    void device::set_frame_observer(const frame_observer_callable& observer) {
+        _observer = observer;
+    }
+
+    void device::set_format_observer(const format_observer_callable& observer) {
+        _format_observer = observer;
+    }
+
+    void device::filter_frame(
+            buffers &b,
+            const struct v4l2_buffer &buf) {
+        if (!_denoiser.enabled() || (buf.flags & V4L2_BUF_FLAG_ERROR))
+            return;
+
+        // the capture buffers are mapped writable, so the frame is cleaned
+        // up where it lies and everything downstream sees the same pixels
+        __u32 used = b.is_mplane ? buf.m.planes[0].bytesused : buf.bytesused;
+        unsigned offset = b.is_mplane ? buf.m.planes[0].data_offset : 0;
+        if (offset > used)
+            offset = 0;
+        _denoiser.apply(static_cast<uint8_t*>(b.bufs[buf.index][0]) + offset, used - offset);
+    }
+
+    void device::observe_frame(
+            buffers &b,
+            const struct v4l2_buffer &buf) {
+        if (!_observer || (buf.flags & V4L2_BUF_FLAG_ERROR))
+            return;
+
+        auto captured = capture_time_ns(buf);
+        if (captured == 0)
+            captured = trace::now_ns();
+
+        for (unsigned j = 0; j < b.num_planes; j++) {
+            __u32 used = b.is_mplane ? buf.m.planes[j].bytesused : buf.bytesused;
+            unsigned offset = b.is_mplane ? buf.m.planes[j].data_offset : 0;
+            if (offset > used)
+                offset = 0;
+            _observer(static_cast<const uint8_t*>(b.bufs[buf.index][j]) + offset, used - offset, captured);
+        }
+    }
+
     int device::do_handle_cap(
             buffers &b,
-            FILE *fout,
+            FILE */*fout*/,
             int *index,
             unsigned &count,
             struct timespec &ts_last,
@@ -407,6 +541,8 @@ namespace sevun {
         struct v4l2_plane planes[VIDEO_MAX_PLANES];
         struct v4l2_buffer buf {};
         static time_t last_sec;
+        uint32_t buffer_errors = 0;
+        uint64_t callback_ns = 0;
 
         memset(&buf, 0, sizeof(buf));
         memset(planes, 0, sizeof(planes));
@@ -419,8 +555,11 @@ namespace sevun {
         }
 
         for (;;) {
-            ret = v4l2_ioctl(_fd, VIDIOC_DQBUF, &buf);
-            if (ret < 0 && errno == EAGAIN)
+            {
+                SEVUN_TRACE_SCOPE(dequeue);
+                ret = v4l2_ioctl(_fd, VIDIOC_DQBUF, &buf);
+            }
+            if (ret < 0 && (errno == EAGAIN || errno == EINTR))
                 return 0;
 
             if (ret < 0) {
@@ -431,10 +570,83 @@ namespace sevun {
             if (!(buf.flags & V4L2_BUF_FLAG_ERROR))
                 break;
 
-            v4l2_ioctl(_fd, VIDIOC_QBUF, &buf);
+            buffer_errors++;
+            if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buf)) {
+                _queued--;
+                return -1;
+            }
         }
 
-        if (fout && (!_stream_skip) && !(buf.flags & V4L2_BUF_FLAG_ERROR)) {
+        _queued--;
+        if (_metrics.enabled())
+            publish_dequeue_metrics(buf, buffer_errors);
+
+        // latest-frame delivery: anything else already waiting is newer, so
+        // the frame in hand only goes to the observer and straight back to
+        // the driver
+        uint32_t skipped = 0;
+        while (_options.latest_frame && index == nullptr) {
+            struct v4l2_plane next_planes[VIDEO_MAX_PLANES];
+            struct v4l2_buffer next {};
+
+            memset(next_planes, 0, sizeof(next_planes));
+            next.type = b.type;
+            next.memory = b.memory;
+            if (b.is_mplane) {
+                next.m.planes = next_planes;
+                next.length = VIDEO_MAX_PLANES;
+            }
+
+            {
+                SEVUN_TRACE_SCOPE(dequeue);
+                ret = v4l2_ioctl(_fd, VIDIOC_DQBUF, &next);
+            }
+            if (ret < 0)
+                break;
+
+            if (next.flags & V4L2_BUF_FLAG_ERROR) {
+                if (v4l2_ioctl(_fd, VIDIOC_QBUF, &next)) {
+                    _queued--;
+                    return -1;
+                }
+                continue;
+            }
+
+            _queued--;
+            if (_metrics.enabled())
+                publish_dequeue_metrics(next, 0);
+
+            filter_frame(b, buf);
+            observe_frame(b, buf);
+            {
+                SEVUN_TRACE_SCOPE(requeue);
+                if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buf))
+                    return -1;
+                _queued++;
+            }
+            skipped++;
+
+            buf = next;
+            if (b.is_mplane) {
+                memcpy(planes, next_planes, sizeof(planes));
+                buf.m.planes = planes;
+            }
+        }
+
+        SEVUN_TRACE_INSTANT(frame, buf.sequence);
+
+        _frame_ns = capture_time_ns(buf);
+        if (_frame_ns == 0)
+            _frame_ns = trace::now_ns();
+        _presented_ns = 0;
+        if (_source_change_ns != 0)
+            note_first_frame();
+        filter_frame(b, buf);
+        observe_frame(b, buf);
+
+        _frame_scratch = _scratch.acquire();
+
+        if ((!_stream_skip) && !(buf.flags & V4L2_BUF_FLAG_ERROR)) {
             for (unsigned j = 0; j < b.num_planes; j++) {
                 __u32 used = b.is_mplane ? planes[j].bytesused : buf.bytesused;
                 unsigned offset = b.is_mplane ? planes[j].data_offset : 0;
@@ -452,15 +664,24 @@ namespace sevun {
 
 //                bayer16_convert_bayer8(
 //                        reinterpret_cast<uint16_t*>(bitmap_ptr),
-//                        bayer_temp,
+//                        _frame_scratch.get(scratch_stage::bayer8),
 //                        width,
 //                        height,
 //                        2);
-//                bayer_mono_to_rgb24(bayer_temp, rgb24_temp, width, height, 0);
-//                rgb2yuyv (rgb24_temp, yuyv_temp, width, height);
+//                bayer_mono_to_rgb24(
+//                        _frame_scratch.get(scratch_stage::bayer8),
+//                        _frame_scratch.get(scratch_stage::rgb24),
+//                        width,
+//                        height,
+//                        0);
+//                rgb2yuyv(
+//                        _frame_scratch.get(scratch_stage::rgb24),
+//                        _frame_scratch.get(scratch_stage::yuyv),
+//                        width,
+//                        height);
 
 //                sz = static_cast<unsigned int>(fwrite(
-//                        yuyv_temp,
+//                        _frame_scratch.get(scratch_stage::yuyv),
 //                        1,
 //                        (width*height)*3,
 //                        fout));
@@ -471,7 +692,14 @@ namespace sevun {
 //                        1,
 //                        used,
 //                        fout));
-                if (!callable(bitmap_ptr, used))
+                bool keep_streaming;
+                {
+                    SEVUN_TRACE_SCOPE(callback);
+                    auto callback_start = trace::now_ns();
+                    keep_streaming = callable(bitmap_ptr, used);
+                    callback_ns += trace::now_ns() - callback_start;
+                }
+                if (!keep_streaming)
                     return -1;
 
 //              if (sz != used)
@@ -479,8 +707,24 @@ namespace sevun {
             }
         }
 
-        if (index == nullptr && v4l2_ioctl(_fd, VIDIOC_QBUF, &buf))
-            return -1;
+        _frame_scratch.release();
+
+        if (index == nullptr) {
+            SEVUN_TRACE_SCOPE(requeue);
+            if (v4l2_ioctl(_fd, VIDIOC_QBUF, &buf))
+                return -1;
+            _queued++;
+        }
+
+        if (_metrics.enabled()) {
+            auto& m = _metrics.begin_update();
+            m.callback_time.add(callback_ns);
+            m.skipped += skipped;
+            if (_presented_ns > _frame_ns)
+                m.display_latency.add(_presented_ns - _frame_ns);
+            m.queue_depth = _queued;
+            _metrics.end_update(trace::now_ns());
+        }
 
         if (index)
             *index = buf.index;
@@ -505,8 +749,9 @@ namespace sevun {
 
                 fps /= (__u64) res.tv_sec * 100ULL + (__u64) res.tv_nsec / 10000000ULL;
                 last_sec = res.tv_sec;
-                fmt::print(" {}.{} fps", fps / 100ULL, fps % 100ULL);
-                fmt::print("\n");
+                SEVUN_TRACE_COUNTER(fps, fps);
+                if (_metrics.enabled())
+                    publish_sched_metrics();
             }
         }
 
@@ -517,8 +762,6 @@ namespace sevun {
             return 0;
         }
 
-        fmt::print("_stream_count = {}\n", _stream_count);
-
         if (_stream_count == 0)
             return 0;
 
@@ -528,6 +771,50 @@ namespace sevun {
         return 0;
     }
 
+    static int do_requeue_cap_buffers(int fd, buffers &b) {
+        // STREAMOFF hands every buffer back; the mappings stay valid, so
+        // they only need queueing again
+        for (unsigned i = 0; i < b.bcount; i++) {
+            struct v4l2_plane planes[VIDEO_MAX_PLANES];
+            struct v4l2_buffer buf {};
+
+            memset(planes, 0, sizeof(planes));
+            buf.type = b.type;
+            buf.memory = b.memory;
+            buf.index = i;
+            if (b.is_mplane) {
+                buf.m.planes = planes;
+                buf.length = b.num_planes;
+                for (unsigned j = 0; j < b.num_planes; j++) {
+                    planes[j].length = b.planes[i][j].length;
+                    if (b.memory == V4L2_MEMORY_USERPTR)
+                        planes[j].m.userptr = (unsigned long) b.bufs[i][j];
+                }
+            } else if (b.memory == V4L2_MEMORY_USERPTR) {
+                buf.m.userptr = (unsigned long) b.bufs[i][0];
+                buf.length = b.planes[i][0].length;
+            }
+            if (v4l2_ioctl(fd, VIDIOC_QBUF, &buf))
+                return -1;
+        }
+
+        return 0;
+    }
+
+    static void do_prefault_buffers(buffers &b) {
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+        // read-only touches: the buffers are already queued, so writing
+        // would race with the driver.
+        for (unsigned i = 0; i < b.bcount; i++) {
+            for (unsigned j = 0; j < b.num_planes; j++) {
+                auto p = static_cast<volatile uint8_t*>(b.bufs[i][j]);
+                for (size_t off = 0; off < b.planes[i][j].length; off += page)
+                    (void) p[off];
+            }
+        }
+    }
+
     static void do_release_buffers(buffers &b) {
         for (unsigned i = 0; i < b.bcount; i++) {
             for (unsigned j = 0; j < b.num_planes; j++) {
@@ -541,6 +828,198 @@ namespace sevun {
         }
     }
 
+    bool device::frame_interval(
+            sevun::result& result,
+            uint32_t& numerator,
+            uint32_t& denominator) {
+        struct v4l2_streamparm parm {};
+        parm.type = _format.type;
+
+        if (do_ioctl_name(result, VIDIOC_G_PARM, &parm, "VIDIOC_G_PARM"))
+            return false;
+
+        if (!(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)
+        ||  parm.parm.capture.timeperframe.denominator == 0) {
+            result.add_message(codes::frame_interval_unsupported, _path);
+            return false;
+        }
+
+        numerator = parm.parm.capture.timeperframe.numerator;
+        denominator = parm.parm.capture.timeperframe.denominator;
+        return true;
+    }
+
+    bool device::apply_frame_interval(
+            sevun::result& result,
+            buffers& b,
+            uint32_t numerator,
+            uint32_t denominator) {
+        SEVUN_TRACE_SCOPE(governor);
+
+        struct v4l2_streamparm parm {};
+        parm.type = b.type;
+        parm.parm.capture.timeperframe.numerator = numerator;
+        parm.parm.capture.timeperframe.denominator = denominator;
+
+        if (v4l2_ioctl(_fd, VIDIOC_S_PARM, &parm) == 0)
+            return true;
+
+        if (errno != EBUSY) {
+            result.add_message(codes::frame_interval_failed, numerator, denominator, os_error {errno});
+            return true;
+        }
+
+        // UVC and friends refuse while streaming: stop, change, and start
+        // again on the same buffers
+        v4l2_ioctl(_fd, VIDIOC_STREAMOFF, &b.type);
+        if (v4l2_ioctl(_fd, VIDIOC_S_PARM, &parm))
+            result.add_message(codes::frame_interval_failed, numerator, denominator, os_error {errno});
+
+        if (do_requeue_cap_buffers(_fd, b)) {
+            result.add_message(codes::ioctl_failed, "VIDIOC_QBUF", os_error {errno});
+            return false;
+        }
+        _queued = b.bcount;
+        _have_sequence = false;
+
+        return do_ioctl_name(result, VIDIOC_STREAMON, &b.type, "VIDIOC_STREAMON") == 0;
+    }
+
+    void device::open_stream_stages(sevun::result& result) {
+        // the history starts over with every stream, since a source change
+        // may have moved the picture
+        if (_options.temporal_denoise) {
+            bool mplane = _format.type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+            _denoiser.open(
+                result,
+                denoise_config_t {},
+                mplane ? _format.fmt.pix_mp.width : _format.fmt.pix.width,
+                mplane ? _format.fmt.pix_mp.height : _format.fmt.pix.height,
+                mplane ? _format.fmt.pix_mp.pixelformat : _format.fmt.pix.pixelformat,
+                mplane ? _format.fmt.pix_mp.plane_fmt[0].bytesperline : _format.fmt.pix.bytesperline);
+        }
+    }
+
+    void device::query_input_timings(sevun::result& result) {
+        struct v4l2_dv_timings new_dv_timings = {};
+        v4l2_std_id new_std;
+        struct v4l2_input in = {};
+
+        if (!do_ioctl_name(result, VIDIOC_G_INPUT, &in.index, "VIDIOC_G_INPUT") &&
+            !do_ioctl_name(result, VIDIOC_ENUMINPUT, &in, "VIDIOC_ENUMINPUT")) {
+            if (in.capabilities & V4L2_IN_CAP_DV_TIMINGS) {
+                // a receiver that has just lost lock usually has it back
+                // within a few frames, so poll at that granularity
+                while (v4l2_ioctl(_fd, VIDIOC_QUERY_DV_TIMINGS, &new_dv_timings)) {
+                    if (_stop_requested.load(std::memory_order_relaxed))
+                        return;
+                    usleep(10000);
+                }
+                do_ioctl_name(result, VIDIOC_S_DV_TIMINGS, &new_dv_timings, "VIDIOC_S_DV_TIMINGS");
+                fprintf(stderr, "New timings found\n");
+            } else if (in.capabilities & V4L2_IN_CAP_STD) {
+                if (!do_ioctl_name(result, VIDIOC_QUERYSTD, &new_std, "VIDIOC_QUERYSTD"))
+                    do_ioctl_name(result, VIDIOC_S_STD, &new_std, "VIDIOC_S_STD");
+            }
+        }
+    }
+
+    // the same picture in the same layout, whatever else changed
+    static bool same_geometry(const struct v4l2_format& a, const struct v4l2_format& b) {
+        if (a.type != b.type)
+            return false;
+        if (a.type != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+            return a.fmt.pix.width == b.fmt.pix.width
+                && a.fmt.pix.height == b.fmt.pix.height
+                && a.fmt.pix.pixelformat == b.fmt.pix.pixelformat
+                && a.fmt.pix.bytesperline == b.fmt.pix.bytesperline;
+
+        const auto& p = a.fmt.pix_mp;
+        const auto& q = b.fmt.pix_mp;
+        if (p.width != q.width || p.height != q.height || p.pixelformat != q.pixelformat || p.num_planes != q.num_planes)
+            return false;
+        for (unsigned i = 0; i < p.num_planes && i < VIDEO_MAX_PLANES; i++)
+            if (p.plane_fmt[i].bytesperline != q.plane_fmt[i].bytesperline)
+                return false;
+        return true;
+    }
+
+    // after STREAMOFF.  false leaves the stream stopped for a full
+    // teardown: the format can't be read, it isn't the picture everything
+    // downstream was set up for, or it needs more planes or bigger buffers
+    // than the ones mapped.
+    bool device::restart_in_place(
+            sevun::result& result,
+            buffers& b) {
+        SEVUN_TRACE_SCOPE(recover);
+
+        query_input_timings(result);
+
+        struct v4l2_format format {};
+        format.type = _format.type;
+        if (do_ioctl_name(result, VIDIOC_G_FMT, &format, "VIDIOC_G_FMT"))
+            return false;
+
+        if (b.memory == V4L2_MEMORY_DMABUF || !same_geometry(format, _format))
+            return false;
+
+        for (unsigned i = 0; i < b.bcount; i++) {
+            if (b.is_mplane) {
+                if (format.fmt.pix_mp.num_planes != b.num_planes)
+                    return false;
+                for (unsigned j = 0; j < b.num_planes; j++)
+                    if (format.fmt.pix_mp.plane_fmt[j].sizeimage > b.planes[i][j].length)
+                        return false;
+            } else if (format.fmt.pix.sizeimage > b.planes[i][0].length) {
+                return false;
+            }
+        }
+
+        _format = format;
+        open_stream_stages(result);
+
+        if (do_requeue_cap_buffers(_fd, b)) {
+            result.add_message(codes::ioctl_failed, "VIDIOC_QBUF", os_error {errno});
+            return false;
+        }
+        _queued = b.bcount;
+        _have_sequence = false;
+
+        if (do_ioctl_name(result, VIDIOC_STREAMON, &b.type, "VIDIOC_STREAMON"))
+            return false;
+
+        _recovery.buffers_kept++;
+        _buffers_kept = true;
+        note_restart();
+        return true;
+    }
+
+    void device::note_restart() {
+        if (_source_change_ns == 0 || _restarted)
+            return;
+
+        _recovery.last_restart_ns = trace::now_ns() - _source_change_ns;
+        _recovery.restart_time.add(_recovery.last_restart_ns);
+        _restarted = true;
+    }
+
+    void device::note_first_frame() {
+        if (!_restarted)
+            return;
+
+        _recovery.last_first_frame_ns = trace::now_ns() - _source_change_ns;
+        _recovery.first_frame_time.add(_recovery.last_first_frame_ns);
+        _source_change_ns = 0;
+        _restarted = false;
+
+        fmt::print(
+            stderr,
+            "\nsource change: {} buffers, streaming again after {:.1f} ms, first frame after {:.1f} ms\n",
+            _buffers_kept ? "kept" : "reallocated",
+            _recovery.last_restart_ns / 1e6,
+            _recovery.last_first_frame_ns / 1e6);
+    }
+
     void device::capture_stream(
             sevun::result &result,
             const std::string& output_path,
@@ -559,37 +1038,49 @@ namespace sevun {
         bool source_change;
         FILE *fout = nullptr;
 
+        apply_capture_options(result);
+
         memset(&sub, 0, sizeof(sub));
         sub.type = V4L2_EVENT_EOS;
         ioctl(_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
-//        if (use_poll) {
-//            sub.type = V4L2_EVENT_SOURCE_CHANGE;
-//            ioctl(_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
-//        }
+        sub.type = V4L2_EVENT_SOURCE_CHANGE;
+        ioctl(_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
 
         recover:
         eos = false;
         source_change = false;
         count = 0;
 
-        struct v4l2_dv_timings new_dv_timings = {};
-        v4l2_std_id new_std;
-        struct v4l2_input in = {};
+        query_input_timings(result);
+
+        // after a source change this is a full restart, possibly at a new
+        // format, which everything downstream has to follow
+        {
+            struct v4l2_format format {};
+            format.type = _format.type;
+            if (!do_ioctl_name(result, VIDIOC_G_FMT, &format, "VIDIOC_G_FMT")) {
+                auto changed = !same_geometry(format, _format);
+                _format = format;
+                if (changed && _format_observer)
+                    _format_observer(_format);
+            }
+        }
 
-        if (!do_ioctl_name(result, VIDIOC_G_INPUT, &in.index, "VIDIOC_G_INPUT") &&
-            !do_ioctl_name(result, VIDIOC_ENUMINPUT, &in, "VIDIOC_ENUMINPUT")) {
-            if (in.capabilities & V4L2_IN_CAP_DV_TIMINGS) {
-                while (do_ioctl_name(result, VIDIOC_QUERY_DV_TIMINGS, &new_dv_timings, "VIDIOC_QUERY_DV_TIMINGS"))
-                    sleep(1);
-                do_ioctl_name(result, VIDIOC_S_DV_TIMINGS, &new_dv_timings, "VIDIOC_S_DV_TIMINGS");
-                fprintf(stderr, "New timings found\n");
-            } else if (in.capabilities & V4L2_IN_CAP_STD) {
-                if (!do_ioctl_name(result, VIDIOC_QUERYSTD, &new_std, "VIDIOC_QUERYSTD"))
-                    do_ioctl_name(result, VIDIOC_S_STD, &new_std, "VIDIOC_S_STD");
+        // conversion scratch for the whole session, so nothing on the frame
+        // path allocates.  a bigger format needs the arena mapped again,
+        // which can't be done under a lease still held on the old one.
+        if (_options.scratch_frames > 0 && !_scratch.fits(_format)) {
+            auto leased = _scratch.stats().in_use;
+            if (leased > 0) {
+                result.add_message(codes::scratch_leased, leased);
+                goto done;
             }
+            _scratch.open(result, _format, _options.scratch_frames);
         }
 
-        fout = fopen(output_path.c_str(), "w+");
+        // nothing to write to when headless
+        if (!output_path.empty() && fout == nullptr)
+            fout = fopen(output_path.c_str(), "w+");
 
         if (b.reqbufs(_fd, 3))
             goto done;
@@ -597,8 +1088,29 @@ namespace sevun {
         if (do_setup_cap_buffers(_fd, b))
             goto done;
 
+        if (_options.prefault_buffers)
+            do_prefault_buffers(b);
+
+        open_stream_stages(result);
+
+        _queued = b.bcount;
+        _have_sequence = false;
+        if (_metrics.enabled()) {
+            auto& m = _metrics.begin_update();
+            m.buffer_count = b.bcount;
+            m.queue_depth = _queued;
+            _metrics.end_update(trace::now_ns());
+        }
+
         if (do_ioctl_name(result, VIDIOC_STREAMON, &b.type, "VIDIOC_STREAMON"))
             goto done;
+        note_restart();
+
+        resume:
+        // latest-frame delivery waits in select() so it can drain without
+        // blocking once the queue is empty
+        if (_options.latest_frame)
+            fcntl(_fd, F_SETFL, fd_flags | O_NONBLOCK);
 
 //        while (stream_sleep == 0)
 //            sleep(100);
@@ -606,19 +1118,24 @@ namespace sevun {
 //        if (use_poll)
 //            fcntl(_fd, F_SETFL, fd_flags | O_NONBLOCK);
 
-        while (!eos && !source_change) {
+        while (!eos && !source_change && !_stop_requested.load(std::memory_order_relaxed)) {
             fd_set read_fds;
             fd_set exception_fds;
-            struct timeval tv = {0, 0}; //{use_poll ? 2 : 0, 0};
+            struct timeval tv = {_options.latest_frame ? 1 : 0, 0}; //{use_poll ? 2 : 0, 0};
             int r;
 
+            auto interval = _interval_request.exchange(0, std::memory_order_acq_rel);
+            if (interval != 0
+            &&  !apply_frame_interval(result, b, static_cast<uint32_t>(interval >> 32), static_cast<uint32_t>(interval)))
+                break;
+
             FD_ZERO(&exception_fds);
             FD_SET(_fd, &exception_fds);
             FD_ZERO(&read_fds);
             FD_SET(_fd, &read_fds);
             r = select(
                     _fd + 1,
-                    nullptr, //use_poll ? &read_fds : nullptr,
+                    _options.latest_frame ? &read_fds : nullptr, //use_poll ? &read_fds : nullptr,
                     nullptr,
                     &exception_fds,
                     &tv);
@@ -643,6 +1160,11 @@ namespace sevun {
                         case V4L2_EVENT_SOURCE_CHANGE:
                             source_change = true;
                             fprintf(stderr, "\nSource changed");
+                            if (_source_change_ns == 0) {
+                                _source_change_ns = trace::now_ns();
+                                _restarted = false;
+                                _recovery.events++;
+                            }
                             break;
                         case V4L2_EVENT_EOS:
                             eos = true;
@@ -666,6 +1188,18 @@ namespace sevun {
         }
 
         v4l2_ioctl(_fd, VIDIOC_STREAMOFF, &b.type);
+
+        // the buffers are all back from the driver and still mapped; if the
+        // new format fits in them, streaming restarts around them
+        if (source_change && !eos && !_stop_requested.load(std::memory_order_relaxed)) {
+            source_change = false;
+            if (restart_in_place(result, b))
+                goto resume;
+            source_change = true;
+            _recovery.buffers_reallocated++;
+            _buffers_kept = false;
+        }
+
         fcntl(_fd, F_SETFL, fd_flags);
         fmt::print("\n");
 
@@ -673,7 +1207,9 @@ namespace sevun {
         if (source_change)
             goto recover;
 
-        done:;
+        done:
+        if (fout != nullptr)
+            fclose(fout);
     }
 
     device::device(const std::string& path): _path(path) {
@@ -682,16 +1218,15 @@ namespace sevun {
     device::~device() {
         if (_fd != -1)
             v4l2_close(_fd);
+        if (_schedstat_fd != -1)
+            ::close(_schedstat_fd);
     }
 
     bool device::open(sevun::result& result) {
         _fd = v4l2_open(_path.c_str(), O_RDWR);
 
         if (_fd < 0) {
-            result.add_message(
-                "V004",
-                fmt::format("failed to open {}: {}\n", _path, strerror(errno)),
-                true);
+            result.add_message(codes::open_failed, _path, os_error {errno});
             return false;
         }
 
@@ -700,10 +1235,7 @@ namespace sevun {
 
         if (!is_sub_device(result)
         &&   do_ioctl_name(result, VIDIOC_QUERYCAP, &vcap, "VIDIOC_QUERYCAP")) {
-            result.add_message(
-                "V005",
-                fmt::format("{}: not a v4l2 node\n", _path),
-                true);
+            result.add_message(codes::not_v4l2_node, _path);
             return false;
         }
 
@@ -751,18 +1283,29 @@ namespace sevun {
         return _info;
     }
 
+    const struct v4l2_format& device::format() const {
+        return _format;
+    }
+
+    void device::set_capture_options(const capture_options_t& options) {
+        _options = options;
+    }
+
+    bool device::publish_metrics(
+            sevun::result& result,
+            const std::string& name) {
+        return _metrics.open(result, name);
+    }
+
     int device::do_ioctl_name(
             sevun::result& result,
             unsigned long int request,
             void* parm,
-            const std::string& name) {
+            const char* name) {
         auto rc = v4l2_ioctl(_fd, request, parm);
 
         if (rc < 0) {
-            result.add_message(
-                "V006",
-                fmt::format("{}: failed: {}\n", name, strerror(errno)),
-                true);
+            result.add_message(codes::ioctl_failed, name, os_error {errno});
         }
 
         return rc;
@@ -772,7 +1315,7 @@ namespace sevun {
         struct stat sb {};
 
         if (fstat(_fd, &sb) == -1) {
-            result.add_message("V001", "failed to stat file.", true);
+            result.add_message(codes::stat_failed);
             return false;
         }
 
@@ -782,7 +1325,7 @@ namespace sevun {
             minor(sb.st_rdev));
         std::ifstream uevent_file(uevent_path);
         if (uevent_file.fail()) {
-            result.add_message("V002", "failed to open file.", true);
+            result.add_message(codes::uevent_open_failed);
             return false;
         }
 
@@ -813,7 +1356,7 @@ namespace sevun {
 
         uevent_file.close();
 
-        result.add_message("V003", "unknown device name.", true);
+        result.add_message(codes::unknown_device_name);
         return false;
     }
 
@@ -862,6 +1405,7 @@ namespace sevun {
         vfmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
         if (do_ioctl_name(result, VIDIOC_G_FMT, &vfmt, "VIDIOC_G_FMT") == 0) {
+            _format = vfmt;
             __u32 colsp = vfmt.fmt.pix.colorspace;
             __u32 ycbcr_enc = vfmt.fmt.pix.ycbcr_enc;
 
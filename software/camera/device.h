@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include "result.h"
 #include "buffers.h"
+#include "metrics.h"
+#include "scratch_pool.h"
+#include "temporal_denoiser.h"
 
 namespace sevun {
 
@@ -35,10 +39,37 @@ namespace sevun {
         device_capabilities_t capabilities {};
     };
 
+    struct capture_options_t {
+        int cpu = -1;                   // core to pin the capture thread to, -1 leaves affinity alone
+        int rt_priority = 0;            // SCHED_FIFO priority, 0 keeps the inherited policy
+        bool lock_memory = false;       // mlockall current and future mappings
+        bool prefault_buffers = false;  // touch every page of the capture buffers before streaming
+        bool latest_frame = false;      // drain every ready buffer per wakeup and render only the newest
+        uint32_t scratch_frames = 2;    // frames that can hold conversion scratch at once, 0 for none
+        bool temporal_denoise = false;  // filter GREY/Y10 frames in place before anything sees them
+    };
+
+    // V4L2_EVENT_SOURCE_CHANGE handling.  a change the current buffers can
+    // hold restarts the stream around them; anything bigger tears them down
+    // and allocates again.  times are from the event.
+    struct recovery_stats_t {
+        uint64_t events;
+        uint64_t buffers_kept;
+        uint64_t buffers_reallocated;
+        uint64_t last_restart_ns;       // until STREAMON
+        uint64_t last_first_frame_ns;   // until the first frame after it
+        histogram_t restart_time;
+        histogram_t first_frame_time;
+    };
+
     class device {
     public:
         using render_frame_callable = std::function<bool (uint8_t*, size_t)>;
 
+        using frame_observer_callable = std::function<void (const uint8_t*, size_t, uint64_t)>;
+
+        using format_observer_callable = std::function<void (const struct v4l2_format&)>;
+
         explicit device(const std::string& path);
 
         virtual ~device();
@@ -47,6 +78,82 @@ namespace sevun {
 
         const device_info_t& info() const;
 
+        // capture format negotiated at open(), or the latest a source
+        // change brought
+        const struct v4l2_format& format() const;
+
+        // applied to the calling thread when capture_stream starts
+        void set_capture_options(const capture_options_t& options);
+
+        // publishes capture health into the named POSIX shared-memory
+        // segment; read it with visor-stat.
+        bool publish_metrics(
+            sevun::result& result,
+            const std::string& name);
+
+        // sees every frame in order with its capture timestamp, whichever
+        // frames the render callback gets; runs on the capture thread
+        // before the buffer is requeued
+        void set_frame_observer(const frame_observer_callable& observer);
+
+        // told when a source change brings a different size, pixel format
+        // or stride, before the first frame at it; runs on the capture
+        // thread while the stream is stopped
+        void set_format_observer(const format_observer_callable& observer);
+
+        // capture thread: CLOCK_MONOTONIC capture time of the frame being
+        // rendered, or its dequeue time if the driver stamps another clock
+        inline uint64_t frame_timestamp_ns() const {
+            return _frame_ns;
+        }
+
+        // render callback: scratch buffers for converting the current
+        // frame.  they go back to the pool once the frame is requeued
+        // unless the lease is moved out to keep them longer.  invalid when
+        // every slot is held.
+        inline scratch_frame& scratch() {
+            return _frame_scratch;
+        }
+
+        inline scratch_stats_t scratch_stats() const {
+            return _scratch.stats();
+        }
+
+        inline denoise_stats_t denoise_stats() const {
+            return _denoiser.stats();
+        }
+
+        inline recovery_stats_t recovery_stats() const {
+            return _recovery;
+        }
+
+        // render callback: the current frame reached the screen at now_ns
+        inline void frame_presented(uint64_t now_ns) {
+            _presented_ns = now_ns;
+        }
+
+        // async-signal-safe.  capture_stream finishes the frame in hand,
+        // or gives up the dequeue it was interrupted in, and returns.
+        inline void request_stop() {
+            _stop_requested.store(true, std::memory_order_relaxed);
+        }
+
+        // current capture frame interval, numerator/denominator seconds
+        bool frame_interval(
+            sevun::result& result,
+            uint32_t& numerator,
+            uint32_t& denominator);
+
+        // any thread.  capture_stream applies it before its next dequeue,
+        // restarting the stream around it if the driver only takes a new
+        // interval while stopped.
+        inline void request_frame_interval(uint32_t numerator, uint32_t denominator) {
+            _interval_request.store(
+                (static_cast<uint64_t>(numerator) << 32) | denominator,
+                std::memory_order_release);
+        }
+
+        // an empty output_path opens no capture file
         void capture_stream(
             sevun::result &result,
             const std::string& output_path,
@@ -54,6 +161,14 @@ namespace sevun {
             const render_frame_callable& callable);
 
     private:
+        void filter_frame(
+            sevun::buffers &b,
+            const struct v4l2_buffer &buf);
+
+        void observe_frame(
+            sevun::buffers &b,
+            const struct v4l2_buffer &buf);
+
         int do_handle_cap(
             sevun::buffers &b,
             FILE *fout,
@@ -62,11 +177,37 @@ namespace sevun {
             timespec &ts_last,
             const render_frame_callable& callable);
 
+        void apply_capture_options(sevun::result& result);
+
+        void open_stream_stages(sevun::result& result);
+
+        void query_input_timings(sevun::result& result);
+
+        bool restart_in_place(
+            sevun::result& result,
+            buffers& b);
+
+        void note_restart();
+
+        void note_first_frame();
+
+        bool apply_frame_interval(
+            sevun::result& result,
+            buffers& b,
+            uint32_t numerator,
+            uint32_t denominator);
+
+        void publish_sched_metrics();
+
+        void publish_dequeue_metrics(
+            const struct v4l2_buffer &buf,
+            uint32_t buffer_errors);
+
         int do_ioctl_name(
             sevun::result& result,
             unsigned long int request,
             void* parm,
-            const std::string& name);
+            const char* name);
 
         bool enumerate_video_formats(
                 sevun::result& result,
@@ -80,7 +221,27 @@ namespace sevun {
         int _fd;
         std::string _path;
         device_info_t _info {};
+        struct v4l2_format _format {};
         uint32_t _stream_skip = 0;
         uint32_t _stream_count = 0;
+        uint32_t _queued = 0;
+        uint32_t _last_sequence = 0;
+        bool _have_sequence = false;
+        metrics_publisher _metrics {};
+        capture_options_t _options {};
+        int _schedstat_fd = -1;
+        std::atomic<uint64_t> _interval_request {0};
+        std::atomic<bool> _stop_requested {false};
+        frame_observer_callable _observer {};
+        format_observer_callable _format_observer {};
+        uint64_t _frame_ns = 0;
+        uint64_t _presented_ns = 0;
+        scratch_pool _scratch {};
+        scratch_frame _frame_scratch {};
+        temporal_denoiser _denoiser {};
+        recovery_stats_t _recovery {};
+        uint64_t _source_change_ns = 0; // pending recovery, 0 when none
+        bool _restarted = false;        // ... and STREAMON is behind it
+        bool _buffers_kept = false;     // ... around the buffers already mapped
     };
 };
\ No newline at end of file
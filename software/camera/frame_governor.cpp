@@ -0,0 +1,239 @@
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <linux/videodev2.h>
+#include "frame_governor.h"
+#include "trace.h"
+
+namespace sevun {
+
+    frame_governor::frame_governor(
+            const governor_config_t& config,
+            const imu_scale_t& scale)
+        : _config(config),
+          _scale(scale) {
+    }
+
+    void frame_governor::start(const switch_callable& apply, uint64_t now_ns) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _apply = apply;
+        _state_since_ns = now_ns;
+        _last_motion_ns.store(now_ns, std::memory_order_relaxed);
+        _state.store(governor_state::active, std::memory_order_release);
+    }
+
+    void frame_governor::set_format(
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline) {
+        _width = width;
+        _height = height;
+        _pixelformat = pixelformat;
+        _bytesperline = bytesperline;
+
+        auto grid = std::max<uint32_t>(_config.frame_grid, 1);
+        _previous.assign(static_cast<size_t>(grid) * grid, 0);
+        _have_previous = false;
+    }
+
+    void frame_governor::push(const imu_sample_t& sample) {
+        auto dt = _last_sample_ns != 0 && sample.timestamp_ns > _last_sample_ns
+                ? sample.timestamp_ns - _last_sample_ns
+                : 0;
+        _last_sample_ns = sample.timestamp_ns;
+
+        // single-pole average with a time constant of the motion window, so
+        // the thresholds mean the same at either sample rate
+        auto alpha = _config.motion_window_ns > 0
+                   ? std::min(1.0f, static_cast<float>(dt) / _config.motion_window_ns)
+                   : 1.0f;
+
+        float gyro = 0.0f;
+        float accel = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            auto w = sample.gyro[axis] * _scale.gyro_dps;
+            auto a = sample.accel[axis] * _scale.accel_g;
+            gyro += w * w;
+            accel += a * a;
+        }
+        auto departure = std::sqrt(accel) - 1.0f;
+
+        _gyro_energy += alpha * (gyro - _gyro_energy);
+        _accel_energy += alpha * (departure * departure - _accel_energy);
+        _gyro_power.store(_gyro_energy, std::memory_order_relaxed);
+        _accel_power.store(_accel_energy, std::memory_order_relaxed);
+
+        if (_gyro_energy > _config.gyro_threshold_dps * _config.gyro_threshold_dps
+        ||  _accel_energy > _config.accel_threshold_g * _config.accel_threshold_g) {
+            _last_motion_ns.store(sample.timestamp_ns, std::memory_order_relaxed);
+            if (state() == governor_state::idle)
+                wake(sample.timestamp_ns, true);
+        }
+    }
+
+    float frame_governor::frame_difference(const uint8_t* data, size_t length) {
+        if (_width == 0 || _height == 0 || _previous.empty())
+            return 0.0f;
+
+        // an 8-bit luma level per sample: the Y byte of YUYV, the top
+        // eight bits of 10- or 16-bit little-endian mono, and otherwise
+        // the most significant byte of each pixel
+        auto grid = std::max<uint32_t>(_config.frame_grid, 1);
+        auto bytes_per_pixel = std::max<uint32_t>(_bytesperline / _width, 1);
+        auto step_x = std::max<uint32_t>(_width / grid, 1);
+        auto step_y = std::max<uint32_t>(_height / grid, 1);
+
+        auto shift = 0u;
+        auto byte = bytes_per_pixel - 1;
+        switch (_pixelformat) {
+            case V4L2_PIX_FMT_YUYV:
+                byte = 0;
+                break;
+            case V4L2_PIX_FMT_Y10:
+                shift = 2;
+                byte = 0;
+                break;
+            case V4L2_PIX_FMT_Y16:
+                shift = 8;
+                byte = 0;
+                break;
+        }
+        auto wide = shift > 0;
+
+        uint64_t sum = 0;
+        uint32_t n = 0;
+        for (uint32_t gy = 0; gy < grid; gy++) {
+            auto y = gy * step_y + step_y / 2;
+            if (y >= _height)
+                break;
+            auto row = static_cast<size_t>(y) * _bytesperline;
+            for (uint32_t gx = 0; gx < grid; gx++) {
+                auto x = gx * step_x + step_x / 2;
+                auto offset = row + static_cast<size_t>(x) * bytes_per_pixel + byte;
+                if (x >= _width || offset + (wide ? 1 : 0) >= length)
+                    break;
+
+                auto& previous = _previous[gy * grid + gx];
+                auto value = wide
+                    ? static_cast<uint8_t>(std::min((data[offset] | data[offset + 1] << 8) >> shift, 255))
+                    : data[offset];
+                sum += static_cast<uint32_t>(std::abs(value - previous));
+                previous = value;
+                n++;
+            }
+        }
+
+        auto had_previous = _have_previous;
+        _have_previous = n > 0;
+        return had_previous && n > 0 ? static_cast<float>(sum) / n : 0.0f;
+    }
+
+    void frame_governor::push_frame(
+            const uint8_t* data,
+            size_t length,
+            uint64_t timestamp_ns) {
+        SEVUN_TRACE_SCOPE(governor);
+
+        auto difference = frame_difference(data, length);
+        _frame_difference.store(difference, std::memory_order_relaxed);
+
+        if (difference > _config.frame_threshold) {
+            _last_motion_ns.store(timestamp_ns, std::memory_order_relaxed);
+            if (state() == governor_state::idle)
+                wake(timestamp_ns, false);
+        }
+
+        auto interval = timestamp_ns - _last_frame_ns;
+        auto have_interval = _last_frame_ns != 0;
+        _last_frame_ns = timestamp_ns;
+
+        if (state() == governor_state::idle)
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_wake_motion_ns != 0) {
+                // full rate once a frame arrives within a quarter period of
+                // the active interval
+                _wake_frames++;
+                const auto& active = _config.active;
+                auto full_rate = have_interval
+                    && interval * active.interval_denominator * 4 <= active.interval_numerator * 5000000000ULL;
+                if (full_rate) {
+                    _last_wake_ns = timestamp_ns > _wake_motion_ns ? timestamp_ns - _wake_motion_ns : 0;
+                    _max_wake_ns = std::max(_max_wake_ns, _last_wake_ns);
+                    _last_wake_frames = _wake_frames;
+                    _wake_motion_ns = 0;
+                }
+            }
+        }
+
+        auto last_motion = _last_motion_ns.load(std::memory_order_relaxed);
+        if (timestamp_ns > last_motion && timestamp_ns - last_motion > _config.idle_after_ns)
+            sleep(timestamp_ns);
+    }
+
+    void frame_governor::wake(uint64_t motion_ns, bool from_imu) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_state.load(std::memory_order_relaxed) == governor_state::active)
+            return;
+
+        enter(governor_state::active, motion_ns);
+        _wakes++;
+        if (from_imu)
+            _imu_wakes++;
+        _wake_motion_ns = motion_ns;
+        _wake_frames = 0;
+    }
+
+    void frame_governor::sleep(uint64_t now_ns) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_state.load(std::memory_order_relaxed) == governor_state::idle)
+            return;
+
+        // a wake that never reached full rate isn't worth reporting
+        _wake_motion_ns = 0;
+        enter(governor_state::idle, now_ns);
+    }
+
+    void frame_governor::enter(governor_state state, uint64_t now_ns) {
+        SEVUN_TRACE_INSTANT(governor, static_cast<uint64_t>(state));
+
+        auto spent = now_ns > _state_since_ns ? now_ns - _state_since_ns : 0;
+        if (_state.load(std::memory_order_relaxed) == governor_state::idle)
+            _idle_ns += spent;
+        else
+            _active_ns += spent;
+        _state_since_ns = std::max(now_ns, _state_since_ns);
+
+        _state.store(state, std::memory_order_release);
+        if (_apply)
+            _apply(state, state == governor_state::active ? _config.active : _config.idle);
+    }
+
+    governor_stats_t frame_governor::stats(uint64_t now_ns) const {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        governor_stats_t s {};
+        s.state = _state.load(std::memory_order_relaxed);
+        s.idle_ns = _idle_ns;
+        s.active_ns = _active_ns;
+        auto current = now_ns > _state_since_ns ? now_ns - _state_since_ns : 0;
+        if (s.state == governor_state::idle)
+            s.idle_ns += current;
+        else
+            s.active_ns += current;
+
+        s.wakes = _wakes;
+        s.imu_wakes = _imu_wakes;
+        s.last_wake_ns = _last_wake_ns;
+        s.max_wake_ns = _max_wake_ns;
+        s.last_wake_frames = _last_wake_frames;
+        s.motion_dps = std::sqrt(_gyro_power.load(std::memory_order_relaxed));
+        s.motion_g = std::sqrt(_accel_power.load(std::memory_order_relaxed));
+        s.frame_difference = _frame_difference.load(std::memory_order_relaxed);
+        return s;
+    }
+
+};
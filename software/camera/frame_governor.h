@@ -0,0 +1,143 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "imu.h"
+
+namespace sevun {
+
+    enum class governor_state : uint8_t {
+        idle,
+        active
+    };
+
+    // what the camera and the IMU run at in one state
+    struct governor_profile_t {
+        uint32_t interval_numerator;            // frame interval, seconds
+        uint32_t interval_denominator;
+        uint8_t accel_rate;                     // FXOS_DR_*
+        uint8_t gyro_rate;                      // FXAS_DR_*
+    };
+
+    struct governor_config_t {
+        governor_profile_t active {1, 60, FXOS_DR_800HZ, FXAS_DR_800HZ};
+        governor_profile_t idle {1, 15, FXOS_DR_400HZ, FXAS_DR_200HZ};
+
+        // motion energy: rms over the last motion_window_ns of the angular
+        // rate, and of the specific force's departure from 1 g
+        float gyro_threshold_dps = 15.0f;
+        float accel_threshold_g = 0.08f;
+        uint64_t motion_window_ns = 50000000ULL;
+
+        // mean absolute difference between consecutive frames, in 8-bit
+        // levels over a sparse grid of samples
+        float frame_threshold = 6.0f;
+        uint32_t frame_grid = 64;               // samples per row and column
+
+        // stillness needed before dropping to idle
+        uint64_t idle_after_ns = 3000000000ULL;
+    };
+
+    struct governor_stats_t {
+        uint64_t idle_ns;
+        uint64_t active_ns;
+        uint64_t wakes;
+        uint64_t imu_wakes;                     // woken by the IMU rather than the picture
+        uint64_t last_wake_ns;                  // motion to the first frame at the active rate
+        uint64_t max_wake_ns;
+        uint32_t last_wake_frames;              // frames delivered in between
+        float motion_dps;
+        float motion_g;
+        float frame_difference;
+        governor_state state;
+    };
+
+    // switches camera frame interval and IMU output data rate between a
+    // low-power idle profile and the full-rate active one.  motion seen by
+    // either the IMU or the picture wakes it straight away, from whichever
+    // thread saw it; it only drops back to idle after idle_after_ns with
+    // neither.  switching goes through the callback, which must be safe to
+    // call from both threads (device::request_frame_interval and
+    // imu_service::set_rates are).
+    class frame_governor {
+    public:
+        using switch_callable = std::function<void (governor_state, const governor_profile_t&)>;
+
+        frame_governor(const governor_config_t& config, const imu_scale_t& scale);
+
+        frame_governor(const frame_governor&) = delete;
+
+        frame_governor& operator=(const frame_governor&) = delete;
+
+        // starts in the active profile, which the camera and IMU are
+        // expected to be running already; call once before streaming
+        void start(const switch_callable& apply, uint64_t now_ns);
+
+        // capture thread, before the first frame
+        void set_format(uint32_t width, uint32_t height, uint32_t pixelformat, uint32_t bytesperline);
+
+        // IMU consumer thread
+        void push(const imu_sample_t& sample);
+
+        // capture thread
+        void push_frame(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        inline governor_state state() const {
+            return _state.load(std::memory_order_acquire);
+        }
+
+        governor_stats_t stats(uint64_t now_ns) const;
+
+    private:
+        void wake(uint64_t motion_ns, bool from_imu);
+
+        void sleep(uint64_t now_ns);
+
+        void enter(governor_state state, uint64_t now_ns);
+
+        float frame_difference(const uint8_t* data, size_t length);
+
+    private:
+        governor_config_t _config;
+        imu_scale_t _scale;
+        switch_callable _apply;
+        std::atomic<governor_state> _state {governor_state::active};
+        std::atomic<uint64_t> _last_motion_ns {0};
+
+        // IMU thread
+        float _gyro_energy = 0.0f;
+        float _accel_energy = 0.0f;
+        uint64_t _last_sample_ns = 0;
+
+        // capture thread
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _pixelformat = 0;
+        uint32_t _bytesperline = 0;
+        std::vector<uint8_t> _previous;
+        bool _have_previous = false;
+        uint64_t _last_frame_ns = 0;
+
+        // transitions and the time accounting behind stats()
+        mutable std::mutex _lock;
+        uint64_t _state_since_ns = 0;
+        uint64_t _idle_ns = 0;
+        uint64_t _active_ns = 0;
+        uint64_t _wakes = 0;
+        uint64_t _imu_wakes = 0;
+        uint64_t _wake_motion_ns = 0;           // motion behind a wake still waiting for full rate
+        uint32_t _wake_frames = 0;
+        uint64_t _last_wake_ns = 0;
+        uint64_t _max_wake_ns = 0;
+        uint32_t _last_wake_frames = 0;
+
+        // mean squares, for stats()
+        std::atomic<float> _gyro_power {0.0f};
+        std::atomic<float> _accel_power {0.0f};
+        std::atomic<float> _frame_difference {0.0f};
+    };
+
+};
@@ -0,0 +1,95 @@
+#include <cstring>
+#include <algorithm>
+#include "frame_queue.h"
+
+namespace sevun {
+
+    void frame_queue::open(uint32_t slots, size_t bytes) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _slots.resize(std::max(slots, 1u));
+        for (auto& slot : _slots) {
+            slot.data.assign(bytes, 0);
+            slot.length = 0;
+            slot.state = slot_state::free;
+        }
+        _sequence = 0;
+        _running = true;
+    }
+
+    void frame_queue::stop() {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _running = false;
+        }
+        _queued.notify_one();
+    }
+
+    frame_queue::slot_t* frame_queue::oldest_queued() {
+        slot_t* slot = nullptr;
+        for (auto& s : _slots) {
+            if (s.state == slot_state::queued && (slot == nullptr || s.sequence < slot->sequence))
+                slot = &s;
+        }
+        return slot;
+    }
+
+    bool frame_queue::push(const uint8_t* data, size_t length, uint64_t timestamp_ns) {
+        slot_t* slot = nullptr;
+        bool dropped = false;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            for (auto& s : _slots) {
+                if (s.state == slot_state::free) {
+                    slot = &s;
+                    break;
+                }
+            }
+            if (slot == nullptr) {
+                slot = oldest_queued();
+                dropped = true;
+            }
+            if (slot == nullptr)
+                return false;
+            slot->state = slot_state::filling;
+        }
+
+        length = std::min(length, slot->data.size());
+        memcpy(slot->data.data(), data, length);
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            slot->length = length;
+            slot->timestamp_ns = timestamp_ns;
+            slot->sequence = _sequence++;
+            slot->state = slot_state::queued;
+        }
+        _queued.notify_one();
+        return !dropped;
+    }
+
+    bool frame_queue::take(frame_t& frame) {
+        std::unique_lock<std::mutex> lock(_lock);
+        slot_t* slot = nullptr;
+        _queued.wait(lock, [this, &slot] {
+            slot = oldest_queued();
+            return !_running || slot != nullptr;
+        });
+        if (!_running)
+            return false;
+
+        slot->state = slot_state::taken;
+        frame = frame_t {
+            slot->data.data(),
+            slot->length,
+            slot->timestamp_ns,
+            static_cast<uint32_t>(slot - _slots.data())
+        };
+        return true;
+    }
+
+    void frame_queue::release(const frame_t& frame) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _slots[frame.slot].state = slot_state::free;
+    }
+
+};
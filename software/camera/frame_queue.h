@@ -0,0 +1,74 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+namespace sevun {
+
+    // frames handed from the capture thread to one worker thread through a
+    // fixed set of preallocated slots.  push() copies a frame into a free
+    // slot and returns; the worker takes the oldest frame queued.  when
+    // every slot is busy the oldest frame still waiting is replaced, so
+    // under load whole frames are dropped and what does get worked on is
+    // recent.
+    class frame_queue {
+    public:
+        // valid until release()
+        struct frame_t {
+            const uint8_t* data;
+            size_t length;
+            uint64_t timestamp_ns;
+            uint32_t slot;
+        };
+
+        frame_queue() = default;
+
+        frame_queue(const frame_queue&) = delete;
+
+        frame_queue& operator=(const frame_queue&) = delete;
+
+        // slots of bytes each, all allocated here
+        void open(uint32_t slots, size_t bytes);
+
+        // take() returns false from now on
+        void stop();
+
+        // capture thread only.  false when a frame was dropped: a queued
+        // one to make room, or this one for want of any slot.
+        bool push(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        // worker thread.  blocks for the oldest queued frame.
+        bool take(frame_t& frame);
+
+        // worker thread, once done with the frame from take()
+        void release(const frame_t& frame);
+
+    private:
+        enum class slot_state : uint8_t {
+            free,
+            filling,
+            queued,
+            taken
+        };
+
+        struct slot_t {
+            std::vector<uint8_t> data;
+            size_t length;
+            uint64_t timestamp_ns;
+            uint64_t sequence;
+            slot_state state;
+        };
+
+        slot_t* oldest_queued();
+
+    private:
+        std::mutex _lock;
+        std::condition_variable _queued;
+        std::vector<slot_t> _slots;
+        uint64_t _sequence = 0;
+        bool _running = false;
+    };
+
+};
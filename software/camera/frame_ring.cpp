@@ -0,0 +1,369 @@
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <fmt/format.h>
+#include "frame_ring.h"
+#include "unix_socket.h"
+
+namespace sevun {
+
+    static size_t round_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static bool fill_address(
+            struct sockaddr_un& addr,
+            const std::string& path) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            return false;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    frame_publisher::~frame_publisher() {
+        close();
+    }
+
+    bool frame_publisher::open(
+            sevun::result& result,
+            const std::string& socket_path,
+            uint32_t slot_count,
+            uint32_t slot_size) {
+        close();
+
+        auto stride = round_up(frame_slot_t::data_offset + slot_size, 4096);
+        _map_size = frame_ring_header_t::size + stride * slot_count;
+
+        _memfd = memfd_create("visor-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (_memfd < 0) {
+            result.add_message(codes::frame_ring_create_failed, socket_path, os_error {errno});
+            return false;
+        }
+
+        if (ftruncate(_memfd, static_cast<off_t>(_map_size)) < 0
+        ||  fcntl(_memfd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+            result.add_message(codes::frame_ring_create_failed, socket_path, os_error {errno});
+            close();
+            return false;
+        }
+
+        auto addr = mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _memfd, 0);
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::frame_ring_create_failed, socket_path, os_error {errno});
+            close();
+            return false;
+        }
+
+        _header = static_cast<frame_ring_header_t*>(addr);
+        _slots = static_cast<uint8_t*>(addr) + frame_ring_header_t::size;
+        _header->magic = frame_ring_header_t::magic_value;
+        _header->version = frame_ring_header_t::version_value;
+        _header->slot_count = slot_count;
+        _header->slot_size = slot_size;
+        _header->slot_stride = stride;
+        _header->published.store(0, std::memory_order_release);
+        _header->retired.store(0, std::memory_order_release);
+        _next = 0;
+        _width = 0;
+        _height = 0;
+        _pixelformat = 0;
+        _bytesperline = 0;
+
+        struct sockaddr_un sa {};
+        if (!fill_address(sa, socket_path)) {
+            result.add_message(codes::frame_ring_create_failed, socket_path, os_error {ENAMETOOLONG});
+            close();
+            return false;
+        }
+
+        auto error = claim_socket_path(socket_path);
+        if (error != 0) {
+            result.add_message(codes::frame_ring_create_failed, socket_path, os_error {error});
+            close();
+            return false;
+        }
+
+        _listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_listen_fd < 0
+        ||  bind(_listen_fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)) < 0
+        ||  listen(_listen_fd, 8) < 0) {
+            result.add_message(codes::frame_ring_create_failed, socket_path, os_error {errno});
+            close();
+            return false;
+        }
+
+        _socket_path = socket_path;
+        _server = std::thread(&frame_publisher::serve, this);
+
+        return true;
+    }
+
+    void frame_publisher::set_format(
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline) {
+        _width = width;
+        _height = height;
+        _pixelformat = pixelformat;
+        _bytesperline = bytesperline;
+
+        // only ever set before the first frame; subscribers go by the
+        // slots once frames are flowing
+        if (_header == nullptr || _next > 0)
+            return;
+        _header->width = width;
+        _header->height = height;
+        _header->pixelformat = pixelformat;
+        _header->bytesperline = bytesperline;
+    }
+
+    void frame_publisher::close() {
+        if (_listen_fd >= 0) {
+            shutdown(_listen_fd, SHUT_RDWR);
+            if (_server.joinable())
+                _server.join();
+            ::close(_listen_fd);
+            unlink(_socket_path.c_str());
+            _listen_fd = -1;
+        }
+
+        if (_header != nullptr) {
+            _header->retired.store(1, std::memory_order_release);
+            munmap(_header, _map_size);
+            _header = nullptr;
+            _slots = nullptr;
+        }
+
+        if (_memfd >= 0) {
+            ::close(_memfd);
+            _memfd = -1;
+        }
+    }
+
+    bool frame_publisher::publish(
+            const uint8_t* data,
+            size_t length,
+            uint64_t timestamp_ns) {
+        if (_header == nullptr || length > _header->slot_size)
+            return false;
+
+        auto n = _next++;
+        auto slot = reinterpret_cast<frame_slot_t*>(
+            _slots + (n % _header->slot_count) * _header->slot_stride);
+
+        slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->index = n;
+        slot->timestamp_ns = timestamp_ns;
+        slot->length = static_cast<uint32_t>(length);
+        slot->width = _width;
+        slot->height = _height;
+        slot->pixelformat = _pixelformat;
+        slot->bytesperline = _bytesperline;
+        memcpy(reinterpret_cast<uint8_t*>(slot) + frame_slot_t::data_offset, data, length);
+
+        slot->seq.store(2 * n + 2, std::memory_order_release);
+        _header->published.store(n + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    void frame_publisher::serve() {
+        // subscribers get a descriptor opened O_RDONLY, so they can't map
+        // the ring writable even by accident.
+        auto proc_path = fmt::format("/proc/self/fd/{}", _memfd);
+        auto ro_fd = ::open(proc_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (ro_fd < 0)
+            return;
+
+        for (;;) {
+            auto client = accept4(_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            char payload = 'F';
+            struct iovec iov {&payload, 1};
+            char control[CMSG_SPACE(sizeof(int))] {};
+            struct msghdr msg {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            auto cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &ro_fd, sizeof(int));
+
+            sendmsg(client, &msg, MSG_NOSIGNAL);
+            ::close(client);
+        }
+
+        ::close(ro_fd);
+    }
+
+    frame_subscriber::~frame_subscriber() {
+        close();
+    }
+
+    bool frame_subscriber::open(
+            sevun::result& result,
+            const std::string& socket_path) {
+        close();
+
+        struct sockaddr_un sa {};
+        if (!fill_address(sa, socket_path)) {
+            result.add_message(codes::frame_ring_connect_failed, socket_path, os_error {ENAMETOOLONG});
+            return false;
+        }
+
+        auto sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock < 0
+        ||  connect(sock, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)) < 0) {
+            result.add_message(codes::frame_ring_connect_failed, socket_path, os_error {errno});
+            if (sock >= 0)
+                ::close(sock);
+            return false;
+        }
+
+        char payload;
+        struct iovec iov {&payload, 1};
+        char control[CMSG_SPACE(sizeof(int))] {};
+        struct msghdr msg {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        auto received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        ::close(sock);
+
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        if (received <= 0 || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) {
+            result.add_message(codes::frame_ring_connect_failed, socket_path, os_error {errno});
+            return false;
+        }
+
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+        struct stat sb {};
+        if (fstat(fd, &sb) < 0 || static_cast<size_t>(sb.st_size) < frame_ring_header_t::size) {
+            result.add_message(codes::frame_ring_bad_segment, socket_path);
+            ::close(fd);
+            return false;
+        }
+
+        _map_size = static_cast<size_t>(sb.st_size);
+        auto addr = mmap(nullptr, _map_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::frame_ring_connect_failed, socket_path, os_error {errno});
+            return false;
+        }
+
+        _header = static_cast<const frame_ring_header_t*>(addr);
+        _slots = static_cast<const uint8_t*>(addr) + frame_ring_header_t::size;
+        if (_header->magic != frame_ring_header_t::magic_value
+        ||  _header->version != frame_ring_header_t::version_value) {
+            result.add_message(codes::frame_ring_bad_segment, socket_path);
+            close();
+            return false;
+        }
+
+        _cursor = _header->published.load(std::memory_order_acquire);
+        _lost = 0;
+
+        return true;
+    }
+
+    void frame_subscriber::close() {
+        if (_header != nullptr) {
+            munmap(const_cast<frame_ring_header_t*>(_header), _map_size);
+            _header = nullptr;
+            _slots = nullptr;
+        }
+    }
+
+    const frame_slot_t* frame_subscriber::slot(uint64_t index) const {
+        return reinterpret_cast<const frame_slot_t*>(
+            _slots + (index % _header->slot_count) * _header->slot_stride);
+    }
+
+    frame_subscriber::status frame_subscriber::read(
+            uint64_t index,
+            frame_view_t& view) const {
+        auto s = slot(index);
+        if (s->seq.load(std::memory_order_acquire) != 2 * index + 2)
+            return status::torn;
+
+        view.data = reinterpret_cast<const uint8_t*>(s) + frame_slot_t::data_offset;
+        view.length = s->length;
+        view.index = s->index;
+        view.timestamp_ns = s->timestamp_ns;
+        view.width = s->width;
+        view.height = s->height;
+        view.pixelformat = s->pixelformat;
+        view.bytesperline = s->bytesperline;
+
+        return still_valid(view) ? status::ok : status::torn;
+    }
+
+    frame_subscriber::status frame_subscriber::latest(frame_view_t& view) {
+        if (_header->retired.load(std::memory_order_acquire))
+            return status::retired;
+
+        auto published = _header->published.load(std::memory_order_acquire);
+        if (published == 0)
+            return status::empty;
+
+        auto result = read(published - 1, view);
+        if (result == status::ok)
+            _cursor = published;
+        return result;
+    }
+
+    frame_subscriber::status frame_subscriber::next(frame_view_t& view) {
+        // whatever was published before the ring was retired can still
+        // be read
+        auto retired = _header->retired.load(std::memory_order_acquire);
+        auto published = _header->published.load(std::memory_order_acquire);
+        if (_cursor >= published)
+            return retired ? status::retired : status::empty;
+
+        // the slot for frame `published` may already be mid-write, which
+        // leaves slot_count - 1 frames that are safe to read.
+        auto oldest = published > _header->slot_count - 1
+                    ? published - (_header->slot_count - 1)
+                    : 0;
+        if (_cursor < oldest) {
+            _lost += oldest - _cursor;
+            _cursor = oldest;
+            return status::lagged;
+        }
+
+        auto result = read(_cursor, view);
+        if (result == status::ok)
+            _cursor++;
+        return result;
+    }
+
+    bool frame_subscriber::still_valid(const frame_view_t& view) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot(view.index)->seq.load(std::memory_order_relaxed) == 2 * view.index + 2;
+    }
+
+};
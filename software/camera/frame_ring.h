@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include "result.h"
+
+namespace sevun {
+
+    struct frame_ring_header_t {
+        static constexpr uint32_t magic_value = 0x53564631;   // 'SVF1'
+        static constexpr uint32_t version_value = 2;
+        static constexpr size_t size = 4096;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slot_count;
+        uint32_t slot_size;
+        uint64_t slot_stride;
+        uint32_t width;             // format at open, for display; every frame carries its own
+        uint32_t height;
+        uint32_t pixelformat;
+        uint32_t bytesperline;
+        std::atomic<uint64_t> published;
+        std::atomic<uint32_t> retired;  // set once the publisher has moved to another ring
+    };
+
+    // each slot carries its own sequence: 2n+1 while frame n is being
+    // written, 2n+2 once it is complete.  a reader holding frame n can
+    // always tell whether the publisher has since reused the slot, and
+    // the same sequence covers the frame's format.
+    struct alignas(64) frame_slot_t {
+        static constexpr size_t data_offset = 64;
+
+        std::atomic<uint64_t> seq;
+        uint64_t index;
+        uint64_t timestamp_ns;
+        uint32_t length;
+        uint32_t width;
+        uint32_t height;
+        uint32_t pixelformat;
+        uint32_t bytesperline;
+    };
+
+    struct frame_view_t {
+        const uint8_t* data;
+        uint32_t length;
+        uint64_t index;
+        uint64_t timestamp_ns;
+        uint32_t width;
+        uint32_t height;
+        uint32_t pixelformat;
+        uint32_t bytesperline;
+    };
+
+    // writes frames into a sealed memfd ring and hands a read-only
+    // descriptor for it to anyone who connects to the unix socket.  the
+    // capture thread only ever memcpys into the next slot; it never waits
+    // on subscribers, so a slow one simply gets overrun.  a ring too small
+    // for a new format is replaced by opening again; the old one is marked
+    // retired so its subscribers know to reconnect.
+    class frame_publisher {
+    public:
+        frame_publisher() = default;
+
+        virtual ~frame_publisher();
+
+        bool open(
+            sevun::result& result,
+            const std::string& socket_path,
+            uint32_t slot_count,
+            uint32_t slot_size);
+
+        // applies to the frames published from now on
+        void set_format(
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline);
+
+        // retires the ring; subscribers keep their mapping of it
+        void close();
+
+        inline bool enabled() const {
+            return _header != nullptr;
+        }
+
+        inline uint32_t slot_size() const {
+            return _header != nullptr ? _header->slot_size : 0;
+        }
+
+        // returns false if the frame is larger than a slot.
+        bool publish(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+    private:
+        void serve();
+
+    private:
+        int _memfd = -1;
+        int _listen_fd = -1;
+        std::string _socket_path;
+        size_t _map_size = 0;
+        frame_ring_header_t* _header = nullptr;
+        uint8_t* _slots = nullptr;
+        uint64_t _next = 0;
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _pixelformat = 0;
+        uint32_t _bytesperline = 0;
+        std::thread _server;
+    };
+
+    class frame_subscriber {
+    public:
+        enum class status {
+            ok,
+            empty,
+            lagged,
+            torn,
+            retired                         // nothing more will come; open again
+        };
+
+        frame_subscriber() = default;
+
+        virtual ~frame_subscriber();
+
+        bool open(sevun::result& result, const std::string& socket_path);
+
+        void close();
+
+        inline const frame_ring_header_t& header() const {
+            return *_header;
+        }
+
+        // newest complete frame; frames in between are skipped silently.
+        status latest(frame_view_t& view);
+
+        // next frame after the last one returned.  if the publisher lapped
+        // us, lagged is returned without a frame, the cursor jumps to the
+        // oldest frame still in the ring and lost() grows by the number of
+        // frames skipped; call again to resume reading.
+        status next(frame_view_t& view);
+
+        // the view points straight into shared memory; call this after using
+        // the data to confirm the publisher didn't overwrite it meanwhile.
+        bool still_valid(const frame_view_t& view) const;
+
+        inline uint64_t lost() const {
+            return _lost;
+        }
+
+    private:
+        const frame_slot_t* slot(uint64_t index) const;
+
+        status read(uint64_t index, frame_view_t& view) const;
+
+    private:
+        size_t _map_size = 0;
+        const frame_ring_header_t* _header = nullptr;
+        const uint8_t* _slots = nullptr;
+        uint64_t _cursor = 0;
+        uint64_t _lost = 0;
+    };
+
+};
@@ -25,4 +25,11 @@ namespace sevun {
         return stream.str();
     }
 
+    std::string hex_formatter::fourcc_string(uint32_t pixelformat) {
+        std::string s(4, ' ');
+        for (int i = 0; i < 4; i++)
+            s[i] = static_cast<char>((pixelformat >> (8 * i)) & 0xff);
+        return s;
+    }
+
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 
 namespace sevun {
 
@@ -9,6 +10,9 @@ namespace sevun {
         static std::string dump_to_string(
             const void* data,
             size_t size);
+
+        // a V4L2 pixelformat as its four characters, e.g. "YUYV"
+        static std::string fourcc_string(uint32_t pixelformat);
     };
 
 };
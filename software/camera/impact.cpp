@@ -0,0 +1,143 @@
+#include <cmath>
+#include <algorithm>
+#include "impact.h"
+#include "trace.h"
+
+namespace sevun {
+
+    static inline int64_t magnitude2(const int16_t* v) {
+        return static_cast<int64_t>(v[0]) * v[0]
+             + static_cast<int64_t>(v[1]) * v[1]
+             + static_cast<int64_t>(v[2]) * v[2];
+    }
+
+    static inline bool saturated(const int16_t* v, int32_t full_scale) {
+        return v[0] >= full_scale || v[0] < -full_scale
+            || v[1] >= full_scale || v[1] < -full_scale
+            || v[2] >= full_scale || v[2] < -full_scale;
+    }
+
+    // a threshold at or past full scale only fires when more than one axis
+    // is loaded, so it is capped a little below
+    static int64_t threshold2(float threshold, float per_count, int32_t full_scale) {
+        auto counts = std::min(static_cast<double>(threshold) / per_count, 0.9 * full_scale);
+        return static_cast<int64_t>(counts * counts);
+    }
+
+    impact_detector::impact_detector(
+            const impact_config_t& config,
+            const imu_scale_t& scale) : _config(config),
+                                        _scale(scale) {
+        // compare squared resultants in raw counts so the per-sample path
+        // has no square roots or float conversions
+        _accel_threshold2 = threshold2(config.accel_threshold_g, scale.accel_g, imu_accel_full_scale);
+        _gyro_threshold2 = threshold2(config.gyro_threshold_dps, scale.gyro_dps, imu_gyro_full_scale);
+    }
+
+    impact_detector::status impact_detector::push(const imu_sample_t& sample) {
+        auto index = _head++;
+        _ring[index & (capacity - 1)] = sample;
+
+        auto accel2 = magnitude2(sample.accel);
+        auto gyro2 = magnitude2(sample.gyro);
+
+        switch (_state) {
+            case states::holdoff:
+                // the window start keeps trailing, so re-arming doesn't
+                // have to catch up a whole holdoff's worth in one push
+                trail(sample.timestamp_ns);
+                if (sample.timestamp_ns < _holdoff_until)
+                    return status::idle;
+                _state = states::armed;
+
+                // fall through
+
+            case states::armed: {
+                trail(sample.timestamp_ns);
+
+                auto accel_hit = accel2 >= _accel_threshold2;
+                auto gyro_hit = gyro2 >= _gyro_threshold2;
+                if (!accel_hit && !gyro_hit)
+                    return status::idle;
+
+                SEVUN_TRACE_INSTANT(impact, _sequence);
+
+                _state = states::recording;
+                _trigger_index = index;
+                _peak_accel2 = accel2;
+                _peak_gyro2 = gyro2;
+
+                _event = impact_event_t {};
+                _event.sequence = _sequence;
+                _event.trigger_ns = sample.timestamp_ns;
+                _event.detected_ns = trace::now_ns();
+                _event.accel_triggered = accel_hit;
+                _event.gyro_triggered = gyro_hit;
+                _event.peak_accel_ns = sample.timestamp_ns;
+                _event.peak_gyro_ns = sample.timestamp_ns;
+                _event.accel_saturated = saturated(sample.accel, imu_accel_full_scale);
+                _event.gyro_saturated = saturated(sample.gyro, imu_gyro_full_scale);
+                return status::triggered;
+            }
+
+            case states::recording:
+                _event.accel_saturated = _event.accel_saturated || saturated(sample.accel, imu_accel_full_scale);
+                _event.gyro_saturated = _event.gyro_saturated || saturated(sample.gyro, imu_gyro_full_scale);
+                if (accel2 > _peak_accel2) {
+                    _peak_accel2 = accel2;
+                    _event.peak_accel_ns = sample.timestamp_ns;
+                }
+                if (gyro2 > _peak_gyro2) {
+                    _peak_gyro2 = gyro2;
+                    _event.peak_gyro_ns = sample.timestamp_ns;
+                }
+
+                // the ring can't hold more; close the window early rather
+                // than overwrite its start
+                if (sample.timestamp_ns - _event.trigger_ns < _config.post_trigger_ns
+                &&  index + 1 - _first_index < capacity)
+                    return status::recording;
+
+                _event.pre_count = static_cast<uint32_t>(_trigger_index - _first_index);
+                _event.post_count = static_cast<uint32_t>(index + 1 - _trigger_index);
+                _event.peak_accel_g = std::sqrt(static_cast<float>(_peak_accel2)) * _scale.accel_g;
+                _event.peak_gyro_dps = std::sqrt(static_cast<float>(_peak_gyro2)) * _scale.gyro_dps;
+
+                _window_index = _first_index;
+                _sequence++;
+                _state = states::holdoff;
+                _holdoff_until = sample.timestamp_ns + _config.holdoff_ns;
+                return status::complete;
+        }
+
+        return status::idle;
+    }
+
+    // keeps the start of the pre-trigger window trailing the newest sample;
+    // amortized O(1), and never further back than the ring can hold
+    void impact_detector::trail(uint64_t timestamp_ns) {
+        auto oldest = _head > capacity ? _head - capacity : 0;
+        if (_first_index < oldest)
+            _first_index = oldest;
+        while (timestamp_ns - _ring[_first_index & (capacity - 1)].timestamp_ns > _config.pre_trigger_ns)
+            _first_index++;
+    }
+
+    impact_window_t impact_detector::window() const {
+        impact_window_t w {};
+        auto count = static_cast<size_t>(_event.pre_count) + _event.post_count;
+        auto start = static_cast<size_t>(_window_index & (capacity - 1));
+
+        w.first = _ring + start;
+        if (start + count <= capacity) {
+            w.first_count = count;
+        } else {
+            w.first_count = capacity - start;
+            w.second = _ring;
+            w.second_count = count - w.first_count;
+        }
+
+        return w;
+    }
+
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "imu.h"
+
+namespace sevun {
+
+    // thresholds have to sit below the sensors' full scale: at the default
+    // ±8 g range a single-axis hit clips just under 8 g and would never
+    // reach 10 g.  the detector lowers anything above 90% of full scale.
+    struct impact_config_t {
+        float accel_threshold_g = 6.0f;         // resultant linear acceleration
+        float gyro_threshold_dps = 800.0f;      // resultant angular velocity
+        uint64_t pre_trigger_ns = 2000000000ULL;
+        uint64_t post_trigger_ns = 1000000000ULL;
+        uint64_t holdoff_ns = 500000000ULL;     // after a window completes, before re-arming
+    };
+
+    struct impact_event_t {
+        uint64_t sequence;
+        uint64_t trigger_ns;
+        uint64_t detected_ns;           // wall time the triggering sample was pushed
+        bool accel_triggered;
+        bool gyro_triggered;
+        float peak_accel_g;             // over trigger..end of window
+        float peak_gyro_dps;
+        uint64_t peak_accel_ns;
+        uint64_t peak_gyro_ns;
+        uint32_t pre_count;             // samples before the trigger
+        uint32_t post_count;            // trigger sample onwards
+        bool accel_saturated;           // an axis hit full scale after the trigger, so
+        bool gyro_saturated;            // the peaks are lower bounds
+    };
+
+    // the window may wrap the ring, so it comes back as up to two runs.
+    struct impact_window_t {
+        const imu_sample_t* first;
+        size_t first_count;
+        const imu_sample_t* second;
+        size_t second_count;
+    };
+
+    // keeps the last few seconds of samples in a fixed ring and checks each
+    // new one against the thresholds, so detection costs O(1) per sample and
+    // never allocates.  on a trigger the detector keeps recording until the
+    // post-trigger time has passed, then reports the whole window.
+    class impact_detector {
+    public:
+        // 5 s at the 800 Hz gyro rate
+        static constexpr size_t capacity = 4096;
+
+        enum class status {
+            idle,
+            triggered,      // this sample crossed a threshold
+            recording,
+            complete        // window() and event() describe a finished event
+        };
+
+        impact_detector(const impact_config_t& config, const imu_scale_t& scale);
+
+        status push(const imu_sample_t& sample);
+
+        inline const impact_event_t& event() const {
+            return _event;
+        }
+
+        // valid after complete until capacity - (pre + post) more samples
+        // have been pushed.
+        impact_window_t window() const;
+
+        inline uint64_t events() const {
+            return _sequence;
+        }
+
+    private:
+        enum class states {
+            armed,
+            recording,
+            holdoff
+        };
+
+        void trail(uint64_t timestamp_ns);
+
+    private:
+        impact_config_t _config;
+        imu_scale_t _scale;
+        int64_t _accel_threshold2;      // squared, in counts
+        int64_t _gyro_threshold2;
+
+        imu_sample_t _ring[capacity];
+        uint64_t _head = 0;             // samples pushed so far
+
+        states _state = states::armed;
+        uint64_t _trigger_index = 0;
+        uint64_t _first_index = 0;      // start of the pre-trigger window, trailing the newest sample
+        uint64_t _window_index = 0;     // start of the last completed window
+        uint64_t _holdoff_until = 0;
+        int64_t _peak_accel2 = 0;
+        int64_t _peak_gyro2 = 0;
+        uint64_t _sequence = 0;
+        impact_event_t _event {};
+    };
+
+};
@@ -0,0 +1,435 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include "imu.h"
+#include "trace.h"
+
+namespace sevun {
+
+    // FXAS21002C output data rates in mHz, indexed by FXAS_DR_*
+    static const uint32_t gyro_rate_mhz[8] {
+        800000, 400000, 200000, 100000, 50000, 25000, 12500, 12500
+    };
+
+    // mdps per count, indexed by FXAS_FS_*
+    static const float gyro_mdps[4] {62.5f, 31.25f, 15.625f, 7.8125f};
+
+    // mg per 14-bit count, indexed by FXOS_FS_*
+    static const float accel_mg[4] {0.244f, 0.488f, 0.976f, 0.976f};
+
+    // leave a few samples of headroom in the gyro FIFO for a late wakeup
+    static constexpr uint32_t gyro_fifo_budget = FXAS_FIFO_DEPTH - 8;
+
+    imu_service::~imu_service() {
+        close();
+    }
+
+    bool imu_service::open(
+            sevun::result& result,
+            const imu_options_t& options) {
+        close();
+        _options = options;
+
+        if (_options.simulate) {
+            I2CSimInit(&_sim, &_bus, _options.bus_hz);
+            if (_options.virtual_clock)
+                I2CSimUseVirtualClock(&_sim, &_bus, I2CMonotonicNs());
+            FXOSSimInit(&_fxos_sim, _options.accel_address, nullptr, nullptr);
+            FXASSimInit(&_fxas_sim, _options.gyro_address, nullptr, nullptr);
+            I2CSimAddDevice(&_sim, &_fxos_sim.sDevice);
+            I2CSimAddDevice(&_sim, &_fxas_sim.sDevice);
+        } else if (I2CBusOpenLinux(&_bus, _options.adapter, _options.bus_hz) != 0) {
+            result.add_message(codes::imu_bus_failed, _options.adapter, os_error {errno});
+            return false;
+        }
+        _bus_open = true;
+
+        if (!configure_sampler(result)) {
+            close();
+            return false;
+        }
+
+        _scale.accel_g = accel_mg[_options.accel_range & 3] / 1000.0f;
+        _scale.mag_ut = 0.1f;
+        _scale.gyro_dps = gyro_mdps[_options.gyro_range & 3] / 1000.0f;
+
+        if (_options.irq_line >= 0) {
+            auto err = _options.simulate
+                     ? IrqOpenSim(&_irq, &_bus, &_fxos_sim.sDevice, 1)
+                     : IrqOpenGpio(&_irq, _options.irq_chip.c_str(), static_cast<uint32_t>(_options.irq_line), 1);
+            if (err == 0)
+                _irq_open = true;
+            else
+                result.add_message(codes::imu_irq_failed, _options.irq_line, os_error {-err});
+        }
+
+        return true;
+    }
+
+    bool imu_service::configure_sampler(sevun::result& result) {
+        // the gyro FIFO has to hold a whole cycle's worth of its samples, so
+        // a fast gyro shortens the cycle rather than overrunning
+        _gyro_period_ns = 1000000000000ULL / gyro_rate_mhz[_options.gyro_rate & 7];
+        auto watermark = _options.watermark;
+        if (watermark == 0 || watermark > FXOS_FIFO_DEPTH)
+            watermark = FXOS_FIFO_DEPTH / 2;
+
+        if (AGSamplerInit(
+                &_sampler,
+                &_bus,
+                _options.accel_address,
+                _options.accel_rate,
+                _options.accel_range,
+                watermark) != 0) {
+            result.add_message(codes::imu_sensor_missing, "FXOS8700CQ", static_cast<uint32_t>(_options.accel_address));
+            return false;
+        }
+
+        auto max_watermark = gyro_fifo_budget * _sampler.ui64PeriodNs / _gyro_period_ns;
+        if (max_watermark == 0)
+            max_watermark = 1;
+        if (watermark > max_watermark) {
+            watermark = static_cast<uint8_t>(max_watermark);
+            if (AGSamplerInit(
+                    &_sampler,
+                    &_bus,
+                    _options.accel_address,
+                    _options.accel_rate,
+                    _options.accel_range,
+                    watermark) != 0) {
+                result.add_message(codes::imu_configure_failed, "FXOS8700CQ");
+                return false;
+            }
+        }
+
+        auto expected = (watermark * _sampler.ui64PeriodNs + _gyro_period_ns - 1) / _gyro_period_ns;
+        _gyro_burst = static_cast<uint32_t>(expected + 2 > FXAS_FIFO_DEPTH ? FXAS_FIFO_DEPTH : expected + 2);
+        _period_ns.store(std::min(_sampler.ui64PeriodNs, _gyro_period_ns), std::memory_order_relaxed);
+        _accel_held = false;
+
+        return configure_gyro(result);
+    }
+
+    bool imu_service::configure_gyro(sevun::result& result) {
+        uint8_t who_am_i = 0;
+        auto address = _options.gyro_address;
+
+        if (I2CBusReadReg(&_bus, address, FXAS_WHO_AM_I, &who_am_i) != 0
+        ||  who_am_i != FXAS_WHO_AM_I_VALUE) {
+            result.add_message(codes::imu_sensor_missing, "FXAS21002C", static_cast<uint32_t>(address));
+            return false;
+        }
+
+        // standby, range, circular FIFO, and bursts that wrap from OUT_Z_LSB
+        // to OUT_X_MSB so one read pops as many samples as it is long
+        int err = 0;
+        err |= I2CBusWriteReg(&_bus, address, FXAS_CTRL_REG1, 0);
+        err |= I2CBusWriteReg(&_bus, address, FXAS_CTRL_REG0, _options.gyro_range & FXAS_FS_MASK);
+        err |= I2CBusWriteReg(&_bus, address, FXAS_F_SETUP, FXAS_F_MODE_CIRCULAR);
+        err |= I2CBusWriteReg(&_bus, address, FXAS_CTRL_REG3, FXAS_WRAPTOONE);
+        err |= I2CBusWriteReg(
+            &_bus,
+            address,
+            FXAS_CTRL_REG1,
+            static_cast<uint8_t>(((_options.gyro_rate & 7) << FXAS_DR_SHIFT) | FXAS_ACTIVE));
+
+        if (err != 0) {
+            result.add_message(codes::imu_configure_failed, "FXAS21002C");
+            return false;
+        }
+
+        return true;
+    }
+
+    void imu_service::start() {
+        if (!_bus_open || _running.load())
+            return;
+        _running.store(true);
+        _thread = std::thread(&imu_service::run, this);
+    }
+
+    void imu_service::stop() {
+        _running.store(false);
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    void imu_service::close() {
+        stop();
+
+        if (_irq_open) {
+            IrqClose(&_irq);
+            _irq_open = false;
+        }
+
+        if (_bus_open) {
+            if (!_options.simulate)
+                I2CBusCloseLinux(&_bus);
+            _bus_open = false;
+        }
+    }
+
+    imu_stats_t imu_service::stats() const {
+        imu_stats_t s {};
+        s.samples = _samples.load(std::memory_order_relaxed);
+        s.cycles = _cycles.load(std::memory_order_relaxed);
+        s.queue_full = _queue_full.load(std::memory_order_relaxed);
+        s.accel_overflows = _accel_overflows.load(std::memory_order_relaxed);
+        s.gyro_overflows = _gyro_overflows.load(std::memory_order_relaxed);
+        s.gyro_stale = _gyro_stale.load(std::memory_order_relaxed);
+        s.irq_timeouts = _irq_timeouts.load(std::memory_order_relaxed);
+        s.bus_errors = _bus_errors.load(std::memory_order_relaxed);
+        s.bus_utilization = _bus_ppm.load(std::memory_order_relaxed) / 1e6;
+        s.sample_rate = _rate_mhz.load(std::memory_order_relaxed) / 1e3;
+        return s;
+    }
+
+    void imu_service::set_rates(uint8_t accel_rate, uint8_t gyro_rate) {
+        // bit 15 marks a pending request so rate 0 still registers
+        _rate_request.store(
+            static_cast<uint16_t>(0x8000u | ((accel_rate & 7u) << 4) | (gyro_rate & 7u)),
+            std::memory_order_release);
+    }
+
+    void imu_service::apply_rates(uint16_t request) {
+        SEVUN_TRACE_SCOPE(imu);
+
+        _options.accel_rate = static_cast<uint8_t>((request >> 4) & 7u);
+        _options.gyro_rate = static_cast<uint8_t>(request & 7u);
+
+        // reprogramming puts both parts through standby; gyro samples still
+        // waiting to be merged belong to the old period
+        sevun::result ignored;
+        if (!configure_sampler(ignored))
+            _bus_errors.fetch_add(1, std::memory_order_relaxed);
+        _gyro_count = 0;
+        _gyro_backlog = 0;
+    }
+
+    void imu_service::run() {
+        auto cycle_ns = _sampler.ui64PeriodNs * _sampler.ui8Watermark;
+
+        while (_running.load(std::memory_order_relaxed)) {
+            if (_irq_open) {
+                // the timeout bounds the damage of a missed edge to one late
+                // cycle and lets stop() get through when the sensor is idle
+                uint64_t irq_ns;
+                if (IrqWait(&_irq, 2 * cycle_ns, &irq_ns) < 0) {
+                    IrqClose(&_irq);
+                    _irq_open = false;
+                }
+                _irq_timeouts.store(_irq.ui64Timeouts, std::memory_order_relaxed);
+            } else {
+                I2CBusSleepUntil(&_bus, _bus.pfnNow(&_bus) + AGSamplerWaitNs(&_sampler));
+            }
+
+            if (!cycle())
+                _bus_errors.fetch_add(1, std::memory_order_relaxed);
+
+            // straight after a drain, so a rate change loses nothing
+            auto request = _rate_request.exchange(0, std::memory_order_acq_rel);
+            if (request != 0) {
+                apply_rates(request);
+                cycle_ns = _sampler.ui64PeriodNs * _sampler.ui8Watermark;
+            }
+        }
+    }
+
+    bool imu_service::cycle() {
+        SEVUN_TRACE_SCOPE(imu);
+
+        auto accel_overflows = _sampler.ui64Overflows;
+        auto count = AGSamplerDrain(&_sampler, _accel, FXOS_FIFO_DEPTH);
+        if (count < 0)
+            return false;
+
+        auto gyro_status = drain_gyro();
+        if (gyro_status < 0)
+            return false;
+
+        uint16_t flags = 0;
+        if (_sampler.ui64Overflows != accel_overflows) {
+            flags |= imu_accel_overflow;
+            _accel_overflows.fetch_add(_sampler.ui64Overflows - accel_overflows, std::memory_order_relaxed);
+        }
+        if (gyro_status & FXAS_F_OVF) {
+            flags |= imu_gyro_overflow;
+            _gyro_overflows.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        merge(static_cast<uint32_t>(count), flags);
+
+        _cycles.fetch_add(1, std::memory_order_relaxed);
+        _bus_ppm.store(static_cast<uint32_t>(AGSamplerBusUtilization(&_sampler) * 1e6), std::memory_order_relaxed);
+        _rate_mhz.store(
+            static_cast<uint32_t>(AGSamplerRate(&_sampler) * 1e3 * _sampler.ui64PeriodNs / period_ns()),
+            std::memory_order_relaxed);
+
+        return true;
+    }
+
+    int imu_service::drain_gyro() {
+        // F_STATUS (mirrored at STATUS with the FIFO on) and the cycle's
+        // expected samples in one transaction; what's left over is read
+        // next cycle
+        uint8_t burst[1 + 6 * FXAS_FIFO_DEPTH];
+        if (I2CBusRead(&_bus, _options.gyro_address, FXAS_STATUS, burst, 1 + 6 * _gyro_burst) != 0)
+            return -1;
+        auto now = _bus.pfnNow(&_bus);
+
+        auto count = static_cast<uint32_t>(burst[0] & FXAS_F_CNT_MASK);
+        _gyro_backlog = 0;
+        if (count > _gyro_burst) {
+            _gyro_backlog = count - _gyro_burst;
+            count = _gyro_burst;
+        }
+
+        // keep room for this batch; anything that old has been merged or
+        // is too stale to match an accelerometer sample anyway
+        auto capacity = static_cast<uint32_t>(sizeof(_gyro) / sizeof(_gyro[0]));
+        if (_gyro_count + count > capacity) {
+            auto drop = _gyro_count + count - capacity;
+            memmove(_gyro, _gyro + drop, (_gyro_count - drop) * sizeof(_gyro[0]));
+            _gyro_count -= drop;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t* p = burst + 1 + 6 * i;
+            auto& g = _gyro[_gyro_count++];
+            g.timestamp_ns = now - (_gyro_backlog + count - 1 - i) * _gyro_period_ns;
+            for (int axis = 0; axis < 3; axis++)
+                g.rate[axis] = static_cast<int16_t>((p[2 * axis] << 8) | p[2 * axis + 1]);
+        }
+
+        return burst[0];
+    }
+
+    void imu_service::merge(uint32_t count, uint16_t flags) {
+        // a gyro that has gone quiet mustn't take the accelerometer with it
+        if (_gyro_period_ns < _sampler.ui64PeriodNs && _gyro_count > 0) {
+            merge_at_gyro_rate(count, flags);
+            return;
+        }
+
+        // each accelerometer sample gets the mean of the gyro samples taken
+        // during its period
+        auto period = _sampler.ui64PeriodNs;
+        uint32_t next = 0;
+
+        for (uint32_t i = 0; i < count; i++) {
+            const auto& a = _accel[i];
+            int32_t sum[3] {0, 0, 0};
+            int32_t n = 0;
+
+            while (next < _gyro_count && _gyro[next].timestamp_ns <= a.ui64TimeNs) {
+                if (_gyro[next].timestamp_ns + period > a.ui64TimeNs) {
+                    for (int axis = 0; axis < 3; axis++)
+                        sum[axis] += _gyro[next].rate[axis];
+                    n++;
+                }
+                next++;
+            }
+
+            imu_sample_t s {};
+            s.timestamp_ns = a.ui64TimeNs;
+            s.flags = i == 0 ? flags : 0;
+            if (n > 0) {
+                for (int axis = 0; axis < 3; axis++)
+                    _gyro_hold[axis] = static_cast<int16_t>(sum[axis] / n);
+            } else {
+                s.flags |= imu_gyro_stale;
+                _gyro_stale.fetch_add(1, std::memory_order_relaxed);
+            }
+            for (int axis = 0; axis < 3; axis++) {
+                s.accel[axis] = a.pi16Accel[axis];
+                s.mag[axis] = a.pi16Mag[axis];
+                s.gyro[axis] = _gyro_hold[axis];
+            }
+            push_sample(s);
+        }
+        if (count > 0) {
+            _accel_hold = _accel[count - 1];
+            _accel_held = true;
+        }
+
+        // gyro samples newer than the last accelerometer sample wait for
+        // the next cycle
+        if (next > 0) {
+            memmove(_gyro, _gyro + next, (_gyro_count - next) * sizeof(_gyro[0]));
+            _gyro_count -= next;
+        }
+
+        _samples.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // one sample per gyro sample, so the filters downstream integrate every
+    // one of them.  acceleration and field are interpolated between the
+    // accelerometer samples either side; a gyro sample later than the
+    // newest of those waits for the next cycle.
+    void imu_service::merge_at_gyro_rate(uint32_t count, uint16_t flags) {
+        if (count == 0)
+            return;
+
+        auto last_ns = _accel[count - 1].ui64TimeNs;
+        uint32_t next = 0;
+        uint32_t a = 0;
+        uint32_t pushed = 0;
+
+        while (next < _gyro_count && _gyro[next].timestamp_ns <= last_ns) {
+            const auto& g = _gyro[next++];
+            while (_accel[a].ui64TimeNs < g.timestamp_ns) {
+                _accel_hold = _accel[a++];
+                _accel_held = true;
+            }
+
+            const auto& after = _accel[a];
+            imu_sample_t s {};
+            s.timestamp_ns = g.timestamp_ns;
+            s.flags = pushed == 0 ? flags : 0;
+            if (!_accel_held || g.timestamp_ns <= _accel_hold.ui64TimeNs) {
+                const auto& nearest = _accel_held ? _accel_hold : after;
+                for (int axis = 0; axis < 3; axis++) {
+                    s.accel[axis] = nearest.pi16Accel[axis];
+                    s.mag[axis] = nearest.pi16Mag[axis];
+                }
+            } else {
+                auto span = static_cast<int64_t>(after.ui64TimeNs - _accel_hold.ui64TimeNs);
+                auto into = static_cast<int64_t>(g.timestamp_ns - _accel_hold.ui64TimeNs);
+                for (int axis = 0; axis < 3; axis++) {
+                    int64_t a0 = _accel_hold.pi16Accel[axis];
+                    int64_t m0 = _accel_hold.pi16Mag[axis];
+                    s.accel[axis] = static_cast<int16_t>(a0 + (after.pi16Accel[axis] - a0) * into / span);
+                    s.mag[axis] = static_cast<int16_t>(m0 + (after.pi16Mag[axis] - m0) * into / span);
+                }
+            }
+            for (int axis = 0; axis < 3; axis++) {
+                s.gyro[axis] = g.rate[axis];
+                _gyro_hold[axis] = g.rate[axis];
+            }
+
+            push_sample(s);
+            pushed++;
+        }
+
+        _accel_hold = _accel[count - 1];
+        _accel_held = true;
+
+        if (next > 0) {
+            memmove(_gyro, _gyro + next, (_gyro_count - next) * sizeof(_gyro[0]));
+            _gyro_count -= next;
+        }
+
+        _samples.fetch_add(pushed, std::memory_order_relaxed);
+    }
+
+    void imu_service::push_sample(const imu_sample_t& s) {
+        while (!_queue.push(s)) {
+            if (!_options.virtual_clock || !_running.load(std::memory_order_relaxed)) {
+                _queue_full.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include "result.h"
+#include "spsc_queue.h"
+#include "../common/i2c_sim.h"
+#include "../common/irq_source.h"
+#include "../common/fxos8700cq_sim.h"
+#include "../common/fxas21002c_sim.h"
+#include "../accelmag/fifo_sampler.h"
+
+namespace sevun {
+
+    enum imu_flags : uint16_t {
+        imu_accel_overflow = 1u << 0,   // FXOS8700CQ FIFO overran before this batch
+        imu_gyro_overflow = 1u << 1,    // FXAS21002C FIFO overran before this batch
+        imu_gyro_stale = 1u << 2        // no gyro sample in this period; previous value held
+    };
+
+    // one 9-axis sample at the faster sensor's rate: per gyro sample, with
+    // acceleration and field interpolated, when the gyro outruns the 400 Hz
+    // hybrid accelerometer.  values are raw counts; imu_scale_t turns them
+    // into units.
+    struct imu_sample_t {
+        uint64_t timestamp_ns;
+        int16_t accel[3];
+        int16_t mag[3];
+        int16_t gyro[3];
+        uint16_t flags;
+    };
+
+    // largest count either sensor reports on an axis: the accelerometer
+    // is 14-bit, the gyro 16-bit.  an axis at or past it was clipped.
+    static constexpr int16_t imu_accel_full_scale = 8191;
+    static constexpr int16_t imu_gyro_full_scale = 32767;
+
+    struct imu_scale_t {
+        float accel_g;      // g per count
+        float mag_ut;       // microtesla per count
+        float gyro_dps;     // degrees/s per count
+    };
+
+    struct imu_options_t {
+        uint32_t adapter = 0;                   // /dev/i2c-N shared by both sensors
+        uint32_t bus_hz = 400000;
+        bool simulate = false;                  // register-level models instead of hardware
+        bool virtual_clock = false;             // with simulate: run on bus time, as fast as the host allows
+        uint8_t accel_address = 0x1d;
+        uint8_t gyro_address = 0x20;
+        uint8_t accel_rate = FXOS_DR_800HZ;     // hybrid mode, so 400 Hz per sensor
+        uint8_t accel_range = FXOS_FS_8G;
+        uint8_t gyro_rate = FXAS_DR_800HZ;
+        uint8_t gyro_range = FXAS_FS_2000DPS;
+        uint8_t watermark = 8;                  // accel samples per bus cycle, lowered if the gyro FIFO can't hold a cycle
+        std::string irq_chip = "/dev/gpiochip0";
+        int irq_line = 36;                      // FXOS8700CQ INT1; -1 wakes on a timer instead
+    };
+
+    struct imu_stats_t {
+        uint64_t samples;
+        uint64_t cycles;
+        uint64_t queue_full;
+        uint64_t accel_overflows;
+        uint64_t gyro_overflows;
+        uint64_t gyro_stale;
+        uint64_t irq_timeouts;
+        uint64_t bus_errors;
+        double bus_utilization;
+        double sample_rate;
+    };
+
+    // owns the i2c bus and both sensors.  one thread wakes on the
+    // accelerometer's FIFO watermark and, per cycle, drains the FXOS8700CQ
+    // FIFO and the FXAS21002C FIFO with one burst each, then merges them
+    // into 9-axis samples on a lock-free queue for a single consumer.
+    // hybrid mode halves the FXOS8700CQ's 800 Hz ODR, so with the default
+    // rates the stream follows the gyro at 800 Hz.
+    //
+    // on a virtual clock the sensors are simulated and time only moves
+    // with bus traffic and waits, so nothing is ever late; a full queue
+    // holds the IMU thread back instead of dropping samples.
+    class imu_service {
+    public:
+        static constexpr size_t queue_capacity = 4096;
+
+        using queue_t = spsc_queue<imu_sample_t, queue_capacity>;
+
+        imu_service() = default;
+
+        virtual ~imu_service();
+
+        bool open(sevun::result& result, const imu_options_t& options);
+
+        void start();
+
+        void stop();
+
+        void close();
+
+        inline queue_t& samples() {
+            return _queue;
+        }
+
+        inline const imu_scale_t& scale() const {
+            return _scale;
+        }
+
+        // output sample period: the gyro's when it is the faster part,
+        // otherwise the accelerometer's
+        inline uint64_t period_ns() const {
+            return _period_ns.load(std::memory_order_relaxed);
+        }
+
+        imu_stats_t stats() const;
+
+        // the clock sample timestamps are on.  with a virtual clock only
+        // read it before start(); after that it belongs to the IMU thread.
+        inline uint64_t clock_ns() {
+            return _bus.pfnNow(&_bus);
+        }
+
+        // any thread.  the IMU thread reprograms both sensors between
+        // cycles; samples after the change come at the new period.
+        void set_rates(uint8_t accel_rate, uint8_t gyro_rate);
+
+        // the simulated parts, for feeding motion into them; null on hardware
+        inline tFXOSSim* accel_sim() {
+            return _options.simulate ? &_fxos_sim : nullptr;
+        }
+
+        inline tFXASSim* gyro_sim() {
+            return _options.simulate ? &_fxas_sim : nullptr;
+        }
+
+    private:
+        struct gyro_sample_t {
+            uint64_t timestamp_ns;
+            int16_t rate[3];
+        };
+
+        bool configure_sampler(sevun::result& result);
+
+        bool configure_gyro(sevun::result& result);
+
+        void apply_rates(uint16_t request);
+
+        void run();
+
+        bool cycle();
+
+        int drain_gyro();
+
+        void merge(uint32_t count, uint16_t flags);
+
+        void merge_at_gyro_rate(uint32_t count, uint16_t flags);
+
+        void push_sample(const imu_sample_t& s);
+
+    private:
+        imu_options_t _options {};
+        imu_scale_t _scale {};
+        tI2CBus _bus {};
+        tI2CSim _sim {};
+        tFXOSSim _fxos_sim {};
+        tFXASSim _fxas_sim {};
+        tIrqSource _irq {};
+        bool _bus_open = false;
+        bool _irq_open = false;
+
+        tAGSampler _sampler {};
+        tAGSample _accel[FXOS_FIFO_DEPTH] {};
+
+        uint64_t _gyro_period_ns = 0;
+        uint32_t _gyro_burst = 0;
+        uint32_t _gyro_backlog = 0;
+        gyro_sample_t _gyro[2 * FXAS_FIFO_DEPTH] {};
+        uint32_t _gyro_count = 0;
+        int16_t _gyro_hold[3] {};
+        tAGSample _accel_hold {};           // last accelerometer sample merged at the gyro rate
+        bool _accel_held = false;
+        std::atomic<uint64_t> _period_ns {0};
+
+        queue_t _queue;
+        std::thread _thread;
+        std::atomic<bool> _running {false};
+        std::atomic<uint16_t> _rate_request {0};
+
+        // written by the service thread, read by stats()
+        std::atomic<uint64_t> _samples {0};
+        std::atomic<uint64_t> _cycles {0};
+        std::atomic<uint64_t> _queue_full {0};
+        std::atomic<uint64_t> _accel_overflows {0};
+        std::atomic<uint64_t> _gyro_overflows {0};
+        std::atomic<uint64_t> _gyro_stale {0};
+        std::atomic<uint64_t> _irq_timeouts {0};
+        std::atomic<uint64_t> _bus_errors {0};
+        std::atomic<uint32_t> _bus_ppm {0};
+        std::atomic<uint32_t> _rate_mhz {0};
+    };
+
+};
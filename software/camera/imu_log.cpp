@@ -0,0 +1,479 @@
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "imu_log.h"
+
+namespace sevun {
+
+    // a gap longer than this starts a new block, which keeps every time
+    // residual inside 32 bits and the index honest about dropouts
+    static constexpr uint64_t max_gap_ns = 1000000000ULL;
+
+    static uint32_t fnv1a(const void* data, size_t length) {
+        auto p = static_cast<const uint8_t*>(data);
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            h ^= p[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static uint64_t clock_ns(clockid_t clock) {
+        timespec ts {};
+        clock_gettime(clock, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    static inline uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    static inline int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    static inline const int16_t* axes(const imu_sample_t& sample, int group) {
+        return group == 0 ? sample.accel : group == 1 ? sample.mag : sample.gyro;
+    }
+
+    static inline int16_t* axes(imu_sample_t& sample, int group) {
+        return group == 0 ? sample.accel : group == 1 ? sample.mag : sample.gyro;
+    }
+
+    static inline uint8_t* put(uint8_t* p, uint32_t value, size_t width) {
+        // records are little-endian whatever the host; width is 1, 2 or 4
+        for (size_t i = 0; i < width; i++)
+            p[i] = static_cast<uint8_t>(value >> (8 * i));
+        return p + width;
+    }
+
+    static inline const uint8_t* get(const uint8_t* p, uint32_t& value, size_t width) {
+        value = 0;
+        for (size_t i = 0; i < width; i++)
+            value |= static_cast<uint32_t>(p[i]) << (8 * i);
+        return p + width;
+    }
+
+    imu_log_writer::~imu_log_writer() {
+        if (_fd >= 0) {
+            sevun::result ignored;
+            close(ignored);
+        }
+    }
+
+    bool imu_log_writer::open(
+            sevun::result& result,
+            const std::string& path,
+            const imu_scale_t& scale,
+            uint32_t period_ns) {
+        _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            result.add_message(codes::imu_log_open_failed, path, os_error {errno});
+            return false;
+        }
+
+        _path = path;
+        _offset = 0;
+        _samples = 0;
+        _count = 0;
+        _index.clear();
+        _buffer.clear();
+        _buffer.reserve(buffer_size + sizeof(imu_log_block_t) + block_capacity * 32);
+
+        imu_log_header_t header {};
+        header.magic = imu_log_header_t::magic_value;
+        header.version = imu_log_header_t::version_value;
+        header.block_capacity = block_capacity;
+        header.scale = scale;
+        header.period_ns = period_ns;
+        header.created_ns = clock_ns(CLOCK_REALTIME);
+        header.created_mono_ns = clock_ns(CLOCK_MONOTONIC);
+
+        auto p = reinterpret_cast<const uint8_t*>(&header);
+        _buffer.insert(_buffer.end(), p, p + sizeof(header));
+        return true;
+    }
+
+    bool imu_log_writer::append(
+            sevun::result& result,
+            const imu_sample_t& sample) {
+        if (_count > 0) {
+            const auto& prev = _block[_count - 1];
+            if (sample.timestamp_ns < prev.timestamp_ns
+            ||  sample.timestamp_ns - prev.timestamp_ns > max_gap_ns)
+                seal();
+        }
+
+        _block[_count++] = sample;
+        _samples++;
+        if (_count < block_capacity)
+            return true;
+
+        seal();
+        if (_buffer.size() < buffer_size)
+            return true;
+        return write_buffer(result);
+    }
+
+    bool imu_log_writer::append(
+            sevun::result& result,
+            const imu_sample_t* samples,
+            size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (!append(result, samples[i]))
+                return false;
+        }
+        return true;
+    }
+
+    void imu_log_writer::seal() {
+        if (_count == 0)
+            return;
+
+        imu_log_block_t block {};
+        block.magic = imu_log_block_t::magic_value;
+        block.first_ns = _block[0].timestamp_ns;
+        block.last_ns = _block[_count - 1].timestamp_ns;
+        block.sequence = static_cast<uint32_t>(_index.size());
+        block.count = static_cast<uint16_t>(_count);
+        block.first_flags = _block[0].flags;
+        block.period_ns = _count > 1
+            ? static_cast<uint32_t>((block.last_ns - block.first_ns + (_count - 1) / 2) / (_count - 1))
+            : 0;
+        for (int g = 0; g < 3; g++)
+            memcpy(&block.first[3 * g], axes(_block[0], g), 3 * sizeof(int16_t));
+
+        // pick the widths in one pass over the block
+        uint32_t max_residual = 0;
+        int low[3] {};
+        int high[3] {};
+        bool flags_change = false;
+        for (uint32_t i = 1; i < _count; i++) {
+            const auto& cur = _block[i];
+            const auto& prev = _block[i - 1];
+            auto residual = static_cast<int32_t>(cur.timestamp_ns - prev.timestamp_ns - block.period_ns);
+            max_residual = std::max(max_residual, zigzag(residual));
+            for (int g = 0; g < 3; g++) {
+                for (int k = 0; k < 3; k++) {
+                    int d = static_cast<int16_t>(axes(cur, g)[k] - axes(prev, g)[k]);
+                    low[g] = std::min(low[g], d);
+                    high[g] = std::max(high[g], d);
+                }
+            }
+            flags_change |= cur.flags != block.first_flags;
+        }
+
+        block.time_width = max_residual <= 0xff ? 1 : max_residual <= 0xffff ? 2 : 4;
+        for (int g = 0; g < 3; g++) {
+            block.axis_width[g] = low[g] == 0 && high[g] == 0 ? 0
+                                : low[g] >= -128 && high[g] <= 127 ? 1
+                                : 2;
+        }
+        block.flags_width = flags_change ? 2 : 0;
+        block.payload = static_cast<uint32_t>(block.record_size() * (_count - 1));
+
+        auto start = _buffer.size();
+        _buffer.resize(start + block.stride(), 0);
+        auto records = _buffer.data() + start + sizeof(block);
+        auto p = records;
+
+        for (uint32_t i = 1; i < _count; i++) {
+            const auto& cur = _block[i];
+            const auto& prev = _block[i - 1];
+            auto residual = static_cast<int32_t>(cur.timestamp_ns - prev.timestamp_ns - block.period_ns);
+            p = put(p, zigzag(residual), block.time_width);
+            for (int g = 0; g < 3; g++) {
+                if (block.axis_width[g] == 0)
+                    continue;
+                for (int k = 0; k < 3; k++) {
+                    auto d = static_cast<uint16_t>(axes(cur, g)[k] - axes(prev, g)[k]);
+                    p = put(p, d, block.axis_width[g]);
+                }
+            }
+            if (block.flags_width != 0)
+                p = put(p, cur.flags, block.flags_width);
+        }
+
+        block.checksum = fnv1a(records, block.payload);
+        memcpy(_buffer.data() + start, &block, sizeof(block));
+
+        imu_log_index_entry_t entry {};
+        entry.first_ns = block.first_ns;
+        entry.last_ns = block.last_ns;
+        entry.offset = _offset + start;
+        entry.count = _count;
+        _index.push_back(entry);
+
+        _count = 0;
+    }
+
+    bool imu_log_writer::write_buffer(sevun::result& result) {
+        size_t done = 0;
+        while (done < _buffer.size()) {
+            auto n = write(_fd, _buffer.data() + done, _buffer.size() - done);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                result.add_message(codes::imu_log_write_failed, _path, os_error {errno});
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+
+        _offset += _buffer.size();
+        _buffer.clear();
+        return true;
+    }
+
+    bool imu_log_writer::flush(sevun::result& result) {
+        if (_fd < 0)
+            return false;
+        seal();
+        return write_buffer(result);
+    }
+
+    bool imu_log_writer::close(sevun::result& result) {
+        if (_fd < 0)
+            return false;
+
+        seal();
+
+        imu_log_footer_t footer {};
+        footer.magic = imu_log_footer_t::magic_value;
+        footer.block_count = static_cast<uint32_t>(_index.size());
+        footer.index_offset = _offset + _buffer.size();
+        footer.sample_count = _samples;
+        footer.checksum = fnv1a(_index.data(), _index.size() * sizeof(imu_log_index_entry_t));
+
+        auto p = reinterpret_cast<const uint8_t*>(_index.data());
+        _buffer.insert(_buffer.end(), p, p + _index.size() * sizeof(imu_log_index_entry_t));
+        p = reinterpret_cast<const uint8_t*>(&footer);
+        _buffer.insert(_buffer.end(), p, p + sizeof(footer));
+
+        auto ok = write_buffer(result);
+        if (::close(_fd) != 0 && ok) {
+            result.add_message(codes::imu_log_write_failed, _path, os_error {errno});
+            ok = false;
+        }
+        _fd = -1;
+        return ok;
+    }
+
+    imu_log_reader::~imu_log_reader() {
+        close();
+    }
+
+    bool imu_log_reader::open(
+            sevun::result& result,
+            const std::string& path) {
+        close();
+
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            result.add_message(codes::imu_log_open_failed, path, os_error {errno});
+            return false;
+        }
+
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            result.add_message(codes::imu_log_open_failed, path, os_error {errno});
+            ::close(fd);
+            return false;
+        }
+
+        _path = path;
+        _size = static_cast<size_t>(st.st_size);
+        if (_size < sizeof(imu_log_header_t)) {
+            result.add_message(codes::imu_log_bad_file, path);
+            ::close(fd);
+            return false;
+        }
+
+        auto addr = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::imu_log_open_failed, path, os_error {errno});
+            return false;
+        }
+
+        _map = static_cast<const uint8_t*>(addr);
+        _header = reinterpret_cast<const imu_log_header_t*>(_map);
+        if (_header->magic != imu_log_header_t::magic_value
+        ||  _header->version != imu_log_header_t::version_value) {
+            result.add_message(codes::imu_log_bad_file, path);
+            close();
+            return false;
+        }
+
+        // a closed log ends in a footer pointing back at its index
+        if (_size >= sizeof(imu_log_header_t) + sizeof(imu_log_footer_t)
+        &&  _size % alignof(imu_log_footer_t) == 0) {
+            auto footer = reinterpret_cast<const imu_log_footer_t*>(_map + _size - sizeof(imu_log_footer_t));
+            auto index_bytes = static_cast<uint64_t>(footer->block_count) * sizeof(imu_log_index_entry_t);
+            if (footer->magic == imu_log_footer_t::magic_value
+            &&  footer->index_offset >= sizeof(imu_log_header_t)
+            &&  footer->index_offset % alignof(imu_log_index_entry_t) == 0
+            &&  footer->index_offset + index_bytes + sizeof(imu_log_footer_t) == _size
+            &&  fnv1a(_map + footer->index_offset, index_bytes) == footer->checksum) {
+                _index = reinterpret_cast<const imu_log_index_entry_t*>(_map + footer->index_offset);
+                _block_count = footer->block_count;
+                _sample_count = footer->sample_count;
+                return true;
+            }
+        }
+
+        // no footer: walk the block headers.  only the headers are touched,
+        // and a torn final block simply ends the walk.
+        size_t offset = sizeof(imu_log_header_t);
+        for (;;) {
+            auto block = valid_block(offset);
+            if (block == nullptr)
+                break;
+
+            imu_log_index_entry_t entry {};
+            entry.first_ns = block->first_ns;
+            entry.last_ns = block->last_ns;
+            entry.offset = offset;
+            entry.count = block->count;
+            _recovered.push_back(entry);
+            _sample_count += block->count;
+            offset += block->stride();
+        }
+
+        _index = _recovered.data();
+        _block_count = _recovered.size();
+        result.add_message(codes::imu_log_recovered, path, _block_count);
+        return true;
+    }
+
+    void imu_log_reader::close() {
+        if (_map != nullptr)
+            munmap(const_cast<uint8_t*>(_map), _size);
+        _map = nullptr;
+        _size = 0;
+        _header = nullptr;
+        _index = nullptr;
+        _block_count = 0;
+        _sample_count = 0;
+        _recovered.clear();
+    }
+
+    const imu_log_block_t* imu_log_reader::valid_block(uint64_t offset) const {
+        if (offset < sizeof(imu_log_header_t)
+        ||  offset % alignof(imu_log_block_t) != 0
+        ||  offset + sizeof(imu_log_block_t) > _size)
+            return nullptr;
+
+        auto block = reinterpret_cast<const imu_log_block_t*>(_map + offset);
+        if (block->magic != imu_log_block_t::magic_value
+        ||  block->count == 0
+        ||  block->count > _header->block_capacity
+        ||  block->payload != block->record_size() * (block->count - 1u)
+        ||  offset + block->stride() > _size)
+            return nullptr;
+        return block;
+    }
+
+    bool imu_log_reader::decode(
+            const imu_log_block_t* block,
+            imu_sample_t* out) const {
+        auto records = reinterpret_cast<const uint8_t*>(block + 1);
+        if (fnv1a(records, block->payload) != block->checksum)
+            return false;
+
+        imu_sample_t cur {};
+        cur.timestamp_ns = block->first_ns;
+        cur.flags = block->first_flags;
+        for (int g = 0; g < 3; g++)
+            memcpy(axes(cur, g), &block->first[3 * g], 3 * sizeof(int16_t));
+        out[0] = cur;
+
+        auto p = records;
+        for (uint32_t i = 1; i < block->count; i++) {
+            uint32_t value;
+            p = get(p, value, block->time_width);
+            cur.timestamp_ns += block->period_ns + static_cast<int64_t>(unzigzag(value));
+            for (int g = 0; g < 3; g++) {
+                auto width = block->axis_width[g];
+                if (width == 0)
+                    continue;
+                auto a = axes(cur, g);
+                for (int k = 0; k < 3; k++) {
+                    p = get(p, value, width);
+                    // sign-extend the 1-byte deltas; 2-byte ones wrap anyway
+                    auto d = width == 1 ? static_cast<int8_t>(value) : static_cast<int16_t>(value);
+                    a[k] = static_cast<int16_t>(a[k] + d);
+                }
+            }
+            if (block->flags_width != 0) {
+                p = get(p, value, block->flags_width);
+                cur.flags = static_cast<uint16_t>(value);
+            }
+            out[i] = cur;
+        }
+
+        return true;
+    }
+
+    size_t imu_log_reader::read(
+            sevun::result& result,
+            uint64_t from_ns,
+            uint64_t to_ns,
+            std::vector<imu_sample_t>& out) const {
+        if (_map == nullptr || from_ns > to_ns)
+            return 0;
+
+        // first block that ends at or after from_ns
+        auto begin = std::lower_bound(
+            _index,
+            _index + _block_count,
+            from_ns,
+            [](const imu_log_index_entry_t& entry, uint64_t t) {
+                return entry.last_ns < t;
+            });
+
+        // decode straight into the tail of out, then trim the ends of the
+        // first and last block to the range
+        size_t appended = 0;
+        for (auto entry = begin; entry != _index + _block_count && entry->first_ns <= to_ns; entry++) {
+            auto block = valid_block(entry->offset);
+            auto start = out.size();
+            if (block != nullptr) {
+                out.resize(start + block->count);
+                if (!decode(block, &out[start])) {
+                    out.resize(start);
+                    block = nullptr;
+                }
+            }
+            if (block == nullptr) {
+                result.add_message(codes::imu_log_bad_block, _path, static_cast<uint64_t>(entry - _index));
+                continue;
+            }
+
+            auto first = out.begin() + static_cast<ptrdiff_t>(start);
+            auto last = out.end();
+            if (entry->first_ns < from_ns)
+                first = std::lower_bound(first, last, from_ns, [](const imu_sample_t& s, uint64_t t) {
+                    return s.timestamp_ns < t;
+                });
+            if (entry->last_ns > to_ns)
+                last = std::upper_bound(first, last, to_ns, [](uint64_t t, const imu_sample_t& s) {
+                    return t < s.timestamp_ns;
+                });
+
+            auto kept = static_cast<size_t>(last - first);
+            std::move(first, last, out.begin() + static_cast<ptrdiff_t>(start));
+            out.resize(start + kept);
+            appended += kept;
+        }
+
+        return appended;
+    }
+
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "result.h"
+#include "imu.h"
+
+namespace sevun {
+
+    // file layout:
+    //
+    //   imu_log_header_t
+    //   block 0: imu_log_block_t, count - 1 fixed-size delta records,
+    //            zero padding to a multiple of 8 bytes
+    //   block 1: ...
+    //   imu_log_index_entry_t[block_count]     written on close
+    //   imu_log_footer_t                       written on close
+    //
+    // a log that was never closed has no index; the reader rebuilds it by
+    // hopping from block header to block header.  the padding keeps every
+    // block header and the index 8-byte aligned in the reader's mapping.
+
+    struct imu_log_header_t {
+        static constexpr uint32_t magic_value = 0x53564c31;   // 'SVL1'
+        static constexpr uint32_t version_value = 2;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t block_capacity;
+        uint32_t reserved;
+        imu_scale_t scale;
+        uint32_t period_ns;
+        uint64_t created_ns;        // CLOCK_REALTIME when the log was opened
+        uint64_t created_mono_ns;   // CLOCK_MONOTONIC at the same moment, for the sample timestamps
+    };
+
+    // the first sample sits in the header verbatim.  every following sample
+    // is a record of its differences from the one before: the timestamp as
+    // the zigzagged deviation from the block's mean period, then accel, mag
+    // and gyro as 16-bit wrapping deltas.  each field group gets the
+    // narrowest width that holds every delta in the block, so all records
+    // in a block are the same size.
+    struct imu_log_block_t {
+        static constexpr uint32_t magic_value = 0x53564231;   // 'SVB1'
+
+        uint32_t magic;
+        uint32_t payload;           // record bytes following the header, before padding
+        uint64_t first_ns;
+        uint64_t last_ns;
+        uint32_t sequence;
+        uint32_t period_ns;
+        uint16_t count;
+        uint16_t first_flags;
+        int16_t first[9];           // accel, mag, gyro
+        uint8_t time_width;         // 1, 2 or 4 bytes
+        uint8_t axis_width[3];      // 0, 1 or 2 bytes per axis for accel, mag, gyro
+        uint8_t flags_width;        // 0 when every sample has the first sample's flags, else 2
+        uint8_t reserved[3];
+        uint32_t checksum;          // FNV-1a of the records
+
+        inline size_t record_size() const {
+            return time_width + 3u * (axis_width[0] + axis_width[1] + axis_width[2]) + flags_width;
+        }
+
+        // header, records and padding: the distance to the next block
+        inline size_t stride() const {
+            return sizeof(imu_log_block_t) + (payload + 7u) / 8u * 8u;
+        }
+    };
+
+    struct imu_log_index_entry_t {
+        uint64_t first_ns;
+        uint64_t last_ns;
+        uint64_t offset;
+        uint32_t count;
+        uint32_t reserved;
+    };
+
+    struct imu_log_footer_t {
+        static constexpr uint32_t magic_value = 0x53564931;   // 'SVI1'
+
+        uint32_t magic;
+        uint32_t block_count;
+        uint64_t index_offset;
+        uint64_t sample_count;
+        uint32_t checksum;          // FNV-1a of the index entries
+        uint32_t reserved;
+    };
+
+    // append-only writer.  samples collect in a raw block; a full block is
+    // encoded into a memory buffer that goes to disk in large writes, so
+    // the IMU loop makes one write() every few seconds.
+    class imu_log_writer {
+    public:
+        static constexpr uint32_t block_capacity = 256;
+        static constexpr size_t buffer_size = 64 * 1024;
+
+        imu_log_writer() = default;
+
+        ~imu_log_writer();
+
+        imu_log_writer(const imu_log_writer&) = delete;
+
+        imu_log_writer& operator=(const imu_log_writer&) = delete;
+
+        bool open(
+            sevun::result& result,
+            const std::string& path,
+            const imu_scale_t& scale,
+            uint32_t period_ns);
+
+        bool append(sevun::result& result, const imu_sample_t& sample);
+
+        bool append(sevun::result& result, const imu_sample_t* samples, size_t count);
+
+        // seals the current block and writes everything buffered.
+        bool flush(sevun::result& result);
+
+        // flushes, then writes the index and footer.
+        bool close(sevun::result& result);
+
+        inline bool is_open() const {
+            return _fd >= 0;
+        }
+
+        inline uint64_t samples() const {
+            return _samples;
+        }
+
+        inline uint64_t bytes() const {
+            return _offset + _buffer.size();
+        }
+
+        inline size_t blocks() const {
+            return _index.size();
+        }
+
+    private:
+        void seal();
+
+        bool write_buffer(sevun::result& result);
+
+    private:
+        int _fd = -1;
+        std::string _path;
+        uint64_t _offset = 0;           // file bytes written so far
+        uint64_t _samples = 0;
+
+        imu_sample_t _block[block_capacity];
+        uint32_t _count = 0;
+
+        std::vector<uint8_t> _buffer;
+        std::vector<imu_log_index_entry_t> _index;
+    };
+
+    // maps the whole log read-only and decodes only the blocks a time range
+    // touches, found by binary search on the index.
+    class imu_log_reader {
+    public:
+        imu_log_reader() = default;
+
+        ~imu_log_reader();
+
+        imu_log_reader(const imu_log_reader&) = delete;
+
+        imu_log_reader& operator=(const imu_log_reader&) = delete;
+
+        bool open(sevun::result& result, const std::string& path);
+
+        void close();
+
+        // appends samples with from_ns <= timestamp <= to_ns to out;
+        // corrupt blocks are reported and skipped.
+        size_t read(
+            sevun::result& result,
+            uint64_t from_ns,
+            uint64_t to_ns,
+            std::vector<imu_sample_t>& out) const;
+
+        inline const imu_log_header_t& header() const {
+            return *_header;
+        }
+
+        inline size_t blocks() const {
+            return _block_count;
+        }
+
+        inline uint64_t samples() const {
+            return _sample_count;
+        }
+
+        inline uint64_t first_ns() const {
+            return _block_count > 0 ? _index[0].first_ns : 0;
+        }
+
+        inline uint64_t last_ns() const {
+            return _block_count > 0 ? _index[_block_count - 1].last_ns : 0;
+        }
+
+        inline size_t file_size() const {
+            return _size;
+        }
+
+        // false when the index was rebuilt because the log wasn't closed
+        inline bool indexed() const {
+            return _recovered.empty();
+        }
+
+    private:
+        const imu_log_block_t* valid_block(uint64_t offset) const;
+
+        bool decode(const imu_log_block_t* block, imu_sample_t* out) const;
+
+    private:
+        std::string _path;
+        const uint8_t* _map = nullptr;
+        size_t _size = 0;
+        const imu_log_header_t* _header = nullptr;
+        const imu_log_index_entry_t* _index = nullptr;
+        size_t _block_count = 0;
+        uint64_t _sample_count = 0;
+        std::vector<imu_log_index_entry_t> _recovered;
+    };
+
+};
@@ -0,0 +1,189 @@
+#include <cmath>
+#include "injury.h"
+
+namespace sevun {
+
+    static constexpr uint64_t hic15_ns = 15000000ULL;
+    static constexpr uint64_t hic36_ns = 36000000ULL;
+
+    // critical angular velocities for BrIC, rad/s (Takhounts et al. 2013)
+    static const float bric_critical[3] {66.25f, 56.45f, 42.87f};
+
+    static inline float resultant_g(const imu_sample_t& s, float accel_g) {
+        auto x = static_cast<float>(s.accel[0]);
+        auto y = static_cast<float>(s.accel[1]);
+        auto z = static_cast<float>(s.accel[2]);
+        return std::sqrt(x * x + y * y + z * z) * accel_g;
+    }
+
+    static inline bool accel_saturated(const imu_sample_t& s) {
+        for (int axis = 0; axis < 3; axis++)
+            if (s.accel[axis] >= imu_accel_full_scale || s.accel[axis] < -imu_accel_full_scale)
+                return true;
+        return false;
+    }
+
+    static inline float hic_value(double integral, double seconds) {
+        auto mean = integral / seconds;
+        if (mean <= 0.0)
+            return 0.0f;
+        return static_cast<float>(seconds * mean * mean * std::sqrt(mean));
+    }
+
+    // |ω(k) - ω(k-2)| / (t(k) - t(k-2)), the rate change centred on k-1
+    static inline float central_alpha(
+            const imu_sample_t& before,
+            const imu_sample_t& after,
+            float rad_per_count) {
+        if (after.timestamp_ns <= before.timestamp_ns)
+            return 0.0f;
+        float d2 = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            auto d = static_cast<float>(after.gyro[axis] - before.gyro[axis]);
+            d2 += d * d;
+        }
+        return std::sqrt(d2) * rad_per_count / ((after.timestamp_ns - before.timestamp_ns) / 1e9f);
+    }
+
+    static inline void track_omega(
+            float* peak,
+            const imu_sample_t& s,
+            float rad_per_count) {
+        for (int axis = 0; axis < 3; axis++) {
+            auto omega = std::fabs(static_cast<float>(s.gyro[axis])) * rad_per_count;
+            if (omega > peak[axis])
+                peak[axis] = omega;
+        }
+    }
+
+    static float bric(const float* peak) {
+        float sum = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            auto r = peak[axis] / bric_critical[axis];
+            sum += r * r;
+        }
+        return std::sqrt(sum);
+    }
+
+    injury_metrics::injury_metrics(const imu_scale_t& scale) : _scale(scale),
+                                                              _rad_per_count(scale.gyro_dps * static_cast<float>(M_PI / 180.0)) {
+    }
+
+    void injury_metrics::push(const imu_sample_t& sample) {
+        auto a = resultant_g(sample, _scale.accel_g);
+
+        point_t p {sample.timestamp_ns, 0.0};
+        if (_count > 0) {
+            const auto& prev = _points[(_count - 1) % history];
+            p.integral = prev.integral + 0.5 * (a + _last_accel) * ((sample.timestamp_ns - prev.ns) / 1e9);
+        }
+        _points[_count % history] = p;
+        _count++;
+        _last_accel = a;
+
+        float alpha = 0.0f;
+        if (_count >= 3)
+            alpha = central_alpha(_omega[0], sample, _rad_per_count);
+        auto alpha_ns = _omega[1].timestamp_ns;
+        _omega[0] = _omega[1];
+        _omega[1] = sample;
+
+        if (!_active)
+            return;
+
+        _report.samples++;
+        _report.saturated = _report.saturated || accel_saturated(sample);
+        if (a > _report.peak_accel_g)
+            _report.peak_accel_g = a;
+        if (alpha > _report.peak_alpha) {
+            _report.peak_alpha = alpha;
+            _report.peak_alpha_ns = alpha_ns;
+        }
+        track_omega(_report.peak_omega, sample, _rad_per_count);
+
+        search(_report.hic15, hic15_ns);
+        search(_report.hic36, hic36_ns);
+    }
+
+    void injury_metrics::search(hic_t& best, uint64_t limit_ns) const {
+        const auto& newest = _points[(_count - 1) % history];
+        auto oldest = _count > history ? _count - history : 0;
+
+        for (auto j = _count - 1; j-- > oldest;) {
+            const auto& start = _points[j % history];
+            auto dt = newest.ns - start.ns;
+            if (dt > limit_ns)
+                break;
+            if (dt == 0)
+                continue;
+
+            auto value = hic_value(newest.integral - start.integral, dt / 1e9);
+            if (value > best.value) {
+                best.value = value;
+                best.t1_ns = start.ns;
+                best.t2_ns = newest.ns;
+            }
+        }
+    }
+
+    void injury_metrics::begin() {
+        _report = injury_report_t {};
+        _active = true;
+    }
+
+    injury_report_t injury_metrics::end() {
+        _active = false;
+        _report.bric = bric(_report.peak_omega);
+        return _report;
+    }
+
+    injury_report_t injury_metrics::brute_force(
+            const imu_sample_t* samples,
+            size_t count,
+            const imu_scale_t& scale) {
+        injury_report_t report {};
+        auto rad_per_count = scale.gyro_dps * static_cast<float>(M_PI / 180.0);
+        report.samples = static_cast<uint32_t>(count);
+
+        for (size_t i = 0; i < count; i++) {
+            auto a = resultant_g(samples[i], scale.accel_g);
+            if (a > report.peak_accel_g)
+                report.peak_accel_g = a;
+            report.saturated = report.saturated || accel_saturated(samples[i]);
+            track_omega(report.peak_omega, samples[i], rad_per_count);
+
+            if (i >= 1 && i + 1 < count) {
+                auto alpha = central_alpha(samples[i - 1], samples[i + 1], rad_per_count);
+                if (alpha > report.peak_alpha) {
+                    report.peak_alpha = alpha;
+                    report.peak_alpha_ns = samples[i].timestamp_ns;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            double integral = 0.0;
+            auto previous = resultant_g(samples[i], scale.accel_g);
+
+            for (size_t k = i + 1; k < count; k++) {
+                auto a = resultant_g(samples[k], scale.accel_g);
+                integral += 0.5 * (a + previous) * ((samples[k].timestamp_ns - samples[k - 1].timestamp_ns) / 1e9);
+                previous = a;
+
+                auto dt = samples[k].timestamp_ns - samples[i].timestamp_ns;
+                if (dt == 0)
+                    continue;
+
+                auto value = hic_value(integral, dt / 1e9);
+                if (dt <= hic15_ns && value > report.hic15.value)
+                    report.hic15 = hic_t {value, samples[i].timestamp_ns, samples[k].timestamp_ns};
+                if (dt <= hic36_ns && value > report.hic36.value)
+                    report.hic36 = hic_t {value, samples[i].timestamp_ns, samples[k].timestamp_ns};
+            }
+        }
+
+        report.bric = bric(report.peak_omega);
+        return report;
+    }
+
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "imu.h"
+
+namespace sevun {
+
+    struct hic_t {
+        float value;
+        uint64_t t1_ns;
+        uint64_t t2_ns;
+    };
+
+    struct injury_report_t {
+        hic_t hic15;
+        hic_t hic36;
+        float peak_accel_g;
+        float peak_alpha;           // resultant rotational acceleration, rad/s²
+        uint64_t peak_alpha_ns;
+        float peak_omega[3];        // per-axis max |ω|, rad/s
+        float bric;
+        uint32_t samples;
+        bool saturated;             // an accel axis hit full scale: peak_accel_g and HIC are lower bounds
+    };
+
+    // head injury criteria over an event, computed as samples arrive.
+    //
+    // HIC needs the max over all windows [t1, t2] no longer than 15/36 ms
+    // of (t2 - t1) * mean(a)^2.5.  the running integral of |a| is kept as a
+    // prefix sum, so any window's mean is one subtraction, and only the
+    // samples inside the last 36 ms can start a window ending at the newest
+    // one; each push is a bounded scan over those candidates instead of
+    // the O(n²) search over the whole capture.
+    //
+    // the accelerometer clips at its range, ±8 g by default, well below
+    // the tens of g of a real impact.  HIC is computed from what was
+    // measured, so on a saturated event it is only a lower bound; the
+    // report says when that happened.
+    //
+    // rotational acceleration is the central difference of the gyro rates;
+    // BrIC uses the per-axis peak angular velocities against the critical
+    // values from Takhounts et al. (2013).
+    class injury_metrics {
+    public:
+        // enough for 36 ms at 800 Hz with room to spare
+        static constexpr size_t history = 64;
+
+        explicit injury_metrics(const imu_scale_t& scale);
+
+        // every sample, whether or not an event is open; the history is
+        // what lets a window start before the trigger.
+        void push(const imu_sample_t& sample);
+
+        // resets the maxima; windows may still reach back into history.
+        void begin();
+
+        inline bool active() const {
+            return _active;
+        }
+
+        injury_report_t end();
+
+        // reference implementation: every (t1, t2) pair over the samples,
+        // with integrals summed directly.
+        static injury_report_t brute_force(
+            const imu_sample_t* samples,
+            size_t count,
+            const imu_scale_t& scale);
+
+    private:
+        struct point_t {
+            uint64_t ns;
+            double integral;        // ∫|a| dt in g·s up to this sample
+        };
+
+        void search(hic_t& best, uint64_t limit_ns) const;
+
+    private:
+        imu_scale_t _scale;
+        float _rad_per_count;
+
+        point_t _points[history];
+        uint64_t _count = 0;
+        float _last_accel = 0.0f;
+
+        imu_sample_t _omega[2] {};      // the two samples before the newest
+
+        bool _active = false;
+        injury_report_t _report {};
+    };
+
+};
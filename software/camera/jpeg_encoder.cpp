@@ -0,0 +1,558 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "jpeg_encoder.h"
+#include "trace.h"
+
+namespace sevun {
+
+    // zigzag position -> natural (row-major) index
+    static const uint8_t natural_order[64] {
+         0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+    };
+
+    // the example tables of ITU-T T.81 Annex K
+    static const uint8_t luma_quant[64] {
+        16, 11, 10, 16,  24,  40,  51,  61,
+        12, 12, 14, 19,  26,  58,  60,  55,
+        14, 13, 16, 24,  40,  57,  69,  56,
+        14, 17, 22, 29,  51,  87,  80,  62,
+        18, 22, 37, 56,  68, 109, 103,  77,
+        24, 35, 55, 64,  81, 104, 113,  92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103,  99
+    };
+
+    static const uint8_t chroma_quant[64] {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99
+    };
+
+    static const uint8_t dc_luma_bits[16] {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    static const uint8_t dc_chroma_bits[16] {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+    static const uint8_t dc_values[12] {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+    static const uint8_t ac_luma_bits[16] {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+    static const uint8_t ac_luma_values[162] {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa
+    };
+
+    static const uint8_t ac_chroma_bits[16] {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+    static const uint8_t ac_chroma_values[162] {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa
+    };
+
+    // a block's worst case: an 11-bit DC category and 63 coefficients of a
+    // 16-bit code plus 10 bits each, doubled for 0xFF stuffing
+    static constexpr size_t max_block_bytes = 2 * (27 + 63 * 26 + 7) / 8;
+
+    static void build_huffman(
+            const uint8_t* bits,
+            const uint8_t* values,
+            uint16_t* code,
+            uint8_t* size) {
+        // canonical codes, Annex C
+        uint16_t next = 0;
+        size_t k = 0;
+        for (int length = 1; length <= 16; length++) {
+            for (int i = 0; i < bits[length - 1]; i++, k++) {
+                code[values[k]] = next++;
+                size[values[k]] = static_cast<uint8_t>(length);
+            }
+            next = static_cast<uint16_t>(next << 1);
+        }
+    }
+
+    // islow integer DCT of libjpeg (Loeffler, Ligtenberg, Moschytz), one
+    // dimension down all eight columns at once so the compiler can keep
+    // each row in vector registers: NEON on the A53s, SSE on a desktop.
+    // out = in * 8 scaled as the two passes require.
+    static constexpr int const_bits = 13;
+    static constexpr int pass1_bits = 2;
+
+    template<int shift_even, int shift_odd, bool first>
+    static inline void dct_columns(const int32_t (&in)[8][8], int32_t (&out)[8][8]) {
+        for (int c = 0; c < 8; c++) {
+            int32_t tmp0 = in[0][c] + in[7][c];
+            int32_t tmp7 = in[0][c] - in[7][c];
+            int32_t tmp1 = in[1][c] + in[6][c];
+            int32_t tmp6 = in[1][c] - in[6][c];
+            int32_t tmp2 = in[2][c] + in[5][c];
+            int32_t tmp5 = in[2][c] - in[5][c];
+            int32_t tmp3 = in[3][c] + in[4][c];
+            int32_t tmp4 = in[3][c] - in[4][c];
+
+            int32_t tmp10 = tmp0 + tmp3;
+            int32_t tmp13 = tmp0 - tmp3;
+            int32_t tmp11 = tmp1 + tmp2;
+            int32_t tmp12 = tmp1 - tmp2;
+
+            if (first) {
+                out[0][c] = (tmp10 + tmp11) * (1 << pass1_bits);
+                out[4][c] = (tmp10 - tmp11) * (1 << pass1_bits);
+            } else {
+                out[0][c] = (tmp10 + tmp11 + (1 << (pass1_bits - 1))) >> pass1_bits;
+                out[4][c] = (tmp10 - tmp11 + (1 << (pass1_bits - 1))) >> pass1_bits;
+            }
+
+            int32_t z1 = (tmp12 + tmp13) * 4433;
+            out[2][c] = (z1 + tmp13 * 6270 + (1 << (shift_even - 1))) >> shift_even;
+            out[6][c] = (z1 - tmp12 * 15137 + (1 << (shift_even - 1))) >> shift_even;
+
+            z1 = tmp4 + tmp7;
+            int32_t z2 = tmp5 + tmp6;
+            int32_t z3 = tmp4 + tmp6;
+            int32_t z4 = tmp5 + tmp7;
+            int32_t z5 = (z3 + z4) * 9633;
+
+            tmp4 *= 2446;
+            tmp5 *= 16819;
+            tmp6 *= 25172;
+            tmp7 *= 12299;
+            z1 *= -7373;
+            z2 *= -20995;
+            z3 = z3 * -16069 + z5;
+            z4 = z4 * -3196 + z5;
+
+            out[7][c] = (tmp4 + z1 + z3 + (1 << (shift_odd - 1))) >> shift_odd;
+            out[5][c] = (tmp5 + z2 + z4 + (1 << (shift_odd - 1))) >> shift_odd;
+            out[3][c] = (tmp6 + z2 + z3 + (1 << (shift_odd - 1))) >> shift_odd;
+            out[1][c] = (tmp7 + z1 + z4 + (1 << (shift_odd - 1))) >> shift_odd;
+        }
+    }
+
+    static inline void transpose(const int32_t (&in)[8][8], int32_t (&out)[8][8]) {
+        for (int r = 0; r < 8; r++)
+            for (int c = 0; c < 8; c++)
+                out[c][r] = in[r][c];
+    }
+
+    // columns, transpose, columns again: the coefficients come out
+    // transposed, which the reciprocal table and the zigzag walk allow for
+    static inline void forward_dct(
+            const int16_t* samples,
+            const float* reciprocal,
+            int16_t* coefficients) {
+        int32_t a[8][8];
+        int32_t b[8][8];
+
+        for (int i = 0; i < 64; i++)
+            a[i >> 3][i & 7] = samples[i];
+
+        dct_columns<const_bits - pass1_bits, const_bits - pass1_bits, true>(a, b);
+        transpose(b, a);
+        dct_columns<const_bits + pass1_bits, const_bits + pass1_bits, false>(a, b);
+
+        // round half away from zero; copysign rather than a branch keeps
+        // the loop vectorized
+        const int32_t* flat = &b[0][0];
+        for (int i = 0; i < 64; i++) {
+            auto v = static_cast<float>(flat[i]) * reciprocal[i];
+            coefficients[i] = static_cast<int16_t>(static_cast<int32_t>(v + std::copysign(0.5f, v)));
+        }
+    }
+
+    // eight rows of eight samples, `step` bytes apart within a row: 1 for
+    // GREY, 2 for YUYV luma, 4 for YUYV chroma
+    template<int step>
+    static inline void load_rows(const uint8_t* p, size_t bytesperline, int16_t* block) {
+        for (int r = 0; r < 8; r++, p += bytesperline) {
+            for (int i = 0; i < 8; i++)
+                block[r * 8 + i] = static_cast<int16_t>(p[step * i] - 128);
+        }
+    }
+
+    template<int shift>
+    static inline void load_rows16(const uint8_t* p, size_t bytesperline, int16_t* block) {
+        for (int r = 0; r < 8; r++, p += bytesperline) {
+            for (int i = 0; i < 8; i++) {
+                auto v = (p[2 * i] | (p[2 * i + 1] << 8)) >> shift;
+                block[r * 8 + i] = static_cast<int16_t>(std::min(v, 255) - 128);
+            }
+        }
+    }
+
+    namespace {
+
+        struct bit_writer {
+            uint8_t* out;
+            uint64_t accumulator;
+            int bits;
+
+            inline void put(uint32_t code, int size) {
+                accumulator = (accumulator << size) | code;
+                bits += size;
+                while (bits >= 8) {
+                    auto byte = static_cast<uint8_t>(accumulator >> (bits - 8));
+                    *out++ = byte;
+                    if (byte == 0xff)
+                        *out++ = 0;
+                    bits -= 8;
+                }
+            }
+
+            // pad with ones to the byte boundary before a marker
+            inline void flush() {
+                if (bits > 0)
+                    put((1u << (8 - bits)) - 1, 8 - bits);
+            }
+        };
+
+        inline int magnitude_bits(int value) {
+            auto v = static_cast<uint32_t>(value < 0 ? -value : value);
+            return v == 0 ? 0 : 32 - __builtin_clz(v);
+        }
+
+    };
+
+    bool jpeg_encoder::configure(
+            uint32_t width,
+            uint32_t height,
+            uint32_t bytesperline,
+            jpeg_input input,
+            int quality,
+            uint32_t rows_per_slice) {
+        if (width == 0 || height == 0 || width > 65535 || height > 65535)
+            return false;
+
+        _width = width;
+        _height = height;
+        _bytesperline = bytesperline;
+        _input = input;
+
+        // the last row need only reach the end of its pixels
+        auto row_bytes = input == jpeg_input::y8 ? width : 2 * width;
+        if (bytesperline < row_bytes)
+            return false;
+        _frame_bytes = static_cast<size_t>(bytesperline) * (height - 1) + row_bytes;
+        _quality = std::min(std::max(quality, 1), 100);
+
+        auto mcu_width = input == jpeg_input::yuyv ? 16u : 8u;
+        _mcus_x = (width + mcu_width - 1) / mcu_width;
+        _mcu_rows = (height + 7) / 8;
+        _rows_per_slice = std::min(std::max(rows_per_slice, 1u), _mcu_rows);
+        _slice_count = (_mcu_rows + _rows_per_slice - 1) / _rows_per_slice;
+
+        auto blocks_per_mcu = input == jpeg_input::yuyv ? 4u : 1u;
+        _max_slice_bytes = static_cast<size_t>(_mcus_x) * _rows_per_slice * blocks_per_mcu * max_block_bytes + 16;
+
+        // IJG quality scaling
+        auto scale = _quality < 50 ? 5000 / _quality : 200 - 2 * _quality;
+        for (int i = 0; i < 64; i++) {
+            _quant[0][i] = static_cast<uint8_t>(std::min(std::max((luma_quant[i] * scale + 50) / 100, 1), 255));
+            _quant[1][i] = static_cast<uint8_t>(std::min(std::max((chroma_quant[i] * scale + 50) / 100, 1), 255));
+        }
+        for (int t = 0; t < 2; t++) {
+            for (int r = 0; r < 8; r++)
+                for (int c = 0; c < 8; c++)
+                    _reciprocal[t][c * 8 + r] = 1.0f / (8.0f * _quant[t][r * 8 + c]);
+        }
+
+        memset(_dc, 0, sizeof(_dc));
+        memset(_ac, 0, sizeof(_ac));
+        build_huffman(dc_luma_bits, dc_values, _dc[0].code, _dc[0].size);
+        build_huffman(dc_chroma_bits, dc_values, _dc[1].code, _dc[1].size);
+        build_huffman(ac_luma_bits, ac_luma_values, _ac[0].code, _ac[0].size);
+        build_huffman(ac_chroma_bits, ac_chroma_values, _ac[1].code, _ac[1].size);
+
+        build_header();
+        return true;
+    }
+
+    size_t jpeg_encoder::max_frame_bytes() const {
+        return _header.size() + _slice_count * (_max_slice_bytes + 2) + 2;
+    }
+
+    void jpeg_encoder::build_header() {
+        auto& h = _header;
+        h.clear();
+        auto put16 = [&h](uint32_t v) {
+            h.push_back(static_cast<uint8_t>(v >> 8));
+            h.push_back(static_cast<uint8_t>(v));
+        };
+        auto color = _input == jpeg_input::yuyv;
+        auto components = color ? 3 : 1;
+
+        // SOI, JFIF APP0
+        put16(0xffd8);
+        put16(0xffe0);
+        put16(16);
+        h.insert(h.end(), {'J', 'F', 'I', 'F', 0, 1, 1, 0});
+        put16(1);
+        put16(1);
+        h.insert(h.end(), {0, 0});
+
+        // DQT, zigzag order
+        for (int t = 0; t < (color ? 2 : 1); t++) {
+            put16(0xffdb);
+            put16(67);
+            h.push_back(static_cast<uint8_t>(t));
+            for (int k = 0; k < 64; k++)
+                h.push_back(_quant[t][natural_order[k]]);
+        }
+
+        // SOF0: luma 2x1 over chroma for 4:2:2
+        put16(0xffc0);
+        put16(static_cast<uint32_t>(8 + 3 * components));
+        h.push_back(8);
+        put16(_height);
+        put16(_width);
+        h.push_back(static_cast<uint8_t>(components));
+        h.insert(h.end(), {1, static_cast<uint8_t>(color ? 0x21 : 0x11), 0});
+        if (color) {
+            h.insert(h.end(), {2, 0x11, 1});
+            h.insert(h.end(), {3, 0x11, 1});
+        }
+
+        // DHT
+        struct table_t {
+            uint8_t id;
+            const uint8_t* bits;
+            const uint8_t* values;
+            size_t count;
+        };
+        const table_t tables[4] {
+            {0x00, dc_luma_bits, dc_values, sizeof(dc_values)},
+            {0x10, ac_luma_bits, ac_luma_values, sizeof(ac_luma_values)},
+            {0x01, dc_chroma_bits, dc_values, sizeof(dc_values)},
+            {0x11, ac_chroma_bits, ac_chroma_values, sizeof(ac_chroma_values)},
+        };
+        for (int t = 0; t < (color ? 4 : 2); t++) {
+            put16(0xffc4);
+            put16(static_cast<uint32_t>(2 + 1 + 16 + tables[t].count));
+            h.push_back(tables[t].id);
+            h.insert(h.end(), tables[t].bits, tables[t].bits + 16);
+            h.insert(h.end(), tables[t].values, tables[t].values + tables[t].count);
+        }
+
+        // DRI: one slice per restart interval
+        if (_slice_count > 1) {
+            put16(0xffdd);
+            put16(4);
+            put16(_mcus_x * _rows_per_slice);
+        }
+
+        // SOS
+        put16(0xffda);
+        put16(static_cast<uint32_t>(6 + 2 * components));
+        h.push_back(static_cast<uint8_t>(components));
+        h.insert(h.end(), {1, 0x00});
+        if (color) {
+            h.insert(h.end(), {2, 0x11});
+            h.insert(h.end(), {3, 0x11});
+        }
+        h.insert(h.end(), {0, 63, 0});
+    }
+
+    void jpeg_encoder::load_block(
+            const uint8_t* frame,
+            int component,
+            uint32_t x0,
+            uint32_t y0,
+            int16_t* block) const {
+        auto p = frame + static_cast<size_t>(y0) * _bytesperline;
+        switch (_input) {
+            case jpeg_input::y8:
+                load_rows<1>(p + x0, _bytesperline, block);
+                break;
+            case jpeg_input::y10:
+                load_rows16<2>(p + 2 * x0, _bytesperline, block);
+                break;
+            case jpeg_input::y16:
+                load_rows16<8>(p + 2 * x0, _bytesperline, block);
+                break;
+            case jpeg_input::yuyv:
+                // Y0 U Y1 V: luma every other byte, chroma pairs every four
+                if (component == 0)
+                    load_rows<2>(p + 2 * x0, _bytesperline, block);
+                else
+                    load_rows<4>(p + 4 * x0 + (component == 1 ? 1 : 3), _bytesperline, block);
+                break;
+        }
+    }
+
+    void jpeg_encoder::load_edge_block(
+            const uint8_t* frame,
+            int component,
+            uint32_t x0,
+            uint32_t y0,
+            int16_t* block) const {
+        // edge blocks repeat the last row and column
+        auto plane_width = component == 0 ? _width : (_width + 1) / 2;
+        size_t columns[8];
+        for (int i = 0; i < 8; i++) {
+            size_t x = std::min(x0 + i, plane_width - 1);
+            switch (_input) {
+                case jpeg_input::y8:
+                    columns[i] = x;
+                    break;
+                case jpeg_input::y10:
+                case jpeg_input::y16:
+                    columns[i] = 2 * x;
+                    break;
+                case jpeg_input::yuyv:
+                    columns[i] = component == 0 ? 2 * x : 4 * x + (component == 1 ? 1 : 3);
+                    break;
+            }
+        }
+
+        auto shift = _input == jpeg_input::y10 ? 2 : 8;
+        for (int r = 0; r < 8; r++) {
+            auto row = frame + static_cast<size_t>(std::min(y0 + r, _height - 1)) * _bytesperline;
+            for (int i = 0; i < 8; i++) {
+                auto p = row + columns[i];
+                int v = *p;
+                if (_input == jpeg_input::y10 || _input == jpeg_input::y16)
+                    v = std::min((p[0] | (p[1] << 8)) >> shift, 255);
+                block[r * 8 + i] = static_cast<int16_t>(v - 128);
+            }
+        }
+    }
+
+    size_t jpeg_encoder::encode_slice(
+            const uint8_t* frame,
+            size_t length,
+            uint32_t slice,
+            uint8_t* out) const {
+        SEVUN_TRACE_SCOPE(encode);
+
+        // every load below trusts the frame to be complete
+        if (length < _frame_bytes)
+            return 0;
+
+        bit_writer writer {out, 0, 0};
+        int16_t samples[64];
+        int16_t coefficients[64];
+        int predictor[3] {0, 0, 0};
+
+        auto color = _input == jpeg_input::yuyv;
+        auto first_row = slice * _rows_per_slice;
+        auto last_row = std::min(first_row + _rows_per_slice, _mcu_rows);
+
+        auto encode_block = [&](int component) {
+            auto table = component == 0 ? 0 : 1;
+            forward_dct(samples, _reciprocal[table], coefficients);
+
+            // coefficients are transposed: natural index r * 8 + c sits at
+            // c * 8 + r
+            auto at = [&](int k) {
+                auto n = natural_order[k];
+                return coefficients[((n & 7) << 3) | (n >> 3)];
+            };
+
+            int dc = at(0);
+            int diff = dc - predictor[component];
+            predictor[component] = dc;
+            auto category = magnitude_bits(diff);
+            writer.put(_dc[table].code[category], _dc[table].size[category]);
+            if (category > 0)
+                writer.put(static_cast<uint32_t>(diff < 0 ? diff - 1 : diff) & ((1u << category) - 1), category);
+
+            int run = 0;
+            for (int k = 1; k < 64; k++) {
+                int v = at(k);
+                if (v == 0) {
+                    run++;
+                    continue;
+                }
+                while (run > 15) {
+                    writer.put(_ac[table].code[0xf0], _ac[table].size[0xf0]);
+                    run -= 16;
+                }
+                auto bits = magnitude_bits(v);
+                auto symbol = (run << 4) | bits;
+                writer.put(_ac[table].code[symbol], _ac[table].size[symbol]);
+                writer.put(static_cast<uint32_t>(v < 0 ? v - 1 : v) & ((1u << bits) - 1), bits);
+                run = 0;
+            }
+            if (run > 0)
+                writer.put(_ac[table].code[0x00], _ac[table].size[0x00]);
+        };
+
+        // only MCUs over the right or bottom edge need clamping
+        auto full_rows = _height / 8;
+        auto full_mcus = _width / (color ? 16 : 8);
+
+        for (auto row = first_row; row < last_row; row++) {
+            auto y0 = row * 8;
+            for (uint32_t mx = 0; mx < _mcus_x; mx++) {
+                auto edge = row >= full_rows || mx >= full_mcus;
+                auto load = [&](int component, uint32_t x0) {
+                    if (edge)
+                        load_edge_block(frame, component, x0, y0, samples);
+                    else
+                        load_block(frame, component, x0, y0, samples);
+                };
+
+                if (color) {
+                    load(0, mx * 16);
+                    encode_block(0);
+                    load(0, mx * 16 + 8);
+                    encode_block(0);
+                    load(1, mx * 8);
+                    encode_block(1);
+                    load(2, mx * 8);
+                    encode_block(2);
+                } else {
+                    load(0, mx * 8);
+                    encode_block(0);
+                }
+            }
+        }
+
+        writer.flush();
+        return static_cast<size_t>(writer.out - out);
+    }
+
+    size_t jpeg_encoder::assemble(
+            const uint8_t* const* slices,
+            const size_t* lengths,
+            uint8_t* out) const {
+        auto p = out;
+        memcpy(p, _header.data(), _header.size());
+        p += _header.size();
+
+        for (uint32_t i = 0; i < _slice_count; i++) {
+            memcpy(p, slices[i], lengths[i]);
+            p += lengths[i];
+            if (i + 1 < _slice_count) {
+                *p++ = 0xff;
+                *p++ = static_cast<uint8_t>(0xd0 + (i & 7));
+            }
+        }
+
+        *p++ = 0xff;
+        *p++ = 0xd9;
+        return static_cast<size_t>(p - out);
+    }
+
+};
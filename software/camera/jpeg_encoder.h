@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace sevun {
+
+    enum class jpeg_input : uint8_t {
+        y8,         // V4L2_PIX_FMT_GREY
+        y10,        // V4L2_PIX_FMT_Y10, 10 bits in a little-endian 16-bit word
+        y16,        // V4L2_PIX_FMT_Y16
+        yuyv        // V4L2_PIX_FMT_YUYV, encoded 4:2:2
+    };
+
+    // baseline JPEG split into restart intervals of whole MCU rows, so the
+    // slices of one frame can be entropy coded independently and in
+    // parallel, then joined with RSTn markers.  configure() does all the
+    // allocation; encode_slice() is const and only touches the caller's
+    // buffer, so any number of threads can run it on the same encoder.
+    class jpeg_encoder {
+    public:
+        jpeg_encoder() = default;
+
+        bool configure(
+            uint32_t width,
+            uint32_t height,
+            uint32_t bytesperline,
+            jpeg_input input,
+            int quality,
+            uint32_t rows_per_slice);
+
+        // the shortest buffer encode_slice() accepts
+        inline size_t frame_bytes() const {
+            return _frame_bytes;
+        }
+
+        inline uint32_t slice_count() const {
+            return _slice_count;
+        }
+
+        // worst case for one slice's entropy-coded bytes
+        inline size_t max_slice_bytes() const {
+            return _max_slice_bytes;
+        }
+
+        // worst case for a whole frame from assemble()
+        size_t max_frame_bytes() const;
+
+        // SOI through SOS
+        inline const std::vector<uint8_t>& header() const {
+            return _header;
+        }
+
+        // entropy-coded data of one slice, byte aligned; returns its length,
+        // or 0 if the frame is shorter than frame_bytes()
+        size_t encode_slice(
+            const uint8_t* frame,
+            size_t length,
+            uint32_t slice,
+            uint8_t* out) const;
+
+        // header, slices with RSTn markers between them, EOI
+        size_t assemble(
+            const uint8_t* const* slices,
+            const size_t* lengths,
+            uint8_t* out) const;
+
+    private:
+        struct huffman_t {
+            uint16_t code[256];
+            uint8_t size[256];
+        };
+
+        void build_header();
+
+        // a block wholly inside the frame
+        void load_block(
+            const uint8_t* frame,
+            int component,
+            uint32_t x0,
+            uint32_t y0,
+            int16_t* block) const;
+
+        // a block over the right or bottom edge
+        void load_edge_block(
+            const uint8_t* frame,
+            int component,
+            uint32_t x0,
+            uint32_t y0,
+            int16_t* block) const;
+
+    private:
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _bytesperline = 0;
+        size_t _frame_bytes = 0;
+        jpeg_input _input = jpeg_input::y8;
+        int _quality = 75;
+        uint32_t _mcus_x = 0;
+        uint32_t _mcu_rows = 0;
+        uint32_t _rows_per_slice = 1;
+        uint32_t _slice_count = 0;
+        size_t _max_slice_bytes = 0;
+
+        uint8_t _quant[2][64] {};           // natural order
+        float _reciprocal[2][64] {};        // 1 / (8 q), transposed as the DCT leaves it
+        huffman_t _dc[2] {};
+        huffman_t _ac[2] {};
+        std::vector<uint8_t> _header;
+    };
+
+};
@@ -1,13 +1,138 @@
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <algorithm>
+#include <unistd.h>
+#include <pthread.h>
 #include <SDL2/SDL.h>
 #include <fmt/format.h>
 #include "result.h"
 #include "device.h"
+#include "trace.h"
+#include "hex_formatter.h"
+#include "frame_ring.h"
+#include "clip_recorder.h"
+#include "imu.h"
+#include "impact.h"
+#include "frame_governor.h"
+#include "mjpeg_encoder.h"
+#include "motion_estimator.h"
+#include "undistort.h"
+#include "stream_server.h"
+#include "../common/sim_motion.h"
+
+static sevun::device* running_device = nullptr;
+
+static void request_stop(int) {
+    if (running_device != nullptr)
+        running_device->request_stop();
+}
+
+// runs the impact detector on the IMU stream and cuts a clip around every
+// impact it finds, feeds the frame-rate governor its motion, and passes
+// the samples on to stream clients
+static void watch_imu(
+        sevun::imu_service& imu,
+        sevun::clip_recorder& clips,
+        sevun::frame_governor* governor,
+        sevun::stream_server& stream,
+        const std::atomic<bool>& running) {
+    // its 128 KiB pre-trigger ring fits the thread's 8 MiB stack
+    sevun::impact_detector detector(sevun::impact_config_t {}, imu.scale());
+    sevun::imu_sample_t batch[256];
+
+    while (running.load(std::memory_order_relaxed)) {
+        auto count = imu.samples().pop(batch, sizeof(batch) / sizeof(batch[0]));
+        if (count == 0) {
+            usleep(2000);
+            continue;
+        }
+
+        if (stream.enabled())
+            stream.push_imu(batch, count);
+
+        for (size_t i = 0; i < count; i++) {
+            if (governor != nullptr)
+                governor->push(batch[i]);
+            if (clips.enabled() && detector.push(batch[i]) == sevun::impact_detector::status::triggered)
+                clips.trigger(detector.event().trigger_ns);
+        }
+    }
+}
 
 int main(int argc, char** argv) {
+    sevun::capture_options_t options {};
+    sevun::clip_config_t clip_config {};
+    sevun::governor_config_t governor_config {};
+    sevun::mjpeg_config_t mjpeg_config {};
+    uint32_t idle_fps = 0;
+    bool preview = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:p:mflnb:a:g:dq:")) != -1) {
+        switch (opt) {
+            case 'c':
+                options.cpu = atoi(optarg);
+                break;
+            case 'p':
+                options.rt_priority = atoi(optarg);
+                break;
+            case 'm':
+                options.lock_memory = true;
+                break;
+            case 'f':
+                options.prefault_buffers = true;
+                break;
+            case 'l':
+                options.latest_frame = true;
+                break;
+            case 'n':
+                options.temporal_denoise = true;
+                break;
+            case 'b':
+                clip_config.pre_roll_ns = static_cast<uint64_t>(atof(optarg) * 1e9);
+                break;
+            case 'a':
+                clip_config.post_roll_ns = static_cast<uint64_t>(atof(optarg) * 1e9);
+                break;
+            case 'g':
+                idle_fps = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'd':
+                preview = false;
+                break;
+            case 'q':
+                mjpeg_config.quality = atoi(optarg);
+                break;
+            default:
+                fmt::print("usage: {} [-c cpu] [-p fifo-priority] [-m] [-f] [-l] [-n] [-b pre-roll-s] [-a post-roll-s] [-g idle-fps] [-d] [-q jpeg-quality]\n", argv[0]);
+                return 1;
+        }
+    }
+
     sevun::device video_device("/dev/video0");
+    video_device.set_capture_options(options);
+
+    // SIGINT and SIGTERM stop capture cleanly, preview or not.  worker
+    // threads start with them blocked so the capture thread is the one
+    // interrupted, and no SA_RESTART so a blocked dequeue gives up.
+    running_device = &video_device;
+    struct sigaction action {};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
 
     sevun::result result;
     if (!video_device.open(result)) {
@@ -17,6 +142,205 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    auto metrics_name = getenv("VISOR_METRICS");
+    if (!video_device.publish_metrics(result, metrics_name != nullptr ? metrics_name : "/visor-metrics"))
+        fmt::print("metrics disabled: {}\n", result.find_code(sevun::codes::metrics_open_failed)->message());
+
+    // VISOR_LENS=file corrects lens distortion before frames reach the
+    // ring, clips, encoder and motion estimation; the preview stays raw
+    sevun::undistorter lens;
+    std::vector<uint8_t> undistorted;
+    sevun::lens_calibration_t calibration {};
+    auto lens_path = getenv("VISOR_LENS");
+    if (lens_path != nullptr) {
+        const auto& pix = video_device.format().fmt.pix;
+        if (sevun::load_lens_calibration(result, lens_path, calibration)
+        &&  lens.configure(result, calibration, sevun::undistort_config_t {}, pix.width, pix.height, pix.pixelformat, pix.bytesperline))
+            undistorted.assign(pix.sizeimage, 0);
+        else
+            fmt::print("undistortion disabled: {}\n", result.at(result.size() - 1).message());
+    }
+
+    // local subscribers connect here to map the frame ring read-only
+    sevun::frame_publisher frame_ring;
+    auto ring_path = getenv("VISOR_FRAME_RING");
+    if (ring_path != nullptr) {
+        const auto& pix = video_device.format().fmt.pix;
+        if (frame_ring.open(result, ring_path, 8, pix.sizeimage))
+            frame_ring.set_format(pix.width, pix.height, pix.pixelformat, pix.bytesperline);
+        else
+            fmt::print("frame ring disabled: {}\n", result.find_code(sevun::codes::frame_ring_create_failed)->message());
+    }
+
+    // with VISOR_CLIPS set, frames are only kept in memory until an impact
+    // on the IMU (VISOR_IMU=sim or an i2c adapter number) asks for a clip
+    sevun::clip_recorder clips;
+    auto clip_dir = getenv("VISOR_CLIPS");
+    if (clip_dir != nullptr) {
+        const auto& pix = video_device.format().fmt.pix;
+        clip_config.directory = clip_dir;
+        if (clips.open(result, clip_config))
+            clips.set_format(pix.width, pix.height, pix.pixelformat, pix.bytesperline);
+        else
+            fmt::print("clips disabled: {}\n", result.at(result.size() - 1).message());
+    }
+
+    // VISOR_MJPEG=file records what's captured as MJPEG, encoded across
+    // all cores; frames the encoder can't keep up with are dropped rather
+    // than queued, so capture never waits on it
+    sevun::mjpeg_encoder mjpeg;
+    auto mjpeg_path = getenv("VISOR_MJPEG");
+    if (mjpeg_path != nullptr) {
+        const auto& pix = video_device.format().fmt.pix;
+        mjpeg_config.path = mjpeg_path;
+        if (!mjpeg.open(result, mjpeg_config, pix.width, pix.height, pix.pixelformat, pix.bytesperline, pix.sizeimage))
+            fmt::print("mjpeg disabled: {}\n", result.at(result.size() - 1).message());
+    }
+
+    // VISOR_MOTION=1 estimates head and gross eye motion from the picture,
+    // to set against what the IMU reports
+    sevun::motion_estimator motion;
+    if (getenv("VISOR_MOTION") != nullptr) {
+        const auto& pix = video_device.format().fmt.pix;
+        if (!motion.open(result, sevun::motion_config_t {}, pix.width, pix.height, pix.pixelformat, pix.bytesperline, pix.sizeimage))
+            fmt::print("motion estimation disabled: {}\n", result.at(result.size() - 1).message());
+    }
+
+    // -g drops the camera to idle-fps and the IMU to a lower rate while
+    // the wearer is still; the active profile is whatever the driver
+    // negotiated
+    auto use_governor = false;
+    if (idle_fps > 0) {
+        auto& active = governor_config.active;
+        use_governor = video_device.frame_interval(result, active.interval_numerator, active.interval_denominator);
+        governor_config.idle.interval_numerator = 1;
+        governor_config.idle.interval_denominator = idle_fps;
+        if (!use_governor)
+            fmt::print("frame-rate governor disabled: {}\n", result.at(result.size() - 1).message());
+    }
+
+    sevun::imu_service imu;
+    auto imu_open = false;
+    auto imu_source = getenv("VISOR_IMU");
+    auto stream_address = getenv("VISOR_STREAM");
+    if ((clips.enabled() || use_governor || stream_address != nullptr) && imu_source != nullptr) {
+        sevun::imu_options_t imu_options {};
+        if (strcmp(imu_source, "sim") == 0)
+            imu_options.simulate = true;
+        else
+            imu_options.adapter = static_cast<uint32_t>(atoi(imu_source));
+        governor_config.active.accel_rate = imu_options.accel_rate;
+        governor_config.active.gyro_rate = imu_options.gyro_rate;
+
+        // a simulated IMU takes a blow every few seconds, so the whole path
+        // can be exercised on the bench
+        static tSimMotion motion;
+        imu_open = imu.open(result, imu_options);
+        if (imu_open && imu_options.simulate) {
+            SimMotionInit(&motion, SIM_MOTION_IMPACTS);
+            SimMotionAttach(&motion, imu.accel_sim(), imu.gyro_sim(), imu.clock_ns());
+        } else if (!imu_open) {
+            fmt::print("imu disabled: {}\n", result.at(result.size() - 1).message());
+        }
+    }
+
+    // VISOR_STREAM=address (unix:path, /path or host:port) serves frames
+    // and IMU samples to bench PCs.  the capture thread only copies each
+    // frame once; slow clients skip frames instead of holding it up
+    sevun::stream_server stream;
+    if (stream_address != nullptr) {
+        const auto& pix = video_device.format().fmt.pix;
+        sevun::stream_config_t stream_config {};
+        stream_config.address = stream_address;
+        if (!stream.open(result, stream_config, pix.width, pix.height, pix.pixelformat, pix.bytesperline, pix.sizeimage, imu.scale()))
+            fmt::print("streaming disabled: {}\n", result.at(result.size() - 1).message());
+    }
+
+    sevun::frame_governor governor(governor_config, imu.scale());
+    if (use_governor) {
+        const auto& pix = video_device.format().fmt.pix;
+        governor.set_format(pix.width, pix.height, pix.pixelformat, pix.bytesperline);
+        governor.start(
+            [&](sevun::governor_state, const sevun::governor_profile_t& profile) {
+                video_device.request_frame_interval(profile.interval_numerator, profile.interval_denominator);
+                if (imu_open)
+                    imu.set_rates(profile.accel_rate, profile.gyro_rate);
+            },
+            sevun::trace::now_ns());
+    }
+
+    std::atomic<bool> watching {false};
+    std::thread imu_watcher;
+    if (imu_open) {
+        imu.start();
+        watching = true;
+        imu_watcher = std::thread(
+            watch_imu,
+            std::ref(imu),
+            std::ref(clips),
+            use_governor ? &governor : nullptr,
+            std::ref(stream),
+            std::cref(watching));
+    }
+
+    // a source change can bring a new size or pixel format; everything
+    // that sized itself for the old one starts over at it
+    video_device.set_format_observer(
+        [&](const struct v4l2_format& format) {
+            const auto& pix = format.fmt.pix;
+            fmt::print(
+                "format changed: {}x{} {}\n",
+                pix.width,
+                pix.height,
+                sevun::hex_formatter::fourcc_string(pix.pixelformat));
+
+            if (lens.enabled()) {
+                if (lens.configure(result, calibration, sevun::undistort_config_t {}, pix.width, pix.height, pix.pixelformat, pix.bytesperline))
+                    undistorted.assign(pix.sizeimage, 0);
+                else
+                    fmt::print("undistortion disabled: {}\n", result.at(result.size() - 1).message());
+            }
+            if (frame_ring.enabled()) {
+                if (pix.sizeimage > frame_ring.slot_size()
+                &&  !frame_ring.open(result, ring_path, 8, pix.sizeimage))
+                    fmt::print("frame ring disabled: {}\n", result.at(result.size() - 1).message());
+                frame_ring.set_format(pix.width, pix.height, pix.pixelformat, pix.bytesperline);
+            }
+            if (clips.enabled())
+                clips.set_format(pix.width, pix.height, pix.pixelformat, pix.bytesperline);
+            if (use_governor)
+                governor.set_format(pix.width, pix.height, pix.pixelformat, pix.bytesperline);
+            if (mjpeg.enabled() && !mjpeg.set_format(result, pix.width, pix.height, pix.pixelformat, pix.bytesperline, pix.sizeimage))
+                fmt::print("mjpeg disabled: {}\n", result.at(result.size() - 1).message());
+            if (motion.enabled() && !motion.set_format(result, pix.width, pix.height, pix.pixelformat, pix.bytesperline, pix.sizeimage))
+                fmt::print("motion estimation disabled: {}\n", result.at(result.size() - 1).message());
+            if (stream.enabled() && !stream.set_format(result, pix.width, pix.height, pix.pixelformat, pix.bytesperline, pix.sizeimage))
+                fmt::print("streaming disabled: {}\n", result.at(result.size() - 1).message());
+        });
+
+    // the ring, clips and governor want every frame; only the preview
+    // gives them up under -l
+    video_device.set_frame_observer(
+        [&](const uint8_t* data, size_t len, uint64_t captured_ns) {
+            if (lens.enabled() && len >= undistorted.size()) {
+                lens.remap(data, len, undistorted.data());
+                data = undistorted.data();
+                len = undistorted.size();
+            }
+            if (frame_ring.enabled())
+                frame_ring.publish(data, len, captured_ns);
+            if (clips.enabled())
+                clips.push(data, len, captured_ns);
+            if (use_governor)
+                governor.push_frame(data, len, captured_ns);
+            if (mjpeg.enabled())
+                mjpeg.push(data, len, captured_ns);
+            if (motion.enabled())
+                motion.push(data, len, captured_ns);
+            if (stream.enabled())
+                stream.push_frame(data, len, captured_ns);
+        });
+
     auto info = video_device.info();
 
     fmt::print("      driver: {}\n", info.driver);
@@ -45,45 +369,58 @@ int main(int argc, char** argv) {
     fmt::print("async_io                    {}\n", info.capabilities.async_io);
     fmt::print("streaming                   {}\n", info.capabilities.streaming);
 
-    auto window = SDL_CreateWindow(
-            "Sevun OV7251 Test",
-            SDL_WINDOWPOS_CENTERED,
-            SDL_WINDOWPOS_CENTERED,
-            640,
-            480,
-            SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
-
-    auto renderer = SDL_CreateRenderer(
-            window,
-            -1,
-            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-
-    auto texture = SDL_CreateTexture(
-            renderer,
-            SDL_PIXELFORMAT_RGBA32,
-            SDL_TEXTUREACCESS_STREAMING,
-            320,
-            240);
-
-    auto surface = SDL_CreateRGBSurfaceWithFormat(
-            0,
-            320,
-            240,
-            32,
-            SDL_PIXELFORMAT_RGB565);
-    SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
-
-//    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
-//    SDL_RenderSetLogicalSize(
-//            renderer,
-//            640,
-//            480);
+    pthread_sigmask(SIG_UNBLOCK, &stop_signals, nullptr);
+
+    // -d runs headless: no SDL at all, and the render callback does nothing
+    SDL_Window* window = nullptr;
+    SDL_Renderer* renderer = nullptr;
+    SDL_Texture* texture = nullptr;
+    SDL_Surface* surface = nullptr;
+
+    if (preview) {
+        window = SDL_CreateWindow(
+                "Sevun OV7251 Test",
+                SDL_WINDOWPOS_CENTERED,
+                SDL_WINDOWPOS_CENTERED,
+                640,
+                480,
+                SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+
+        renderer = SDL_CreateRenderer(
+                window,
+                -1,
+                SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+        texture = SDL_CreateTexture(
+                renderer,
+                SDL_PIXELFORMAT_RGBA32,
+                SDL_TEXTUREACCESS_STREAMING,
+                320,
+                240);
+
+        surface = SDL_CreateRGBSurfaceWithFormat(
+                0,
+                320,
+                240,
+                32,
+                SDL_PIXELFORMAT_RGB565);
+        SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+
+//        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+//        SDL_RenderSetLogicalSize(
+//                renderer,
+//                640,
+//                480);
+    }
 
     video_device.capture_stream(
             result,
-            "capture.raw",
+            preview ? "capture.raw" : "",
             0,
             [&](uint8_t* data, size_t len) {
+                if (!preview)
+                    return true;
+
                 SDL_Event e {};
 
                 while (SDL_PollEvent(&e) != 0) {
@@ -118,10 +455,155 @@ int main(int argc, char** argv) {
                         nullptr);
 
                 SDL_RenderPresent(renderer);
+                video_device.frame_presented(sevun::trace::now_ns());
 
                 return true;
             });
 
+    running_device = nullptr;
+
+    if (preview) {
+        SDL_FreeSurface(surface);
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+    }
+
+    for (const auto& msg : result.messages())
+        fmt::print("{}: {}\n", msg.code(), msg.message());
+
+    auto scratch = video_device.scratch_stats();
+    if (scratch.slots > 0)
+        fmt::print(
+            "scratch: {} slots in {:.1f} MiB, {} frames, high water {}, exhausted {}\n",
+            scratch.slots,
+            scratch.arena_bytes / 1048576.0,
+            scratch.acquired,
+            scratch.high_water,
+            scratch.exhausted);
+
+    auto recovery = video_device.recovery_stats();
+    if (recovery.events > 0)
+        fmt::print(
+            "source changes: {}, buffers kept {} / reallocated {}, streaming again p50 {:.1f} ms / max {:.1f} ms, first frame p50 {:.1f} ms / max {:.1f} ms\n",
+            recovery.events,
+            recovery.buffers_kept,
+            recovery.buffers_reallocated,
+            recovery.restart_time.quantile(0.5) / 1e6,
+            recovery.restart_time.max / 1e6,
+            recovery.first_frame_time.quantile(0.5) / 1e6,
+            recovery.first_frame_time.max / 1e6);
+
+    auto denoise = video_device.denoise_stats();
+    if (denoise.frames > 0)
+        fmt::print(
+            "denoise: {} frames, filter p50 {:.2f} ms / p99 {:.2f} ms, {:.1f} MiB reference\n",
+            denoise.frames,
+            denoise.filter_time.quantile(0.5) / 1e6,
+            denoise.filter_time.quantile(0.99) / 1e6,
+            denoise.reference_bytes / 1048576.0);
+
+    watching = false;
+    if (imu_watcher.joinable())
+        imu_watcher.join();
+    imu.close();
+
+    if (stream.enabled()) {
+        stream.close();
+        auto s = stream.stats();
+        fmt::print(
+            "stream: {} connections ({} turned away), {} frames sent, {} skipped, {} dropped, {:.1f} MiB, {} zerocopy ({} copied), {} imu samples, {} lost, push p99 {:.1f} us\n",
+            s.connections,
+            s.rejected,
+            s.frames_sent,
+            s.frames_skipped,
+            s.frames_dropped,
+            s.bytes_sent / 1048576.0,
+            s.zerocopy_sends,
+            s.zerocopy_copied,
+            s.imu_sent,
+            s.imu_dropped,
+            s.push_time.quantile(0.99) / 1e3);
+    }
+
+    if (use_governor) {
+        auto s = governor.stats(sevun::trace::now_ns());
+        auto total = std::max<uint64_t>(s.idle_ns + s.active_ns, 1);
+        fmt::print(
+            "governor: active {:.1f} s ({:.0f}%), idle {:.1f} s, {} wakes ({} from the imu), wake to full rate last {:.1f} ms / {} frames, worst {:.1f} ms\n",
+            s.active_ns / 1e9,
+            100.0 * s.active_ns / total,
+            s.idle_ns / 1e9,
+            s.wakes,
+            s.imu_wakes,
+            s.last_wake_ns / 1e6,
+            s.last_wake_frames,
+            s.max_wake_ns / 1e6);
+    }
+
+    if (clips.enabled()) {
+        clips.close();
+        auto s = clips.stats();
+        fmt::print(
+            "clips: {} of {} written, {} frames / {:.1f} MiB out of {} captured, {} dropped, {} errors, last flush {:.1f} ms\n",
+            s.clips_written,
+            s.clips_started,
+            s.frames_written,
+            s.bytes_written / 1048576.0,
+            s.frames,
+            s.frames_dropped,
+            s.write_errors,
+            s.last_flush_ns / 1e6);
+    }
+
+    if (lens.enabled()) {
+        auto s = lens.stats();
+        fmt::print(
+            "undistort: {} frames, remap p50 {:.1f} ms / p99 {:.1f} ms, {:.1f} MiB table\n",
+            s.frames,
+            s.remap_time.quantile(0.5) / 1e6,
+            s.remap_time.quantile(0.99) / 1e6,
+            s.table_bytes / 1048576.0);
+    }
+
+    if (mjpeg.enabled()) {
+        mjpeg.close();
+        auto s = mjpeg.stats();
+        fmt::print(
+            "mjpeg: {} of {} frames encoded, {} dropped, {:.1f} KiB per frame, last {:.1f} KiB, encode p50 {:.1f} ms / p99 {:.1f} ms, latency p99 {:.1f} ms, {} threads, {} errors\n",
+            s.encoded,
+            s.frames,
+            s.dropped,
+            s.encoded > 0 ? s.bytes / 1024.0 / s.encoded : 0.0,
+            s.last_bytes / 1024.0,
+            s.encode_time.quantile(0.5) / 1e6,
+            s.encode_time.quantile(0.99) / 1e6,
+            s.latency.quantile(0.99) / 1e6,
+            s.threads,
+            s.write_errors);
+    }
+
+    if (motion.enabled()) {
+        motion.close();
+        auto s = motion.stats();
+        fmt::print(
+            "motion: {} of {} frames estimated, {} dropped, {} over budget, estimate p50 {:.1f} ms / p99 {:.1f} ms, latency p99 {:.1f} ms, last global ({:.1f}, {:.1f}) px\n",
+            s.estimated,
+            s.frames,
+            s.dropped,
+            s.over_budget,
+            s.estimate_time.quantile(0.5) / 1e6,
+            s.estimate_time.quantile(0.99) / 1e6,
+            s.latency.quantile(0.99) / 1e6,
+            s.global_dx,
+            s.global_dy);
+    }
+
+#ifdef SEVUN_TRACE
+    auto trace_path = getenv("VISOR_TRACE_FILE");
+    if (trace_path != nullptr && !sevun::trace::export_chrome_json(trace_path))
+        fmt::print("failed to write trace to {}\n", trace_path);
+#endif
 
     return 0;
 }
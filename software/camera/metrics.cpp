@@ -0,0 +1,168 @@
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "metrics.h"
+
+namespace sevun {
+
+    uint64_t histogram_t::quantile(double q) const {
+        if (count == 0)
+            return 0;
+
+        auto target = static_cast<uint64_t>(q * count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            if (seen + buckets[i] <= target) {
+                seen += buckets[i];
+                continue;
+            }
+
+            // bucket i holds [lower, lower + width)
+            uint64_t lower = i;
+            uint64_t width = 1;
+            if (i >= sub_buckets) {
+                auto shift = i / sub_buckets - 1;
+                lower = (sub_buckets + i % sub_buckets) << shift;
+                width = 1ULL << shift;
+            }
+
+            // the samples are taken as spread evenly across the bucket
+            auto fraction = (target - seen + 0.5) / buckets[i];
+            auto value = lower + static_cast<uint64_t>(fraction * width);
+            return std::min(value, max);
+        }
+        return max;
+    }
+
+    metrics_publisher::~metrics_publisher() {
+        close();
+    }
+
+    bool metrics_publisher::open(
+            sevun::result& result,
+            const std::string& name) {
+        close();
+
+        auto fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            result.add_message(codes::metrics_open_failed, name, os_error {errno});
+            return false;
+        }
+
+        if (ftruncate(fd, sizeof(metrics_segment_t)) < 0) {
+            result.add_message(codes::metrics_open_failed, name, os_error {errno});
+            ::close(fd);
+            return false;
+        }
+
+        auto addr = mmap(
+            nullptr,
+            sizeof(metrics_segment_t),
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            fd,
+            0);
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::metrics_open_failed, name, os_error {errno});
+            return false;
+        }
+
+        _name = name;
+        _segment = static_cast<metrics_segment_t*>(addr);
+
+        _segment->seq.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memset(&_segment->data, 0, sizeof(_segment->data));
+        _segment->magic = metrics_segment_t::magic_value;
+        _segment->version = metrics_segment_t::version_value;
+        _segment->pid = static_cast<uint32_t>(getpid());
+        _segment->seq.store(2, std::memory_order_release);
+
+        return true;
+    }
+
+    void metrics_publisher::close() {
+        if (_segment == nullptr)
+            return;
+
+        munmap(_segment, sizeof(metrics_segment_t));
+        shm_unlink(_name.c_str());
+        _segment = nullptr;
+    }
+
+    metrics_reader::~metrics_reader() {
+        if (_segment != nullptr)
+            munmap(const_cast<metrics_segment_t*>(_segment), sizeof(metrics_segment_t));
+    }
+
+    bool metrics_reader::open(
+            sevun::result& result,
+            const std::string& name) {
+        auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            result.add_message(codes::metrics_open_failed, name, os_error {errno});
+            return false;
+        }
+
+        // a truncated or foreign object would fault on the first read
+        struct stat st {};
+        if (fstat(fd, &st) < 0) {
+            result.add_message(codes::metrics_open_failed, name, os_error {errno});
+            ::close(fd);
+            return false;
+        }
+        if (static_cast<size_t>(st.st_size) < sizeof(metrics_segment_t)) {
+            result.add_message(codes::metrics_bad_segment, name);
+            ::close(fd);
+            return false;
+        }
+
+        auto addr = mmap(
+            nullptr,
+            sizeof(metrics_segment_t),
+            PROT_READ,
+            MAP_SHARED,
+            fd,
+            0);
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::metrics_open_failed, name, os_error {errno});
+            return false;
+        }
+
+        _segment = static_cast<const metrics_segment_t*>(addr);
+        if (_segment->magic != metrics_segment_t::magic_value
+        ||  _segment->version != metrics_segment_t::version_value) {
+            result.add_message(codes::metrics_bad_segment, name);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool metrics_reader::read(
+            capture_metrics_t& out,
+            uint32_t& pid) const {
+        for (auto attempt = 0; attempt < 100; attempt++) {
+            auto before = _segment->seq.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+
+            memcpy(&out, &_segment->data, sizeof(out));
+            pid = _segment->pid;
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (_segment->seq.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+        return false;
+    }
+
+};
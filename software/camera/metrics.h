@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "result.h"
+
+namespace sevun {
+
+    // each octave [2^k, 2^(k+1)) nanoseconds is split into 8 linear
+    // sub-buckets, so a bucket is at most 1/8 of its lower bound wide;
+    // values below 8 get a bucket each.  the last bucket absorbs
+    // everything above ~4s.
+    struct histogram_t {
+        static constexpr int sub_bits = 3;
+        static constexpr size_t sub_buckets = 1 << sub_bits;
+        static constexpr size_t bucket_count = sub_buckets * (32 - sub_bits + 1);
+
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[bucket_count];
+
+        static inline size_t bucket_of(uint64_t value) {
+            if (value < sub_buckets)
+                return static_cast<size_t>(value);
+            auto octave = 63 - __builtin_clzll(value);
+            auto bucket = sub_buckets * static_cast<size_t>(octave - sub_bits + 1)
+                        + static_cast<size_t>((value >> (octave - sub_bits)) & (sub_buckets - 1));
+            return bucket < bucket_count ? bucket : bucket_count - 1;
+        }
+
+        inline void add(uint64_t value) {
+            buckets[bucket_of(value)]++;
+            count++;
+            sum += value;
+            if (value > max)
+                max = value;
+        }
+
+        // the given quantile, interpolated linearly within its bucket and
+        // never above the largest value seen
+        uint64_t quantile(double q) const;
+    };
+
+    struct capture_metrics_t {
+        uint64_t updated_ns;
+        uint64_t frames;
+        uint64_t drops;
+        uint64_t skipped;               // dequeued but superseded before rendering (latest-frame delivery)
+        uint64_t buffer_errors;
+        uint32_t queue_depth;
+        uint32_t buffer_count;
+        uint64_t run_delay_ns;
+        uint64_t involuntary_switches;
+        histogram_t dequeue_latency;
+        histogram_t callback_time;
+        histogram_t display_latency;    // capture timestamp to the frame on screen
+    };
+
+    struct metrics_segment_t {
+        static constexpr uint32_t magic_value = 0x53564d31;   // 'SVM1'
+        static constexpr uint32_t version_value = 4;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t pid;
+        std::atomic<uint32_t> seq;
+        capture_metrics_t data;
+    };
+
+    // single writer, owned by the capture thread.  updates go straight into
+    // the shared segment bracketed by a sequence counter, so the writer never
+    // waits on readers; readers retry if they raced an update.
+    class metrics_publisher {
+    public:
+        metrics_publisher() = default;
+
+        virtual ~metrics_publisher();
+
+        bool open(sevun::result& result, const std::string& name);
+
+        void close();
+
+        inline bool enabled() const {
+            return _segment != nullptr;
+        }
+
+        inline capture_metrics_t& begin_update() {
+            auto seq = _segment->seq.load(std::memory_order_relaxed);
+            _segment->seq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            return _segment->data;
+        }
+
+        inline void end_update(uint64_t now_ns) {
+            _segment->data.updated_ns = now_ns;
+            auto seq = _segment->seq.load(std::memory_order_relaxed);
+            _segment->seq.store(seq + 1, std::memory_order_release);
+        }
+
+    private:
+        std::string _name;
+        metrics_segment_t* _segment = nullptr;
+    };
+
+    class metrics_reader {
+    public:
+        metrics_reader() = default;
+
+        virtual ~metrics_reader();
+
+        bool open(sevun::result& result, const std::string& name);
+
+        // copies a consistent snapshot; false if the writer kept the segment
+        // busy for every attempt.
+        bool read(capture_metrics_t& out, uint32_t& pid) const;
+
+    private:
+        const metrics_segment_t* _segment = nullptr;
+    };
+
+};
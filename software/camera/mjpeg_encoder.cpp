@@ -0,0 +1,234 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include "mjpeg_encoder.h"
+#include "hex_formatter.h"
+#include "trace.h"
+
+namespace sevun {
+
+    mjpeg_encoder::~mjpeg_encoder() {
+        close();
+    }
+
+    bool mjpeg_encoder::open(
+            sevun::result& result,
+            const mjpeg_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage) {
+        close();
+        _config = config;
+        _frames = 0;
+        _dropped = 0;
+        _stats = mjpeg_stats_t {};
+
+        if (!configure(result, width, height, pixelformat, bytesperline, sizeimage))
+            return false;
+
+        if (!_config.path.empty()) {
+            _fd = ::open(_config.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (_fd == -1) {
+                result.add_message(codes::mjpeg_open_failed, _config.path, os_error {errno});
+                close();
+                return false;
+            }
+        }
+
+        _encoder_thread = std::thread(&mjpeg_encoder::encode_loop, this);
+        return true;
+    }
+
+    bool mjpeg_encoder::set_format(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage) {
+        if (!enabled())
+            return false;
+
+        stop();
+        if (!configure(result, width, height, pixelformat, bytesperline, sizeimage)) {
+            close();
+            return false;
+        }
+
+        _encoder_thread = std::thread(&mjpeg_encoder::encode_loop, this);
+        return true;
+    }
+
+    // with the encoder thread stopped: sizes every per-frame buffer and
+    // starts the pool
+    bool mjpeg_encoder::configure(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage) {
+        jpeg_input input;
+        switch (pixelformat) {
+            case V4L2_PIX_FMT_GREY:
+                input = jpeg_input::y8;
+                break;
+            case V4L2_PIX_FMT_Y10:
+                input = jpeg_input::y10;
+                break;
+            case V4L2_PIX_FMT_Y16:
+                input = jpeg_input::y16;
+                break;
+            case V4L2_PIX_FMT_YUYV:
+                input = jpeg_input::yuyv;
+                break;
+            default:
+                result.add_message(codes::mjpeg_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+                return false;
+        }
+
+        auto threads = _config.threads;
+        if (threads == 0)
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+        // a single thread gains nothing from restart markers
+        auto rows_per_slice = _config.rows_per_slice;
+        auto mcu_rows = (height + 7) / 8;
+        if (rows_per_slice == 0)
+            rows_per_slice = threads == 1 ? mcu_rows : std::max((mcu_rows + 2 * threads - 1) / (2 * threads), 1u);
+
+        if (!_encoder.configure(width, height, bytesperline, input, _config.quality, rows_per_slice)) {
+            result.add_message(codes::mjpeg_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+            return false;
+        }
+
+        // everything the encoder touches per frame is allocated here
+        _queue.open(_config.slots, sizeimage);
+        auto slices = _encoder.slice_count();
+        _slice_buffers.resize(slices);
+        for (auto& buffer : _slice_buffers)
+            buffer.assign(_encoder.max_slice_bytes(), 0);
+        _slice_lengths.assign(slices, 0);
+        _slice_pointers.resize(slices);
+        for (uint32_t i = 0; i < slices; i++)
+            _slice_pointers[i] = _slice_buffers[i].data();
+        _frame.assign(_encoder.max_frame_bytes(), 0);
+
+        {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats.threads = threads;
+            _stats.slices = slices;
+        }
+
+        // the encoder thread does its share of the slices too
+        _pool.start(threads);
+        return true;
+    }
+
+    void mjpeg_encoder::stop() {
+        if (_encoder_thread.joinable()) {
+            _queue.stop();
+            _encoder_thread.join();
+        }
+
+        _pool.stop();
+    }
+
+    void mjpeg_encoder::close() {
+        stop();
+
+        if (_fd != -1) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    void mjpeg_encoder::push(const uint8_t* data, size_t length, uint64_t timestamp_ns) {
+        if (!enabled())
+            return;
+        _frames.fetch_add(1, std::memory_order_relaxed);
+
+        // a short buffer can't be encoded; checked once here so the
+        // encoder's inner loops don't have to
+        if (length < _encoder.frame_bytes()) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // when every slot is busy the oldest frame still waiting goes: the
+        // encoder is behind, and this one is newer
+        if (!_queue.push(data, length, timestamp_ns))
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void mjpeg_encoder::encode_loop() {
+        frame_queue::frame_t frame;
+        while (_queue.take(frame)) {
+            auto started_ns = trace::now_ns();
+            _pool.run(
+                _encoder.slice_count(),
+                [this, &frame](uint32_t slice) {
+                    _slice_lengths[slice] = _encoder.encode_slice(
+                        frame.data,
+                        frame.length,
+                        slice,
+                        _slice_buffers[slice].data());
+                });
+            auto length = _encoder.assemble(_slice_pointers.data(), _slice_lengths.data(), _frame.data());
+            auto done_ns = trace::now_ns();
+            SEVUN_TRACE_COUNTER(jpeg_bytes, length);
+
+            auto timestamp_ns = frame.timestamp_ns;
+            _queue.release(frame);
+
+            {
+                std::lock_guard<std::mutex> guard(_stats_lock);
+                _stats.encoded++;
+                _stats.bytes += length;
+                _stats.last_bytes = length;
+                _stats.encode_time.add(done_ns - started_ns);
+                if (timestamp_ns != 0 && timestamp_ns <= done_ns)
+                    _stats.latency.add(done_ns - timestamp_ns);
+            }
+
+            if (_fd != -1 && !write_all(_frame.data(), length)) {
+                std::lock_guard<std::mutex> guard(_stats_lock);
+                _stats.write_errors++;
+            }
+
+            if (_sink)
+                _sink(_frame.data(), length, timestamp_ns);
+        }
+    }
+
+    bool mjpeg_encoder::write_all(const uint8_t* data, size_t length) {
+        while (length > 0) {
+            auto written = ::write(_fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    mjpeg_stats_t mjpeg_encoder::stats() const {
+        mjpeg_stats_t s;
+        {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            s = _stats;
+        }
+        s.frames = _frames.load(std::memory_order_relaxed);
+        s.dropped = _dropped.load(std::memory_order_relaxed);
+        return s;
+    }
+
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "result.h"
+#include "metrics.h"
+#include "jpeg_encoder.h"
+#include "work_pool.h"
+#include "frame_queue.h"
+
+namespace sevun {
+
+    struct mjpeg_config_t {
+        std::string path;                   // concatenated JPEGs; empty for the sink only
+        int quality = 75;
+        uint32_t threads = 0;               // 0: one per core
+        uint32_t slots = 3;                 // frames queued or being encoded
+        uint32_t rows_per_slice = 0;        // MCU rows per restart interval, 0: two slices per thread
+    };
+
+    struct mjpeg_stats_t {
+        uint64_t frames;                    // pushed by the capture thread
+        uint64_t encoded;
+        uint64_t dropped;                   // superseded while queued, no slot free, or short
+        uint64_t bytes;
+        uint64_t last_bytes;
+        uint64_t write_errors;
+        uint32_t threads;
+        uint32_t slices;
+        histogram_t latency;                // capture timestamp to the JPEG being ready
+        histogram_t encode_time;            // start of encoding to the JPEG being ready
+    };
+
+    // JPEG encodes GREY, Y10, Y16 and YUYV frames off the capture thread.
+    // push() copies a frame into a preallocated slot and returns; an
+    // encoder thread takes the oldest queued frame and, with a pool of
+    // workers, entropy codes its restart-interval slices in parallel.
+    // when every slot is busy the oldest frame still waiting is replaced,
+    // so under load whole frames are dropped and what does get encoded is
+    // recent.  frames go to the output file as MJPEG and to the sink.
+    class mjpeg_encoder {
+    public:
+        using sink_callable = std::function<void (const uint8_t*, size_t, uint64_t)>;
+
+        mjpeg_encoder() = default;
+
+        virtual ~mjpeg_encoder();
+
+        mjpeg_encoder(const mjpeg_encoder&) = delete;
+
+        mjpeg_encoder& operator=(const mjpeg_encoder&) = delete;
+
+        bool open(
+            sevun::result& result,
+            const mjpeg_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage);
+
+        // capture thread only.  drops whatever is still queued, finishes
+        // the frame in hand and carries on at the new format into the same
+        // output; false leaves the encoder closed.
+        bool set_format(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage);
+
+        // drops whatever is still queued, waits for the frame in hand
+        void close();
+
+        inline bool enabled() const {
+            return _encoder_thread.joinable();
+        }
+
+        // called on the encoder thread with each JPEG and its capture
+        // timestamp; set before open()
+        inline void set_sink(const sink_callable& sink) {
+            _sink = sink;
+        }
+
+        // capture thread only
+        void push(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        mjpeg_stats_t stats() const;
+
+    private:
+        bool configure(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage);
+
+        void stop();
+
+        void encode_loop();
+
+        bool write_all(const uint8_t* data, size_t length);
+
+    private:
+        mjpeg_config_t _config;
+        jpeg_encoder _encoder;
+        sink_callable _sink;
+        int _fd = -1;
+
+        frame_queue _queue;
+        std::thread _encoder_thread;
+
+        // one frame's slices, shared out over the pool
+        work_pool _pool;
+        std::vector<std::vector<uint8_t>> _slice_buffers;
+        std::vector<size_t> _slice_lengths;
+        std::vector<const uint8_t*> _slice_pointers;
+        std::vector<uint8_t> _frame;
+
+        std::atomic<uint64_t> _frames {0};
+        std::atomic<uint64_t> _dropped {0};
+        mutable std::mutex _stats_lock;
+        mjpeg_stats_t _stats {};
+    };
+
+};
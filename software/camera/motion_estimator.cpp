@@ -0,0 +1,438 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <linux/videodev2.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "motion_estimator.h"
+#include "hex_formatter.h"
+#include "trace.h"
+
+namespace sevun {
+
+    // std::min binds it by reference, which C++11 wants defined somewhere
+    constexpr uint32_t motion_estimator::max_levels;
+
+    static constexpr uint32_t band_rows = 16;
+
+    // sum of absolute differences over an 8x8 block, both at the same stride
+    static inline uint32_t sad8x8(const uint8_t* a, const uint8_t* b, size_t stride) {
+#if defined(__SSE2__)
+        auto sum = _mm_setzero_si128();
+        for (int r = 0; r < 8; r += 2) {
+            auto va = _mm_unpacklo_epi64(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + r * stride)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + (r + 1) * stride)));
+            auto vb = _mm_unpacklo_epi64(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + r * stride)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + (r + 1) * stride)));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+        }
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#elif defined(__ARM_NEON)
+        auto sum = vdupq_n_u16(0);
+        for (int r = 0; r < 8; r++)
+            sum = vabal_u8(sum, vld1_u8(a + r * stride), vld1_u8(b + r * stride));
+        auto wide = vpaddlq_u32(vpaddlq_u16(sum));
+        return static_cast<uint32_t>(vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1));
+#else
+        uint32_t sum = 0;
+        for (int r = 0; r < 8; r++) {
+            for (int c = 0; c < 8; c++)
+                sum += static_cast<uint32_t>(std::abs(a[r * stride + c] - b[r * stride + c]));
+        }
+        return sum;
+#endif
+    }
+
+    motion_estimator::~motion_estimator() {
+        close();
+    }
+
+    bool motion_estimator::configure(
+            sevun::result& result,
+            const motion_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline) {
+        _config = config;
+
+        switch (pixelformat) {
+            case V4L2_PIX_FMT_GREY:
+            case V4L2_PIX_FMT_Y10:
+            case V4L2_PIX_FMT_Y16:
+            case V4L2_PIX_FMT_YUYV:
+                break;
+            default:
+                result.add_message(codes::motion_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+                return false;
+        }
+
+        _width = width;
+        _height = height;
+        _bytesperline = bytesperline;
+        _pixelformat = pixelformat;
+
+        // every level needs at least one whole block
+        _levels = 0;
+        auto w = width / 2;
+        auto h = height / 2;
+        auto levels = std::min(std::max(_config.levels, 1u), max_levels);
+        while (_levels < levels && w >= block && h >= block) {
+            auto& level = _pyramid[_levels];
+            level.width = w;
+            level.height = h;
+            level.columns = w / block;
+            level.rows = h / block;
+            level.pixels[0].assign(static_cast<size_t>(w) * h, 0);
+            level.pixels[1].assign(static_cast<size_t>(w) * h, 0);
+            _search[_levels].assign(level.columns * level.rows, search_t {0, 0, 0, 0.0f, 0.0f});
+            _levels++;
+            w /= 2;
+            h /= 2;
+        }
+        if (_levels == 0) {
+            result.add_message(codes::motion_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+            return false;
+        }
+
+        auto blocks = _pyramid[0].columns * _pyramid[0].rows;
+        _vectors.assign(blocks, motion_vector_t {0.0f, 0.0f, 0, 0});
+        _median.assign(blocks, 0.0f);
+        _field = motion_field_t {};
+        _current = 0;
+        _have_previous = false;
+        _sequence_out = 0;
+
+        _stats = motion_stats_t {};
+        _frames = 0;
+        _dropped = 0;
+
+        _pool.start(_config.threads);
+        return true;
+    }
+
+    bool motion_estimator::open(
+            sevun::result& result,
+            const motion_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage) {
+        close();
+        if (!configure(result, config, width, height, pixelformat, bytesperline))
+            return false;
+
+        _queue.open(_config.slots, sizeimage);
+        _estimator_thread = std::thread(&motion_estimator::estimate_loop, this);
+        return true;
+    }
+
+    bool motion_estimator::set_format(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage) {
+        if (!enabled())
+            return false;
+
+        close();
+        auto stats = this->stats();
+        if (!configure(result, _config, width, height, pixelformat, bytesperline))
+            return false;
+        {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats = stats;
+        }
+        _frames = stats.frames;
+        _dropped = stats.dropped;
+
+        _queue.open(_config.slots, sizeimage);
+        _estimator_thread = std::thread(&motion_estimator::estimate_loop, this);
+        return true;
+    }
+
+    void motion_estimator::close() {
+        if (_estimator_thread.joinable()) {
+            _queue.stop();
+            _estimator_thread.join();
+        }
+        _pool.stop();
+    }
+
+    void motion_estimator::push(const uint8_t* data, size_t length, uint64_t timestamp_ns) {
+        if (!enabled())
+            return;
+        _frames.fetch_add(1, std::memory_order_relaxed);
+
+        if (!_queue.push(data, length, timestamp_ns))
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void motion_estimator::estimate_loop() {
+        frame_queue::frame_t frame;
+        while (_queue.take(frame)) {
+            estimate(frame.data, frame.length, frame.timestamp_ns);
+            _queue.release(frame);
+        }
+    }
+
+    bool motion_estimator::estimate(const uint8_t* data, size_t length, uint64_t timestamp_ns) {
+        SEVUN_TRACE_SCOPE(motion);
+        auto started_ns = trace::now_ns();
+
+        // the new frame replaces the one before last
+        _current ^= 1;
+
+        _source = data;
+        _source_length = length;
+        auto bands = (_pyramid[0].height + band_rows - 1) / band_rows;
+        _pool.run(bands, [this](uint32_t band) {
+            downscale_source(band * band_rows, std::min((band + 1) * band_rows, _pyramid[0].height));
+        });
+        for (uint32_t l = 1; l < _levels; l++) {
+            bands = (_pyramid[l].height + band_rows - 1) / band_rows;
+            _pool.run(bands, [this, l](uint32_t band) {
+                downscale_level(l, band * band_rows, std::min((band + 1) * band_rows, _pyramid[l].height));
+            });
+        }
+
+        if (!_have_previous) {
+            _have_previous = true;
+            return false;
+        }
+
+        // coarse to fine; once the budget is spent the finer levels just
+        // scale up what the coarser ones found
+        uint32_t searched = 0;
+        auto over_budget = false;
+        for (auto l = static_cast<int>(_levels) - 1; l >= 0; l--) {
+            auto level = static_cast<uint32_t>(l);
+            auto exhaustive = level == _levels - 1;
+            if (!exhaustive && trace::now_ns() - started_ns > _config.budget_ns) {
+                over_budget = true;
+                _pool.run(_pyramid[level].rows, [this, level](uint32_t row) {
+                    predict_row(level, row);
+                });
+                continue;
+            }
+            _pool.run(_pyramid[level].rows, [this, level, exhaustive](uint32_t row) {
+                search_row(level, row, exhaustive);
+            });
+            searched++;
+        }
+
+        // vectors run from the previous frame to this one, the opposite of
+        // where each block was found
+        const auto& finest = _search[0];
+        auto count = finest.size();
+        for (size_t i = 0; i < count; i++) {
+            _vectors[i].dx = -2.0f * (finest[i].x + finest[i].fx);
+            _vectors[i].dy = -2.0f * (finest[i].y + finest[i].fy);
+            _vectors[i].sad = finest[i].sad;
+        }
+
+        // the median keeps a moving eye or hand from pulling the head
+        // estimate along with it
+        auto median = [this, count](bool x) {
+            for (size_t i = 0; i < count; i++)
+                _median[i] = x ? _vectors[i].dx : _vectors[i].dy;
+            auto middle = _median.begin() + static_cast<ptrdiff_t>(count / 2);
+            std::nth_element(_median.begin(), middle, _median.begin() + static_cast<ptrdiff_t>(count));
+            return *middle;
+        };
+
+        _field.sequence = _sequence_out++;
+        _field.timestamp_ns = timestamp_ns;
+        _field.columns = _pyramid[0].columns;
+        _field.rows = _pyramid[0].rows;
+        _field.block_size = 2 * block;
+        _field.levels_searched = searched;
+        _field.over_budget = over_budget;
+        _field.global_dx = median(true);
+        _field.global_dy = median(false);
+        _field.vectors = _vectors.data();
+
+        auto done_ns = trace::now_ns();
+        {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats.estimated++;
+            if (over_budget)
+                _stats.over_budget++;
+            _stats.global_dx = _field.global_dx;
+            _stats.global_dy = _field.global_dy;
+            _stats.estimate_time.add(done_ns - started_ns);
+            if (timestamp_ns != 0 && timestamp_ns <= done_ns)
+                _stats.latency.add(done_ns - timestamp_ns);
+        }
+
+        if (_sink)
+            _sink(_field);
+        return true;
+    }
+
+    void motion_estimator::downscale_source(uint32_t first_row, uint32_t last_row) {
+        auto& level = _pyramid[0];
+        auto data = _source;
+        auto out = level.pixels[_current].data();
+        auto available = static_cast<uint32_t>(_source_length / _bytesperline);
+
+        for (auto y = first_row; y < last_row; y++) {
+            auto dst = out + static_cast<size_t>(y) * level.width;
+            if (2 * y + 1 >= available) {
+                memset(dst, 0, level.width);
+                continue;
+            }
+            auto a = data + static_cast<size_t>(2 * y) * _bytesperline;
+            auto b = a + _bytesperline;
+
+            // 2x2 box of luma
+            switch (_pixelformat) {
+                case V4L2_PIX_FMT_GREY:
+                    for (uint32_t x = 0; x < level.width; x++)
+                        dst[x] = static_cast<uint8_t>((a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1] + 2) >> 2);
+                    break;
+                case V4L2_PIX_FMT_YUYV:
+                    for (uint32_t x = 0; x < level.width; x++)
+                        dst[x] = static_cast<uint8_t>((a[4 * x] + a[4 * x + 2] + b[4 * x] + b[4 * x + 2] + 2) >> 2);
+                    break;
+                default: {
+                    // Y10 and Y16: the top 8 bits of each little-endian sample
+                    auto shift = _pixelformat == V4L2_PIX_FMT_Y10 ? 4 : 10;
+                    auto pa = reinterpret_cast<const uint16_t*>(a);
+                    auto pb = reinterpret_cast<const uint16_t*>(b);
+                    for (uint32_t x = 0; x < level.width; x++) {
+                        uint32_t sum = pa[2 * x] + pa[2 * x + 1] + pb[2 * x] + pb[2 * x + 1];
+                        dst[x] = static_cast<uint8_t>(std::min<uint32_t>(sum >> shift, 255));
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    void motion_estimator::downscale_level(uint32_t level, uint32_t first_row, uint32_t last_row) {
+        const auto& src = _pyramid[level - 1];
+        auto& dst = _pyramid[level];
+        auto in = src.pixels[_current].data();
+        auto out = dst.pixels[_current].data();
+
+        for (auto y = first_row; y < last_row; y++) {
+            auto a = in + static_cast<size_t>(2 * y) * src.width;
+            auto b = a + src.width;
+            auto d = out + static_cast<size_t>(y) * dst.width;
+            for (uint32_t x = 0; x < dst.width; x++)
+                d[x] = static_cast<uint8_t>((a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1] + 2) >> 2);
+        }
+    }
+
+    void motion_estimator::search_row(uint32_t level, uint32_t row, bool exhaustive) {
+        const auto& lv = _pyramid[level];
+        auto stride = static_cast<size_t>(lv.width);
+        auto current = lv.pixels[_current].data();
+        auto previous = lv.pixels[_current ^ 1].data();
+        auto& found = _search[level];
+        auto y0 = static_cast<int>(row * block);
+
+        for (uint32_t column = 0; column < lv.columns; column++) {
+            auto x0 = static_cast<int>(column * block);
+            auto cur = current + static_cast<size_t>(y0) * stride + x0;
+
+            int cx = 0;
+            int cy = 0;
+            int range = _config.search_range;
+            if (!exhaustive) {
+                const auto& parent_level = _pyramid[level + 1];
+                auto px = std::min(column / 2, parent_level.columns - 1);
+                auto py = std::min(row / 2, parent_level.rows - 1);
+                const auto& parent = _search[level + 1][py * parent_level.columns + px];
+                cx = 2 * parent.x;
+                cy = 2 * parent.y;
+                range = _config.refine_range;
+            }
+
+            // no motion first, so flat blocks, where everything ties, stay put
+            auto best = sad8x8(cur, previous + static_cast<size_t>(y0) * stride + x0, stride);
+            int best_x = 0;
+            int best_y = 0;
+
+            auto min_x = std::max(cx - range, -x0);
+            auto max_x = std::min(cx + range, static_cast<int>(lv.width - block) - x0);
+            auto min_y = std::max(cy - range, -y0);
+            auto max_y = std::min(cy + range, static_cast<int>(lv.height - block) - y0);
+            for (auto oy = min_y; oy <= max_y; oy++) {
+                auto ref = previous + static_cast<size_t>(y0 + oy) * stride + x0;
+                for (auto ox = min_x; ox <= max_x; ox++) {
+                    auto sad = sad8x8(cur, ref + ox, stride);
+                    if (sad < best) {
+                        best = sad;
+                        best_x = ox;
+                        best_y = oy;
+                    }
+                }
+            }
+
+            // the vertex of a parabola through the best SAD and its
+            // neighbours on either side, for each axis
+            auto fx = 0.0f;
+            auto fy = 0.0f;
+            if (level == 0) {
+                auto ref = previous + static_cast<size_t>(y0 + best_y) * stride + x0 + best_x;
+                auto vertex = [best](uint32_t before, uint32_t after) {
+                    auto curvature = static_cast<float>(before) + after - 2.0f * best;
+                    return curvature > 0.0f ? 0.5f * (static_cast<float>(before) - after) / curvature : 0.0f;
+                };
+                if (x0 + best_x >= 1 && x0 + best_x + block + 1 <= lv.width)
+                    fx = vertex(sad8x8(cur, ref - 1, stride), sad8x8(cur, ref + 1, stride));
+                if (y0 + best_y >= 1 && y0 + best_y + block + 1 <= lv.height)
+                    fy = vertex(sad8x8(cur, ref - stride, stride), sad8x8(cur, ref + stride, stride));
+            }
+
+            found[row * lv.columns + column] = search_t {
+                static_cast<int16_t>(best_x),
+                static_cast<int16_t>(best_y),
+                static_cast<uint16_t>(std::min<uint32_t>(best, 0xfffe)),
+                fx,
+                fy
+            };
+        }
+    }
+
+    void motion_estimator::predict_row(uint32_t level, uint32_t row) {
+        const auto& lv = _pyramid[level];
+        const auto& parent_level = _pyramid[level + 1];
+        auto& found = _search[level];
+
+        for (uint32_t column = 0; column < lv.columns; column++) {
+            auto px = std::min(column / 2, parent_level.columns - 1);
+            auto py = std::min(row / 2, parent_level.rows - 1);
+            const auto& parent = _search[level + 1][py * parent_level.columns + px];
+            found[row * lv.columns + column] = search_t {
+                static_cast<int16_t>(2 * parent.x),
+                static_cast<int16_t>(2 * parent.y),
+                0xffff,
+                0.0f,
+                0.0f
+            };
+        }
+    }
+
+    motion_stats_t motion_estimator::stats() const {
+        motion_stats_t s;
+        {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            s = _stats;
+        }
+        s.frames = _frames.load(std::memory_order_relaxed);
+        s.dropped = _dropped.load(std::memory_order_relaxed);
+        return s;
+    }
+
+};
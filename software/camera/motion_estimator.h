@@ -0,0 +1,195 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "result.h"
+#include "metrics.h"
+#include "work_pool.h"
+#include "frame_queue.h"
+
+namespace sevun {
+
+    struct motion_config_t {
+        uint32_t threads = 0;               // 0: one per core
+        uint32_t levels = 3;                // pyramid levels, the finest at half resolution
+        int search_range = 4;               // ± pixels, exhaustive, at the coarsest level
+        int refine_range = 1;               // ± pixels around the prediction at finer levels
+        uint32_t slots = 2;                 // frames queued or being estimated
+        uint64_t budget_ns = 8000000ULL;    // per frame; finer levels are only predicted past it
+    };
+
+    struct motion_vector_t {
+        float dx;                           // full-resolution pixels, previous frame to this one
+        float dy;
+        uint16_t sad;                       // over the block at half resolution; 0xffff if not searched
+        uint16_t reserved;
+    };
+
+    // valid for the duration of the sink call
+    struct motion_field_t {
+        uint64_t sequence;
+        uint64_t timestamp_ns;
+        uint32_t columns;
+        uint32_t rows;
+        uint32_t block_size;                // full-resolution pixels per block side
+        uint32_t levels_searched;
+        bool over_budget;
+        float global_dx;                    // median of the block vectors
+        float global_dy;
+        const motion_vector_t* vectors;     // row major, columns * rows
+    };
+
+    struct motion_stats_t {
+        uint64_t frames;                    // pushed by the capture thread
+        uint64_t estimated;
+        uint64_t dropped;
+        uint64_t over_budget;
+        float global_dx;                    // last frame
+        float global_dy;
+        histogram_t latency;                // capture timestamp to the field being ready
+        histogram_t estimate_time;
+    };
+
+    // block-matching motion estimation between consecutive frames, for
+    // the head and gross eye motion the picture shows.  each frame is
+    // reduced to a luma pyramid, the coarsest level is searched
+    // exhaustively, and every finer level refines the vector its parent
+    // block found, so large motion costs no more than small; a parabola
+    // through the neighbouring SADs places the finest vectors between
+    // pixels.  block rows are shared out over a pool; SAD is SSE2 or NEON
+    // where available.  frames are taken through a frame_queue, like
+    // mjpeg_encoder takes them: a full set of slots drops the oldest, so a
+    // field can span more than one frame interval.
+    class motion_estimator {
+    public:
+        static constexpr uint32_t max_levels = 5;
+        static constexpr uint32_t block = 8;        // block side at each level
+
+        using sink_callable = std::function<void (const motion_field_t&)>;
+
+        motion_estimator() = default;
+
+        virtual ~motion_estimator();
+
+        motion_estimator(const motion_estimator&) = delete;
+
+        motion_estimator& operator=(const motion_estimator&) = delete;
+
+        // threaded: push() queues frames for the estimator thread
+        bool open(
+            sevun::result& result,
+            const motion_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage);
+
+        // just the buffers, for estimate() on the caller's thread
+        bool configure(
+            sevun::result& result,
+            const motion_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline);
+
+        // capture thread only, after open().  drops the queued frames and
+        // starts over at the new format with nothing to compare against;
+        // the stats carry on.  false leaves the estimator closed.
+        bool set_format(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage);
+
+        void close();
+
+        inline bool enabled() const {
+            return _estimator_thread.joinable();
+        }
+
+        // called on the estimating thread; set before open()
+        inline void set_sink(const sink_callable& sink) {
+            _sink = sink;
+        }
+
+        // capture thread only
+        void push(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        // one frame, synchronously; false for the first, which has nothing
+        // to be compared with.  not with push().
+        bool estimate(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        // the last field estimate() produced
+        inline const motion_field_t& field() const {
+            return _field;
+        }
+
+        motion_stats_t stats() const;
+
+    private:
+        struct level_t {
+            uint32_t width;
+            uint32_t height;
+            uint32_t columns;               // whole blocks
+            uint32_t rows;
+            std::vector<uint8_t> pixels[2]; // current and previous frame, by _current
+        };
+
+        struct search_t {
+            int16_t x;                      // offset into the previous frame, level pixels
+            int16_t y;
+            uint16_t sad;
+            float fx;                       // sub-pixel part, finest level only
+            float fy;
+        };
+
+        void estimate_loop();
+
+        void downscale_source(uint32_t first_row, uint32_t last_row);
+
+        void downscale_level(uint32_t level, uint32_t first_row, uint32_t last_row);
+
+        void search_row(uint32_t level, uint32_t row, bool exhaustive);
+
+        void predict_row(uint32_t level, uint32_t row);
+
+    private:
+        motion_config_t _config;
+        sink_callable _sink;
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _bytesperline = 0;
+        uint32_t _pixelformat = 0;
+        uint32_t _levels = 0;
+
+        level_t _pyramid[max_levels];
+        std::vector<search_t> _search[max_levels];
+        uint32_t _current = 0;
+        bool _have_previous = false;
+        uint64_t _sequence_out = 0;
+        const uint8_t* _source = nullptr;   // the frame being downscaled
+        size_t _source_length = 0;
+
+        std::vector<motion_vector_t> _vectors;
+        std::vector<float> _median;
+        motion_field_t _field {};
+        work_pool _pool;
+
+        frame_queue _queue;
+        std::thread _estimator_thread;
+
+        std::atomic<uint64_t> _frames {0};
+        std::atomic<uint64_t> _dropped {0};
+        mutable std::mutex _stats_lock;
+        motion_stats_t _stats {};
+    };
+
+};
@@ -1,14 +1,71 @@
 #pragma once
 
-#include <string>
-#include <vector>
-#include <utility>
+#include <cstdint>
 #include "result_message.h"
+#include "result_codes.h"
 
 namespace sevun {
 
+    // result keeps the most recent messages in a fixed ring.  recording a
+    // message is a handful of stores with no allocation, so it's safe to use
+    // from the per-frame path; text is only produced when message() is read.
     class result {
     public:
+        static constexpr size_t capacity = 16;
+
+        class const_iterator {
+        public:
+            const_iterator(const result* owner, size_t pos) : _owner(owner),
+                                                              _pos(pos) {
+            }
+
+            inline const result_message& operator*() const {
+                return _owner->at(_pos);
+            }
+
+            inline const result_message* operator->() const {
+                return &_owner->at(_pos);
+            }
+
+            inline const_iterator& operator++() {
+                _pos++;
+                return *this;
+            }
+
+            inline bool operator!=(const const_iterator& other) const {
+                return _pos != other._pos;
+            }
+
+        private:
+            const result* _owner;
+            size_t _pos;
+        };
+
+        class message_view {
+        public:
+            explicit message_view(const result* owner) : _owner(owner) {
+            }
+
+            inline const_iterator begin() const {
+                return const_iterator(_owner, 0);
+            }
+
+            inline const_iterator end() const {
+                return const_iterator(_owner, _owner->size());
+            }
+
+            inline size_t size() const {
+                return _owner->size();
+            }
+
+            inline bool empty() const {
+                return _owner->size() == 0;
+            }
+
+        private:
+            const result* _owner;
+        };
+
         result() = default;
 
         inline void fail() {
@@ -19,65 +76,95 @@ namespace sevun {
             _success = true;
         }
 
+        template <typename... Args>
         inline void add_message(
-                const std::string& code,
-                const std::string& message) {
-            _messages.emplace_back(code, message, std::string(), result_message::types::info);
-        }
+                const result_code& code,
+                Args&&... args) {
+            result_message candidate;
+            candidate.reset(&code);
+            candidate.push_all(std::forward<Args>(args)...);
 
-        inline void add_message(
-                const std::string& code,
-                const std::string& message,
-                bool error) {
-            _messages.emplace_back(
-                code,
-                message,
-                std::string(),
-                error ? result_message::types::error : result_message::types::info);
-            if (error)
+            _total++;
+            if (code.id < 64)
+                _seen |= 1ULL << code.id;
+            if (code.error)
                 fail();
-        }
 
-        inline void add_message(
-                const std::string& code,
-                const std::string& message,
-                const std::string& details,
-                bool error) {
-            _messages.emplace_back(
-                code,
-                message,
-                details,
-                error ? result_message::types::error : result_message::types::info);
-            if (error)
-                fail();
+            if (_count > 0) {
+                auto& last = _ring[(_head + capacity - 1) % capacity];
+                if (last.same_as(candidate)) {
+                    last._repeat++;
+                    return;
+                }
+            }
+
+            _ring[_head] = candidate;
+            _head = (_head + 1) % capacity;
+            if (_count < capacity)
+                _count++;
+            else
+                _dropped++;
         }
 
         inline bool is_failed() const {
             return !_success;
         }
 
-        inline const result_message_list& messages() const {
-            return _messages;
+        // oldest to newest
+        inline message_view messages() const {
+            return message_view(this);
+        }
+
+        inline size_t size() const {
+            return _count;
+        }
+
+        inline const result_message& at(size_t index) const {
+            return _ring[(_head + capacity - _count + index) % capacity];
+        }
+
+        // messages recorded over the lifetime of the result, including
+        // repeats and entries that have since been overwritten.
+        inline uint64_t total() const {
+            return _total;
         }
 
-        inline bool has_code(const std::string& code) const {
-            for (const auto& msg : _messages)
-                if (msg.code() == code)
-                    return true;
-            return false;
+        inline uint64_t dropped() const {
+            return _dropped;
         }
 
-        inline const result_message* find_code(const std::string& code) const {
-            for (auto it = _messages.begin(); it != _messages.end(); ++it) {
-                if ((*it).code() == code)
-                    return &(*it);
+        inline bool has_code(const result_code& code) const {
+            if (code.id < 64)
+                return (_seen & (1ULL << code.id)) != 0;
+            return find_code(code) != nullptr;
+        }
+
+        inline const result_message* find_code(const result_code& code) const {
+            for (size_t i = _count; i > 0; i--) {
+                const auto& msg = at(i - 1);
+                if (msg.id() == code.id)
+                    return &msg;
             }
             return nullptr;
         }
 
+        inline void clear() {
+            _success = true;
+            _head = 0;
+            _count = 0;
+            _total = 0;
+            _dropped = 0;
+            _seen = 0;
+        }
+
     private:
         bool _success = true;
-        result_message_list _messages {};
+        size_t _head = 0;
+        size_t _count = 0;
+        uint64_t _total = 0;
+        uint64_t _dropped = 0;
+        uint64_t _seen = 0;
+        result_message _ring[capacity] {};
     };
 
-};
\ No newline at end of file
+};
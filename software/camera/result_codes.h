@@ -0,0 +1,55 @@
+#pragma once
+
+#include "result_message.h"
+
+namespace sevun {
+
+    namespace codes {
+
+        constexpr result_code stat_failed {1, "V001", "failed to stat file.", true};
+        constexpr result_code uevent_open_failed {2, "V002", "failed to open file.", true};
+        constexpr result_code unknown_device_name {3, "V003", "unknown device name.", true};
+        constexpr result_code open_failed {4, "V004", "failed to open {}: {}", true};
+        constexpr result_code not_v4l2_node {5, "V005", "{}: not a v4l2 node", true};
+        constexpr result_code ioctl_failed {6, "V006", "{}: failed: {}", true};
+        constexpr result_code metrics_open_failed {7, "V007", "failed to open metrics segment {}: {}", true};
+        constexpr result_code metrics_bad_segment {8, "V008", "{}: not a visor metrics segment", true};
+        constexpr result_code frame_ring_create_failed {9, "V009", "failed to create frame ring {}: {}", true};
+        constexpr result_code frame_ring_connect_failed {10, "V010", "failed to connect to frame ring {}: {}", true};
+        constexpr result_code frame_ring_bad_segment {11, "V011", "{}: not a visor frame ring", true};
+        constexpr result_code pin_cpu_failed {12, "V012", "failed to pin capture thread to cpu {}: {}", false};
+        constexpr result_code sched_fifo_failed {13, "V013", "failed to set SCHED_FIFO priority {}: {}", false};
+        constexpr result_code mlock_failed {14, "V014", "failed to lock memory: {}", false};
+        constexpr result_code imu_bus_failed {15, "V015", "failed to open i2c adapter {}: {}", true};
+        constexpr result_code imu_sensor_missing {16, "V016", "{} not responding at address {}", true};
+        constexpr result_code imu_configure_failed {17, "V017", "{}: configuration failed", true};
+        constexpr result_code imu_irq_failed {18, "V018", "failed to request interrupt line {}, polling instead: {}", false};
+        constexpr result_code calibration_load_failed {19, "V019", "failed to load calibration {}: {}", false};
+        constexpr result_code calibration_bad_file {20, "V020", "{}: not a visor calibration file", false};
+        constexpr result_code calibration_save_failed {21, "V021", "failed to save calibration {}: {}", true};
+        constexpr result_code imu_log_open_failed {22, "V022", "failed to open imu log {}: {}", true};
+        constexpr result_code imu_log_write_failed {23, "V023", "failed to write imu log {}: {}", true};
+        constexpr result_code imu_log_bad_file {24, "V024", "{}: not a visor imu log", true};
+        constexpr result_code imu_log_bad_block {25, "V025", "{}: block {} is corrupt, skipped", false};
+        constexpr result_code imu_log_recovered {26, "V026", "{}: log was not closed, rebuilt the index from {} blocks", false};
+        constexpr result_code clip_directory_failed {27, "V027", "clip directory {} is not writable: {}", true};
+        constexpr result_code clip_arena_failed {28, "V028", "failed to allocate a {} byte clip pre-roll arena: {}", true};
+        constexpr result_code frame_interval_unsupported {29, "V029", "{}: driver has no frame interval control", false};
+        constexpr result_code frame_interval_failed {30, "V030", "failed to set a {}/{} s frame interval: {}", false};
+        constexpr result_code scratch_arena_failed {31, "V031", "failed to allocate a {} byte frame scratch arena: {}", true};
+        constexpr result_code mjpeg_format_unsupported {32, "V032", "{} frames can't be JPEG encoded; GREY, Y10, Y16 and YUYV can", true};
+        constexpr result_code mjpeg_open_failed {33, "V033", "failed to open mjpeg output {}: {}", true};
+        constexpr result_code motion_format_unsupported {34, "V034", "{} frames can't be used for motion estimation; GREY, Y10, Y16 and YUYV can", true};
+        constexpr result_code lens_calibration_failed {35, "V035", "failed to load lens calibration {}: {}", true};
+        constexpr result_code lens_calibration_bad_file {36, "V036", "{}: expected width height fx fy cx cy k1 k2 p1 p2 k3", true};
+        constexpr result_code undistort_format_unsupported {37, "V037", "{} frames can't be undistorted; GREY, Y10, Y16 and YUYV can", true};
+        constexpr result_code denoise_format_unsupported {38, "V038", "{} frames can't be denoised; GREY and Y10 can", true};
+        constexpr result_code stream_address_invalid {39, "V039", "{}: expected unix:path, /path or host:port", true};
+        constexpr result_code stream_open_failed {40, "V040", "failed to open stream server {}: {}", true};
+        constexpr result_code stream_connect_failed {41, "V041", "failed to connect to stream {}: {}", true};
+        constexpr result_code stream_bad_reply {42, "V042", "{}: not a visor stream", true};
+        constexpr result_code scratch_leased {43, "V043", "the new format needs a bigger frame scratch arena, but {} slots are still leased", true};
+
+    };
+
+};
@@ -1,55 +1,272 @@
 #pragma once
 
-#include <vector>
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+#include <fmt/format.h>
 
 namespace sevun {
 
+    // codes are declared once, statically, in result_codes.h; messages only
+    // ever hold a pointer to one, so recording a message never copies text.
+    struct result_code {
+        uint16_t id;
+        const char* name;
+        const char* format;
+        bool error;
+    };
+
+    struct os_error {
+        int value;
+    };
+
+    class result_arg {
+    public:
+        enum kinds {
+            none,
+            signed_int,
+            unsigned_int,
+            real,
+            literal,
+            text,
+            errno_value
+        };
+
+        result_arg() : _kind(kinds::none) {
+            _value.u = 0;
+        }
+
+        inline kinds kind() const {
+            return _kind;
+        }
+
+        inline void set(int64_t value) {
+            _kind = kinds::signed_int;
+            _value.i = value;
+        }
+
+        inline void set(uint64_t value) {
+            _kind = kinds::unsigned_int;
+            _value.u = value;
+        }
+
+        inline void set(double value) {
+            _kind = kinds::real;
+            _value.d = value;
+        }
+
+        inline void set(const char* value) {
+            _kind = kinds::literal;
+            _value.s = value;
+        }
+
+        inline void set(os_error value) {
+            _kind = kinds::errno_value;
+            _value.i = value.value;
+        }
+
+        inline void set_text(uint64_t offset) {
+            _kind = kinds::text;
+            _value.u = offset;
+        }
+
+        inline bool operator==(const result_arg& other) const {
+            return _kind == other._kind && _value.u == other._value.u;
+        }
+
+        std::string to_string(const char* text_pool) const {
+            switch (_kind) {
+                case kinds::signed_int:
+                    return fmt::format("{}", _value.i);
+                case kinds::unsigned_int:
+                    return fmt::format("{}", _value.u);
+                case kinds::real:
+                    return fmt::format("{}", _value.d);
+                case kinds::literal:
+                    return _value.s != nullptr ? _value.s : "";
+                case kinds::text:
+                    return text_pool + _value.u;
+                case kinds::errno_value:
+                    return strerror(static_cast<int>(_value.i));
+                default:
+                    return "";
+            }
+        }
+
+    private:
+        kinds _kind;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            const char* s;
+        } _value;
+    };
+
     class result_message {
     public:
+        static constexpr size_t max_args = 4;
+        static constexpr size_t text_size = 64;
+
         enum types {
             info,
             error,
             data
         };
 
-        result_message(
-            const std::string& code,
-            const std::string& message,
-            const std::string& details = "",
-            types type = types::info) : _type(type),
-                                        _code(code),
-                                        _message(message),
-                                        _details(details) {
-        }
+        result_message() = default;
 
         inline types type() const {
-            return _type;
+            return _code != nullptr && _code->error ? types::error : types::info;
         }
 
         inline bool is_error() const {
-            return _type == types::error;
+            return type() == types::error;
         }
 
-        inline const std::string& code() const {
-            return _code;
+        inline uint16_t id() const {
+            return _code != nullptr ? _code->id : 0;
         }
 
-        inline const std::string& details() const {
-            return _details;
+        inline const char* code() const {
+            return _code != nullptr ? _code->name : "";
         }
 
-        inline const std::string& message() const {
-            return _message;
+        // number of consecutive times this code was recorded; repeats are
+        // folded into one entry so retry loops can't flood the ring.
+        inline uint32_t repeat() const {
+            return _repeat;
+        }
+
+        std::string message() const {
+            std::string out;
+            if (_code == nullptr)
+                return out;
+
+            size_t next = 0;
+            for (const char* p = _code->format; *p; p++) {
+                if (p[0] == '{' && p[1] == '}') {
+                    if (next < _arg_count)
+                        out += _args[next].to_string(_text);
+                    next++;
+                    p++;
+                } else {
+                    out += *p;
+                }
+            }
+            return out;
+        }
+
+        inline bool same_as(const result_message& other) const {
+            if (id() != other.id() || _arg_count != other._arg_count)
+                return false;
+            for (size_t i = 0; i < _arg_count; i++)
+                if (!(_args[i] == other._args[i]))
+                    return false;
+            return memcmp(_text, other._text, _text_used) == 0;
         }
 
     private:
-        types _type;
-        std::string _code;
-        std::string _message {};
-        std::string _details {};
-    };
+        friend class result;
+
+        inline void reset(const result_code* code) {
+            _code = code;
+            _repeat = 1;
+            _arg_count = 0;
+            _text_used = 0;
+            _text[0] = '\0';
+        }
+
+        inline void push(double value) {
+            if (_arg_count < max_args)
+                _args[_arg_count++].set(value);
+        }
+
+        inline void push(os_error value) {
+            if (_arg_count < max_args)
+                _args[_arg_count++].set(value);
+        }
+
+        // only a string literal is kept as a pointer; it lives as long as
+        // the program does
+        template <size_t N>
+        inline void push(const char (&value)[N]) {
+            if (_arg_count < max_args)
+                _args[_arg_count++].set(static_cast<const char*>(value));
+        }
+
+        // anything else may be gone by the time the message is read, so
+        // its text is copied in: a char buffer, c_str() or any char pointer
+        template <size_t N>
+        inline void push(char (&value)[N]) {
+            push_text(value, strnlen(value, N));
+        }
+
+        template <typename T>
+        inline typename std::enable_if<
+            std::is_convertible<T, const char*>::value
+            && !std::is_array<typename std::remove_reference<T>::type>::value>::type
+        push(T&& value) {
+            const char* s = value;
+            push_text(s, s != nullptr ? strlen(s) : 0);
+        }
+
+        inline void push(int value) { push_signed(value); }
+        inline void push(long value) { push_signed(value); }
+        inline void push(long long value) { push_signed(value); }
+        inline void push(unsigned value) { push_unsigned(value); }
+        inline void push(unsigned long value) { push_unsigned(value); }
+        inline void push(unsigned long long value) { push_unsigned(value); }
+        inline void push(float value) { push(static_cast<double>(value)); }
+
+        inline void push_signed(int64_t value) {
+            if (_arg_count < max_args)
+                _args[_arg_count++].set(value);
+        }
+
+        inline void push_unsigned(uint64_t value) {
+            if (_arg_count < max_args)
+                _args[_arg_count++].set(value);
+        }
+
+        inline void push(const std::string& value) {
+            push_text(value.data(), value.size());
+        }
 
-    typedef std::vector <result_message> result_message_list;
+        inline void push_text(const char* value, size_t length) {
+            if (_arg_count >= max_args)
+                return;
+            if (_text_used >= text_size) {
+                push("");
+                return;
+            }
+            size_t avail = text_size - _text_used - 1;
+            size_t len = length < avail ? length : avail;
+            memcpy(_text + _text_used, value, len);
+            _text[_text_used + len] = '\0';
+            _args[_arg_count++].set_text(_text_used);
+            _text_used = static_cast<uint8_t>(_text_used + len + 1);
+        }
+
+        inline void push_all() {
+        }
+
+        // forwarded as they came, so a literal can be told from a buffer
+        template <typename T, typename... Args>
+        inline void push_all(T&& value, Args&&... args) {
+            push(std::forward<T>(value));
+            push_all(std::forward<Args>(args)...);
+        }
+
+    private:
+        const result_code* _code = nullptr;
+        uint32_t _repeat = 0;
+        uint8_t _arg_count = 0;
+        uint8_t _text_used = 0;
+        result_arg _args[max_args] {};
+        char _text[text_size] {};
+    };
 
 };
@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <sys/mman.h>
+#include "scratch_pool.h"
+
+namespace sevun {
+
+    static size_t align_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    scratch_frame::~scratch_frame() {
+        release();
+    }
+
+    scratch_frame::scratch_frame(scratch_frame&& other) noexcept
+        : _pool(other._pool),
+          _slot(other._slot) {
+        other._pool = nullptr;
+    }
+
+    scratch_frame& scratch_frame::operator=(scratch_frame&& other) noexcept {
+        if (this != &other) {
+            release();
+            _pool = other._pool;
+            _slot = other._slot;
+            other._pool = nullptr;
+        }
+        return *this;
+    }
+
+    uint8_t* scratch_frame::get(scratch_stage stage) const {
+        if (_pool == nullptr)
+            return nullptr;
+        return _pool->_arena
+             + _slot * _pool->_slot_bytes
+             + _pool->_offset[static_cast<size_t>(stage)];
+    }
+
+    size_t scratch_frame::size(scratch_stage stage) const {
+        return _pool != nullptr ? _pool->_size[static_cast<size_t>(stage)] : 0;
+    }
+
+    void scratch_frame::release() {
+        if (_pool != nullptr) {
+            _pool->release(_slot);
+            _pool = nullptr;
+        }
+    }
+
+    scratch_pool::~scratch_pool() {
+        close();
+    }
+
+    static void stage_sizes(const struct v4l2_format& format, size_t* sizes) {
+        size_t width;
+        size_t height;
+        size_t sizeimage;
+        if (format.type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+            const auto& pix = format.fmt.pix_mp;
+            width = pix.width;
+            height = pix.height;
+            sizeimage = 0;
+            for (unsigned i = 0; i < pix.num_planes && i < VIDEO_MAX_PLANES; i++)
+                sizeimage += pix.plane_fmt[i].sizeimage;
+        } else {
+            const auto& pix = format.fmt.pix;
+            width = pix.width;
+            height = pix.height;
+            sizeimage = pix.sizeimage;
+        }
+
+        auto pixels = width * height;
+        sizes[static_cast<size_t>(scratch_stage::copy)] = sizeimage;
+        sizes[static_cast<size_t>(scratch_stage::bayer8)] = pixels;
+        sizes[static_cast<size_t>(scratch_stage::rgb24)] = pixels * 3;
+        sizes[static_cast<size_t>(scratch_stage::yuyv)] = pixels * 2;
+    }
+
+    bool scratch_pool::open(
+            sevun::result& result,
+            const struct v4l2_format& format,
+            uint32_t slots) {
+        close();
+
+        stage_sizes(format, _size);
+
+        // each stage starts on a cache line, and so does each slot
+        size_t offset = 0;
+        for (size_t i = 0; i < static_cast<size_t>(scratch_stage::count); i++) {
+            _offset[i] = offset;
+            offset += align_up(_size[i], alignment);
+        }
+        _slot_bytes = offset;
+
+        _slots = slots == 0 ? 1 : (slots > max_slots ? max_slots : slots);
+        auto bytes = _slot_bytes * _slots;
+
+        // faulted in now so the first frames don't pay for it
+        auto addr = mmap(
+            nullptr,
+            bytes,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+            -1,
+            0);
+        if (addr == MAP_FAILED) {
+            result.add_message(codes::scratch_arena_failed, static_cast<uint64_t>(bytes), os_error {errno});
+            _slots = 0;
+            return false;
+        }
+
+        _arena = static_cast<uint8_t*>(addr);
+        _arena_bytes = bytes;
+        _free = _slots == 32 ? 0xffffffffu : (1u << _slots) - 1;
+        _acquired = 0;
+        _exhausted = 0;
+        _high_water = 0;
+        return true;
+    }
+
+    void scratch_pool::close() {
+        if (_arena == nullptr)
+            return;
+
+        munmap(_arena, _arena_bytes);
+        _arena = nullptr;
+        _arena_bytes = 0;
+        _slots = 0;
+        _free = 0;
+    }
+
+    bool scratch_pool::fits(const struct v4l2_format& format) const {
+        if (_arena == nullptr)
+            return false;
+
+        size_t sizes[static_cast<size_t>(scratch_stage::count)];
+        stage_sizes(format, sizes);
+        for (size_t i = 0; i < static_cast<size_t>(scratch_stage::count); i++)
+            if (sizes[i] > _size[i])
+                return false;
+        return true;
+    }
+
+    scratch_frame scratch_pool::acquire() {
+        if (_free == 0) {
+            if (_arena != nullptr)
+                _exhausted++;
+            return scratch_frame {};
+        }
+
+        auto slot = static_cast<uint32_t>(__builtin_ctz(_free));
+        _free &= ~(1u << slot);
+        _acquired++;
+
+        auto in_use = _slots - static_cast<uint32_t>(__builtin_popcount(_free));
+        if (in_use > _high_water)
+            _high_water = in_use;
+
+        return scratch_frame {this, slot};
+    }
+
+    void scratch_pool::release(uint32_t slot) {
+        _free |= 1u << slot;
+    }
+
+    scratch_stats_t scratch_pool::stats() const {
+        scratch_stats_t s {};
+        s.acquired = _acquired;
+        s.exhausted = _exhausted;
+        s.in_use = _slots - static_cast<uint32_t>(__builtin_popcount(_free));
+        s.high_water = _high_water;
+        s.slots = _slots;
+        s.arena_bytes = _arena_bytes;
+        return s;
+    }
+
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <linux/videodev2.h>
+#include "result.h"
+
+namespace sevun {
+
+    // intermediate frames of the conversion chain
+    enum class scratch_stage : uint8_t {
+        copy,       // the frame as captured, sizeimage bytes
+        bayer8,     // 8 bits per pixel
+        rgb24,      // 24 bits per pixel
+        yuyv,       // 16 bits per pixel
+        count
+    };
+
+    struct scratch_stats_t {
+        uint64_t acquired;
+        uint64_t exhausted;         // acquire() found every slot in use
+        uint32_t in_use;
+        uint32_t high_water;
+        uint32_t slots;
+        size_t arena_bytes;
+    };
+
+    class scratch_pool;
+
+    // one frame's worth of scratch buffers, held for as long as the frame
+    // is being worked on.  the slot goes back to the pool when the lease
+    // is destroyed or released.
+    class scratch_frame {
+    public:
+        scratch_frame() = default;
+
+        ~scratch_frame();
+
+        scratch_frame(scratch_frame&& other) noexcept;
+
+        scratch_frame& operator=(scratch_frame&& other) noexcept;
+
+        scratch_frame(const scratch_frame&) = delete;
+
+        scratch_frame& operator=(const scratch_frame&) = delete;
+
+        inline bool valid() const {
+            return _pool != nullptr;
+        }
+
+        // 64-byte aligned
+        uint8_t* get(scratch_stage stage) const;
+
+        size_t size(scratch_stage stage) const;
+
+        void release();
+
+    private:
+        friend class scratch_pool;
+
+        scratch_frame(scratch_pool* pool, uint32_t slot)
+            : _pool(pool),
+              _slot(slot) {
+        }
+
+        scratch_pool* _pool = nullptr;
+        uint32_t _slot = 0;
+    };
+
+    // fixed set of per-frame scratch slots carved out of one arena that is
+    // mapped and faulted in when the capture session starts, sized from the
+    // negotiated format.  every buffer starts on a cache line, so SIMD loads
+    // are aligned and two stages never share a line.  single thread: the
+    // capture thread acquires and releases.
+    class scratch_pool {
+    public:
+        static constexpr size_t alignment = 64;
+        static constexpr uint32_t max_slots = 32;
+
+        scratch_pool() = default;
+
+        virtual ~scratch_pool();
+
+        scratch_pool(const scratch_pool&) = delete;
+
+        scratch_pool& operator=(const scratch_pool&) = delete;
+
+        // slots is how many frames can hold scratch at once
+        bool open(sevun::result& result, const struct v4l2_format& format, uint32_t slots);
+
+        void close();
+
+        inline bool enabled() const {
+            return _arena != nullptr;
+        }
+
+        // whether every stage of format fits the slots already mapped
+        bool fits(const struct v4l2_format& format) const;
+
+        // an invalid lease when every slot is taken; never allocates
+        scratch_frame acquire();
+
+        scratch_stats_t stats() const;
+
+    private:
+        friend class scratch_frame;
+
+        void release(uint32_t slot);
+
+    private:
+        uint8_t* _arena = nullptr;
+        size_t _arena_bytes = 0;
+        size_t _slot_bytes = 0;
+        size_t _offset[static_cast<size_t>(scratch_stage::count)] {};
+        size_t _size[static_cast<size_t>(scratch_stage::count)] {};
+        uint32_t _slots = 0;
+        uint32_t _free = 0;         // bit per free slot
+
+        uint64_t _acquired = 0;
+        uint64_t _exhausted = 0;
+        uint32_t _high_water = 0;
+    };
+
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sevun {
+
+    // bounded single-producer/single-consumer queue.  head and tail live on
+    // separate cache lines and each side keeps a cached copy of the other's
+    // index, so a push or pop only touches shared state when the cached
+    // view says the queue looks full or empty.
+    template <typename T, size_t Capacity>
+    class spsc_queue {
+        static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        static constexpr size_t capacity = Capacity;
+
+        spsc_queue() = default;
+
+        spsc_queue(const spsc_queue&) = delete;
+
+        spsc_queue& operator=(const spsc_queue&) = delete;
+
+        // producer side; false if the consumer hasn't made room.
+        inline bool push(const T& value) {
+            auto head = _head.load(std::memory_order_relaxed);
+            if (head - _tail_cache == Capacity) {
+                _tail_cache = _tail.load(std::memory_order_acquire);
+                if (head - _tail_cache == Capacity)
+                    return false;
+            }
+            _items[head & (Capacity - 1)] = value;
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side; false if nothing is queued.
+        inline bool pop(T& value) {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail == _head_cache) {
+                _head_cache = _head.load(std::memory_order_acquire);
+                if (tail == _head_cache)
+                    return false;
+            }
+            value = _items[tail & (Capacity - 1)];
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side; copies up to max items, returns how many.
+        inline size_t pop(T* values, size_t max) {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            _head_cache = _head.load(std::memory_order_acquire);
+            auto count = static_cast<size_t>(_head_cache - tail);
+            if (count > max)
+                count = max;
+            for (size_t i = 0; i < count; i++)
+                values[i] = _items[(tail + i) & (Capacity - 1)];
+            _tail.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+        // approximate from either side.
+        inline size_t size() const {
+            return static_cast<size_t>(
+                _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire));
+        }
+
+    private:
+        alignas(64) std::atomic<uint64_t> _head {0};
+        uint64_t _tail_cache = 0;
+        alignas(64) std::atomic<uint64_t> _tail {0};
+        uint64_t _head_cache = 0;
+        alignas(64) T _items[Capacity];
+    };
+
+};
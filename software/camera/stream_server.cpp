@@ -0,0 +1,797 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include "stream_server.h"
+#include "unix_socket.h"
+#include "trace.h"
+
+namespace sevun {
+
+    static constexpr uint32_t imu_batch = 256;
+
+    static size_t round_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    struct stream_address_t {
+        bool tcp;
+        std::string path;
+        struct sockaddr_storage addr;
+        socklen_t length;
+    };
+
+    // unix:path or anything starting with / is a unix socket; otherwise
+    // [tcp:]host:port, where an empty host is every interface for the
+    // server and loopback for a client
+    static bool parse_address(
+            const std::string& address,
+            bool listening,
+            stream_address_t& out) {
+        memset(&out.addr, 0, sizeof(out.addr));
+        out.tcp = false;
+        out.path.clear();
+
+        if (address.compare(0, 5, "unix:") == 0 || (!address.empty() && address[0] == '/')) {
+            out.path = address[0] == '/' ? address : address.substr(5);
+            auto& sun = reinterpret_cast<struct sockaddr_un&>(out.addr);
+            if (out.path.empty() || out.path.size() >= sizeof(sun.sun_path))
+                return false;
+            sun.sun_family = AF_UNIX;
+            memcpy(sun.sun_path, out.path.c_str(), out.path.size() + 1);
+            out.length = sizeof(struct sockaddr_un);
+            return true;
+        }
+
+        auto spec = address.compare(0, 4, "tcp:") == 0 ? address.substr(4) : address;
+        auto colon = spec.rfind(':');
+        if (colon == std::string::npos || colon + 1 == spec.size())
+            return false;
+        auto host = spec.substr(0, colon);
+        auto port = spec.substr(colon + 1);
+
+        struct addrinfo hints {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_NUMERICSERV | (listening ? AI_PASSIVE : 0);
+        struct addrinfo* found = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0 || found == nullptr)
+            return false;
+        memcpy(&out.addr, found->ai_addr, found->ai_addrlen);
+        out.length = found->ai_addrlen;
+        out.tcp = true;
+        freeaddrinfo(found);
+        return true;
+    }
+
+    stream_server::~stream_server() {
+        close();
+    }
+
+    bool stream_server::open(
+            sevun::result& result,
+            const stream_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage,
+            const imu_scale_t& imu_scale) {
+        close();
+        _config = config;
+        _config.max_clients = std::max(_config.max_clients, 1u);
+        _config.imu_samples = std::max(_config.imu_samples, imu_batch);
+
+        stream_address_t address {};
+        if (!parse_address(_config.address, true, address)) {
+            result.add_message(codes::stream_address_invalid, _config.address);
+            return false;
+        }
+
+        _hello.width = width;
+        _hello.height = height;
+        _hello.pixelformat = pixelformat;
+        _hello.bytesperline = bytesperline;
+        _hello.imu_scale = imu_scale;
+
+        // a client pins at most one slot while sending and the kernel holds
+        // on to it until the zerocopy completion; one more is the latest
+        // frame and one more is being written
+        auto slots = _config.slots != 0 ? _config.slots : _config.max_clients + 2;
+        if (!map_slots(sizeimage, std::max(slots, 2u))) {
+            result.add_message(codes::stream_open_failed, _config.address, os_error {errno});
+            return false;
+        }
+        _frame_index = 0;
+
+        _imu.assign(_config.imu_samples, imu_sample_t {});
+        _imu_head = 0;
+
+        if (!address.tcp) {
+            auto error = claim_socket_path(address.path);
+            if (error != 0) {
+                result.add_message(codes::stream_open_failed, _config.address, os_error {error});
+                close();
+                return false;
+            }
+        }
+
+        _listen_fd = socket(address.tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_listen_fd >= 0 && address.tcp) {
+            int one = 1;
+            setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (_listen_fd < 0
+        ||  bind(_listen_fd, reinterpret_cast<struct sockaddr*>(&address.addr), address.length) < 0
+        ||  listen(_listen_fd, static_cast<int>(_config.max_clients)) < 0) {
+            result.add_message(codes::stream_open_failed, _config.address, os_error {errno});
+            close();
+            return false;
+        }
+        _tcp = address.tcp;
+        _socket_path = address.path;
+
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_epoll_fd < 0 || _wake_fd < 0) {
+            result.add_message(codes::stream_open_failed, _config.address, os_error {errno});
+            close();
+            return false;
+        }
+
+        struct epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = _listen_fd;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _listen_fd, &event);
+        event.data.fd = _wake_fd;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &event);
+
+        _clients.reserve(_config.max_clients);
+        _stats = stream_stats_t {};
+        _stopping = false;
+        _server = std::thread(&stream_server::serve, this);
+        return true;
+    }
+
+    bool stream_server::set_format(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage) {
+        if (!enabled())
+            return false;
+
+        stop_serving();
+        _hello.width = width;
+        _hello.height = height;
+        _hello.pixelformat = pixelformat;
+        _hello.bytesperline = bytesperline;
+        if (!map_slots(sizeimage, _slots.size())) {
+            result.add_message(codes::stream_open_failed, _config.address, os_error {errno});
+            close();
+            return false;
+        }
+
+        _stopping = false;
+        _server = std::thread(&stream_server::serve, this);
+        return true;
+    }
+
+    // a fresh arena every time: the kernel may still be sending from the
+    // old one to clients just dropped
+    bool stream_server::map_slots(uint32_t sizeimage, size_t slots) {
+        auto slot_bytes = round_up(sizeof(stream_message_t) + sizeimage, 4096);
+        auto addr = mmap(
+            nullptr,
+            slot_bytes * slots,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+            -1,
+            0);
+        if (addr == MAP_FAILED)
+            return false;
+
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_arena != nullptr)
+            munmap(_arena, _arena_bytes);
+        _arena = static_cast<uint8_t*>(addr);
+        _arena_bytes = slot_bytes * slots;
+        _slot_bytes = slot_bytes;
+        _frame_bytes = sizeimage;
+        _slots.assign(slots, slot_t {});
+        for (size_t i = 0; i < _slots.size(); i++)
+            _slots[i].data = _arena + i * _slot_bytes;
+        _latest = -1;
+        return true;
+    }
+
+    void stream_server::stop_serving() {
+        if (_server.joinable()) {
+            _stopping = true;
+            uint64_t one = 1;
+            (void) ::write(_wake_fd, &one, sizeof(one));
+            _server.join();
+        }
+
+        for (auto& client : _clients)
+            drop_client(client);
+        _clients.clear();
+    }
+
+    void stream_server::close() {
+        stop_serving();
+
+        if (_listen_fd >= 0) {
+            ::close(_listen_fd);
+            if (!_socket_path.empty())
+                unlink(_socket_path.c_str());
+            _listen_fd = -1;
+        }
+        if (_epoll_fd >= 0) {
+            ::close(_epoll_fd);
+            _epoll_fd = -1;
+        }
+        if (_wake_fd >= 0) {
+            ::close(_wake_fd);
+            _wake_fd = -1;
+        }
+
+        // the kernel keeps its own references to pages still in flight
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_arena != nullptr) {
+            munmap(_arena, _arena_bytes);
+            _arena = nullptr;
+            _arena_bytes = 0;
+        }
+        _slots.clear();
+    }
+
+    void stream_server::push_frame(const uint8_t* data, size_t length, uint64_t timestamp_ns) {
+        if (_arena == nullptr)
+            return;
+
+        SEVUN_TRACE_SCOPE(stream);
+        auto started_ns = trace::now_ns();
+
+        // any slot nobody holds, other than the latest frame
+        int32_t slot = -1;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            for (size_t i = 0; i < _slots.size(); i++) {
+                if (static_cast<int32_t>(i) != _latest && _slots[i].pins == 0) {
+                    slot = static_cast<int32_t>(i);
+                    _slots[i].writing = true;
+                    break;
+                }
+            }
+        }
+
+        if (slot < 0) {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats.frames++;
+            _stats.frames_dropped++;
+            return;
+        }
+
+        // the header travels with the frame, so a slot goes out in one
+        // contiguous send and nothing the kernel may still be reading
+        // changes under it
+        length = std::min<size_t>(length, _frame_bytes);
+        auto message = reinterpret_cast<stream_message_t*>(_slots[slot].data);
+        message->magic = stream_message_t::magic_value;
+        message->type = stream_message_t::frame;
+        message->reserved = 0;
+        message->length = static_cast<uint32_t>(length);
+        message->count = 1;
+        message->index = _frame_index;
+        message->timestamp_ns = timestamp_ns;
+        memcpy(_slots[slot].data + sizeof(stream_message_t), data, length);
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _slots[slot].writing = false;
+            _latest = slot;
+            _frame_index++;
+        }
+
+        uint64_t one = 1;
+        (void) ::write(_wake_fd, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> guard(_stats_lock);
+        _stats.frames++;
+        _stats.push_time.add(trace::now_ns() - started_ns);
+    }
+
+    void stream_server::push_imu(const imu_sample_t* samples, size_t count) {
+        if (count == 0)
+            return;
+
+        // the producer isn't the capture thread, so it can race a close()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_arena == nullptr || _imu.empty())
+                return;
+            for (size_t i = 0; i < count; i++)
+                _imu[(_imu_head + i) % _imu.size()] = samples[i];
+            _imu_head += count;
+        }
+
+        uint64_t one = 1;
+        (void) ::write(_wake_fd, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> guard(_stats_lock);
+        _stats.imu_samples += count;
+    }
+
+    stream_stats_t stream_server::stats() const {
+        std::lock_guard<std::mutex> guard(_stats_lock);
+        return _stats;
+    }
+
+    void stream_server::serve() {
+        std::vector<struct epoll_event> events(_config.max_clients + 2);
+
+        while (!_stopping.load(std::memory_order_relaxed)) {
+            auto n = epoll_wait(_epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            for (int i = 0; i < n; i++) {
+                auto fd = events[i].data.fd;
+                auto flags = events[i].events;
+
+                if (fd == _wake_fd) {
+                    uint64_t count;
+                    (void) ::read(_wake_fd, &count, sizeof(count));
+                    continue;
+                }
+                if (fd == _listen_fd) {
+                    accept_clients();
+                    continue;
+                }
+
+                auto client = std::find_if(
+                    _clients.begin(),
+                    _clients.end(),
+                    [fd](const client_t& c) { return c.fd == fd; });
+                if (client == _clients.end())
+                    continue;
+
+                // EPOLLERR is also how zerocopy completions are announced
+                if (flags & EPOLLERR) {
+                    read_completions(*client);
+                    client->blocked = false;
+                }
+                if ((flags & (EPOLLIN | EPOLLHUP)) && !read_request(*client)) {
+                    drop_client(*client);
+                    continue;
+                }
+                if ((flags & EPOLLOUT) && client->blocked) {
+                    client->blocked = false;
+                    watch_writable(*client, false);
+                }
+            }
+
+            for (auto& client : _clients)
+                if (client.fd >= 0 && !pump(client))
+                    drop_client(client);
+
+            _clients.erase(
+                std::remove_if(
+                    _clients.begin(),
+                    _clients.end(),
+                    [](const client_t& c) { return c.fd < 0; }),
+                _clients.end());
+        }
+    }
+
+    void stream_server::accept_clients() {
+        for (;;) {
+            auto fd = accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+
+            if (_clients.size() >= _config.max_clients) {
+                ::close(fd);
+                std::lock_guard<std::mutex> guard(_stats_lock);
+                _stats.rejected++;
+                continue;
+            }
+
+            client_t client {};
+            client.fd = fd;
+            client.out_slot = -1;
+            client.buffer.reserve(sizeof(stream_message_t) + imu_batch * sizeof(imu_sample_t));
+
+            // room for about two frames, so a client that can't keep up
+            // fills its socket and starts skipping straight away instead of
+            // working through seconds of frames queued in the kernel
+            auto sndbuf = static_cast<int>(_slot_bytes);
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+            // unix sockets always copy; TCP takes MSG_ZEROCOPY from 4.14 on
+            if (_tcp) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_ZEROCOPY
+                client.zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#endif
+            }
+
+            struct epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+            _clients.push_back(std::move(client));
+
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats.connections++;
+            _stats.clients = static_cast<uint32_t>(_clients.size());
+        }
+    }
+
+    // false once the client has hung up or sent something that isn't a
+    // request; anything after the request is read and ignored
+    bool stream_server::read_request(client_t& client) {
+        for (;;) {
+            uint8_t discard[256];
+            auto into = client.requested
+                ? discard
+                : reinterpret_cast<uint8_t*>(&client.request) + client.request_bytes;
+            auto wanted = client.requested ? sizeof(discard) : sizeof(client.request) - client.request_bytes;
+
+            auto n = recv(client.fd, into, wanted, MSG_DONTWAIT);
+            if (n == 0)
+                return false;
+            if (n < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            if (client.requested)
+                continue;
+
+            client.request_bytes += static_cast<size_t>(n);
+            if (client.request_bytes < sizeof(client.request))
+                continue;
+            if (client.request.magic != stream_request_t::magic_value)
+                return false;
+
+            auto fps = client.request.max_fps;
+            if (_config.max_fps != 0 && (fps == 0 || fps > _config.max_fps))
+                fps = _config.max_fps;
+            client.min_interval_ns = fps != 0 ? 1000000000ULL / fps : 0;
+            client.requested = true;
+
+            std::lock_guard<std::mutex> guard(_lock);
+            client.imu_cursor = _imu_head;
+        }
+    }
+
+    void stream_server::read_completions(client_t& client) {
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+        for (;;) {
+            char control[128];
+            struct msghdr msg {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(client.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+                return;
+
+            for (auto cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                ||    (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                    continue;
+
+                struct sock_extended_err err;
+                memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0)
+                    continue;
+
+                // sends ee_info..ee_data are done with their pages; TCP
+                // reports them in order
+                while (!client.in_flight.empty()
+                &&     static_cast<int32_t>(client.in_flight.front().first - err.ee_data) <= 0) {
+                    unpin(client.in_flight.front().second);
+                    client.in_flight.pop_front();
+                }
+
+                // the kernel had to copy after all, as it does over
+                // loopback, so zerocopy only costs this client extra
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    client.zerocopy = false;
+                    std::lock_guard<std::mutex> guard(_stats_lock);
+                    _stats.zerocopy_copied += err.ee_data - err.ee_info + 1;
+                }
+            }
+        }
+#else
+        (void) client;
+#endif
+    }
+
+    // sends until the socket is full or nothing is due; false if the
+    // client is gone
+    bool stream_server::pump(client_t& client) {
+        if (!client.requested || client.blocked)
+            return true;
+
+        for (;;) {
+            if (client.out == nullptr && !next_message(client))
+                return true;
+
+            struct iovec iov {};
+            iov.iov_base = const_cast<uint8_t*>(client.out + client.out_sent);
+            iov.iov_len = client.out_length - client.out_sent;
+            struct msghdr msg {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            auto flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+            auto zerocopy = false;
+#ifdef MSG_ZEROCOPY
+            zerocopy = client.zerocopy && client.out_slot >= 0 && client.out_length >= _config.zerocopy_min;
+            if (zerocopy)
+                flags |= MSG_ZEROCOPY;
+#endif
+
+            auto n = sendmsg(client.fd, &msg, flags);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                // ENOBUFS: too many zerocopy sends awaiting completion,
+                // which come back as EPOLLERR
+                if (errno == EAGAIN || errno == EWOULDBLOCK || (zerocopy && errno == ENOBUFS)) {
+                    client.blocked = true;
+                    watch_writable(client, true);
+                    return true;
+                }
+                return false;
+            }
+
+            if (zerocopy) {
+                client.zerocopy_calls++;
+                client.out_zerocopy = true;
+            }
+            client.out_sent += static_cast<size_t>(n);
+
+            {
+                std::lock_guard<std::mutex> guard(_stats_lock);
+                _stats.bytes_sent += static_cast<uint64_t>(n);
+                if (zerocopy)
+                    _stats.zerocopy_sends++;
+            }
+
+            if (client.out_sent == client.out_length) {
+                if (client.out_zerocopy) {
+                    // the slot stays pinned until the completion for the
+                    // last send covers it
+                    client.in_flight.emplace_back(client.zerocopy_calls - 1, client.out_slot);
+                    client.out_slot = -1;
+                }
+                finish_message(client);
+            }
+        }
+    }
+
+    // what a client gets next: the hello, then IMU samples as they come,
+    // then the newest frame if its rate allows
+    bool stream_server::next_message(client_t& client) {
+        auto header = [&](uint16_t type, uint32_t length, uint32_t count, uint64_t index, uint64_t timestamp_ns) {
+            client.buffer.resize(sizeof(stream_message_t) + length);
+            auto message = reinterpret_cast<stream_message_t*>(client.buffer.data());
+            message->magic = stream_message_t::magic_value;
+            message->type = type;
+            message->reserved = 0;
+            message->length = length;
+            message->count = count;
+            message->index = index;
+            message->timestamp_ns = timestamp_ns;
+            client.out = client.buffer.data();
+            client.out_length = client.buffer.size();
+            client.out_sent = 0;
+            client.out_slot = -1;
+            return client.buffer.data() + sizeof(stream_message_t);
+        };
+
+        if (!client.hello_sent) {
+            memcpy(header(stream_message_t::hello, sizeof(_hello), 1, 0, trace::now_ns()), &_hello, sizeof(_hello));
+            client.hello_sent = true;
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(_lock);
+
+        if ((client.request.flags & stream_request_t::imu) && _imu_head > client.imu_cursor) {
+            uint64_t dropped = 0;
+            if (_imu_head - client.imu_cursor > _imu.size()) {
+                dropped = _imu_head - _imu.size() - client.imu_cursor;
+                client.imu_cursor = _imu_head - _imu.size();
+            }
+
+            auto count = static_cast<uint32_t>(std::min<uint64_t>(_imu_head - client.imu_cursor, imu_batch));
+            auto first = _imu[client.imu_cursor % _imu.size()];
+            auto out = reinterpret_cast<imu_sample_t*>(
+                header(stream_message_t::imu, count * sizeof(imu_sample_t), count, client.imu_cursor, first.timestamp_ns));
+            for (uint32_t i = 0; i < count; i++)
+                out[i] = _imu[(client.imu_cursor + i) % _imu.size()];
+            client.imu_cursor += count;
+            lock.unlock();
+
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats.imu_sent += count;
+            _stats.imu_dropped += dropped;
+            return true;
+        }
+
+        if (!(client.request.flags & stream_request_t::frames) || _latest < 0 || _frame_index <= client.last_frame)
+            return false;
+
+        // paced on capture time, with an eighth of the interval spare so
+        // a client limited to the capture rate, or a fraction of it,
+        // doesn't lose frames to jitter; the next frame that arrives late
+        // enough goes out
+        auto slot = _latest;
+        auto index = _frame_index;
+        auto message = reinterpret_cast<const stream_message_t*>(_slots[slot].data);
+        if (client.min_interval_ns != 0
+        &&  client.last_frame != 0
+        &&  message->timestamp_ns - client.last_frame_ns < client.min_interval_ns - client.min_interval_ns / 8)
+            return false;
+
+        _slots[slot].pins++;
+        lock.unlock();
+
+        auto skipped = client.last_frame != 0 ? index - client.last_frame - 1 : 0;
+        client.last_frame = index;
+        client.last_frame_ns = message->timestamp_ns;
+
+        client.out = _slots[slot].data;
+        client.out_length = sizeof(stream_message_t) + message->length;
+        client.out_sent = 0;
+        client.out_slot = slot;
+
+        std::lock_guard<std::mutex> guard(_stats_lock);
+        _stats.frames_skipped += skipped;
+        return true;
+    }
+
+    void stream_server::finish_message(client_t& client) {
+        if (client.out_slot >= 0) {
+            unpin(client.out_slot);
+            client.out_slot = -1;
+        }
+        if (client.out != client.buffer.data()) {
+            std::lock_guard<std::mutex> guard(_stats_lock);
+            _stats.frames_sent++;
+        }
+        client.out = nullptr;
+        client.out_length = 0;
+        client.out_sent = 0;
+        client.out_zerocopy = false;
+    }
+
+    void stream_server::drop_client(client_t& client) {
+        if (client.fd < 0)
+            return;
+
+        ::close(client.fd);
+        client.fd = -1;
+
+        if (client.out_slot >= 0)
+            unpin(client.out_slot);
+        client.out_slot = -1;
+        for (const auto& pending : client.in_flight)
+            unpin(pending.second);
+        client.in_flight.clear();
+
+        std::lock_guard<std::mutex> guard(_stats_lock);
+        _stats.clients--;
+    }
+
+    void stream_server::unpin(int32_t slot) {
+        if (slot < 0)
+            return;
+        std::lock_guard<std::mutex> guard(_lock);
+        _slots[slot].pins--;
+    }
+
+    void stream_server::watch_writable(client_t& client, bool writable) {
+        struct epoll_event event {};
+        event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.fd = client.fd;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+    }
+
+    stream_client::~stream_client() {
+        close();
+    }
+
+    bool stream_client::open(
+            sevun::result& result,
+            const std::string& address,
+            uint32_t flags,
+            uint32_t max_fps) {
+        close();
+
+        stream_address_t target {};
+        if (!parse_address(address, false, target)) {
+            result.add_message(codes::stream_address_invalid, address);
+            return false;
+        }
+
+        // a small receive window keeps a slow reader's backlog on the
+        // server, where it turns into skipped frames rather than latency
+        _fd = socket(target.tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_fd >= 0 && target.tcp) {
+            int rcvbuf = 256 * 1024;
+            setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        if (_fd < 0 || connect(_fd, reinterpret_cast<struct sockaddr*>(&target.addr), target.length) < 0) {
+            result.add_message(codes::stream_connect_failed, address, os_error {errno});
+            close();
+            return false;
+        }
+
+        stream_request_t request {};
+        request.magic = stream_request_t::magic_value;
+        request.flags = flags;
+        request.max_fps = max_fps;
+        if (send(_fd, &request, sizeof(request), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(request))) {
+            result.add_message(codes::stream_connect_failed, address, os_error {errno});
+            close();
+            return false;
+        }
+
+        stream_message_t message {};
+        std::vector<uint8_t> payload;
+        if (!read(message, payload) || message.type != stream_message_t::hello || payload.size() != sizeof(_hello)) {
+            result.add_message(codes::stream_bad_reply, address);
+            close();
+            return false;
+        }
+        memcpy(&_hello, payload.data(), sizeof(_hello));
+        return true;
+    }
+
+    void stream_client::close() {
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    bool stream_client::read(stream_message_t& message, std::vector<uint8_t>& payload) {
+        if (!read_exactly(&message, sizeof(message)) || message.magic != stream_message_t::magic_value)
+            return false;
+        payload.resize(message.length);
+        return read_exactly(payload.data(), payload.size());
+    }
+
+    bool stream_client::read_exactly(void* data, size_t length) {
+        auto p = static_cast<uint8_t*>(data);
+        while (length > 0) {
+            auto n = recv(_fd, p, length, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+};
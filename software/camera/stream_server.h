@@ -0,0 +1,262 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include "result.h"
+#include "metrics.h"
+#include "imu.h"
+
+namespace sevun {
+
+    // every message on a stream socket: this header, then length bytes
+    struct stream_message_t {
+        static constexpr uint32_t magic_value = 0x53565331;   // 'SVS1'
+
+        enum type_t : uint16_t {
+            hello = 1,                      // a stream_hello_t, once, first
+            frame = 2,                      // the frame as captured
+            imu = 3                         // count imu_sample_t
+        };
+
+        uint32_t magic;
+        uint16_t type;
+        uint16_t reserved;
+        uint32_t length;
+        uint32_t count;
+        uint64_t index;                     // frame number, or the first sample's
+        uint64_t timestamp_ns;              // capture time; CLOCK_MONOTONIC
+    };
+
+    struct stream_hello_t {
+        uint32_t width;
+        uint32_t height;
+        uint32_t pixelformat;
+        uint32_t bytesperline;
+        imu_scale_t imu_scale;
+    };
+
+    // the first thing a client sends; nothing is sent back until it has
+    struct stream_request_t {
+        static constexpr uint32_t magic_value = 0x53565231;   // 'SVR1'
+        static constexpr uint32_t frames = 1;
+        static constexpr uint32_t imu = 2;
+
+        uint32_t magic;
+        uint32_t flags;
+        uint32_t max_fps;                   // 0: as fast as the server allows
+        uint32_t reserved;
+    };
+
+    struct stream_config_t {
+        std::string address;                // unix:path, /path, or host:port for TCP
+        uint32_t max_clients = 4;
+        uint32_t slots = 0;                 // frame buffers, 0: two more than max_clients
+        uint32_t max_fps = 0;               // per client, 0 for no limit
+        uint32_t imu_samples = 4096;        // kept for clients that fall behind
+        uint32_t zerocopy_min = 16384;      // smaller messages are copied into the socket
+    };
+
+    struct stream_stats_t {
+        uint64_t frames;                    // pushed by the capture thread
+        uint64_t frames_dropped;            // no slot free, so clients kept the previous one
+        uint64_t frames_sent;
+        uint64_t frames_skipped;            // newer ones went instead: rate limit or backpressure
+        uint64_t imu_samples;
+        uint64_t imu_sent;
+        uint64_t imu_dropped;               // overwritten before a slow client got to them
+        uint64_t bytes_sent;
+        uint64_t zerocopy_sends;
+        uint64_t zerocopy_copied;           // completions where the kernel copied anyway
+        uint64_t connections;
+        uint64_t rejected;                  // over max_clients
+        uint32_t clients;
+        histogram_t push_time;              // capture thread cost per frame
+    };
+
+    // serves frames and IMU samples to local or LAN clients over a unix or
+    // TCP socket.  push_frame() copies the frame once into a free slot,
+    // header first, and returns; the capture buffer goes back to the driver
+    // as usual.  a server thread then sends the newest frame to each client
+    // straight from the slot, with MSG_ZEROCOPY where the socket takes it,
+    // and a slot is only reused once the kernel says it is done with it.
+    // each client gets at most max_fps and never more than one frame in
+    // flight: while its socket is full, frames arriving meanwhile are
+    // skipped and it resumes with the latest.  IMU samples are kept in a
+    // ring and each client reads its own way through it.
+    class stream_server {
+    public:
+        stream_server() = default;
+
+        virtual ~stream_server();
+
+        stream_server(const stream_server&) = delete;
+
+        stream_server& operator=(const stream_server&) = delete;
+
+        bool open(
+            sevun::result& result,
+            const stream_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage,
+            const imu_scale_t& imu_scale);
+
+        // capture thread only.  disconnects every client, so each one
+        // reconnects to a hello with the new format, and keeps listening;
+        // false leaves the server closed.
+        bool set_format(
+            sevun::result& result,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline,
+            uint32_t sizeimage);
+
+        // disconnects every client
+        void close();
+
+        inline bool enabled() const {
+            return _server.joinable();
+        }
+
+        // capture thread only.  never waits on a client.
+        void push_frame(const uint8_t* data, size_t length, uint64_t timestamp_ns);
+
+        // one producer thread
+        void push_imu(const imu_sample_t* samples, size_t count);
+
+        stream_stats_t stats() const;
+
+    private:
+        struct slot_t {
+            uint8_t* data;                  // stream_message_t, then the frame
+            uint32_t pins;                  // clients sending it, or the kernel still holding it
+            bool writing;
+        };
+
+        struct client_t {
+            int fd;
+            bool zerocopy;
+            bool requested;
+            stream_request_t request;
+            size_t request_bytes;
+            uint64_t min_interval_ns;
+
+            // the message being sent
+            const uint8_t* out;
+            size_t out_length;
+            size_t out_sent;
+            int32_t out_slot;               // -1 unless it is a frame
+            bool out_zerocopy;              // some of it went with MSG_ZEROCOPY
+            bool blocked;                   // waiting for EPOLLOUT
+            std::vector<uint8_t> buffer;    // hello and imu messages
+
+            bool hello_sent;
+            uint64_t last_frame;            // index + 1 of the last one sent, 0 for none
+            uint64_t last_frame_ns;         // its capture time
+            uint64_t imu_cursor;
+
+            // zerocopy sends so far, and the slots waiting on their completions
+            uint32_t zerocopy_calls;
+            std::deque<std::pair<uint32_t, int32_t>> in_flight;
+        };
+
+        void serve();
+
+        void accept_clients();
+
+        bool read_request(client_t& client);
+
+        void read_completions(client_t& client);
+
+        bool pump(client_t& client);
+
+        bool next_message(client_t& client);
+
+        void finish_message(client_t& client);
+
+        void drop_client(client_t& client);
+
+        void unpin(int32_t slot);
+
+        void watch_writable(client_t& client, bool writable);
+
+        bool map_slots(uint32_t sizeimage, size_t slots);
+
+        void stop_serving();
+
+    private:
+        stream_config_t _config;
+        stream_hello_t _hello {};
+        bool _tcp = false;
+        int _listen_fd = -1;
+        int _epoll_fd = -1;
+        int _wake_fd = -1;
+        std::string _socket_path;           // unix only, removed on close
+        std::atomic<bool> _stopping {false};
+
+        // frames: _lock guards the slots and the latest frame
+        uint8_t* _arena = nullptr;
+        size_t _arena_bytes = 0;
+        size_t _slot_bytes = 0;
+        uint32_t _frame_bytes = 0;
+        mutable std::mutex _lock;
+        std::vector<slot_t> _slots;
+        int32_t _latest = -1;
+        uint64_t _frame_index = 0;          // frames published
+
+        // imu samples, also under _lock
+        std::vector<imu_sample_t> _imu;
+        uint64_t _imu_head = 0;             // samples pushed
+
+        // server thread
+        std::vector<client_t> _clients;
+        std::thread _server;
+
+        mutable std::mutex _stats_lock;
+        stream_stats_t _stats {};
+    };
+
+    // the other end, for tools and tests
+    class stream_client {
+    public:
+        stream_client() = default;
+
+        virtual ~stream_client();
+
+        stream_client(const stream_client&) = delete;
+
+        stream_client& operator=(const stream_client&) = delete;
+
+        // connects, sends the request and waits for the hello
+        bool open(
+            sevun::result& result,
+            const std::string& address,
+            uint32_t flags,
+            uint32_t max_fps);
+
+        void close();
+
+        inline const stream_hello_t& hello() const {
+            return _hello;
+        }
+
+        // blocks for the next message; false once the server has gone
+        bool read(stream_message_t& message, std::vector<uint8_t>& payload);
+
+    private:
+        bool read_exactly(void* data, size_t length);
+
+    private:
+        int _fd = -1;
+        stream_hello_t _hello {};
+    };
+
+};
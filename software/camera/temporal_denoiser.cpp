@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <linux/videodev2.h>
+#include "temporal_denoiser.h"
+#include "hex_formatter.h"
+#include "trace.h"
+
+namespace sevun {
+
+    static constexpr uint32_t chunk = 16;
+
+    bool temporal_denoiser::open(
+            sevun::result& result,
+            const denoise_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline) {
+        close();
+
+        switch (pixelformat) {
+            case V4L2_PIX_FMT_GREY:
+                _wide = false;
+                break;
+            case V4L2_PIX_FMT_Y10:
+                _wide = true;
+                break;
+            default:
+                result.add_message(codes::denoise_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+                return false;
+        }
+
+        _config = config;
+        _width = width;
+        _height = height;
+        _bytesperline = bytesperline != 0 ? bytesperline : width * (_wide ? 2 : 1);
+
+        // reference units: Q4 samples, and a 10-bit sample is four 8-bit levels
+        auto unit = _wide ? 64 : 16;
+        _floor = 256 - static_cast<int32_t>(std::min(_config.strength, 255u));
+        _still = static_cast<int32_t>(_config.still_threshold) * unit;
+        _motion = std::max(static_cast<int32_t>(_config.motion_threshold) * unit, _still + 1);
+        _slope = ((256 - _floor) << 16) / (_motion - _still);
+
+        _reference.assign(static_cast<size_t>(width) * height, 0);
+        _primed = false;
+        _stats = denoise_stats_t {};
+        _stats.reference_bytes = _reference.size() * sizeof(uint16_t);
+        return true;
+    }
+
+    void temporal_denoiser::close() {
+        _reference.clear();
+        _reference.shrink_to_fit();
+        _primed = false;
+    }
+
+    void temporal_denoiser::apply(uint8_t* frame, size_t length) {
+        if (!enabled())
+            return;
+
+        SEVUN_TRACE_SCOPE(denoise);
+        auto started_ns = trace::now_ns();
+
+        auto rows = std::min<size_t>(_height, length / _bytesperline);
+        for (size_t y = 0; y < rows; y++) {
+            auto row = frame + y * _bytesperline;
+            auto reference = _reference.data() + y * _width;
+            if (_wide) {
+                auto samples = reinterpret_cast<uint16_t*>(row);
+                if (_primed)
+                    filter_row(samples, reference);
+                else
+                    prime_row(samples, reference);
+            } else {
+                if (_primed)
+                    filter_row(row, reference);
+                else
+                    prime_row(row, reference);
+            }
+        }
+        _primed = true;
+
+        _stats.frames++;
+        _stats.filter_time.add(trace::now_ns() - started_ns);
+    }
+
+    template <typename sample_t>
+    void temporal_denoiser::prime_row(const sample_t* row, uint16_t* reference) {
+        for (uint32_t x = 0; x < _width; x++)
+            reference[x] = static_cast<uint16_t>(row[x] << 4);
+    }
+
+    template <typename sample_t>
+    void temporal_denoiser::filter_row(sample_t* row, uint16_t* reference) {
+        auto chunks = _width / chunk;
+        filter_chunks(row, reference, chunks);
+
+        // the last few pixels go through a padded chunk of their own
+        auto done = chunks * chunk;
+        if (done == _width)
+            return;
+
+        sample_t samples[chunk] {};
+        uint16_t history[chunk] {};
+        std::copy(row + done, row + _width, samples);
+        std::copy(reference + done, reference + _width, history);
+        filter_chunks(samples, history, 1);
+        std::copy(samples, samples + (_width - done), row + done);
+        std::copy(history, history + (_width - done), reference + done);
+    }
+
+    // row and reference never overlap and the loop runs a whole number of
+    // chunks, which is what the compiler needs to turn it into NEON/SSE
+    // at -O2
+    template <typename sample_t>
+    void temporal_denoiser::filter_chunks(
+            sample_t* __restrict row,
+            uint16_t* __restrict reference,
+            uint32_t chunks) const {
+        const auto floor = _floor;
+        const auto still = _still;
+        const auto span = _motion - _still;
+        const auto slope = _slope;
+        const sample_t top = _wide ? 1023 : 255;
+
+        for (uint32_t x = 0; x < chunks * chunk; x++) {
+            auto current = static_cast<int32_t>(std::min(row[x], top)) << 4;
+            auto previous = static_cast<int32_t>(reference[x]);
+            auto difference = current - previous;
+            auto magnitude = difference < 0 ? -difference : difference;
+            auto excess = std::min(std::max(magnitude - still, 0), span);
+            auto weight = floor + ((excess * slope) >> 16);
+            auto blended = previous + ((difference * weight + 128) >> 8);
+            reference[x] = static_cast<uint16_t>(blended);
+            row[x] = static_cast<sample_t>((blended + 8) >> 4);
+        }
+    }
+
+};
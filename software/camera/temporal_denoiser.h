@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "result.h"
+#include "metrics.h"
+
+namespace sevun {
+
+    // thresholds are in 8-bit levels; 10-bit frames scale them up
+    struct denoise_config_t {
+        uint32_t strength = 192;            // Q8 weight of the history on still pixels, 0..255
+        uint32_t still_threshold = 4;       // differences up to this are treated as noise
+        uint32_t motion_threshold = 20;     // differences from this take the new pixel as it is
+    };
+
+    struct denoise_stats_t {
+        uint64_t frames;
+        uint64_t reference_bytes;
+        histogram_t filter_time;
+    };
+
+    // recursive temporal filter for noisy mono IR frames.  every pixel is
+    // blended into a single reference frame, weighted per pixel by how far
+    // it moved from the reference: noise-sized differences are averaged
+    // away, anything larger passes through, so a moving pupil edge doesn't
+    // smear.  the frame is overwritten with the result.  the reference
+    // keeps four fractional bits, so slow drifts converge instead of
+    // sticking a level short.  GREY and Y10.
+    class temporal_denoiser {
+    public:
+        temporal_denoiser() = default;
+
+        virtual ~temporal_denoiser() = default;
+
+        temporal_denoiser(const temporal_denoiser&) = delete;
+
+        temporal_denoiser& operator=(const temporal_denoiser&) = delete;
+
+        bool open(
+            sevun::result& result,
+            const denoise_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline);
+
+        void close();
+
+        inline bool enabled() const {
+            return !_reference.empty();
+        }
+
+        // the next frame starts the history again
+        inline void reset() {
+            _primed = false;
+        }
+
+        // in place; a short frame only filters the rows it has
+        void apply(uint8_t* frame, size_t length);
+
+        inline denoise_stats_t stats() const {
+            return _stats;
+        }
+
+    private:
+        template <typename sample_t>
+        void filter_row(sample_t* row, uint16_t* reference);
+
+        template <typename sample_t>
+        void filter_chunks(sample_t* __restrict row, uint16_t* __restrict reference, uint32_t chunks) const;
+
+        template <typename sample_t>
+        void prime_row(const sample_t* row, uint16_t* reference);
+
+    private:
+        denoise_config_t _config;
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _bytesperline = 0;
+        bool _wide = false;                 // 16-bit samples
+
+        // per-pixel weight of the new sample, Q8: _floor up to 256 as the
+        // difference goes from _still to _motion, in reference units
+        int32_t _floor = 64;
+        int32_t _still = 0;
+        int32_t _motion = 0;
+        int32_t _slope = 0;                 // Q16 weight per reference unit
+
+        std::vector<uint16_t> _reference;   // Q4, _width per row
+        bool _primed = false;
+
+        denoise_stats_t _stats {};
+    };
+
+};
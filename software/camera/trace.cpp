@@ -0,0 +1,109 @@
+#include <mutex>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <fmt/format.h>
+#include "trace.h"
+
+namespace sevun {
+
+    namespace trace {
+
+        static const char* s_event_names[] = {
+#define SEVUN_TRACE_NAME(id, name) name,
+            SEVUN_TRACE_EVENTS(SEVUN_TRACE_NAME)
+#undef SEVUN_TRACE_NAME
+        };
+
+        static std::mutex s_registry_lock;
+        static std::atomic<thread_buffer*> s_buffers {nullptr};
+
+        const char* event_name(events event) {
+            auto index = static_cast<size_t>(event);
+            if (index >= static_cast<size_t>(events::count))
+                return "unknown";
+            return s_event_names[index];
+        }
+
+        thread_buffer::thread_buffer(int tid) : _tid(tid) {
+        }
+
+        thread_buffer& local_buffer() {
+            // buffers are intentionally never freed so the exporter can still
+            // read records left behind by threads that have exited.
+            static thread_local thread_buffer* buffer = nullptr;
+            if (buffer == nullptr) {
+                buffer = new thread_buffer(static_cast<int>(syscall(SYS_gettid)));
+                std::lock_guard<std::mutex> guard(s_registry_lock);
+                buffer->_next = s_buffers.load(std::memory_order_relaxed);
+                s_buffers.store(buffer, std::memory_order_release);
+            }
+            return *buffer;
+        }
+
+        bool export_chrome_json(const std::string& path) {
+            auto file = fopen(path.c_str(), "w");
+            if (file == nullptr)
+                return false;
+
+            auto pid = getpid();
+            bool first = true;
+
+            fmt::print(file, "{{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+            for (auto buffer = s_buffers.load(std::memory_order_acquire);
+                 buffer != nullptr;
+                 buffer = buffer->next()) {
+                auto head = buffer->head();
+                auto tail = head > thread_buffer::capacity ? head - thread_buffer::capacity : 0;
+
+                for (auto i = tail; i < head; i++) {
+                    const auto& r = buffer->at(i);
+                    auto name = event_name(static_cast<events>(r.event));
+                    auto ts_us = r.ts_ns / 1000.0;
+
+                    fmt::print(file, "{}", first ? "" : ",\n");
+                    first = false;
+
+                    switch (static_cast<phases>(r.phase)) {
+                        case phases::complete:
+                            fmt::print(
+                                file,
+                                "{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+                                name,
+                                ts_us,
+                                r.value / 1000.0,
+                                pid,
+                                buffer->tid());
+                            break;
+                        case phases::counter:
+                            fmt::print(
+                                file,
+                                "{{\"name\":\"{}\",\"ph\":\"C\",\"ts\":{:.3f},\"pid\":{},\"tid\":{},\"args\":{{\"value\":{}}}}}",
+                                name,
+                                ts_us,
+                                pid,
+                                buffer->tid(),
+                                r.value);
+                            break;
+                        default:
+                            fmt::print(
+                                file,
+                                "{{\"name\":\"{}\",\"ph\":\"i\",\"s\":\"t\",\"ts\":{:.3f},\"pid\":{},\"tid\":{},\"args\":{{\"value\":{}}}}}",
+                                name,
+                                ts_us,
+                                pid,
+                                buffer->tid(),
+                                r.value);
+                            break;
+                    }
+                }
+            }
+            fmt::print(file, "\n]}}\n");
+
+            fclose(file);
+            return true;
+        }
+
+    };
+
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <ctime>
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+// every trace point is listed here so ids are fixed at compile time and a
+// record is just an integer; the exporter maps them back to names.
+#define SEVUN_TRACE_EVENTS(X) \
+    X(dequeue,   "dequeue")   \
+    X(callback,  "callback")  \
+    X(requeue,   "requeue")   \
+    X(convert,   "convert")   \
+    X(write,     "write")     \
+    X(frame,     "frame")     \
+    X(fps,       "fps")       \
+    X(imu,       "imu")       \
+    X(impact,    "impact")    \
+    X(governor,  "governor")  \
+    X(encode,    "encode")    \
+    X(jpeg_bytes, "jpeg_bytes") \
+    X(motion,    "motion")    \
+    X(undistort, "undistort") \
+    X(denoise,   "denoise")   \
+    X(recover,   "recover")   \
+    X(stream,    "stream")
+
+namespace sevun {
+
+    namespace trace {
+
+        enum class events : uint16_t {
+#define SEVUN_TRACE_ENUM(id, name) id,
+            SEVUN_TRACE_EVENTS(SEVUN_TRACE_ENUM)
+#undef SEVUN_TRACE_ENUM
+            count
+        };
+
+        enum class phases : uint8_t {
+            complete,
+            instant,
+            counter
+        };
+
+        struct record_t {
+            uint64_t ts_ns;
+            uint64_t value;
+            uint16_t event;
+            uint8_t phase;
+        };
+
+        const char* event_name(events event);
+
+        inline uint64_t now_ns() {
+            struct timespec ts {};
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+        }
+
+        // single-producer ring owned by one thread.  the owner publishes with
+        // a release store on _head; readers only ever look at a snapshot.
+        class thread_buffer {
+        public:
+            static constexpr size_t capacity = 1u << 14;
+
+            explicit thread_buffer(int tid);
+
+            inline void push(
+                    events event,
+                    phases phase,
+                    uint64_t ts_ns,
+                    uint64_t value) {
+                auto head = _head.load(std::memory_order_relaxed);
+                auto& r = _records[head & (capacity - 1)];
+                r.ts_ns = ts_ns;
+                r.value = value;
+                r.event = static_cast<uint16_t>(event);
+                r.phase = static_cast<uint8_t>(phase);
+                _head.store(head + 1, std::memory_order_release);
+            }
+
+            inline int tid() const {
+                return _tid;
+            }
+
+            inline uint64_t head() const {
+                return _head.load(std::memory_order_acquire);
+            }
+
+            inline const record_t& at(uint64_t index) const {
+                return _records[index & (capacity - 1)];
+            }
+
+            inline thread_buffer* next() const {
+                return _next;
+            }
+
+        private:
+            friend thread_buffer& local_buffer();
+
+            int _tid;
+            std::atomic<uint64_t> _head {0};
+            thread_buffer* _next = nullptr;
+            record_t _records[capacity];
+        };
+
+        // registers the calling thread's buffer on first use.  the only lock
+        // is taken here, once per thread.
+        thread_buffer& local_buffer();
+
+        inline void instant(events event, uint64_t value = 0) {
+            local_buffer().push(event, phases::instant, now_ns(), value);
+        }
+
+        inline void counter(events event, uint64_t value) {
+            local_buffer().push(event, phases::counter, now_ns(), value);
+        }
+
+        class scope {
+        public:
+            explicit scope(events event) : _event(event),
+                                           _start(now_ns()) {
+            }
+
+            ~scope() {
+                local_buffer().push(_event, phases::complete, _start, now_ns() - _start);
+            }
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+        private:
+            events _event;
+            uint64_t _start;
+        };
+
+        // writes every thread's retained records as Chrome trace event JSON,
+        // loadable in chrome://tracing and ui.perfetto.dev.  intended to run
+        // after capture has stopped; records written concurrently may be torn.
+        bool export_chrome_json(const std::string& path);
+
+    };
+
+};
+
+#ifdef SEVUN_TRACE
+#define SEVUN_TRACE_CONCAT_(a, b) a##b
+#define SEVUN_TRACE_CONCAT(a, b) SEVUN_TRACE_CONCAT_(a, b)
+#define SEVUN_TRACE_SCOPE(id) \
+    sevun::trace::scope SEVUN_TRACE_CONCAT(_trace_scope_, __LINE__)(sevun::trace::events::id)
+#define SEVUN_TRACE_INSTANT(id, value) sevun::trace::instant(sevun::trace::events::id, (value))
+#define SEVUN_TRACE_COUNTER(id, value) sevun::trace::counter(sevun::trace::events::id, (value))
+#else
+#define SEVUN_TRACE_SCOPE(id) do {} while (0)
+#define SEVUN_TRACE_INSTANT(id, value) do {} while (0)
+#define SEVUN_TRACE_COUNTER(id, value) do {} while (0)
+#endif
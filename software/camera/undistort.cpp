@@ -0,0 +1,316 @@
+#include <cmath>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <linux/videodev2.h>
+#include "undistort.h"
+#include "hex_formatter.h"
+#include "trace.h"
+
+namespace sevun {
+
+    bool load_lens_calibration(
+            sevun::result& result,
+            const std::string& path,
+            lens_calibration_t& calibration) {
+        std::ifstream file(path);
+        if (!file) {
+            result.add_message(codes::lens_calibration_failed, path, os_error {errno});
+            return false;
+        }
+
+        std::vector<double> values;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            double value;
+            while (fields >> value)
+                values.push_back(value);
+            if (!fields.eof()) {
+                result.add_message(codes::lens_calibration_bad_file, path);
+                return false;
+            }
+        }
+
+        if (values.size() != 11 || values[0] < 1.0 || values[1] < 1.0 || values[2] <= 0.0 || values[3] <= 0.0) {
+            result.add_message(codes::lens_calibration_bad_file, path);
+            return false;
+        }
+
+        calibration.width = static_cast<uint32_t>(values[0]);
+        calibration.height = static_cast<uint32_t>(values[1]);
+        calibration.fx = values[2];
+        calibration.fy = values[3];
+        calibration.cx = values[4];
+        calibration.cy = values[5];
+        calibration.k1 = values[6];
+        calibration.k2 = values[7];
+        calibration.p1 = values[8];
+        calibration.p2 = values[9];
+        calibration.k3 = values[10];
+        return true;
+    }
+
+    bool undistorter::configure(
+            sevun::result& result,
+            const lens_calibration_t& calibration,
+            const undistort_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline) {
+        _table.clear();
+        _chroma.clear();
+        _config = config;
+
+        switch (pixelformat) {
+            case V4L2_PIX_FMT_GREY:
+                _step = 1;
+                break;
+            case V4L2_PIX_FMT_Y10:
+            case V4L2_PIX_FMT_Y16:
+            case V4L2_PIX_FMT_YUYV:
+                _step = 2;
+                break;
+            default:
+                result.add_message(codes::undistort_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+                return false;
+        }
+        if (width < 2 || height < 2) {
+            result.add_message(codes::undistort_format_unsupported, hex_formatter::fourcc_string(pixelformat));
+            return false;
+        }
+
+        _width = width;
+        _height = height;
+        _bytesperline = bytesperline;
+        _pixelformat = pixelformat;
+
+        // the same lens at another resolution: scale about pixel centres
+        _lens = calibration;
+        auto sx = calibration.width > 0 ? static_cast<double>(width) / calibration.width : 1.0;
+        auto sy = calibration.height > 0 ? static_cast<double>(height) / calibration.height : 1.0;
+        _lens.width = width;
+        _lens.height = height;
+        _lens.fx *= sx;
+        _lens.fy *= sy;
+        _lens.cx = (calibration.cx + 0.5) * sx - 0.5;
+        _lens.cy = (calibration.cy + 0.5) * sy - 0.5;
+
+        _config.tile_width = std::max(_config.tile_width, 8u);
+        _config.tile_height = std::max(_config.tile_height, 1u);
+        _tiles_x = (width + _config.tile_width - 1) / _config.tile_width;
+        _tiles_y = (height + _config.tile_height - 1) / _config.tile_height;
+
+        auto pixels = static_cast<size_t>(width) * height;
+        _table.resize(pixels);
+        auto yuyv = pixelformat == V4L2_PIX_FMT_YUYV;
+        if (yuyv)
+            _chroma.resize(pixels);
+
+        // forward model: where in the distorted frame each output pixel's
+        // ray lands
+        size_t index = 0;
+        for (uint32_t ty = 0; ty < _tiles_y; ty++) {
+            auto y0 = ty * _config.tile_height;
+            auto y1 = std::min(y0 + _config.tile_height, height);
+            for (uint32_t tx = 0; tx < _tiles_x; tx++) {
+                auto x0 = tx * _config.tile_width;
+                auto x1 = std::min(x0 + _config.tile_width, width);
+                for (auto v = y0; v < y1; v++) {
+                    for (auto u = x0; u < x1; u++, index++) {
+                        auto x = (u - _lens.cx) / _lens.fx;
+                        auto y = (v - _lens.cy) / _lens.fy;
+                        auto r2 = x * x + y * y;
+                        auto radial = 1.0 + r2 * (_lens.k1 + r2 * (_lens.k2 + r2 * _lens.k3));
+                        auto xd = x * radial + 2.0 * _lens.p1 * x * y + _lens.p2 * (r2 + 2.0 * x * x);
+                        auto yd = y * radial + _lens.p1 * (r2 + 2.0 * y * y) + 2.0 * _lens.p2 * x * y;
+                        auto src_x = _lens.fx * xd + _lens.cx;
+                        auto src_y = _lens.fy * yd + _lens.cy;
+
+                        auto& entry = _table[index];
+                        if (!(src_x >= 0.0 && src_y >= 0.0 && src_x <= width - 1.0 && src_y <= height - 1.0)) {
+                            entry = entry_t {invalid_offset, 0, 0};
+                            if (yuyv)
+                                _chroma[index] = invalid_offset;
+                            continue;
+                        }
+
+                        auto ix = std::min(static_cast<uint32_t>(src_x), width - 2);
+                        auto iy = std::min(static_cast<uint32_t>(src_y), height - 2);
+                        entry.offset = iy * bytesperline + ix * _step;
+                        entry.fx = static_cast<uint16_t>(std::lround((src_x - ix) * 256.0));
+                        entry.fy = static_cast<uint16_t>(std::lround((src_y - iy) * 256.0));
+
+                        // chroma from the nearest source pair: U for even
+                        // output pixels, V for odd
+                        if (yuyv) {
+                            auto nx = static_cast<uint32_t>(std::lround(src_x));
+                            auto ny = static_cast<uint32_t>(std::lround(src_y));
+                            _chroma[index] = ny * bytesperline + 4 * (nx / 2) + (u & 1 ? 3 : 1);
+                        }
+                    }
+                }
+            }
+        }
+
+        _stats = undistort_stats_t {};
+        _stats.table_bytes = _table.size() * sizeof(entry_t) + _chroma.size() * sizeof(uint32_t);
+
+        _pool.start(_config.threads);
+        return true;
+    }
+
+    void undistorter::remap(const uint8_t* frame, size_t length, uint8_t* out) {
+        remap(frame, length, out, roi_t {0, 0, _width, _height});
+    }
+
+    void undistorter::remap(const uint8_t* frame, size_t length, uint8_t* out, const roi_t& roi) {
+        // the table was checked against a full frame
+        if (!enabled() || length < static_cast<size_t>(_bytesperline) * _height)
+            return;
+
+        auto x1 = std::min(roi.x + roi.width, _width);
+        auto y1 = std::min(roi.y + roi.height, _height);
+        if (roi.x >= x1 || roi.y >= y1)
+            return;
+
+        SEVUN_TRACE_SCOPE(undistort);
+        auto started_ns = trace::now_ns();
+
+        _frame = frame;
+        _out = out;
+        _roi = roi_t {roi.x, roi.y, x1 - roi.x, y1 - roi.y};
+        _first_tile_x = roi.x / _config.tile_width;
+        _first_tile_y = roi.y / _config.tile_height;
+        _roi_tiles_x = (x1 - 1) / _config.tile_width - _first_tile_x + 1;
+        auto roi_tiles_y = (y1 - 1) / _config.tile_height - _first_tile_y + 1;
+
+        _pool.run(_roi_tiles_x * roi_tiles_y, [this](uint32_t tile) {
+            remap_tile(tile);
+        });
+
+        _stats.frames++;
+        _stats.pixels += static_cast<uint64_t>(_roi.width) * _roi.height;
+        _stats.remap_time.add(trace::now_ns() - started_ns);
+    }
+
+    void undistorter::remap_tile(uint32_t tile) {
+        auto tx = _first_tile_x + tile % _roi_tiles_x;
+        auto ty = _first_tile_y + tile / _roi_tiles_x;
+
+        auto tile_x0 = tx * _config.tile_width;
+        auto tile_y0 = ty * _config.tile_height;
+        auto tile_w = std::min(_config.tile_width, _width - tile_x0);
+        auto tile_h = std::min(_config.tile_height, _height - tile_y0);
+
+        // every tile row before this one is full width; within the row,
+        // every tile before this one is tile_width wide
+        auto base = static_cast<size_t>(tile_y0) * _width + static_cast<size_t>(tile_x0) * tile_h;
+
+        auto x0 = std::max(tile_x0, _roi.x);
+        auto x1 = std::min(tile_x0 + tile_w, _roi.x + _roi.width);
+        auto y0 = std::max(tile_y0, _roi.y);
+        auto y1 = std::min(tile_y0 + tile_h, _roi.y + _roi.height);
+
+        for (auto y = y0; y < y1; y++) {
+            auto first = base + static_cast<size_t>(y - tile_y0) * tile_w + (x0 - tile_x0);
+            auto entries = _table.data() + first;
+            auto row = _out + static_cast<size_t>(y) * _bytesperline;
+            auto count = x1 - x0;
+
+            switch (_pixelformat) {
+                case V4L2_PIX_FMT_GREY:
+                    remap_span<uint8_t>(entries, count, row + x0);
+                    break;
+                case V4L2_PIX_FMT_YUYV: {
+                    remap_span<uint8_t>(entries, count, row + 2 * x0);
+                    auto chroma = _chroma.data() + first;
+                    for (uint32_t i = 0; i < count; i++)
+                        row[2 * (x0 + i) + 1] = chroma[i] != invalid_offset ? _frame[chroma[i]] : 128;
+                    break;
+                }
+                default:
+                    remap_span<uint16_t>(entries, count, reinterpret_cast<uint16_t*>(row) + x0);
+                    break;
+            }
+        }
+    }
+
+    template <typename sample_t>
+    void undistorter::remap_span(const entry_t* entries, uint32_t count, sample_t* out) const {
+        // YUYV luma sits in every other byte, as its taps do
+        const auto stride = _pixelformat == V4L2_PIX_FMT_YUYV ? 2 : 1;
+        const auto below = _bytesperline;
+        const auto right = _step;
+
+        constexpr uint32_t chunk = 8;
+        uint32_t a[chunk];
+        uint32_t b[chunk];
+        uint32_t c[chunk];
+        uint32_t d[chunk];
+        uint32_t wx[chunk];
+        uint32_t wy[chunk];
+        uint32_t value[chunk];
+
+        for (uint32_t i = 0; i < count; i += chunk) {
+            auto n = std::min(chunk, count - i);
+
+            // gather: scattered loads, one pixel at a time
+            for (uint32_t k = 0; k < n; k++) {
+                const auto& e = entries[i + k];
+                if (e.offset == invalid_offset) {
+                    a[k] = b[k] = c[k] = d[k] = 0;
+                    wx[k] = wy[k] = 0;
+                    continue;
+                }
+                auto p = _frame + e.offset;
+                a[k] = *reinterpret_cast<const sample_t*>(p);
+                b[k] = *reinterpret_cast<const sample_t*>(p + right);
+                c[k] = *reinterpret_cast<const sample_t*>(p + below);
+                d[k] = *reinterpret_cast<const sample_t*>(p + below + right);
+                wx[k] = e.fx;
+                wy[k] = e.fy;
+            }
+            for (auto k = n; k < chunk; k++)
+                a[k] = b[k] = c[k] = d[k] = wx[k] = wy[k] = 0;
+
+            // blend: fixed trip count, straight-line arithmetic, so this
+            // is a few NEON/SSE multiplies for all eight.  16-bit samples
+            // peak at 65535 * 2^16 + 2^15, which still fits in 32 bits.
+            for (uint32_t k = 0; k < chunk; k++) {
+                auto top = a[k] * (256 - wx[k]) + b[k] * wx[k];
+                auto bottom = c[k] * (256 - wx[k]) + d[k] * wx[k];
+                value[k] = (top * (256 - wy[k]) + bottom * wy[k] + 32768) >> 16;
+            }
+
+            for (uint32_t k = 0; k < n; k++)
+                out[(i + k) * stride] = static_cast<sample_t>(value[k]);
+        }
+    }
+
+    void undistorter::undistort_points(const float* in, float* out, size_t count) const {
+        // the forward model has no closed-form inverse; a few fixed-point
+        // steps converge well inside a pixel for lenses like these
+        for (size_t i = 0; i < count; i++) {
+            auto xd = (in[2 * i] - _lens.cx) / _lens.fx;
+            auto yd = (in[2 * i + 1] - _lens.cy) / _lens.fy;
+            auto x = xd;
+            auto y = yd;
+            for (int iteration = 0; iteration < 8; iteration++) {
+                auto r2 = x * x + y * y;
+                auto radial = 1.0 + r2 * (_lens.k1 + r2 * (_lens.k2 + r2 * _lens.k3));
+                auto dx = 2.0 * _lens.p1 * x * y + _lens.p2 * (r2 + 2.0 * x * x);
+                auto dy = _lens.p1 * (r2 + 2.0 * y * y) + 2.0 * _lens.p2 * x * y;
+                x = (xd - dx) / radial;
+                y = (yd - dy) / radial;
+            }
+            out[2 * i] = static_cast<float>(_lens.fx * x + _lens.cx);
+            out[2 * i + 1] = static_cast<float>(_lens.fy * y + _lens.cy);
+        }
+    }
+
+};
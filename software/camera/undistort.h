@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "result.h"
+#include "metrics.h"
+#include "work_pool.h"
+
+namespace sevun {
+
+    // pinhole intrinsics and Brown-Conrady distortion in OpenCV's order,
+    // so calibrateCamera output can be used as it is
+    struct lens_calibration_t {
+        uint32_t width;                 // resolution the calibration was made at
+        uint32_t height;
+        double fx;
+        double fy;
+        double cx;
+        double cy;
+        double k1;
+        double k2;
+        double p1;
+        double p2;
+        double k3;
+    };
+
+    // a text file of the eleven values above, in that order, separated by
+    // whitespace; lines starting with # are comments
+    bool load_lens_calibration(
+        sevun::result& result,
+        const std::string& path,
+        lens_calibration_t& calibration);
+
+    struct undistort_config_t {
+        uint32_t threads = 0;           // 0: one per core
+        uint32_t tile_width = 64;       // output pixels; a tile's table, source and
+        uint32_t tile_height = 32;      // output stay within L1 for 8-bit frames
+    };
+
+    // output rectangle, pixels
+    struct roi_t {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct undistort_stats_t {
+        uint64_t frames;
+        uint64_t pixels;
+        uint64_t table_bytes;
+        histogram_t remap_time;
+    };
+
+    // removes lens distortion with a remap table built once per format
+    // and calibration: for every output pixel, the byte offset of the
+    // source pixel above and left of where it came from and 8-bit
+    // bilinear weights.  the table is laid out tile by tile, so each tile
+    // reads its entries in order, and tiles are shared out over a pool.
+    // taps are gathered and then blended eight pixels at a time in plain
+    // loops the compiler vectorizes.  output keeps the camera matrix and
+    // the frame's layout; pixels that map from outside the sensor are 0.
+    // remap() can be limited to a rectangle, and undistort_points()
+    // corrects just a few coordinates without touching the frame.
+    class undistorter {
+    public:
+        undistorter() = default;
+
+        virtual ~undistorter() = default;
+
+        undistorter(const undistorter&) = delete;
+
+        undistorter& operator=(const undistorter&) = delete;
+
+        // builds the table; the calibration is scaled to width x height
+        bool configure(
+            sevun::result& result,
+            const lens_calibration_t& calibration,
+            const undistort_config_t& config,
+            uint32_t width,
+            uint32_t height,
+            uint32_t pixelformat,
+            uint32_t bytesperline);
+
+        inline bool enabled() const {
+            return !_table.empty();
+        }
+
+        // the whole frame, or only roi of it, into out, which has the
+        // source's layout.  one caller at a time.
+        void remap(const uint8_t* frame, size_t length, uint8_t* out);
+
+        void remap(const uint8_t* frame, size_t length, uint8_t* out, const roi_t& roi);
+
+        // distorted pixel coordinates, x y pairs, to where they land in the
+        // remapped frame; in and out may be the same
+        void undistort_points(const float* in, float* out, size_t count) const;
+
+        undistort_stats_t stats() const {
+            return _stats;
+        }
+
+    private:
+        struct entry_t {
+            uint32_t offset;            // source byte offset of the top-left tap; invalid_offset outside
+            uint16_t fx;                // weight of the right-hand taps, 0..256
+            uint16_t fy;                // weight of the lower taps
+        };
+
+        static constexpr uint32_t invalid_offset = 0xffffffffu;
+
+        void remap_tile(uint32_t tile);
+
+        template <typename sample_t>
+        void remap_span(const entry_t* entries, uint32_t count, sample_t* out) const;
+
+    private:
+        undistort_config_t _config;
+        lens_calibration_t _lens {};    // scaled to the frame
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _bytesperline = 0;
+        uint32_t _pixelformat = 0;
+        uint32_t _step = 1;             // bytes between horizontal taps
+        uint32_t _tiles_x = 0;
+        uint32_t _tiles_y = 0;
+
+        std::vector<entry_t> _table;    // tile-major
+        std::vector<uint32_t> _chroma;  // YUYV: offset of each output pixel's U or V, same order
+
+        work_pool _pool;
+
+        // the remap in progress
+        const uint8_t* _frame = nullptr;
+        uint8_t* _out = nullptr;
+        roi_t _roi {};
+        uint32_t _first_tile_x = 0;
+        uint32_t _first_tile_y = 0;
+        uint32_t _roi_tiles_x = 0;
+
+        undistort_stats_t _stats {};
+    };
+
+};
@@ -0,0 +1,36 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include "unix_socket.h"
+
+namespace sevun {
+
+    int claim_socket_path(const std::string& path) {
+        struct sockaddr_un sa {};
+        sa.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(sa.sun_path))
+            return ENAMETOOLONG;
+        memcpy(sa.sun_path, path.c_str(), path.size() + 1);
+
+        struct stat sb {};
+        if (lstat(path.c_str(), &sb) < 0)
+            return errno == ENOENT ? 0 : errno;
+        if (!S_ISSOCK(sb.st_mode))
+            return EEXIST;
+
+        auto probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe < 0)
+            return errno;
+        auto live = connect(probe, reinterpret_cast<const struct sockaddr*>(&sa), sizeof(sa)) == 0;
+        ::close(probe);
+        if (live)
+            return EADDRINUSE;
+
+        unlink(path.c_str());
+        return 0;
+    }
+
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+namespace sevun {
+
+    // before binding a unix socket at path: a socket left behind by a
+    // server that has gone is removed so it can be taken over; anything
+    // else there, or a server still answering on it, is not ours to
+    // remove.  0, or the errno to fail with: EEXIST, EADDRINUSE, or
+    // whatever looking at the path ran into.
+    int claim_socket_path(const std::string& path);
+
+};
@@ -0,0 +1,180 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "trace.h"
+#include "ahrs.h"
+
+// FXOS8700CQ at ±8 g, FXAS21002C at 2000 dps, as the IMU service sets them up
+static const sevun::imu_scale_t bench_scale {0.000976f, 0.1f, 0.0625f};
+
+struct recording_t {
+    std::vector<sevun::imu_sample_t> samples;
+    std::vector<sevun::quaternion_t> truth;
+};
+
+static void rotate_to_body(const double* q, const double* v, double* out) {
+    // R(q)^T v, with q mapping body to earth
+    auto w = q[0], x = q[1], y = q[2], z = q[3];
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y + w * z) * v[1] + 2 * (x * z - w * y) * v[2];
+    out[1] = 2 * (x * y - w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z + w * x) * v[2];
+    out[2] = 2 * (x * z + w * y) * v[0] + 2 * (y * z - w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+// head-like motion: a few rad/s about all three axes, integrated finely
+// for the ground truth, then sampled with sensor noise, a gyro bias and
+// count quantization.
+static recording_t record(int rate, double seconds) {
+    recording_t r;
+    std::mt19937 rng(777);
+    std::normal_distribution<double> noise(0.0, 1.0);
+
+    const double gravity[3] {0.0, 0.0, 1.0};
+    const double field[3] {22.0, 0.0, -43.0};       // uT, x to magnetic north
+    const double bias[3] {0.004, -0.003, 0.002};    // rad/s
+
+    auto period = 1.0 / rate;
+    auto count = static_cast<size_t>(seconds * rate);
+    double q[4] {1.0, 0.0, 0.0, 0.0};
+    const int substeps = 20;
+
+    for (size_t i = 0; i < count; i++) {
+        auto t = i * period;
+        double omega[3] {
+            1.5 * std::sin(0.7 * t),
+            1.0 * std::sin(0.45 * t + 1.0),
+            2.0 * std::sin(0.3 * t + 2.0)
+        };
+
+        for (int s = 0; s < substeps; s++) {
+            auto h = 0.5 * period / substeps;
+            double d[4] {
+                -q[1] * omega[0] - q[2] * omega[1] - q[3] * omega[2],
+                q[0] * omega[0] + q[2] * omega[2] - q[3] * omega[1],
+                q[0] * omega[1] - q[1] * omega[2] + q[3] * omega[0],
+                q[0] * omega[2] + q[1] * omega[1] - q[2] * omega[0]
+            };
+            double n = 0.0;
+            for (int k = 0; k < 4; k++) {
+                q[k] += d[k] * h;
+                n += q[k] * q[k];
+            }
+            n = std::sqrt(n);
+            for (auto& c : q)
+                c /= n;
+        }
+
+        double a[3], m[3];
+        rotate_to_body(q, gravity, a);
+        rotate_to_body(q, field, m);
+
+        sevun::imu_sample_t sample {};
+        sample.timestamp_ns = static_cast<uint64_t>((t + period) * 1e9);
+        for (int k = 0; k < 3; k++) {
+            auto dps = (omega[k] + bias[k]) * 180.0 / M_PI + 0.05 * noise(rng);
+            sample.accel[k] = static_cast<int16_t>(std::lround((a[k] + 0.005 * noise(rng)) / bench_scale.accel_g));
+            sample.mag[k] = static_cast<int16_t>(std::lround((m[k] + 0.3 * noise(rng)) / bench_scale.mag_ut));
+            sample.gyro[k] = static_cast<int16_t>(std::lround(dps / bench_scale.gyro_dps));
+        }
+
+        r.samples.push_back(sample);
+        r.truth.push_back(sevun::quaternion_t {
+            static_cast<float>(q[0]),
+            static_cast<float>(q[1]),
+            static_cast<float>(q[2]),
+            static_cast<float>(q[3])});
+    }
+
+    return r;
+}
+
+template <typename Filter>
+static void run(
+        const char* name,
+        const recording_t& r,
+        int rate,
+        size_t burst,
+        size_t settle) {
+    sevun::ahrs_config_t config {};
+    Filter filter(config, bench_scale);
+    auto dt = 1.0f / rate;
+    const auto& samples = r.samples;
+
+    // timing pass on its own so the error bookkeeping doesn't count
+    auto start = sevun::trace::now_ns();
+    for (size_t i = 0; i < samples.size(); i += burst) {
+        auto n = std::min(burst, samples.size() - i);
+        if (n == 1)
+            filter.update(samples[i], dt);
+        else
+            filter.update(&samples[i], n, dt);
+    }
+    auto elapsed = sevun::trace::now_ns() - start;
+
+    filter.reset();
+    double sum2 = 0.0;
+    double worst = 0.0;
+    size_t measured = 0;
+    for (size_t i = 0; i < samples.size(); i += burst) {
+        auto n = std::min(burst, samples.size() - i);
+        if (n == 1)
+            filter.update(samples[i], dt);
+        else
+            filter.update(&samples[i], n, dt);
+
+        auto last = i + n - 1;
+        if (last < settle)
+            continue;
+        auto error = sevun::angle_between(filter.orientation(), r.truth[last]) * 180.0 / M_PI;
+        sum2 += error * error;
+        worst = std::max(worst, error);
+        measured++;
+    }
+
+    fmt::print(
+        "{:<18}{:>6}{:>14.2f}{:>12.3f}{:>12.3f}\n",
+        name,
+        burst,
+        samples.size() / (elapsed / 1e9) / 1e6,
+        std::sqrt(sum2 / measured),
+        worst);
+}
+
+int main(int argc, char** argv) {
+    int rate = 800;
+    double seconds = 120.0;
+    int burst = 16;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:b:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 's':
+                seconds = atof(optarg);
+                break;
+            case 'b':
+                burst = atoi(optarg);
+                break;
+            default:
+                fmt::print("usage: {} [-r sample-rate] [-s seconds] [-b burst]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    auto recording = record(rate, seconds);
+    auto settle = static_cast<size_t>(5 * rate);
+
+    fmt::print("{:.0f} s at {} Hz, error after the first 5 s against the integrated truth\n\n", seconds, rate);
+    fmt::print("{:<18}{:>6}{:>14}{:>12}{:>12}\n", "filter", "burst", "M updates/s", "rms deg", "max deg");
+    fmt::print("--------------------------------------------------------------\n");
+    run<sevun::ahrs_float>("float", recording, rate, 1, settle);
+    run<sevun::ahrs_float>("float", recording, rate, static_cast<size_t>(burst), settle);
+    run<sevun::ahrs_fixed>("fixed", recording, rate, 1, settle);
+    run<sevun::ahrs_fixed>("fixed", recording, rate, static_cast<size_t>(burst), settle);
+
+    return 0;
+}
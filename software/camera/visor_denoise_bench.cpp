@@ -0,0 +1,233 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <linux/videodev2.h>
+#include "trace.h"
+#include "temporal_denoiser.h"
+
+// the clean picture, 8-bit levels: an eye-camera sort of scene, smooth
+// shading with some texture, and a dark pupil moving sideways across it
+struct scene_t {
+    uint32_t width;
+    uint32_t height;
+    double radius;
+    double speed;                           // pixels per frame
+
+    inline double pupil_x(uint32_t frame) const {
+        auto travel = width - 4.0 * radius;
+        auto x = std::fmod(frame * speed, 2.0 * travel);
+        return 2.0 * radius + (x < travel ? x : 2.0 * travel - x);
+    }
+
+    inline double pupil_y() const {
+        return height / 2.0;
+    }
+
+    inline bool in_pupil(uint32_t frame, uint32_t x, uint32_t y) const {
+        auto dx = x - pupil_x(frame);
+        auto dy = y - pupil_y();
+        return dx * dx + dy * dy <= radius * radius;
+    }
+
+    inline double level(uint32_t frame, uint32_t x, uint32_t y) const {
+        if (in_pupil(frame, x, y))
+            return 30.0;
+        return 150.0 + 40.0 * std::sin(x * 0.02) * std::cos(y * 0.017) + 10.0 * std::sin(x * 0.31 + y * 0.23);
+    }
+
+    // rows the pupil never reaches
+    inline bool background(uint32_t y) const {
+        return std::fabs(y - pupil_y()) > radius + 4.0;
+    }
+};
+
+// roughly gaussian, from the sum of four uniforms
+static double noise(uint32_t& state, double sigma) {
+    double sum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        state = state * 1664525u + 1013904223u;
+        sum += (state >> 8) / 16777216.0;
+    }
+    return (sum - 2.0) * sigma * std::sqrt(3.0);
+}
+
+int main(int argc, char** argv) {
+    uint32_t width = 640;
+    uint32_t height = 480;
+    uint32_t pixelformat = V4L2_PIX_FMT_Y10;
+    uint32_t count = 300;
+    double sigma = 2.0;
+    double speed = 4.0;
+    double min_reduction = 2.0;
+    double max_ghost = 4.0;
+    sevun::denoise_config_t config {};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:h:f:n:s:v:r:g:S:")) != -1) {
+        switch (opt) {
+            case 'w':
+                width = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'h':
+                height = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'f':
+                pixelformat = strcmp(optarg, "grey") == 0 ? V4L2_PIX_FMT_GREY : V4L2_PIX_FMT_Y10;
+                break;
+            case 'n':
+                count = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 's':
+                sigma = atof(optarg);
+                break;
+            case 'v':
+                speed = atof(optarg);
+                break;
+            case 'r':
+                min_reduction = atof(optarg);
+                break;
+            case 'g':
+                max_ghost = atof(optarg);
+                break;
+            case 'S':
+                config.strength = static_cast<uint32_t>(atoi(optarg));
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-w width] [-h height] [-f y10|grey] [-n frames] [-s noise-sigma] [-v pupil-px-per-frame] [-r min-noise-reduction] [-g max-ghost-levels] [-S strength]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    auto wide = pixelformat == V4L2_PIX_FMT_Y10;
+    auto bytesperline = wide ? 2 * width : width;
+    auto scale = wide ? 4.0 : 1.0;
+    auto top = wide ? 1023.0 : 255.0;
+    scene_t scene {width, height, std::max(height / 10.0, 4.0), speed};
+
+    sevun::result result;
+    sevun::temporal_denoiser denoiser;
+    if (!denoiser.open(result, config, width, height, pixelformat, bytesperline)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    std::vector<uint8_t> frame(static_cast<size_t>(bytesperline) * height);
+    std::vector<double> truth(static_cast<size_t>(width) * height);
+    auto sample = [&](uint32_t x, uint32_t y) -> double {
+        auto row = frame.data() + static_cast<size_t>(y) * bytesperline;
+        return wide ? (row[2 * x] | row[2 * x + 1] << 8) / scale : row[x];
+    };
+
+    // the first frames only fill the history
+    auto settle = std::min<uint32_t>(20, count / 2);
+    double noise_in = 0.0;
+    double noise_out = 0.0;
+    uint64_t background_pixels = 0;
+    double ghost = 0.0;
+    uint64_t ghost_pixels = 0;
+    double worst_ghost = 0.0;
+    uint32_t state = 1;
+
+    for (uint32_t f = 0; f < count; f++) {
+        for (uint32_t y = 0; y < height; y++) {
+            auto row = frame.data() + static_cast<size_t>(y) * bytesperline;
+            for (uint32_t x = 0; x < width; x++) {
+                auto clean = scene.level(f, x, y);
+                truth[static_cast<size_t>(y) * width + x] = clean;
+                auto value = std::min(std::max(std::lround((clean + noise(state, sigma)) * scale), 0L), static_cast<long>(top));
+                if (wide) {
+                    row[2 * x] = static_cast<uint8_t>(value);
+                    row[2 * x + 1] = static_cast<uint8_t>(value >> 8);
+                } else {
+                    row[x] = static_cast<uint8_t>(value);
+                }
+            }
+        }
+
+        // the noise going in, on the still background
+        double in = 0.0;
+        if (f >= settle) {
+            for (uint32_t y = 0; y < height; y++) {
+                if (!scene.background(y))
+                    continue;
+                for (uint32_t x = 0; x < width; x++) {
+                    auto e = sample(x, y) - truth[static_cast<size_t>(y) * width + x];
+                    in += e * e;
+                }
+            }
+        }
+
+        denoiser.apply(frame.data(), frame.size());
+        if (f < settle)
+            continue;
+
+        // what's left of it coming out, and the pupil's trail: pixels it
+        // has just left or just arrived at, where a filter that can't tell
+        // motion from noise leaves a smear
+        double out = 0.0;
+        double trail = 0.0;
+        uint64_t trail_pixels = 0;
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                auto e = sample(x, y) - truth[static_cast<size_t>(y) * width + x];
+                if (scene.background(y)) {
+                    out += e * e;
+                    background_pixels++;
+                } else if (scene.in_pupil(f, x, y) != scene.in_pupil(f - 1, x, y)) {
+                    trail += std::fabs(e);
+                    trail_pixels++;
+                }
+            }
+        }
+        noise_in += in;
+        noise_out += out;
+        ghost += trail;
+        ghost_pixels += trail_pixels;
+        if (trail_pixels > 0)
+            worst_ghost = std::max(worst_ghost, trail / trail_pixels);
+    }
+
+    auto rms_in = background_pixels > 0 ? std::sqrt(noise_in / background_pixels) : 0.0;
+    auto rms_out = background_pixels > 0 ? std::sqrt(noise_out / background_pixels) : 0.0;
+    auto reduction = rms_out > 0.0 ? rms_in / rms_out : 0.0;
+    auto mean_ghost = ghost_pixels > 0 ? ghost / ghost_pixels : 0.0;
+
+    auto s = denoiser.stats();
+    fmt::print(
+        "{}x{} {}, {} frames, strength {}, pupil moving {:.1f} px per frame\n",
+        width,
+        height,
+        wide ? "y10" : "grey",
+        s.frames,
+        config.strength,
+        speed);
+    fmt::print(
+        "filter p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms\n",
+        s.filter_time.quantile(0.5) / 1e6,
+        s.filter_time.quantile(0.99) / 1e6,
+        s.filter_time.max / 1e6);
+    fmt::print(
+        "background noise {:.2f} -> {:.2f} levels rms, {:.2f}x less (limit {:.2f}x)\n",
+        rms_in,
+        rms_out,
+        reduction,
+        min_reduction);
+    fmt::print(
+        "pupil edges off by {:.2f} levels on average, {:.2f} in the worst frame (limit {:.2f})\n",
+        mean_ghost,
+        worst_ghost,
+        max_ghost);
+
+    auto failed = reduction < min_reduction || worst_ghost > max_ghost;
+    if (failed)
+        fmt::print("FAIL\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#include <ctime>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+
+// synthetic cpu load for checking capture scheduling settings: run it next
+// to visor and compare the run delay and dequeue latency visor-stat reports.
+int main(int argc, char** argv) {
+    unsigned threads = std::thread::hardware_concurrency();
+    unsigned seconds = 30;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                threads = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 's':
+                seconds = static_cast<unsigned>(atoi(optarg));
+                break;
+            default:
+                fmt::print("usage: {} [-t threads] [-s seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    std::atomic<bool> stop {false};
+    std::vector<std::thread> workers;
+
+    fmt::print("loading {} threads for {} s\n", threads, seconds);
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back([&stop]() {
+            volatile uint64_t spin = 0;
+            while (!stop.load(std::memory_order_relaxed))
+                spin++;
+        });
+    }
+
+    sleep(seconds);
+    stop = true;
+    for (auto& worker : workers)
+        worker.join();
+
+    return 0;
+}
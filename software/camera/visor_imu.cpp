@@ -0,0 +1,230 @@
+#include <string>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "result.h"
+#include "trace.h"
+#include "imu.h"
+#include "impact.h"
+#include "injury.h"
+#include "ahrs.h"
+#include "calibration.h"
+#include "imu_log.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+    stop_requested = 1;
+}
+
+static void print_last(const sevun::result& result) {
+    const auto& msg = result.at(result.size() - 1);
+    fmt::print("{}: {}\n", msg.code(), msg.message());
+}
+
+int main(int argc, char** argv) {
+    sevun::imu_options_t options {};
+    sevun::impact_config_t impact_config {};
+    auto calibration_env = getenv("VISOR_CALIBRATION");
+    std::string calibration_path = calibration_env != nullptr ? calibration_env : "";
+    std::string log_path;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:g:w:spA:G:c:l:")) != -1) {
+        switch (opt) {
+            case 'a':
+                options.adapter = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'g': {
+                auto colon = strchr(optarg, ':');
+                if (colon != nullptr) {
+                    options.irq_chip = std::string(optarg, colon - optarg);
+                    options.irq_line = atoi(colon + 1);
+                }
+                break;
+            }
+            case 'w':
+                options.watermark = static_cast<uint8_t>(atoi(optarg));
+                break;
+            case 's':
+                options.simulate = true;
+                break;
+            case 'p':
+                options.irq_line = -1;
+                break;
+            case 'A':
+                impact_config.accel_threshold_g = static_cast<float>(atof(optarg));
+                break;
+            case 'G':
+                impact_config.gyro_threshold_dps = static_cast<float>(atof(optarg));
+                break;
+            case 'c':
+                calibration_path = optarg;
+                break;
+            case 'l':
+                log_path = optarg;
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-a i2c-adapter] [-g gpiochip:line] [-w watermark] [-s] [-p] [-A impact-g] [-G impact-dps] [-c calibration] [-l imu-log]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    sevun::result result;
+    sevun::imu_service imu;
+    auto opened = imu.open(result, options);
+    for (const auto& msg : result.messages())
+        fmt::print("{}: {}\n", msg.code(), msg.message());
+    if (!opened)
+        return 1;
+
+    const auto& scale = imu.scale();
+    static sevun::impact_detector detector(impact_config, scale);
+    sevun::injury_metrics injury(scale);
+    sevun::ahrs_float ahrs(sevun::ahrs_config_t {}, scale);
+    auto dt = imu.period_ns() / 1e9f;
+
+    // start from the last session's coefficients; the estimators keep
+    // refining them and they're written back every 30 s when they change
+    sevun::imu_calibration calibration(sevun::calibration_config_t {}, scale);
+    if (!calibration_path.empty() && !calibration.load(result, calibration_path))
+        print_last(result);
+    auto save_at = sevun::trace::now_ns() + 30000000000ULL;
+
+    // raw samples go to the log, so it can be replayed through a different
+    // calibration later
+    sevun::imu_log_writer log;
+    if (!log_path.empty() && !log.open(result, log_path, scale, imu.period_ns()))
+        print_last(result);
+
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    imu.start();
+
+    sevun::imu_sample_t batch[256];
+    sevun::imu_sample_t last {};
+    uint64_t received = 0;
+    uint64_t worst_age = 0;
+    auto report_at = sevun::trace::now_ns() + 1000000000ULL;
+
+    while (stop_requested == 0) {
+        auto count = imu.samples().pop(batch, sizeof(batch) / sizeof(batch[0]));
+        if (count == 0) {
+            usleep(2000);
+        } else {
+            if (log.is_open() && !log.append(result, batch, count)) {
+                print_last(result);
+                log.close(result);
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                calibration.push(batch[i]);
+                calibration.apply(batch[i]);
+            }
+
+            auto age = sevun::trace::now_ns() - batch[count - 1].timestamp_ns;
+            if (age > worst_age)
+                worst_age = age;
+            last = batch[count - 1];
+            received += count;
+            ahrs.update(batch, count, dt);
+
+            for (size_t i = 0; i < count; i++) {
+                auto status = detector.push(batch[i]);
+                if (status == sevun::impact_detector::status::triggered)
+                    injury.begin();
+                injury.push(batch[i]);
+                if (status != sevun::impact_detector::status::complete)
+                    continue;
+
+                auto report = injury.end();
+                const auto& e = detector.event();
+                fmt::print(
+                    "impact {}: peak {}{:.1f} g / {}{:.0f} dps, {} + {} samples, detected {:.2f} ms after the sample\n",
+                    e.sequence,
+                    e.accel_saturated ? ">" : "",
+                    e.peak_accel_g,
+                    e.gyro_saturated ? ">" : "",
+                    e.peak_gyro_dps,
+                    e.pre_count,
+                    e.post_count,
+                    (e.detected_ns - e.trigger_ns) / 1e6);
+                fmt::print(
+                    "  HIC15 {}{:.1f}  HIC36 {}{:.1f}  peak {:.0f} rad/s²  BrIC {:.3f}, reported {:.2f} ms after the window\n",
+                    report.saturated ? ">" : "",
+                    report.hic15.value,
+                    report.saturated ? ">" : "",
+                    report.hic36.value,
+                    report.peak_alpha,
+                    report.bric,
+                    (sevun::trace::now_ns() - batch[i].timestamp_ns) / 1e6);
+            }
+        }
+
+        auto now = sevun::trace::now_ns();
+        if (now < report_at)
+            continue;
+
+        auto stats = imu.stats();
+        fmt::print(
+            "accel {:7.3f} {:7.3f} {:7.3f} g  mag {:7.1f} {:7.1f} {:7.1f} uT  gyro {:8.2f} {:8.2f} {:8.2f} dps\n",
+            last.accel[0] * scale.accel_g,
+            last.accel[1] * scale.accel_g,
+            last.accel[2] * scale.accel_g,
+            last.mag[0] * scale.mag_ut,
+            last.mag[1] * scale.mag_ut,
+            last.mag[2] * scale.mag_ut,
+            last.gyro[0] * scale.gyro_dps,
+            last.gyro[1] * scale.gyro_dps,
+            last.gyro[2] * scale.gyro_dps);
+        auto q = ahrs.orientation();
+        fmt::print("  orientation w {:6.3f} x {:6.3f} y {:6.3f} z {:6.3f}\n", q.w, q.x, q.y, q.z);
+        fmt::print(
+            "  {} samples/s ({:.1f} Hz), bus {:.1f}%, max age {:.2f} ms, ovf {}/{}, stale {}, full {}, irq timeouts {}\n",
+            received,
+            stats.sample_rate,
+            stats.bus_utilization * 100.0,
+            worst_age / 1e6,
+            stats.accel_overflows,
+            stats.gyro_overflows,
+            stats.gyro_stale,
+            stats.queue_full,
+            stats.irq_timeouts);
+        auto c = calibration.coefficients();
+        fmt::print(
+            "  gyro bias {} ({} still blocks), mag fit {} ({} samples) offset {:.1f} {:.1f} {:.1f} uT\n",
+            c.gyro_valid ? "ok" : "--",
+            calibration.gyro().still_blocks(),
+            c.mag_valid ? "ok" : "--",
+            calibration.mag().accepted(),
+            c.mag_offset[0] * scale.mag_ut,
+            c.mag_offset[1] * scale.mag_ut,
+            c.mag_offset[2] * scale.mag_ut);
+
+        if (!calibration_path.empty() && calibration.dirty() && now >= save_at) {
+            if (!calibration.save(result, calibration_path))
+                print_last(result);
+            save_at = now + 30000000000ULL;
+        }
+
+        if (log.is_open())
+            fmt::print("  log {} samples, {} blocks, {} bytes\n", log.samples(), log.blocks(), log.bytes());
+
+        received = 0;
+        worst_age = 0;
+        report_at = now + 1000000000ULL;
+    }
+
+    imu.stop();
+    if (log.is_open() && !log.close(result))
+        print_last(result);
+    if (!calibration_path.empty() && calibration.dirty() && !calibration.save(result, calibration_path))
+        print_last(result);
+    imu.close();
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "result.h"
+#include "trace.h"
+#include "imu_log.h"
+
+// FXOS8700CQ at ±8 g, FXAS21002C at 2000 dps, as the IMU service sets them up
+static const sevun::imu_scale_t bench_scale {0.000976f, 0.1f, 0.0625f};
+
+static void print_messages(const sevun::result& result) {
+    for (const auto& msg : result.messages())
+        fmt::print("{}: {}\n", msg.code(), msg.message());
+}
+
+static bool same(const sevun::imu_sample_t& a, const sevun::imu_sample_t& b) {
+    return a.timestamp_ns == b.timestamp_ns
+        && memcmp(a.accel, b.accel, sizeof(a.accel)) == 0
+        && memcmp(a.mag, b.mag, sizeof(a.mag)) == 0
+        && memcmp(a.gyro, b.gyro, sizeof(a.gyro)) == 0
+        && a.flags == b.flags;
+}
+
+// writes seconds of head-like 9-axis data with sensor noise and compares
+// the log against the text the sensor programs print today, then reads it
+// back whole and as a one-second range.
+static int bench(const std::string& path, double seconds, uint32_t rate) {
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> noise(0.0, 1.0);
+
+    auto period = 1000000000u / rate;
+    auto count = static_cast<size_t>(seconds * rate);
+    std::vector<sevun::imu_sample_t> samples(count);
+    uint64_t t = 1000000000ULL;
+    size_t text_bytes = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        auto s = i / static_cast<double>(rate);
+        auto& sample = samples[i];
+        t += period + static_cast<int64_t>(20000 * noise(rng));
+        sample.timestamp_ns = t;
+        sample.accel[0] = static_cast<int16_t>(std::lround(300 * std::sin(0.7 * s) + 4 * noise(rng)));
+        sample.accel[1] = static_cast<int16_t>(std::lround(200 * std::sin(0.45 * s) + 4 * noise(rng)));
+        sample.accel[2] = static_cast<int16_t>(std::lround(1000 + 50 * std::cos(0.3 * s) + 4 * noise(rng)));
+        sample.mag[0] = static_cast<int16_t>(std::lround(220 * std::cos(0.3 * s) + 3 * noise(rng)));
+        sample.mag[1] = static_cast<int16_t>(std::lround(220 * std::sin(0.3 * s) + 3 * noise(rng)));
+        sample.mag[2] = static_cast<int16_t>(std::lround(-430 + 3 * noise(rng)));
+        sample.gyro[0] = static_cast<int16_t>(std::lround(1300 * std::sin(0.7 * s) + 2 * noise(rng)));
+        sample.gyro[1] = static_cast<int16_t>(std::lround(900 * std::sin(0.45 * s + 1) + 2 * noise(rng)));
+        sample.gyro[2] = static_cast<int16_t>(std::lround(1800 * std::sin(0.3 * s + 2) + 2 * noise(rng)));
+
+        text_bytes += fmt::format(
+            "{} {:.3f} {:.3f} {:.3f} {:.1f} {:.1f} {:.1f} {:.2f} {:.2f} {:.2f}\n",
+            sample.timestamp_ns,
+            sample.accel[0] * bench_scale.accel_g,
+            sample.accel[1] * bench_scale.accel_g,
+            sample.accel[2] * bench_scale.accel_g,
+            sample.mag[0] * bench_scale.mag_ut,
+            sample.mag[1] * bench_scale.mag_ut,
+            sample.mag[2] * bench_scale.mag_ut,
+            sample.gyro[0] * bench_scale.gyro_dps,
+            sample.gyro[1] * bench_scale.gyro_dps,
+            sample.gyro[2] * bench_scale.gyro_dps).size();
+    }
+
+    sevun::result result;
+    sevun::imu_log_writer writer;
+    if (!writer.open(result, path, bench_scale, period)) {
+        print_messages(result);
+        return 1;
+    }
+
+    auto start = sevun::trace::now_ns();
+    writer.append(result, samples.data(), samples.size());
+    writer.close(result);
+    auto write_ns = sevun::trace::now_ns() - start;
+    print_messages(result);
+
+    sevun::imu_log_reader reader;
+    if (!reader.open(result, path)) {
+        print_messages(result);
+        return 1;
+    }
+
+    std::vector<sevun::imu_sample_t> all;
+    all.reserve(count);
+    start = sevun::trace::now_ns();
+    reader.read(result, 0, UINT64_MAX, all);
+    auto read_ns = sevun::trace::now_ns() - start;
+
+    size_t mismatched = all.size() == samples.size() ? 0 : 1;
+    for (size_t i = 0; mismatched == 0 && i < all.size(); i++) {
+        if (!same(all[i], samples[i]))
+            mismatched++;
+    }
+
+    std::vector<sevun::imu_sample_t> range;
+    auto middle = samples[count / 2].timestamp_ns;
+    start = sevun::trace::now_ns();
+    reader.read(result, middle, middle + 1000000000ULL, range);
+    auto range_ns = sevun::trace::now_ns() - start;
+
+    fmt::print("{} samples, {:.0f} s at {} Hz\n", count, seconds, rate);
+    fmt::print(
+        "  text   {:>10} bytes  {:6.2f} bytes/sample\n",
+        text_bytes,
+        text_bytes / static_cast<double>(count));
+    fmt::print(
+        "  raw    {:>10} bytes  {:6.2f} bytes/sample\n",
+        count * sizeof(sevun::imu_sample_t),
+        static_cast<double>(sizeof(sevun::imu_sample_t)));
+    fmt::print(
+        "  log    {:>10} bytes  {:6.2f} bytes/sample, {} blocks\n",
+        reader.file_size(),
+        reader.file_size() / static_cast<double>(count),
+        reader.blocks());
+    fmt::print(
+        "  write {:.1f} ns/sample, full read {:.1f} ns/sample, 1 s range {} samples in {:.1f} us\n",
+        write_ns / static_cast<double>(count),
+        read_ns / static_cast<double>(count),
+        range.size(),
+        range_ns / 1e3);
+    fmt::print("  round trip {}\n", mismatched == 0 ? "exact" : "MISMATCH");
+    print_messages(result);
+
+    return mismatched == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    double from = 0.0;
+    double to = -1.0;
+    double bench_seconds = 0.0;
+    uint32_t bench_rate = 800;
+    bool summary_only = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:t:b:r:i")) != -1) {
+        switch (opt) {
+            case 'f':
+                from = atof(optarg);
+                break;
+            case 't':
+                to = atof(optarg);
+                break;
+            case 'b':
+                bench_seconds = atof(optarg);
+                break;
+            case 'r':
+                bench_rate = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'i':
+                summary_only = true;
+                break;
+            default:
+                fmt::print("usage: {} [-f from-s] [-t to-s] [-i] [-b bench-seconds [-r rate]] log\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        fmt::print("usage: {} [-f from-s] [-t to-s] [-i] [-b bench-seconds [-r rate]] log\n", argv[0]);
+        return 1;
+    }
+    std::string path = argv[optind];
+
+    if (bench_seconds > 0.0)
+        return bench(path, bench_seconds, bench_rate);
+
+    sevun::result result;
+    sevun::imu_log_reader reader;
+    auto opened = reader.open(result, path);
+    print_messages(result);
+    if (!opened)
+        return 1;
+
+    const auto& header = reader.header();
+    auto duration = (reader.last_ns() - reader.first_ns()) / 1e9;
+    fmt::print(
+        "{}: {} samples in {} blocks, {:.1f} s, {:.2f} bytes/sample, period {} us, {}\n",
+        path,
+        reader.samples(),
+        reader.blocks(),
+        duration,
+        reader.samples() > 0 ? reader.file_size() / static_cast<double>(reader.samples()) : 0.0,
+        header.period_ns / 1000,
+        reader.indexed() ? "indexed" : "index rebuilt");
+    if (summary_only)
+        return 0;
+
+    // -f/-t are seconds from the first sample
+    result.clear();
+    std::vector<sevun::imu_sample_t> samples;
+    auto from_ns = reader.first_ns() + static_cast<uint64_t>(from * 1e9);
+    auto to_ns = to < 0.0 ? reader.last_ns() : reader.first_ns() + static_cast<uint64_t>(to * 1e9);
+    reader.read(result, from_ns, to_ns, samples);
+    print_messages(result);
+
+    const auto& scale = header.scale;
+    for (const auto& s : samples) {
+        fmt::print(
+            "{:10.6f} {:7.3f} {:7.3f} {:7.3f} {:7.1f} {:7.1f} {:7.1f} {:8.2f} {:8.2f} {:8.2f} {:x}\n",
+            (s.timestamp_ns - reader.first_ns()) / 1e9,
+            s.accel[0] * scale.accel_g,
+            s.accel[1] * scale.accel_g,
+            s.accel[2] * scale.accel_g,
+            s.mag[0] * scale.mag_ut,
+            s.mag[1] * scale.mag_ut,
+            s.mag[2] * scale.mag_ut,
+            s.gyro[0] * scale.gyro_dps,
+            s.gyro[1] * scale.gyro_dps,
+            s.gyro[2] * scale.gyro_dps,
+            s.flags);
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "result.h"
+#include "trace.h"
+#include "imu.h"
+#include "impact.h"
+#include "injury.h"
+#include "ahrs.h"
+#include "calibration.h"
+#include "imu_log.h"
+#include "../common/sim_motion.h"
+
+// runs the acquisition and detection pipeline against the register-level
+// sensor models, by default on the bus's virtual clock so a minute of
+// motion takes a fraction of a second.
+
+static bool load_recording(
+        sevun::result& result,
+        const std::string& path,
+        std::vector<tSimMotionSample>& out,
+        uint64_t& period_ns) {
+    sevun::imu_log_reader reader;
+    if (!reader.open(result, path))
+        return false;
+
+    std::vector<sevun::imu_sample_t> samples;
+    reader.read(result, reader.first_ns(), reader.last_ns(), samples);
+
+    const auto& scale = reader.header().scale;
+    for (const auto& s : samples) {
+        tSimMotionSample m {};
+        for (int k = 0; k < 3; k++) {
+            m.pfAccel[k] = s.accel[k] * scale.accel_g;
+            m.pfMag[k] = s.mag[k] * scale.mag_ut;
+            m.pfGyro[k] = s.gyro[k] * scale.gyro_dps;
+        }
+        out.push_back(m);
+    }
+
+    period_ns = reader.header().period_ns;
+    return !out.empty() && period_ns > 0;
+}
+
+int main(int argc, char** argv) {
+    sevun::imu_options_t options {};
+    sevun::impact_config_t impact_config {};
+    std::string profile = "impacts";
+    double seconds = 60.0;
+    int opt;
+
+    options.simulate = true;
+    options.virtual_clock = true;
+
+    while ((opt = getopt(argc, argv, "p:d:w:rA:G:")) != -1) {
+        switch (opt) {
+            case 'p':
+                profile = optarg;
+                break;
+            case 'd':
+                seconds = atof(optarg);
+                break;
+            case 'w':
+                options.watermark = static_cast<uint8_t>(atoi(optarg));
+                break;
+            case 'r':
+                options.virtual_clock = false;
+                break;
+            case 'A':
+                impact_config.accel_threshold_g = static_cast<float>(atof(optarg));
+                break;
+            case 'G':
+                impact_config.gyro_threshold_dps = static_cast<float>(atof(optarg));
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-p still|swing|impacts|log:path] [-d seconds] [-w watermark] [-r] [-A impact-g] [-G impact-dps]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    sevun::result result;
+    tSimMotion motion;
+    std::vector<tSimMotionSample> recording;
+
+    if (profile == "still") {
+        SimMotionInit(&motion, SIM_MOTION_STILL);
+    } else if (profile == "swing") {
+        SimMotionInit(&motion, SIM_MOTION_SWING);
+    } else if (profile == "impacts") {
+        SimMotionInit(&motion, SIM_MOTION_IMPACTS);
+    } else if (profile.compare(0, 4, "log:") == 0) {
+        // a recording already carries its sensor's noise and offsets
+        SimMotionInit(&motion, SIM_MOTION_RECORDED);
+        motion.fAccelNoiseG = 0.0f;
+        motion.fMagNoiseUt = 0.0f;
+        motion.fGyroNoiseDps = 0.0f;
+        memset(motion.pfGyroBiasDps, 0, sizeof(motion.pfGyroBiasDps));
+        if (!load_recording(result, profile.substr(4), recording, motion.ui64RecordedPeriodNs)) {
+            for (const auto& msg : result.messages())
+                fmt::print("{}: {}\n", msg.code(), msg.message());
+            fmt::print("{}: no samples to play back\n", profile.substr(4));
+            return 1;
+        }
+        motion.psRecorded = recording.data();
+        motion.ui32RecordedCount = static_cast<uint32_t>(recording.size());
+    } else {
+        fmt::print("unknown profile {}\n", profile);
+        return 1;
+    }
+
+    sevun::imu_service imu;
+    auto opened = imu.open(result, options);
+    for (const auto& msg : result.messages())
+        fmt::print("{}: {}\n", msg.code(), msg.message());
+    if (!opened)
+        return 1;
+
+    const auto& scale = imu.scale();
+    auto start_ns = imu.clock_ns();
+    auto end_ns = start_ns + static_cast<uint64_t>(seconds * 1e9);
+    SimMotionAttach(&motion, imu.accel_sim(), imu.gyro_sim(), start_ns);
+
+    static sevun::impact_detector detector(impact_config, scale);
+    sevun::injury_metrics injury(scale);
+    sevun::ahrs_float ahrs(sevun::ahrs_config_t {}, scale);
+    sevun::imu_calibration calibration(sevun::calibration_config_t {}, scale);
+    auto dt = imu.period_ns() / 1e9f;
+
+    sevun::imu_sample_t batch[256];
+    uint64_t samples = 0;
+    uint64_t busy_ns = 0;
+    uint64_t last_ns = 0;
+    uint64_t impacts = 0;
+    float peak_g = 0.0f;
+    float peak_dps = 0.0f;
+    uint64_t accel_triggers = 0;
+    uint64_t saturated = 0;
+    float worst_hic15 = 0.0f;
+    float worst_bric = 0.0f;
+
+    auto wall_start = sevun::trace::now_ns();
+    imu.start();
+
+    while (last_ns < end_ns) {
+        auto count = imu.samples().pop(batch, sizeof(batch) / sizeof(batch[0]));
+        if (count == 0) {
+            if (options.virtual_clock)
+                std::this_thread::yield();
+            else
+                usleep(2000);
+            continue;
+        }
+
+        auto busy_start = sevun::trace::now_ns();
+        for (size_t i = 0; i < count; i++) {
+            calibration.push(batch[i]);
+            calibration.apply(batch[i]);
+        }
+        ahrs.update(batch, count, dt);
+
+        for (size_t i = 0; i < count; i++) {
+            auto status = detector.push(batch[i]);
+            if (status == sevun::impact_detector::status::triggered)
+                injury.begin();
+            injury.push(batch[i]);
+            if (status != sevun::impact_detector::status::complete)
+                continue;
+
+            auto report = injury.end();
+            const auto& e = detector.event();
+            impacts++;
+            accel_triggers += e.accel_triggered ? 1 : 0;
+            saturated += report.saturated ? 1 : 0;
+            peak_g = std::max(peak_g, e.peak_accel_g);
+            peak_dps = std::max(peak_dps, e.peak_gyro_dps);
+            worst_hic15 = std::max(worst_hic15, report.hic15.value);
+            worst_bric = std::max(worst_bric, report.bric);
+        }
+        busy_ns += sevun::trace::now_ns() - busy_start;
+
+        samples += count;
+        last_ns = batch[count - 1].timestamp_ns;
+    }
+
+    auto wall_ns = sevun::trace::now_ns() - wall_start;
+    imu.stop();
+
+    auto simulated = (last_ns - start_ns) / 1e9;
+    auto stats = imu.stats();
+    fmt::print(
+        "{} profile, {:.1f} s simulated in {:.3f} s ({:.0f}x real time{})\n",
+        profile,
+        simulated,
+        wall_ns / 1e9,
+        simulated / (wall_ns / 1e9),
+        options.virtual_clock ? "" : ", real clock");
+    fmt::print(
+        "  {} samples at {:.1f} Hz, bus {:.1f}%, ovf {}/{}, stale {}, queue full {}, {} accel / {} gyro samples modelled\n",
+        samples,
+        stats.sample_rate,
+        stats.bus_utilization * 100.0,
+        stats.accel_overflows,
+        stats.gyro_overflows,
+        stats.gyro_stale,
+        stats.queue_full,
+        imu.accel_sim()->ui64Samples,
+        imu.gyro_sim()->ui64Samples);
+    fmt::print(
+        "  pipeline {:.0f} ns/sample (calibration, AHRS, detector, injury metrics)\n",
+        samples > 0 ? busy_ns / static_cast<double>(samples) : 0.0);
+
+    if (motion.ui32Kind == SIM_MOTION_IMPACTS) {
+        // an impact whose post-trigger window runs past the end can't have
+        // been reported yet
+        auto expected = SimMotionImpactsBefore(
+            &motion,
+            last_ns - impact_config.post_trigger_ns);
+        fmt::print(
+            "  impacts {} detected ({} on acceleration, {} saturated), {} expected; peak {:.1f} g / {:.0f} dps, worst HIC15 {:.1f}, BrIC {:.3f}\n",
+            impacts,
+            accel_triggers,
+            saturated,
+            expected,
+            peak_g,
+            peak_dps,
+            worst_hic15,
+            worst_bric);
+    } else {
+        fmt::print("  impacts {} detected\n", impacts);
+    }
+
+    auto c = calibration.coefficients();
+    fmt::print(
+        "  gyro bias {} {:.2f} {:.2f} {:.2f} dps (modelled {:.2f} {:.2f} {:.2f})\n",
+        c.gyro_valid ? "ok" : "--",
+        c.gyro_bias[0] * scale.gyro_dps,
+        c.gyro_bias[1] * scale.gyro_dps,
+        c.gyro_bias[2] * scale.gyro_dps,
+        motion.pfGyroBiasDps[0],
+        motion.pfGyroBiasDps[1],
+        motion.pfGyroBiasDps[2]);
+    auto q = ahrs.orientation();
+    fmt::print("  orientation w {:6.3f} x {:6.3f} y {:6.3f} z {:6.3f}\n", q.w, q.x, q.y, q.z);
+
+    imu.close();
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "trace.h"
+#include "injury.h"
+
+// the FXOS8700CQ clips at 8 g, well below head impact levels, so the
+// synthetic events use a scale where an int16 count covers ±1600 g; the
+// algorithms only ever see counts times scale.
+static const sevun::imu_scale_t bench_scale {0.05f, 0.1f, 0.0625f};
+
+static void synthesize(
+        std::vector<sevun::imu_sample_t>& samples,
+        std::mt19937& rng,
+        uint64_t start_ns,
+        uint64_t period_ns,
+        size_t count) {
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> peak_g(20.0f, 150.0f);
+    std::uniform_real_distribution<float> width_ms(4.0f, 20.0f);
+    std::uniform_real_distribution<float> peak_dps(300.0f, 1900.0f);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+
+    // half-sine linear pulse and a slightly longer rotational one, in a
+    // random direction, a third of the way into the window
+    float dir[3] {unit(rng), unit(rng), unit(rng)};
+    auto norm = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]) + 1e-6f;
+    for (auto& d : dir)
+        d /= norm;
+    auto g = peak_g(rng);
+    auto width = width_ms(rng) * 1e6f;
+    auto dps = peak_dps(rng);
+    auto pulse_start = start_ns + count / 3 * period_ns;
+
+    samples.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        auto& s = samples[i];
+        s = sevun::imu_sample_t {};
+        // a little timing jitter, as from FIFO-derived timestamps
+        s.timestamp_ns = start_ns + i * period_ns + static_cast<uint64_t>((unit(rng) + 1.0f) * 20000.0f);
+
+        float linear = 0.0f;
+        float angular = 0.0f;
+        if (s.timestamp_ns >= pulse_start) {
+            auto t = static_cast<float>(s.timestamp_ns - pulse_start);
+            if (t < width)
+                linear = g * std::sin(static_cast<float>(M_PI) * t / width);
+            if (t < 3.0f * width)
+                angular = dps * std::sin(static_cast<float>(M_PI) * t / (3.0f * width));
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            auto a = linear * dir[axis] + (axis == 2 ? 1.0f : 0.0f) + 0.02f * noise(rng);
+            auto w = angular * dir[(axis + 1) % 3] + 0.5f * noise(rng);
+            s.accel[axis] = static_cast<int16_t>(std::lround(a / bench_scale.accel_g));
+            s.gyro[axis] = static_cast<int16_t>(std::lround(w / bench_scale.gyro_dps));
+        }
+    }
+}
+
+static double relative_error(float a, float b) {
+    auto scale = std::max(std::fabs(a), std::fabs(b));
+    return scale == 0.0f ? 0.0 : std::fabs(a - b) / scale;
+}
+
+int main(int argc, char** argv) {
+    int events = 200;
+    int rate = 400;
+    double seconds = 3.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                events = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 's':
+                seconds = atof(optarg);
+                break;
+            default:
+                fmt::print("usage: {} [-n events] [-r sample-rate] [-s seconds-per-event]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    std::mt19937 rng(12345);
+    std::vector<sevun::imu_sample_t> samples;
+    auto period_ns = 1000000000ULL / static_cast<uint64_t>(rate);
+    auto count = static_cast<size_t>(seconds * rate);
+
+    uint64_t stream_ns = 0;
+    uint64_t end_ns = 0;
+    uint64_t worst_end_ns = 0;
+    uint64_t brute_ns = 0;
+    double worst_error = 0.0;
+    int mismatches = 0;
+
+    for (int e = 0; e < events; e++) {
+        synthesize(samples, rng, 1000000000ULL + e * 10000000000ULL, period_ns, count);
+
+        sevun::injury_metrics metrics(bench_scale);
+        metrics.begin();
+
+        auto t0 = sevun::trace::now_ns();
+        for (const auto& s : samples)
+            metrics.push(s);
+        auto t1 = sevun::trace::now_ns();
+        auto streamed = metrics.end();
+        auto t2 = sevun::trace::now_ns();
+        auto reference = sevun::injury_metrics::brute_force(samples.data(), samples.size(), bench_scale);
+        auto t3 = sevun::trace::now_ns();
+
+        stream_ns += t1 - t0;
+        end_ns += t2 - t1;
+        worst_end_ns = std::max(worst_end_ns, t2 - t1);
+        brute_ns += t3 - t2;
+
+        double errors[] {
+            relative_error(streamed.hic15.value, reference.hic15.value),
+            relative_error(streamed.hic36.value, reference.hic36.value),
+            relative_error(streamed.peak_alpha, reference.peak_alpha),
+            relative_error(streamed.bric, reference.bric),
+            relative_error(streamed.peak_accel_g, reference.peak_accel_g)
+        };
+        double error = 0.0;
+        for (auto x : errors)
+            error = std::max(error, x);
+        worst_error = std::max(worst_error, error);
+
+        // the prefix sums round differently from a direct sum, so allow a
+        // hair of slack before calling it a mismatch
+        if (error > 1e-4
+        ||  streamed.hic15.t1_ns != reference.hic15.t1_ns
+        ||  streamed.hic36.t2_ns != reference.hic36.t2_ns) {
+            mismatches++;
+            fmt::print(
+                "event {}: HIC15 {:.2f} vs {:.2f}, HIC36 {:.2f} vs {:.2f}, BrIC {:.4f} vs {:.4f}\n",
+                e,
+                streamed.hic15.value,
+                reference.hic15.value,
+                streamed.hic36.value,
+                reference.hic36.value,
+                streamed.bric,
+                reference.bric);
+        }
+
+        if (e == 0)
+            fmt::print(
+                "sample event: HIC15 {:.1f}  HIC36 {:.1f}  peak {:.1f} g  {:.0f} rad/s²  BrIC {:.3f}\n",
+                streamed.hic15.value,
+                streamed.hic36.value,
+                streamed.peak_accel_g,
+                streamed.peak_alpha,
+                streamed.bric);
+    }
+
+    auto total = static_cast<double>(events) * count;
+    fmt::print("{} events x {} samples at {} Hz\n", events, count, rate);
+    fmt::print("  streaming: {:8.1f} ns/sample, report {:.2f} us (worst {:.2f} us)\n",
+               stream_ns / total, end_ns / 1e3 / events, worst_end_ns / 1e3);
+    fmt::print("  brute force: {:8.3f} ms/event\n", brute_ns / 1e6 / events);
+    fmt::print("  worst relative error {:.2e}, {} mismatches\n", worst_error, mismatches);
+
+    return mismatches == 0 ? 0 : 1;
+}
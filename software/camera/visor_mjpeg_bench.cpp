@@ -0,0 +1,199 @@
+#include <cmath>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <linux/videodev2.h>
+#include "trace.h"
+#include "mjpeg_encoder.h"
+
+// a textured scene panning sideways, plus sensor noise, so the encoder
+// sees detail and motion rather than a flat field
+static void render(
+        std::vector<uint8_t>& frame,
+        uint32_t width,
+        uint32_t height,
+        uint32_t pixelformat,
+        uint32_t bytesperline,
+        uint32_t index) {
+    uint32_t noise = 0x9e3779b9u * (index + 1);
+    for (uint32_t y = 0; y < height; y++) {
+        auto row = frame.data() + static_cast<size_t>(y) * bytesperline;
+        for (uint32_t x = 0; x < width; x++) {
+            noise = noise * 1664525u + 1013904223u;
+            auto u = (x + 4 * index) * 0.05;
+            auto v = 128.0 + 90.0 * std::sin(u) * std::cos(y * 0.031) + ((noise >> 28) & 7);
+            auto level = static_cast<uint32_t>(std::min(std::max(v, 0.0), 255.0));
+
+            switch (pixelformat) {
+                case V4L2_PIX_FMT_GREY:
+                    row[x] = static_cast<uint8_t>(level);
+                    break;
+                case V4L2_PIX_FMT_Y10:
+                case V4L2_PIX_FMT_Y16: {
+                    auto sample = pixelformat == V4L2_PIX_FMT_Y10 ? level << 2 : level << 8;
+                    row[2 * x] = static_cast<uint8_t>(sample);
+                    row[2 * x + 1] = static_cast<uint8_t>(sample >> 8);
+                    break;
+                }
+                case V4L2_PIX_FMT_YUYV:
+                    row[2 * x] = static_cast<uint8_t>(level);
+                    row[2 * x + 1] = static_cast<uint8_t>(x & 1 ? 255 - level / 2 : 64 + level / 2);
+                    break;
+            }
+        }
+    }
+}
+
+// a complete baseline JPEG of the expected size: SOI first, EOI last,
+// and an SOF0 before the scan giving the frame's dimensions
+static bool valid_jpeg(const uint8_t* data, size_t length, uint32_t width, uint32_t height) {
+    if (length < 4 || data[0] != 0xff || data[1] != 0xd8 || data[length - 2] != 0xff || data[length - 1] != 0xd9)
+        return false;
+
+    size_t offset = 2;
+    while (offset + 4 <= length && data[offset] == 0xff) {
+        auto marker = data[offset + 1];
+        auto segment = static_cast<size_t>(data[offset + 2] << 8 | data[offset + 3]);
+        if (marker == 0xda || segment < 2 || offset + 2 + segment > length)
+            return false;
+        if (marker == 0xc0) {
+            if (segment < 8)
+                return false;
+            auto h = static_cast<uint32_t>(data[offset + 5] << 8 | data[offset + 6]);
+            auto w = static_cast<uint32_t>(data[offset + 7] << 8 | data[offset + 8]);
+            return w == width && h == height;
+        }
+        offset += 2 + segment;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    uint32_t pixelformat = V4L2_PIX_FMT_YUYV;
+    uint32_t count = 300;
+    double fps = 0.0;
+    sevun::mjpeg_config_t config {};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:h:f:q:t:n:r:s:o:")) != -1) {
+        switch (opt) {
+            case 'w':
+                width = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'h':
+                height = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'f':
+                if (strcmp(optarg, "grey") == 0)
+                    pixelformat = V4L2_PIX_FMT_GREY;
+                else if (strcmp(optarg, "y10") == 0)
+                    pixelformat = V4L2_PIX_FMT_Y10;
+                else if (strcmp(optarg, "y16") == 0)
+                    pixelformat = V4L2_PIX_FMT_Y16;
+                else
+                    pixelformat = V4L2_PIX_FMT_YUYV;
+                break;
+            case 'q':
+                config.quality = atoi(optarg);
+                break;
+            case 't':
+                config.threads = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'n':
+                count = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'r':
+                fps = atof(optarg);
+                break;
+            case 's':
+                config.rows_per_slice = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'o':
+                config.path = optarg;
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-w width] [-h height] [-f grey|y10|y16|yuyv] [-q quality] [-t threads] [-n frames] [-r fps] [-s rows-per-slice] [-o out.mjpeg]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    auto bytesperline = pixelformat == V4L2_PIX_FMT_GREY ? width : 2 * width;
+    auto sizeimage = bytesperline * height;
+
+    // a handful of distinct frames, cycled
+    std::vector<std::vector<uint8_t>> frames(8, std::vector<uint8_t>(sizeimage));
+    for (uint32_t i = 0; i < frames.size(); i++)
+        render(frames[i], width, height, pixelformat, bytesperline, i);
+
+    sevun::result result;
+    sevun::mjpeg_encoder encoder;
+    std::atomic<uint64_t> invalid {0};
+    encoder.set_sink([&](const uint8_t* data, size_t length, uint64_t) {
+        if (!valid_jpeg(data, length, width, height))
+            invalid.fetch_add(1, std::memory_order_relaxed);
+    });
+    if (!encoder.open(result, config, width, height, pixelformat, bytesperline, sizeimage)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    // -r paces the frames like a camera would; without it they come as
+    // fast as push() returns and the drop count shows the encoder's limit
+    auto period_ns = fps > 0.0 ? static_cast<uint64_t>(1e9 / fps) : 0;
+    auto start = sevun::trace::now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        if (period_ns > 0) {
+            auto due = start + i * period_ns;
+            auto now = sevun::trace::now_ns();
+            if (due > now)
+                usleep(static_cast<useconds_t>((due - now) / 1000));
+        }
+        const auto& frame = frames[i % frames.size()];
+        encoder.push(frame.data(), frame.size(), sevun::trace::now_ns());
+    }
+
+    // let the last frames through before counting
+    for (int i = 0; i < 1000 && encoder.stats().encoded + encoder.stats().dropped < count; i++)
+        usleep(1000);
+    auto elapsed = sevun::trace::now_ns() - start;
+    encoder.close();
+
+    auto s = encoder.stats();
+    fmt::print("{}x{} {} quality {}, {} threads, {} slices\n",
+        width,
+        height,
+        pixelformat == V4L2_PIX_FMT_YUYV ? "yuyv" : pixelformat == V4L2_PIX_FMT_GREY ? "grey" : "y10/y16",
+        config.quality,
+        s.threads,
+        s.slices);
+    fmt::print(
+        "{} frames, {} encoded, {} dropped, {:.1f} fps, {:.1f} KiB per frame ({:.2f} bits per pixel)\n",
+        s.frames,
+        s.encoded,
+        s.dropped,
+        s.encoded / (elapsed / 1e9),
+        s.encoded > 0 ? s.bytes / 1024.0 / s.encoded : 0.0,
+        s.encoded > 0 ? 8.0 * s.bytes / s.encoded / (static_cast<double>(width) * height) : 0.0);
+    fmt::print(
+        "encode p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms; latency p50 {:.2f} ms, p99 {:.2f} ms\n",
+        s.encode_time.quantile(0.5) / 1e6,
+        s.encode_time.quantile(0.99) / 1e6,
+        s.encode_time.max / 1e6,
+        s.latency.quantile(0.5) / 1e6,
+        s.latency.quantile(0.99) / 1e6);
+
+    if (invalid > 0) {
+        fmt::print("{} of {} frames were not a valid {}x{} JPEG\n", invalid.load(), s.encoded, width, height);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <linux/videodev2.h>
+#include "trace.h"
+#include "clip_recorder.h"
+#include "motion_estimator.h"
+
+struct session_t {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t bytesperline;
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<uint64_t> timestamps;
+    std::vector<float> truth_dx;            // synthetic sessions only
+    std::vector<float> truth_dy;
+};
+
+// a clip as clip_recorder writes it
+static bool load_clip(const char* path, session_t& session) {
+    auto file = fopen(path, "rb");
+    if (file == nullptr) {
+        fmt::print("{}: {}\n", path, strerror(errno));
+        return false;
+    }
+
+    sevun::clip_file_header_t header {};
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != sevun::clip_file_header_t::magic_value) {
+        fmt::print("{}: not a visor clip\n", path);
+        fclose(file);
+        return false;
+    }
+
+    session.width = header.width;
+    session.height = header.height;
+    session.pixelformat = header.pixelformat;
+    session.bytesperline = header.bytesperline;
+
+    sevun::clip_frame_header_t frame {};
+    while (fread(&frame, sizeof(frame), 1, file) == 1) {
+        std::vector<uint8_t> data(frame.length);
+        if (fread(data.data(), 1, data.size(), file) != data.size())
+            break;
+        session.frames.push_back(std::move(data));
+        session.timestamps.push_back(frame.timestamp_ns);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static uint32_t hash(int32_t u, int32_t v) {
+    auto h = static_cast<uint32_t>(u) * 374761393u + static_cast<uint32_t>(v) * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+// a textured scene the head pans across, plus a dark pupil-sized disk
+// moving on its own, which the global estimate should ignore
+static void synthesize(
+        session_t& session,
+        uint32_t width,
+        uint32_t height,
+        uint32_t pixelformat,
+        uint32_t count) {
+    session.width = width;
+    session.height = height;
+    session.pixelformat = pixelformat;
+    session.bytesperline = pixelformat == V4L2_PIX_FMT_GREY ? width : 2 * width;
+
+    int previous_x = 0;
+    int previous_y = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        auto t = i / 60.0;
+        auto pan_x = static_cast<int>(std::lround(120.0 * std::sin(2.1 * t)));
+        auto pan_y = static_cast<int>(std::lround(60.0 * std::sin(1.3 * t + 0.5)));
+        auto eye_x = width / 2.0 + width / 4.0 * std::sin(7.0 * t);
+        auto eye_y = height / 2.0 + height / 6.0 * std::cos(5.0 * t);
+        auto eye_r2 = (height / 10.0) * (height / 10.0);
+
+        std::vector<uint8_t> frame(static_cast<size_t>(session.bytesperline) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            auto row = frame.data() + static_cast<size_t>(y) * session.bytesperline;
+            for (uint32_t x = 0; x < width; x++) {
+                auto u = static_cast<int>(x) + pan_x;
+                auto v = static_cast<int>(y) + pan_y;
+                auto value = 128.0 + 50.0 * std::sin(0.11 * u + 0.07 * v) + 35.0 * std::sin(0.05 * u - 0.13 * v)
+                           + static_cast<double>(hash(u, v) & 31) - 16.0;
+                auto ex = x - eye_x;
+                auto ey = y - eye_y;
+                if (ex * ex + ey * ey < eye_r2)
+                    value = 20.0;
+                auto level = static_cast<uint8_t>(std::min(std::max(value, 0.0), 255.0));
+
+                if (pixelformat == V4L2_PIX_FMT_GREY) {
+                    row[x] = level;
+                } else {
+                    row[2 * x] = level;
+                    row[2 * x + 1] = 128;
+                }
+            }
+        }
+
+        session.frames.push_back(std::move(frame));
+        session.timestamps.push_back(static_cast<uint64_t>(i) * 16666667ULL);
+        session.truth_dx.push_back(static_cast<float>(previous_x - pan_x));
+        session.truth_dy.push_back(static_cast<float>(previous_y - pan_y));
+        previous_x = pan_x;
+        previous_y = pan_y;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* clip = nullptr;
+    uint32_t width = 640;
+    uint32_t height = 480;
+    uint32_t pixelformat = V4L2_PIX_FMT_GREY;
+    uint32_t count = 240;
+    bool verbose = false;
+    sevun::motion_config_t config {};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:w:h:yn:t:l:r:B:v")) != -1) {
+        switch (opt) {
+            case 'i':
+                clip = optarg;
+                break;
+            case 'w':
+                width = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'h':
+                height = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'y':
+                pixelformat = V4L2_PIX_FMT_YUYV;
+                break;
+            case 'n':
+                count = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 't':
+                config.threads = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'l':
+                config.levels = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'r':
+                config.search_range = atoi(optarg);
+                break;
+            case 'B':
+                config.budget_ns = static_cast<uint64_t>(atof(optarg) * 1e6);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-i clip] [-w width] [-h height] [-y] [-n frames] [-t threads] [-l levels] [-r search-range] [-B budget-ms] [-v]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    // a recorded session, or a synthetic one with known motion
+    session_t session {};
+    if (clip != nullptr) {
+        if (!load_clip(clip, session))
+            return 1;
+    } else {
+        synthesize(session, width, height, pixelformat, count);
+    }
+
+    sevun::result result;
+    sevun::motion_estimator estimator;
+    if (!estimator.configure(result, config, session.width, session.height, session.pixelformat, session.bytesperline)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    double error2 = 0.0;
+    double worst = 0.0;
+    double travel = 0.0;
+    size_t fields = 0;
+    for (size_t i = 0; i < session.frames.size(); i++) {
+        const auto& frame = session.frames[i];
+        if (!estimator.estimate(frame.data(), frame.size(), 0))
+            continue;
+
+        const auto& field = estimator.field();
+        travel += std::hypot(field.global_dx, field.global_dy);
+        fields++;
+
+        auto error = 0.0;
+        if (!session.truth_dx.empty()) {
+            error = std::hypot(field.global_dx - session.truth_dx[i], field.global_dy - session.truth_dy[i]);
+            error2 += error * error;
+            worst = std::max(worst, error);
+        }
+        if (verbose)
+            fmt::print(
+                "{:6} {:7.1f} {:7.1f}  levels {} {}\n",
+                i,
+                field.global_dx,
+                field.global_dy,
+                field.levels_searched,
+                field.over_budget ? "over budget" : "");
+    }
+
+    auto s = estimator.stats();
+    fmt::print(
+        "{}x{} {}, {} fields of {}x{} blocks, {} threads, {} levels\n",
+        session.width,
+        session.height,
+        clip != nullptr ? clip : "synthetic",
+        fields,
+        estimator.field().columns,
+        estimator.field().rows,
+        config.threads != 0 ? config.threads : std::max(std::thread::hardware_concurrency(), 1u),
+        config.levels);
+    fmt::print(
+        "estimate p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms; {} over the {:.1f} ms budget\n",
+        s.estimate_time.quantile(0.5) / 1e6,
+        s.estimate_time.quantile(0.99) / 1e6,
+        s.estimate_time.max / 1e6,
+        s.over_budget,
+        config.budget_ns / 1e6);
+    fmt::print("global motion: {:.1f} px per frame on average\n", fields > 0 ? travel / fields : 0.0);
+    if (!session.truth_dx.empty() && fields > 0)
+        fmt::print("against the truth: rms {:.2f} px, worst {:.2f} px\n", std::sqrt(error2 / fields), worst);
+
+    return 0;
+}
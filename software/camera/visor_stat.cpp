@@ -0,0 +1,90 @@
+#include <string>
+#include <ctime>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "result.h"
+#include "metrics.h"
+
+static void print_histogram(
+        const char* name,
+        const sevun::histogram_t& h) {
+    auto mean = h.count == 0 ? 0 : h.sum / h.count;
+    fmt::print(
+        "{:<18}{:>10}{:>12.3f}{:>12.3f}{:>12.3f}{:>12.3f}\n",
+        name,
+        h.count,
+        mean / 1e6,
+        h.quantile(0.5) / 1e6,
+        h.quantile(0.99) / 1e6,
+        h.max / 1e6);
+}
+
+static void print_metrics(
+        uint32_t pid,
+        const sevun::capture_metrics_t& m) {
+    struct timespec ts {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    auto now = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    auto age = now > m.updated_ns ? (now - m.updated_ns) / 1e6 : 0.0;
+
+    fmt::print("         pid: {}\n", pid);
+    fmt::print("     updated: {:.1f} ms ago\n", age);
+    fmt::print("      frames: {}\n", m.frames);
+    fmt::print("       drops: {}\n", m.drops);
+    fmt::print("     skipped: {}\n", m.skipped);
+    fmt::print("  buf errors: {}\n", m.buffer_errors);
+    fmt::print(" queue depth: {}/{}\n", m.queue_depth, m.buffer_count);
+    fmt::print("   run delay: {:.3f} ms\n", m.run_delay_ns / 1e6);
+    fmt::print("   preempted: {}\n", m.involuntary_switches);
+    fmt::print("\n{:<18}{:>10}{:>12}{:>12}{:>12}{:>12}\n", "ms", "count", "mean", "p50<=", "p99<=", "max");
+    fmt::print("------------------------------------------------------------------------------\n");
+    print_histogram("dequeue latency", m.dequeue_latency);
+    print_histogram("callback time", m.callback_time);
+    print_histogram("display latency", m.display_latency);
+}
+
+int main(int argc, char** argv) {
+    std::string name = "/visor-metrics";
+    bool watch = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w")) != -1) {
+        switch (opt) {
+            case 'n':
+                name = optarg;
+                break;
+            case 'w':
+                watch = true;
+                break;
+            default:
+                fmt::print("usage: {} [-n segment] [-w]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    sevun::result result;
+    sevun::metrics_reader reader;
+    if (!reader.open(result, name)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    do {
+        sevun::capture_metrics_t m {};
+        uint32_t pid = 0;
+
+        if (watch)
+            fmt::print("\033[2J\033[;H");
+
+        if (reader.read(m, pid))
+            print_metrics(pid, m);
+        else
+            fmt::print("segment busy, retrying\n");
+
+        if (watch)
+            sleep(1);
+    } while (watch);
+
+    return 0;
+}
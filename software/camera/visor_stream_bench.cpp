@@ -0,0 +1,218 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <linux/videodev2.h>
+#include "trace.h"
+#include "stream_server.h"
+
+struct client_report_t {
+    uint32_t max_fps;
+    uint32_t delay_ms;                      // per frame, to fall behind on purpose
+    uint64_t frames;
+    uint64_t skipped;
+    uint64_t corrupt;
+    uint64_t imu_samples;
+    uint64_t imu_lost;
+    uint64_t age_ns;
+    bool connected;
+};
+
+// a frame is its index in every byte, so a slot overwritten while it was
+// still being sent shows up as a mismatch
+static bool intact(const std::vector<uint8_t>& payload, uint64_t index) {
+    auto expected = static_cast<uint8_t>(index);
+    return payload.empty()
+        || (payload.front() == expected && payload[payload.size() / 2] == expected && payload.back() == expected);
+}
+
+static void run_client(
+        const std::string& address,
+        client_report_t& report,
+        const std::atomic<bool>& running) {
+    sevun::result result;
+    sevun::stream_client client;
+    if (!client.open(result, address, sevun::stream_request_t::frames | sevun::stream_request_t::imu, report.max_fps)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return;
+    }
+    report.connected = true;
+
+    sevun::stream_message_t message {};
+    std::vector<uint8_t> payload;
+    uint64_t next_frame = UINT64_MAX;
+    uint64_t next_sample = UINT64_MAX;
+    while (running.load(std::memory_order_relaxed) && client.read(message, payload)) {
+        if (message.type == sevun::stream_message_t::frame) {
+            if (next_frame != UINT64_MAX && message.index > next_frame)
+                report.skipped += message.index - next_frame;
+            next_frame = message.index + 1;
+            report.frames++;
+            report.age_ns += sevun::trace::now_ns() - message.timestamp_ns;
+            if (!intact(payload, message.index))
+                report.corrupt++;
+            if (report.delay_ms > 0)
+                usleep(report.delay_ms * 1000);
+        } else if (message.type == sevun::stream_message_t::imu) {
+            if (next_sample != UINT64_MAX && message.index > next_sample)
+                report.imu_lost += message.index - next_sample;
+            next_sample = message.index + message.count;
+            report.imu_samples += message.count;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    sevun::stream_config_t config {};
+    config.address = "unix:/tmp/visor-stream-bench.sock";
+    uint32_t width = 640;
+    uint32_t height = 480;
+    uint32_t fps = 60;
+    uint32_t imu_rate = 800;
+    uint32_t clients = 3;
+    uint32_t limited_fps = 15;
+    uint32_t slow_ms = 50;
+    uint32_t seconds = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:w:h:r:i:n:l:s:t:")) != -1) {
+        switch (opt) {
+            case 'a':
+                config.address = optarg;
+                break;
+            case 'w':
+                width = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'h':
+                height = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'r':
+                fps = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'i':
+                imu_rate = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'n':
+                clients = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'l':
+                limited_fps = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 's':
+                slow_ms = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 't':
+                seconds = static_cast<uint32_t>(atoi(optarg));
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-a address] [-w width] [-h height] [-r fps] [-i imu-hz] [-n clients] [-l limited-fps] [-s slow-ms] [-t seconds]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    sevun::result result;
+    sevun::stream_server server;
+    config.max_clients = std::max(clients, 1u);
+    if (!server.open(result, config, width, height, V4L2_PIX_FMT_GREY, width, width * height, sevun::imu_scale_t {})) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    // loopback clients: the first takes everything, the second asks for a
+    // rate limit and the third reads too slowly to keep up
+    std::atomic<bool> running {true};
+    std::vector<client_report_t> reports(clients, client_report_t {});
+    std::vector<std::thread> readers;
+    for (uint32_t i = 0; i < clients; i++) {
+        reports[i].max_fps = i % 3 == 1 ? limited_fps : 0;
+        reports[i].delay_ms = i % 3 == 2 ? slow_ms : 0;
+        readers.emplace_back(run_client, config.address, std::ref(reports[i]), std::cref(running));
+    }
+
+    // the IMU: a batch every 8 ms, timestamps counting samples
+    std::thread imu([&]() {
+        std::vector<sevun::imu_sample_t> batch(std::max(imu_rate / 125, 1u));
+        uint64_t sample = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            for (auto& s : batch)
+                s.timestamp_ns = sample++;
+            server.push_imu(batch.data(), batch.size());
+            usleep(8000);
+        }
+    });
+
+    // the capture thread, at a steady rate
+    std::vector<uint8_t> frame(static_cast<size_t>(width) * height);
+    auto period_ns = 1000000000ULL / std::max(fps, 1u);
+    auto next_ns = sevun::trace::now_ns();
+    auto end_ns = next_ns + seconds * 1000000000ULL;
+    uint64_t index = 0;
+    while (next_ns < end_ns) {
+        memset(frame.data(), static_cast<uint8_t>(index), frame.size());
+        server.push_frame(frame.data(), frame.size(), sevun::trace::now_ns());
+        index++;
+
+        next_ns += period_ns;
+        auto now = sevun::trace::now_ns();
+        if (next_ns > now)
+            usleep(static_cast<useconds_t>((next_ns - now) / 1000));
+    }
+
+    running = false;
+    imu.join();
+    server.close();
+    for (auto& reader : readers)
+        reader.join();
+
+    auto s = server.stats();
+    fmt::print(
+        "{} frames of {}x{} at {} fps to {} clients on {}\n",
+        s.frames,
+        width,
+        height,
+        fps,
+        clients,
+        config.address);
+    fmt::print(
+        "push p50 {:.1f} us, p99 {:.1f} us, max {:.1f} us; {} dropped for want of a slot\n",
+        s.push_time.quantile(0.5) / 1e3,
+        s.push_time.quantile(0.99) / 1e3,
+        s.push_time.max / 1e3,
+        s.frames_dropped);
+    fmt::print(
+        "sent {} frames, skipped {}, {:.1f} MiB; {} zerocopy sends, {} copied anyway; {} imu samples sent, {} dropped\n",
+        s.frames_sent,
+        s.frames_skipped,
+        s.bytes_sent / 1048576.0,
+        s.zerocopy_sends,
+        s.zerocopy_copied,
+        s.imu_sent,
+        s.imu_dropped);
+
+    auto failed = false;
+    for (uint32_t i = 0; i < clients; i++) {
+        const auto& r = reports[i];
+        fmt::print(
+            "client {}: limit {} fps, {} ms per frame: {:.1f} fps, {} skipped, {} corrupt, mean age {:.2f} ms, {} imu samples, {} lost\n",
+            i,
+            r.max_fps,
+            r.delay_ms,
+            static_cast<double>(r.frames) / seconds,
+            r.skipped,
+            r.corrupt,
+            r.frames > 0 ? r.age_ns / 1e6 / r.frames : 0.0,
+            r.imu_samples,
+            r.imu_lost);
+        failed = failed || !r.connected || r.frames == 0 || r.corrupt > 0;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include <string>
+#include <ctime>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "result.h"
+#include "trace.h"
+#include "frame_ring.h"
+
+int main(int argc, char** argv) {
+    std::string path = "/tmp/visor-frames";
+    bool lossless = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:l")) != -1) {
+        switch (opt) {
+            case 'p':
+                path = optarg;
+                break;
+            case 'l':
+                lossless = true;
+                break;
+            default:
+                fmt::print("usage: {} [-p socket] [-l]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    sevun::result result;
+    sevun::frame_subscriber subscriber;
+    if (!subscriber.open(result, path)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    auto describe = [&]() {
+        const auto& header = subscriber.header();
+        fmt::print(
+            "ring: {} slots of {} bytes, {}x{} stride {}\n",
+            header.slot_count,
+            header.slot_size,
+            header.width,
+            header.height,
+            header.bytesperline);
+    };
+    describe();
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bytesperline = 0;
+    uint64_t frames = 0;
+    uint64_t torn = 0;
+    uint64_t last_index = UINT64_MAX;
+    uint64_t latency_sum = 0;
+    auto report_at = sevun::trace::now_ns() + 1000000000ULL;
+
+    for (;;) {
+        sevun::frame_view_t view {};
+        auto status = lossless ? subscriber.next(view) : subscriber.latest(view);
+
+        switch (status) {
+            case sevun::frame_subscriber::status::ok:
+                // latest() hands back the same frame until a new one lands;
+                // the ring has nothing to block on, so back off instead
+                if (view.index == last_index) {
+                    usleep(500);
+                    break;
+                }
+                last_index = view.index;
+                if (view.width != width || view.height != height || view.bytesperline != bytesperline) {
+                    width = view.width;
+                    height = view.height;
+                    bytesperline = view.bytesperline;
+                    fmt::print("frames now {}x{} stride {}\n", width, height, bytesperline);
+                }
+                frames++;
+                latency_sum += sevun::trace::now_ns() - view.timestamp_ns;
+                break;
+            case sevun::frame_subscriber::status::torn:
+                torn++;
+                break;
+            case sevun::frame_subscriber::status::lagged:
+                continue;
+            case sevun::frame_subscriber::status::retired:
+                // the publisher moved to a bigger ring, or went away;
+                // keep trying until it answers again
+                fmt::print("ring retired, reconnecting\n");
+                while (!subscriber.open(result, path))
+                    usleep(100000);
+                last_index = UINT64_MAX;
+                describe();
+                continue;
+            default:
+                usleep(1000);
+                break;
+        }
+
+        auto now = sevun::trace::now_ns();
+        if (now >= report_at) {
+            fmt::print(
+                "{} fps, {:.3f} ms mean age, {} lost, {} torn\n",
+                frames,
+                frames == 0 ? 0.0 : latency_sum / 1e6 / frames,
+                subscriber.lost(),
+                torn);
+            frames = 0;
+            latency_sum = 0;
+            report_at = now + 1000000000ULL;
+        }
+    }
+}
@@ -0,0 +1,360 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <linux/videodev2.h>
+#include "trace.h"
+#include "undistort.h"
+
+static constexpr double dark = 48.0;
+static constexpr double light = 208.0;
+static constexpr double mid = (dark + light) / 2.0;
+
+struct frame_format_t {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t bytesperline;
+};
+
+// luma in 8-bit levels, with whatever precision the format carries
+static double luma(const std::vector<uint8_t>& frame, const frame_format_t& format, uint32_t x, uint32_t y) {
+    auto row = frame.data() + static_cast<size_t>(y) * format.bytesperline;
+    switch (format.pixelformat) {
+        case V4L2_PIX_FMT_Y10:
+            return (row[2 * x] | row[2 * x + 1] << 8) / 4.0;
+        case V4L2_PIX_FMT_Y16:
+            return (row[2 * x] | row[2 * x + 1] << 8) / 256.0;
+        case V4L2_PIX_FMT_YUYV:
+            return row[2 * x];
+        default:
+            return row[x];
+    }
+}
+
+static void store(std::vector<uint8_t>& frame, const frame_format_t& format, uint32_t x, uint32_t y, double level) {
+    auto row = frame.data() + static_cast<size_t>(y) * format.bytesperline;
+    switch (format.pixelformat) {
+        case V4L2_PIX_FMT_Y10:
+        case V4L2_PIX_FMT_Y16: {
+            auto sample = static_cast<uint32_t>(std::lround(level * (format.pixelformat == V4L2_PIX_FMT_Y10 ? 4.0 : 256.0)));
+            row[2 * x] = static_cast<uint8_t>(sample);
+            row[2 * x + 1] = static_cast<uint8_t>(sample >> 8);
+            break;
+        }
+        case V4L2_PIX_FMT_YUYV:
+            row[2 * x] = static_cast<uint8_t>(std::lround(level));
+            row[2 * x + 1] = 128;
+            break;
+        default:
+            row[x] = static_cast<uint8_t>(std::lround(level));
+            break;
+    }
+}
+
+// what the camera would see of a checkerboard of square pixels: each
+// pixel is the board averaged over a 4x4 grid of rays, each ray traced
+// back through the lens to where it meets the board
+static void render(
+        std::vector<uint8_t>& frame,
+        const frame_format_t& format,
+        const sevun::undistorter& undistorter,
+        uint32_t square) {
+    constexpr uint32_t rays = 4;
+    std::vector<float> points(2 * format.width * rays);
+    std::vector<double> sums(format.width);
+    for (uint32_t y = 0; y < format.height; y++) {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        for (uint32_t sy = 0; sy < rays; sy++) {
+            for (uint32_t x = 0; x < format.width; x++) {
+                for (uint32_t sx = 0; sx < rays; sx++) {
+                    auto i = x * rays + sx;
+                    points[2 * i] = x + (sx + 0.5f) / rays - 0.5f;
+                    points[2 * i + 1] = y + (sy + 0.5f) / rays - 0.5f;
+                }
+            }
+            undistorter.undistort_points(points.data(), points.data(), format.width * rays);
+
+            for (uint32_t x = 0; x < format.width; x++) {
+                for (uint32_t sx = 0; sx < rays; sx++) {
+                    auto i = x * rays + sx;
+                    auto cx = static_cast<int64_t>(std::floor((points[2 * i] + 0.5) / square));
+                    auto cy = static_cast<int64_t>(std::floor((points[2 * i + 1] + 0.5) / square));
+                    sums[x] += (cx + cy) & 1 ? light : dark;
+                }
+            }
+        }
+        for (uint32_t x = 0; x < format.width; x++)
+            store(frame, format, x, y, sums[x] / (rays * rays));
+    }
+}
+
+// where the board's level crosses mid between along and along + 1, on line
+// across; false if it doesn't, or the step is too soft to be a clean edge
+static bool crossing(
+        const std::vector<uint8_t>& frame,
+        const frame_format_t& format,
+        bool vertical,
+        uint32_t across,
+        uint32_t along,
+        double& position) {
+    auto length = vertical ? format.width : format.height;
+    if (along < 2 || along + 3 > length)
+        return false;
+
+    auto at = [&](uint32_t i) {
+        return vertical ? luma(frame, format, i, across) : luma(frame, format, across, i);
+    };
+    auto a = at(along);
+    auto b = at(along + 1);
+    if ((a - mid) * (b - mid) > 0.0 || a == b)
+        return false;
+    if (std::fabs(at(along + 2) - at(along - 1)) < (light - dark) / 2)
+        return false;
+
+    position = along + (mid - a) / (b - a);
+    return true;
+}
+
+// follows one edge of the board from near start, line by line both ways,
+// and returns how far the worst point is from the straight line fitted
+// through all of them; -1 if too little of it was found.  a square size
+// leaves out the lines next to the board's corners, where the edge fades
+// out and its crossing wanders.
+static double straightness(
+        const std::vector<uint8_t>& frame,
+        const frame_format_t& format,
+        bool vertical,
+        double start,
+        uint32_t middle,
+        uint32_t search,
+        uint32_t square) {
+    auto lines = vertical ? format.height : format.width;
+    std::vector<double> positions(lines, -1.0);
+
+    double found = -1.0;
+    double nearest = 1e9;
+    for (auto i = static_cast<int64_t>(start) - search; i <= static_cast<int64_t>(start) + search; i++) {
+        double position;
+        if (i >= 0 && crossing(frame, format, vertical, middle, static_cast<uint32_t>(i), position)
+            && std::fabs(position - start) < nearest) {
+            nearest = std::fabs(position - start);
+            found = position;
+        }
+    }
+    if (found < 0.0)
+        return -1.0;
+    positions[middle] = found;
+
+    // a line bends by well under a pixel from one row to the next, so two
+    // either side of the last position is enough to keep hold of it; a
+    // miss, at a corner of the board, keeps the last one
+    for (int direction = -1; direction <= 1; direction += 2) {
+        auto last = found;
+        for (auto line = static_cast<int64_t>(middle) + direction; line >= 0 && line < lines; line += direction) {
+            double position;
+            for (auto i = static_cast<int64_t>(last) - 2; i <= static_cast<int64_t>(last) + 2; i++) {
+                if (i >= 0 && crossing(frame, format, vertical, static_cast<uint32_t>(line), static_cast<uint32_t>(i), position)
+                    && std::fabs(position - last) < 1.5) {
+                    positions[line] = position;
+                    last = position;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (square > 0) {
+        for (uint32_t t = 0; t < lines; t++) {
+            auto corner = (t + square / 2) % square;
+            if (corner + 2 >= square / 2 && corner <= square / 2 + 1)
+                positions[t] = -1.0;
+        }
+    }
+
+    double n = 0.0, st = 0.0, sp = 0.0, stt = 0.0, stp = 0.0;
+    for (uint32_t t = 0; t < lines; t++) {
+        if (positions[t] < 0.0)
+            continue;
+        n++;
+        st += t;
+        sp += positions[t];
+        stt += static_cast<double>(t) * t;
+        stp += t * positions[t];
+    }
+    if (n < lines / 2)
+        return -1.0;
+
+    auto slope = (n * stp - st * sp) / (n * stt - st * st);
+    auto offset = (sp - slope * st) / n;
+    double worst = 0.0;
+    for (uint32_t t = 0; t < lines; t++)
+        if (positions[t] >= 0.0)
+            worst = std::max(worst, std::fabs(positions[t] - (offset + slope * t)));
+    return worst;
+}
+
+// the interior edges of the board, in a frame or in where the lens puts
+// them: the worst of all of them, and how many could be followed
+static double worst_edge(
+        const std::vector<uint8_t>& frame,
+        const frame_format_t& format,
+        const sevun::lens_calibration_t& lens,
+        uint32_t square,
+        bool distorted,
+        uint32_t& edges) {
+    // the forward model, to find the edges in the distorted frame
+    auto distort = [&](double u, double v, double& du, double& dv) {
+        auto x = (u - lens.cx) / lens.fx;
+        auto y = (v - lens.cy) / lens.fy;
+        auto r2 = x * x + y * y;
+        auto radial = 1.0 + r2 * (lens.k1 + r2 * (lens.k2 + r2 * lens.k3));
+        du = lens.fx * (x * radial + 2.0 * lens.p1 * x * y + lens.p2 * (r2 + 2.0 * x * x)) + lens.cx;
+        dv = lens.fy * (y * radial + lens.p1 * (r2 + 2.0 * y * y) + 2.0 * lens.p2 * x * y) + lens.cy;
+    };
+
+    double worst = 0.0;
+    edges = 0;
+    for (int vertical = 0; vertical <= 1; vertical++) {
+        auto length = vertical ? format.width : format.height;
+        auto lines = vertical ? format.height : format.width;
+        // half a square off the centre line, clear of the board's corners
+        auto middle = (lines / 2 / square) * square + square / 2;
+        for (uint32_t k = 1; k * square < length - 1; k++) {
+            double start = k * square - 0.5;
+            if (distorted) {
+                double du, dv;
+                if (vertical)
+                    distort(start, middle, du, dv);
+                else
+                    distort(middle, start, du, dv);
+                start = vertical ? du : dv;
+            }
+            auto w = distorted
+                ? straightness(frame, format, vertical != 0, start, middle, 4, 0)
+                : straightness(frame, format, vertical != 0, start, middle, 1, square);
+            if (w < 0.0)
+                continue;
+            worst = std::max(worst, w);
+            edges++;
+        }
+    }
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    frame_format_t format {640, 480, V4L2_PIX_FMT_GREY, 0};
+    sevun::undistort_config_t config {};
+    uint32_t count = 200;
+    uint32_t square = 32;
+    double tolerance = 0.5;
+    int opt;
+
+    // a wide lens with strong barrel distortion, the OV7251 module's sort
+    sevun::lens_calibration_t lens {640, 480, 420.0, 420.0, 319.5, 239.5, -0.32, 0.11, 0.0008, -0.0005, -0.015};
+
+    while ((opt = getopt(argc, argv, "w:h:f:t:n:s:e:k:")) != -1) {
+        switch (opt) {
+            case 'w':
+                format.width = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'h':
+                format.height = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'f':
+                if (strcmp(optarg, "y10") == 0)
+                    format.pixelformat = V4L2_PIX_FMT_Y10;
+                else if (strcmp(optarg, "y16") == 0)
+                    format.pixelformat = V4L2_PIX_FMT_Y16;
+                else if (strcmp(optarg, "yuyv") == 0)
+                    format.pixelformat = V4L2_PIX_FMT_YUYV;
+                else
+                    format.pixelformat = V4L2_PIX_FMT_GREY;
+                break;
+            case 't':
+                config.threads = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 'n':
+                count = static_cast<uint32_t>(atoi(optarg));
+                break;
+            case 's':
+                square = std::max(static_cast<uint32_t>(atoi(optarg)), 8u);
+                break;
+            case 'e':
+                tolerance = atof(optarg);
+                break;
+            case 'k':
+                lens.k1 = atof(optarg);
+                break;
+            default:
+                fmt::print(
+                    "usage: {} [-w width] [-h height] [-f grey|y10|y16|yuyv] [-t threads] [-n frames] [-s square] [-e tolerance-px] [-k k1]\n",
+                    argv[0]);
+                return 1;
+        }
+    }
+
+    format.bytesperline = format.pixelformat == V4L2_PIX_FMT_GREY ? format.width : 2 * format.width;
+    auto sizeimage = static_cast<size_t>(format.bytesperline) * format.height;
+
+    sevun::result result;
+    sevun::undistorter undistorter;
+    if (!undistorter.configure(result, lens, config, format.width, format.height, format.pixelformat, format.bytesperline)) {
+        for (const auto& msg : result.messages())
+            fmt::print("{}: {}\n", msg.code(), msg.message());
+        return 1;
+    }
+
+    // the calibration as the undistorter scaled it to this frame
+    auto scaled = lens;
+    scaled.fx *= static_cast<double>(format.width) / lens.width;
+    scaled.fy *= static_cast<double>(format.height) / lens.height;
+    scaled.cx = (lens.cx + 0.5) * format.width / lens.width - 0.5;
+    scaled.cy = (lens.cy + 0.5) * format.height / lens.height - 0.5;
+
+    std::vector<uint8_t> frame(sizeimage);
+    std::vector<uint8_t> out(sizeimage);
+    render(frame, format, undistorter, square);
+
+    for (uint32_t i = 0; i < count; i++)
+        undistorter.remap(frame.data(), frame.size(), out.data());
+
+    uint32_t edges_in;
+    uint32_t edges_out;
+    auto bent = worst_edge(frame, format, scaled, square, true, edges_in);
+    auto straight = worst_edge(out, format, scaled, square, false, edges_out);
+    auto expected = (format.width - 2) / square + (format.height - 2) / square;
+
+    auto s = undistorter.stats();
+    fmt::print(
+        "{}x{} {}, {} frames, {:.1f} KiB table\n",
+        format.width,
+        format.height,
+        format.pixelformat == V4L2_PIX_FMT_YUYV ? "yuyv" : format.pixelformat == V4L2_PIX_FMT_GREY ? "grey" : "y10/y16",
+        s.frames,
+        s.table_bytes / 1024.0);
+    fmt::print(
+        "remap p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms, {:.0f} Mpixel/s\n",
+        s.remap_time.quantile(0.5) / 1e6,
+        s.remap_time.quantile(0.99) / 1e6,
+        s.remap_time.max / 1e6,
+        s.remap_time.sum > 0 ? s.pixels * 1e3 / s.remap_time.sum : 0.0);
+    fmt::print(
+        "board edges: {} of {} followed in the distorted frame, bent up to {:.2f} px; {} after, straight within {:.3f} px (limit {:.3f})\n",
+        edges_in,
+        expected,
+        bent,
+        edges_out,
+        straight,
+        tolerance);
+
+    // a lens that barely bends the board proves nothing
+    auto failed = edges_out < expected || straight > tolerance || bent < 4 * tolerance;
+    if (failed)
+        fmt::print("FAIL\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include "work_pool.h"
+
+namespace sevun {
+
+    work_pool::~work_pool() {
+        stop();
+    }
+
+    void work_pool::start(uint32_t threads) {
+        stop();
+
+        if (threads == 0)
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+        _running = true;
+        for (uint32_t i = 1; i < threads; i++)
+            _workers.emplace_back(&work_pool::work_loop, this);
+    }
+
+    void work_pool::stop() {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _running = false;
+        }
+        _ready.notify_all();
+        for (auto& worker : _workers)
+            worker.join();
+        _workers.clear();
+    }
+
+    void work_pool::run(uint32_t count, const task_callable& task) {
+        if (count == 0)
+            return;
+
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            generation = ++_generation;
+            _count = count;
+            _completed = 0;
+            _task = &task;
+            _next.store(generation << 32, std::memory_order_release);
+        }
+        if (!_workers.empty())
+            _ready.notify_all();
+
+        auto done = take(generation, count, task);
+
+        std::unique_lock<std::mutex> lock(_lock);
+        _completed += done;
+        _done.wait(lock, [this, count] {
+            return _completed == count;
+        });
+        _task = nullptr;
+    }
+
+    void work_pool::work_loop() {
+        uint64_t seen = 0;
+        for (;;) {
+            uint64_t generation;
+            uint32_t count;
+            const task_callable* task;
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                _ready.wait(lock, [this, seen] {
+                    return !_running || (_generation != seen && _task != nullptr);
+                });
+                if (!_running)
+                    return;
+                seen = generation = _generation;
+                count = _count;
+                task = _task;
+            }
+
+            auto done = take(generation, count, *task);
+            if (done > 0) {
+                std::lock_guard<std::mutex> guard(_lock);
+                _completed += done;
+                if (_completed == count)
+                    _done.notify_one();
+            }
+        }
+    }
+
+    uint32_t work_pool::take(uint64_t generation, uint32_t count, const task_callable& task) {
+        uint32_t done = 0;
+        auto next = _next.load(std::memory_order_acquire);
+        for (;;) {
+            if ((next >> 32) != generation || static_cast<uint32_t>(next) >= count)
+                return done;
+            if (!_next.compare_exchange_weak(next, next + 1, std::memory_order_acq_rel))
+                continue;
+            task(static_cast<uint32_t>(next));
+            done++;
+            next = _next.load(std::memory_order_acquire);
+        }
+    }
+
+};
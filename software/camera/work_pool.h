@@ -0,0 +1,63 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace sevun {
+
+    // a fixed set of threads that work through the iterations of a loop
+    // alongside the thread calling run().  indexes are handed out one at a
+    // time, so uneven tiles and slices balance themselves.  one caller at
+    // a time; the threads sleep between runs.
+    class work_pool {
+    public:
+        using task_callable = std::function<void (uint32_t)>;
+
+        work_pool() = default;
+
+        virtual ~work_pool();
+
+        work_pool(const work_pool&) = delete;
+
+        work_pool& operator=(const work_pool&) = delete;
+
+        // threads counts the caller; 0 is one per core
+        void start(uint32_t threads);
+
+        void stop();
+
+        inline uint32_t threads() const {
+            return static_cast<uint32_t>(_workers.size()) + 1;
+        }
+
+        // task(i) for every i in [0, count), returns when all are done
+        void run(uint32_t count, const task_callable& task);
+
+    private:
+        void work_loop();
+
+        uint32_t take(uint64_t generation, uint32_t count, const task_callable& task);
+
+    private:
+        std::mutex _lock;
+        std::condition_variable _ready;
+        std::condition_variable _done;
+        bool _running = false;
+        uint64_t _generation = 0;
+        uint32_t _count = 0;
+        uint32_t _completed = 0;
+        const task_callable* _task = nullptr;
+
+        // generation in the high half, next index in the low half, so a
+        // thread that wakes late can't take an index from a later run
+        std::atomic<uint64_t> _next {0};
+
+        std::vector<std::thread> _workers;
+    };
+
+};
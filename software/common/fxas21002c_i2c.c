@@ -0,0 +1,34 @@
+//*****************************************************************************
+// FXAS21002C register access
+//*****************************************************************************
+
+#include "fxas21002c_i2c.h"
+
+static tI2CBus *g_psGyroBus;
+
+void I2CGyroBind(tI2CBus *psBus)
+{
+    g_psGyroBus = psBus;
+}
+
+int I2CGyroReceive(uint8_t ui8Addr, uint8_t ui8Reg,
+                   uint8_t *pui8Data, uint32_t ui32Count)
+{
+    if (!g_psGyroBus)
+    {
+        return -1;
+    }
+
+    return I2CBusRead(g_psGyroBus, ui8Addr, ui8Reg, pui8Data, ui32Count) ? -1 : 0;
+}
+
+int I2CGyroSend(uint8_t ui8Addr, uint8_t ui8Reg,
+                const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    if (!g_psGyroBus)
+    {
+        return -1;
+    }
+
+    return I2CBusWrite(g_psGyroBus, ui8Addr, ui8Reg, pui8Data, ui32Count) ? -1 : 0;
+}
@@ -0,0 +1,36 @@
+//*****************************************************************************
+// FXAS21002C register access
+//
+// I2CGyroReceive and I2CGyroSend, the entry points the FXAS21002C driver
+// was written against, carried over tI2CBus in place of fxas21002c_linaro.c
+// so they reach either /dev/i2c-N or the simulated part.  Bind a bus
+// before the first call.
+//*****************************************************************************
+
+#ifndef FXAS21002C_I2C_H
+#define FXAS21002C_I2C_H
+
+#include <stdint.h>
+#include "i2c_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void I2CGyroBind(tI2CBus *psBus);
+
+// Reads ui32Count registers starting at ui8Reg.  Returns 0 on success,
+// -1 on a bus error or if no bus is bound.
+extern int I2CGyroReceive(uint8_t ui8Addr, uint8_t ui8Reg,
+                          uint8_t *pui8Data, uint32_t ui32Count);
+
+// Writes ui32Count registers starting at ui8Reg.  Returns 0 on success,
+// -1 on a bus error or if no bus is bound.
+extern int I2CGyroSend(uint8_t ui8Addr, uint8_t ui8Reg,
+                       const uint8_t *pui8Data, uint32_t ui32Count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FXAS21002C_I2C_H
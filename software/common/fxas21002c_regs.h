@@ -0,0 +1,82 @@
+//*****************************************************************************
+// FXAS21002C register map
+//
+// Names are prefixed FXAS_ to keep them apart from the GYRO_ settings in
+// the examples.
+//*****************************************************************************
+
+#ifndef FXAS21002C_REGS_H
+#define FXAS21002C_REGS_H
+
+#define FXAS_STATUS             0x00    // mirrors DR_STATUS, or F_STATUS when the FIFO is on
+#define FXAS_OUT_X_MSB          0x01
+#define FXAS_OUT_Z_LSB          0x06
+#define FXAS_DR_STATUS          0x07
+#define FXAS_F_STATUS           0x08
+#define FXAS_F_SETUP            0x09
+#define FXAS_F_EVENT            0x0A
+#define FXAS_INT_SRC_FLAG       0x0B
+#define FXAS_WHO_AM_I           0x0C
+#define FXAS_CTRL_REG0          0x0D
+#define FXAS_TEMP               0x12
+#define FXAS_CTRL_REG1          0x13
+#define FXAS_CTRL_REG2          0x14
+#define FXAS_CTRL_REG3          0x15
+
+#define FXAS_WHO_AM_I_VALUE     0xD7
+
+// DR_STATUS
+#define FXAS_ZYXOW              0x80
+#define FXAS_ZYXDR              0x08
+
+// F_STATUS
+#define FXAS_F_OVF              0x80
+#define FXAS_F_WMKF             0x40
+#define FXAS_F_CNT_MASK         0x3F
+
+// F_SETUP
+#define FXAS_F_MODE_MASK        0xC0
+#define FXAS_F_MODE_CIRCULAR    0x40
+#define FXAS_F_MODE_FILL        0x80
+#define FXAS_F_WMRK_MASK        0x3F
+#define FXAS_FIFO_DEPTH         32
+
+// INT_SRC_FLAG
+#define FXAS_SRC_FIFO           0x04
+#define FXAS_SRC_DRDY           0x01
+
+// CTRL_REG0
+#define FXAS_FS_MASK            0x03
+#define FXAS_FS_2000DPS         0x00
+#define FXAS_FS_1000DPS         0x01
+#define FXAS_FS_500DPS          0x02
+#define FXAS_FS_250DPS          0x03
+
+// CTRL_REG1
+#define FXAS_RST                0x40
+#define FXAS_DR_SHIFT           2
+#define FXAS_DR_MASK            0x1C
+#define FXAS_ACTIVE             0x02
+#define FXAS_READY              0x01
+
+// CTRL_REG2
+#define FXAS_INT_CFG_FIFO       0x80
+#define FXAS_INT_EN_FIFO        0x40
+#define FXAS_INT_CFG_DRDY       0x08
+#define FXAS_INT_EN_DRDY        0x04
+#define FXAS_IPOL               0x02
+#define FXAS_PP_OD              0x01
+
+// CTRL_REG3
+#define FXAS_WRAPTOONE          0x08
+
+// CTRL_REG1 data rate codes
+#define FXAS_DR_800HZ           0
+#define FXAS_DR_400HZ           1
+#define FXAS_DR_200HZ           2
+#define FXAS_DR_100HZ           3
+#define FXAS_DR_50HZ            4
+#define FXAS_DR_25HZ            5
+#define FXAS_DR_12_5HZ          6
+
+#endif // FXAS21002C_REGS_H
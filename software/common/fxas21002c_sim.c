@@ -0,0 +1,341 @@
+//*****************************************************************************
+// FXAS21002C register-level simulator
+//*****************************************************************************
+
+#include <string.h>
+#include "fxas21002c_sim.h"
+
+// Output data rates in mHz, indexed by CTRL_REG1[dr]
+static const uint32_t g_pui32ODRmHz[8] =
+{
+    800000, 400000, 200000, 100000, 50000, 25000, 12500, 12500
+};
+
+static void FXASSimStationary(void *pvContext, uint64_t ui64TimeNs,
+                              int16_t *pi16Rate)
+{
+    (void)pvContext;
+    (void)ui64TimeNs;
+
+    pi16Rate[0] = 12;
+    pi16Rate[1] = -7;
+    pi16Rate[2] = 3;
+}
+
+static int FXASSimActive(const tFXASSim *psSim)
+{
+    return (psSim->pui8Regs[FXAS_CTRL_REG1] & FXAS_ACTIVE) != 0;
+}
+
+static int FXASSimFifoOn(const tFXASSim *psSim)
+{
+    return (psSim->pui8Regs[FXAS_F_SETUP] & FXAS_F_MODE_MASK) != 0;
+}
+
+uint64_t FXASSimPeriodNs(const tFXASSim *psSim)
+{
+    uint32_t ui32Dr = (psSim->pui8Regs[FXAS_CTRL_REG1] & FXAS_DR_MASK) >> FXAS_DR_SHIFT;
+
+    return 1000000000000ULL / g_pui32ODRmHz[ui32Dr];
+}
+
+static void FXASSimReset(tFXASSim *psSim)
+{
+    memset(psSim->pui8Regs, 0, sizeof(psSim->pui8Regs));
+    psSim->pui8Regs[FXAS_WHO_AM_I] = FXAS_WHO_AM_I_VALUE;
+    psSim->ui32FifoHead = 0;
+    psSim->ui32FifoCount = 0;
+    psSim->ui8Overflow = 0;
+}
+
+static void FXASSimPush(tFXASSim *psSim)
+{
+    uint32_t ui32Tail;
+
+    if (psSim->ui32FifoCount == FXAS_FIFO_DEPTH)
+    {
+        psSim->ui8Overflow = 1;
+        psSim->ui64Overruns++;
+
+        if ((psSim->pui8Regs[FXAS_F_SETUP] & FXAS_F_MODE_MASK) == FXAS_F_MODE_FILL)
+        {
+            return;
+        }
+        psSim->ui32FifoHead = (psSim->ui32FifoHead + 1) % FXAS_FIFO_DEPTH;
+        psSim->ui32FifoCount--;
+    }
+
+    ui32Tail = (psSim->ui32FifoHead + psSim->ui32FifoCount) % FXAS_FIFO_DEPTH;
+    memcpy(psSim->ppi16Fifo[ui32Tail], psSim->pi16Rate, sizeof(psSim->pi16Rate));
+    psSim->ui32FifoCount++;
+}
+
+static void FXASSimAdvance(tFXASSim *psSim, uint64_t ui64NowNs)
+{
+    uint64_t ui64Period;
+    uint64_t ui64Due;
+
+    if (!FXASSimActive(psSim))
+    {
+        return;
+    }
+
+    ui64Period = FXASSimPeriodNs(psSim);
+
+    if (ui64NowNs > psSim->ui64NextSampleNs + ui64Period * 2 * FXAS_FIFO_DEPTH)
+    {
+        ui64Due = (ui64NowNs - psSim->ui64NextSampleNs) / ui64Period - 2 * FXAS_FIFO_DEPTH;
+        psSim->ui64NextSampleNs += ui64Due * ui64Period;
+        psSim->ui64Overruns += ui64Due;
+        if (FXASSimFifoOn(psSim))
+        {
+            psSim->ui8Overflow = 1;
+        }
+        else
+        {
+            psSim->pui8Regs[FXAS_DR_STATUS] |= FXAS_ZYXOW;
+        }
+    }
+
+    while (psSim->ui64NextSampleNs <= ui64NowNs)
+    {
+        psSim->pfnSource(psSim->pvSourceContext, psSim->ui64NextSampleNs, psSim->pi16Rate);
+        psSim->ui64Samples++;
+
+        if (FXASSimFifoOn(psSim))
+        {
+            FXASSimPush(psSim);
+        }
+        else if (psSim->pui8Regs[FXAS_DR_STATUS] & FXAS_ZYXDR)
+        {
+            psSim->pui8Regs[FXAS_DR_STATUS] |= FXAS_ZYXOW;
+        }
+
+        psSim->pui8Regs[FXAS_DR_STATUS] |= 0x0F;
+        psSim->ui64NextSampleNs += ui64Period;
+    }
+}
+
+static uint8_t FXASSimFifoStatus(const tFXASSim *psSim)
+{
+    uint8_t ui8Watermark = psSim->pui8Regs[FXAS_F_SETUP] & FXAS_F_WMRK_MASK;
+    uint8_t ui8Status = (uint8_t)psSim->ui32FifoCount;
+
+    if (ui8Watermark && psSim->ui32FifoCount >= ui8Watermark)
+    {
+        ui8Status |= FXAS_F_WMKF;
+    }
+    if (psSim->ui8Overflow)
+    {
+        ui8Status |= FXAS_F_OVF;
+    }
+
+    return ui8Status;
+}
+
+static uint8_t FXASSimIntSource(const tFXASSim *psSim)
+{
+    uint8_t ui8Ctrl = psSim->pui8Regs[FXAS_CTRL_REG2];
+    uint8_t ui8Source = 0;
+
+    if ((ui8Ctrl & FXAS_INT_EN_FIFO) && (FXASSimFifoStatus(psSim) & (FXAS_F_WMKF | FXAS_F_OVF)))
+    {
+        ui8Source |= FXAS_SRC_FIFO;
+    }
+    if ((ui8Ctrl & FXAS_INT_EN_DRDY) && (psSim->pui8Regs[FXAS_DR_STATUS] & FXAS_ZYXDR))
+    {
+        ui8Source |= FXAS_SRC_DRDY;
+    }
+
+    return ui8Source;
+}
+
+static uint8_t FXASSimSampleByte(const int16_t *pi16Sample, uint32_t ui32Byte)
+{
+    uint16_t ui16Value = (uint16_t)pi16Sample[ui32Byte / 2];
+
+    return (ui32Byte & 1) ? (uint8_t)(ui16Value & 0xFF) : (uint8_t)(ui16Value >> 8);
+}
+
+static uint8_t FXASSimReadByte(tFXASSim *psSim, uint8_t ui8Reg)
+{
+    uint8_t ui8Value;
+
+    if (ui8Reg == FXAS_STATUS)
+    {
+        return FXASSimFifoOn(psSim) ? FXASSimFifoStatus(psSim) : psSim->pui8Regs[FXAS_DR_STATUS];
+    }
+
+    if (ui8Reg == FXAS_F_STATUS)
+    {
+        ui8Value = FXASSimFifoStatus(psSim);
+        psSim->ui8Overflow = 0;
+        return ui8Value;
+    }
+
+    if (ui8Reg >= FXAS_OUT_X_MSB && ui8Reg <= FXAS_OUT_Z_LSB)
+    {
+        uint32_t ui32Byte = ui8Reg - FXAS_OUT_X_MSB;
+
+        if (!FXASSimFifoOn(psSim))
+        {
+            if (ui8Reg == FXAS_OUT_Z_LSB)
+            {
+                psSim->pui8Regs[FXAS_DR_STATUS] = 0;
+            }
+            return FXASSimSampleByte(psSim->pi16Rate, ui32Byte);
+        }
+
+        if (psSim->ui32FifoCount == 0)
+        {
+            return 0;
+        }
+        ui8Value = FXASSimSampleByte(psSim->ppi16Fifo[psSim->ui32FifoHead], ui32Byte);
+        if (ui8Reg == FXAS_OUT_Z_LSB)
+        {
+            psSim->ui32FifoHead = (psSim->ui32FifoHead + 1) % FXAS_FIFO_DEPTH;
+            psSim->ui32FifoCount--;
+            if (psSim->ui32FifoCount == 0)
+            {
+                psSim->ui8Overflow = 0;
+            }
+        }
+        return ui8Value;
+    }
+
+    if (ui8Reg == FXAS_INT_SRC_FLAG)
+    {
+        return FXASSimIntSource(psSim);
+    }
+
+    if (ui8Reg == FXAS_TEMP)
+    {
+        return 25;
+    }
+
+    return ui8Reg < sizeof(psSim->pui8Regs) ? psSim->pui8Regs[ui8Reg] : 0;
+}
+
+static uint8_t FXASSimNextReg(const tFXASSim *psSim, uint8_t ui8Reg)
+{
+    // Bursts through the output registers wrap back to STATUS, or to
+    // OUT_X_MSB with WRAPTOONE so FIFO drains don't re-read the status
+    if (ui8Reg == FXAS_OUT_Z_LSB)
+    {
+        return (psSim->pui8Regs[FXAS_CTRL_REG3] & FXAS_WRAPTOONE) ? FXAS_OUT_X_MSB : FXAS_STATUS;
+    }
+
+    return (uint8_t)(ui8Reg + 1);
+}
+
+static int FXASSimRead(tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                       uint8_t ui8Reg, uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tFXASSim *psSim = (tFXASSim *)psDevice->pvContext;
+    uint32_t ui32Idx;
+
+    FXASSimAdvance(psSim, ui64NowNs);
+
+    for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++)
+    {
+        pui8Data[ui32Idx] = FXASSimReadByte(psSim, ui8Reg);
+        ui8Reg = FXASSimNextReg(psSim, ui8Reg);
+    }
+
+    return 0;
+}
+
+static int FXASSimWrite(tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                        uint8_t ui8Reg, const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tFXASSim *psSim = (tFXASSim *)psDevice->pvContext;
+    uint32_t ui32Idx;
+
+    FXASSimAdvance(psSim, ui64NowNs);
+
+    for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++, ui8Reg++)
+    {
+        uint8_t ui8Value = pui8Data[ui32Idx];
+        int bWasActive = FXASSimActive(psSim);
+
+        if (ui8Reg >= sizeof(psSim->pui8Regs))
+        {
+            continue;
+        }
+
+        if (ui8Reg == FXAS_CTRL_REG1 && (ui8Value & FXAS_RST))
+        {
+            FXASSimReset(psSim);
+            continue;
+        }
+
+        if (ui8Reg <= FXAS_F_STATUS || ui8Reg == FXAS_INT_SRC_FLAG
+            || ui8Reg == FXAS_WHO_AM_I || ui8Reg == FXAS_TEMP)
+        {
+            continue;
+        }
+
+        // Configuration registers only take effect in standby/ready
+        if (bWasActive && ui8Reg != FXAS_CTRL_REG1 && ui8Reg != FXAS_F_SETUP)
+        {
+            continue;
+        }
+
+        if (ui8Reg == FXAS_F_SETUP
+            && (ui8Value & FXAS_F_MODE_MASK) != (psSim->pui8Regs[FXAS_F_SETUP] & FXAS_F_MODE_MASK))
+        {
+            psSim->ui32FifoHead = 0;
+            psSim->ui32FifoCount = 0;
+            psSim->ui8Overflow = 0;
+        }
+
+        psSim->pui8Regs[ui8Reg] = ui8Value;
+
+        if (ui8Reg == FXAS_CTRL_REG1 && !bWasActive && (ui8Value & FXAS_ACTIVE))
+        {
+            psSim->ui64NextSampleNs = ui64NowNs + FXASSimPeriodNs(psSim);
+        }
+    }
+
+    return 0;
+}
+
+static int FXASSimIrq(tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                      uint32_t ui32Line, uint64_t *pui64NextNs)
+{
+    tFXASSim *psSim = (tFXASSim *)psDevice->pvContext;
+    uint8_t ui8Ctrl = psSim->pui8Regs[FXAS_CTRL_REG2];
+    uint8_t ui8Source;
+    uint8_t ui8ToInt1 = 0;
+
+    FXASSimAdvance(psSim, ui64NowNs);
+    *pui64NextNs = FXASSimActive(psSim) ? psSim->ui64NextSampleNs : UINT64_MAX;
+
+    ui8Source = FXASSimIntSource(psSim);
+    if (ui8Ctrl & FXAS_INT_CFG_FIFO)
+    {
+        ui8ToInt1 |= FXAS_SRC_FIFO;
+    }
+    if (ui8Ctrl & FXAS_INT_CFG_DRDY)
+    {
+        ui8ToInt1 |= FXAS_SRC_DRDY;
+    }
+
+    return ui32Line == 1 ? (ui8Source & ui8ToInt1) != 0 : (ui8Source & ~ui8ToInt1) != 0;
+}
+
+void FXASSimInit(tFXASSim *psSim, uint8_t ui8Addr,
+                 tFXASSimSource pfnSource, void *pvSourceContext)
+{
+    memset(psSim, 0, sizeof(*psSim));
+    FXASSimReset(psSim);
+
+    psSim->sDevice.ui8Addr = ui8Addr;
+    psSim->sDevice.pfnRead = FXASSimRead;
+    psSim->sDevice.pfnWrite = FXASSimWrite;
+    psSim->sDevice.pfnIrq = FXASSimIrq;
+    psSim->sDevice.pvContext = psSim;
+
+    psSim->pfnSource = pfnSource ? pfnSource : FXASSimStationary;
+    psSim->pvSourceContext = pvSourceContext;
+}
@@ -0,0 +1,55 @@
+//*****************************************************************************
+// FXAS21002C register-level simulator
+//
+// Models the register file, output data rate timing, data-ready and the
+// 32-sample FIFO with watermark, the INT1/INT2 routing and the
+// auto-increment wrap used by burst reads.
+//*****************************************************************************
+
+#ifndef FXAS21002C_SIM_H
+#define FXAS21002C_SIM_H
+
+#include <stdint.h>
+#include "i2c_sim.h"
+#include "fxas21002c_regs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Supplies raw 16-bit angular rate counts for the sample at ui64TimeNs
+typedef void (*tFXASSimSource)(void *pvContext, uint64_t ui64TimeNs,
+                               int16_t *pi16Rate);
+
+typedef struct
+{
+    tI2CSimDevice sDevice;
+
+    uint8_t pui8Regs[32];
+
+    int16_t ppi16Fifo[FXAS_FIFO_DEPTH][3];
+    uint32_t ui32FifoHead;
+    uint32_t ui32FifoCount;
+    uint8_t ui8Overflow;
+
+    int16_t pi16Rate[3];
+    uint64_t ui64NextSampleNs;
+
+    tFXASSimSource pfnSource;
+    void *pvSourceContext;
+
+    uint64_t ui64Samples;
+    uint64_t ui64Overruns;
+} tFXASSim;
+
+// A null source produces a stationary sensor with a small zero-rate offset
+extern void FXASSimInit(tFXASSim *psSim, uint8_t ui8Addr,
+                        tFXASSimSource pfnSource, void *pvSourceContext);
+
+extern uint64_t FXASSimPeriodNs(const tFXASSim *psSim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FXAS21002C_SIM_H
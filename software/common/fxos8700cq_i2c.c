@@ -0,0 +1,34 @@
+//*****************************************************************************
+// FXOS8700CQ register access
+//*****************************************************************************
+
+#include "fxos8700cq_i2c.h"
+
+static tI2CBus *g_psAGBus;
+
+void I2CAGBind(tI2CBus *psBus)
+{
+    g_psAGBus = psBus;
+}
+
+int I2CAGReceive(uint8_t ui8Addr, uint8_t ui8Reg,
+                 uint8_t *pui8Data, uint32_t ui32Count)
+{
+    if (!g_psAGBus)
+    {
+        return -1;
+    }
+
+    return I2CBusRead(g_psAGBus, ui8Addr, ui8Reg, pui8Data, ui32Count) ? -1 : 0;
+}
+
+int I2CAGSend(uint8_t ui8Addr, uint8_t ui8Reg,
+              const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    if (!g_psAGBus)
+    {
+        return -1;
+    }
+
+    return I2CBusWrite(g_psAGBus, ui8Addr, ui8Reg, pui8Data, ui32Count) ? -1 : 0;
+}
@@ -0,0 +1,36 @@
+//*****************************************************************************
+// FXOS8700CQ register access
+//
+// I2CAGReceive and I2CAGSend, the entry points the FXOS8700CQ driver
+// was written against, carried over tI2CBus in place of fxos8700cq_linaro.c
+// so they reach either /dev/i2c-N or the simulated part.  Bind a bus
+// before the first call.
+//*****************************************************************************
+
+#ifndef FXOS8700CQ_I2C_H
+#define FXOS8700CQ_I2C_H
+
+#include <stdint.h>
+#include "i2c_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void I2CAGBind(tI2CBus *psBus);
+
+// Reads ui32Count registers starting at ui8Reg.  Returns 0 on success,
+// -1 on a bus error or if no bus is bound.
+extern int I2CAGReceive(uint8_t ui8Addr, uint8_t ui8Reg,
+                        uint8_t *pui8Data, uint32_t ui32Count);
+
+// Writes ui32Count registers starting at ui8Reg.  Returns 0 on success,
+// -1 on a bus error or if no bus is bound.
+extern int I2CAGSend(uint8_t ui8Addr, uint8_t ui8Reg,
+                     const uint8_t *pui8Data, uint32_t ui32Count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FXOS8700CQ_I2C_H
@@ -0,0 +1,89 @@
+//*****************************************************************************
+// FXOS8700CQ register map
+//
+// Only what the FIFO sampler and the simulator need.  Names are prefixed
+// FXOS_ to keep them apart from the AG_ settings in the examples.
+//*****************************************************************************
+
+#ifndef FXOS8700CQ_REGS_H
+#define FXOS8700CQ_REGS_H
+
+#define FXOS_STATUS             0x00    // DR_STATUS, or F_STATUS when the FIFO is on
+#define FXOS_OUT_X_MSB          0x01
+#define FXOS_OUT_Z_LSB          0x06
+#define FXOS_F_SETUP            0x09
+#define FXOS_SYSMOD             0x0B
+#define FXOS_INT_SOURCE         0x0C
+#define FXOS_WHO_AM_I           0x0D
+#define FXOS_XYZ_DATA_CFG       0x0E
+#define FXOS_CTRL_REG1          0x2A
+#define FXOS_CTRL_REG2          0x2B
+#define FXOS_CTRL_REG3          0x2C
+#define FXOS_CTRL_REG4          0x2D
+#define FXOS_CTRL_REG5          0x2E
+#define FXOS_M_DR_STATUS        0x32
+#define FXOS_M_OUT_X_MSB        0x33
+#define FXOS_M_OUT_Z_LSB        0x38
+#define FXOS_M_CTRL_REG1        0x5B
+#define FXOS_M_CTRL_REG2        0x5C
+#define FXOS_M_CTRL_REG3        0x5D
+
+#define FXOS_WHO_AM_I_VALUE     0xC7
+
+// F_STATUS
+#define FXOS_F_OVF              0x80
+#define FXOS_F_WMRK_FLAG        0x40
+#define FXOS_F_CNT_MASK         0x3F
+
+// F_SETUP
+#define FXOS_F_MODE_MASK        0xC0
+#define FXOS_F_MODE_CIRCULAR    0x40
+#define FXOS_F_MODE_FILL        0x80
+#define FXOS_F_WMRK_MASK        0x3F
+#define FXOS_FIFO_DEPTH         32
+
+// CTRL_REG1
+#define FXOS_ACTIVE             0x01
+#define FXOS_F_READ             0x02
+#define FXOS_LNOISE             0x04
+#define FXOS_DR_SHIFT           3
+#define FXOS_DR_MASK            0x38
+
+// CTRL_REG2
+#define FXOS_RST                0x40
+
+// CTRL_REG3
+#define FXOS_IPOL               0x02
+#define FXOS_PP_OD              0x01
+
+// CTRL_REG4 / CTRL_REG5 (interrupt enable / route to INT1) and INT_SOURCE
+#define FXOS_INT_FIFO           0x40
+#define FXOS_INT_DRDY           0x01
+
+// XYZ_DATA_CFG
+#define FXOS_FS_MASK            0x03
+#define FXOS_FS_2G              0x00
+#define FXOS_FS_4G              0x01
+#define FXOS_FS_8G              0x02
+
+// M_CTRL_REG1
+#define FXOS_M_HMS_MASK         0x03
+#define FXOS_M_HMS_ACCEL        0x00
+#define FXOS_M_HMS_MAG          0x01
+#define FXOS_M_HMS_HYBRID       0x03
+#define FXOS_M_OS_SHIFT         2
+
+// M_CTRL_REG2
+#define FXOS_M_HYB_AUTOINC      0x20
+
+// CTRL_REG1 data rate codes; in hybrid mode each sensor gets half
+#define FXOS_DR_800HZ           0
+#define FXOS_DR_400HZ           1
+#define FXOS_DR_200HZ           2
+#define FXOS_DR_100HZ           3
+#define FXOS_DR_50HZ            4
+#define FXOS_DR_12_5HZ          5
+#define FXOS_DR_6_25HZ          6
+#define FXOS_DR_1_56HZ          7
+
+#endif // FXOS8700CQ_REGS_H
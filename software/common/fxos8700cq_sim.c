@@ -0,0 +1,363 @@
+//*****************************************************************************
+// FXOS8700CQ register-level simulator
+//*****************************************************************************
+
+#include <string.h>
+#include "fxos8700cq_sim.h"
+
+// Single-sensor output data rates in mHz, indexed by CTRL_REG1[dr]
+static const uint32_t g_pui32ODRmHz[8] =
+{
+    800000, 400000, 200000, 100000, 50000, 12500, 6250, 1563
+};
+
+static void FXOSSimStationary(void *pvContext, uint64_t ui64TimeNs,
+                              int16_t *pi16Accel, int16_t *pi16Mag)
+{
+    const tFXOSSim *psSim = (const tFXOSSim *)pvContext;
+
+    (void)ui64TimeNs;
+
+    // 1 g is 4096 counts at ±2 g full scale, halved for each range step;
+    // mag is ~50 uT at 0.1 uT/LSB
+    pi16Accel[0] = 0;
+    pi16Accel[1] = 0;
+    pi16Accel[2] = (int16_t)(4096 >> (psSim->pui8Regs[FXOS_XYZ_DATA_CFG] & FXOS_FS_MASK));
+    pi16Mag[0] = 220;
+    pi16Mag[1] = -40;
+    pi16Mag[2] = -430;
+}
+
+static int FXOSSimActive(const tFXOSSim *psSim)
+{
+    return (psSim->pui8Regs[FXOS_CTRL_REG1] & FXOS_ACTIVE) != 0;
+}
+
+static int FXOSSimFifoOn(const tFXOSSim *psSim)
+{
+    return (psSim->pui8Regs[FXOS_F_SETUP] & FXOS_F_MODE_MASK) != 0;
+}
+
+static int FXOSSimHybrid(const tFXOSSim *psSim)
+{
+    return (psSim->pui8Regs[FXOS_M_CTRL_REG1] & FXOS_M_HMS_MASK) == FXOS_M_HMS_HYBRID;
+}
+
+uint64_t FXOSSimPeriodNs(const tFXOSSim *psSim)
+{
+    uint32_t ui32Dr = (psSim->pui8Regs[FXOS_CTRL_REG1] & FXOS_DR_MASK) >> FXOS_DR_SHIFT;
+    uint64_t ui64Period = 1000000000000ULL / g_pui32ODRmHz[ui32Dr];
+
+    return FXOSSimHybrid(psSim) ? ui64Period * 2 : ui64Period;
+}
+
+static void FXOSSimReset(tFXOSSim *psSim)
+{
+    memset(psSim->pui8Regs, 0, sizeof(psSim->pui8Regs));
+    psSim->pui8Regs[FXOS_WHO_AM_I] = FXOS_WHO_AM_I_VALUE;
+    psSim->ui32FifoHead = 0;
+    psSim->ui32FifoCount = 0;
+    psSim->ui32FifoByte = 0;
+    psSim->ui8Overflow = 0;
+}
+
+static void FXOSSimPush(tFXOSSim *psSim)
+{
+    uint32_t ui32Tail;
+    uint8_t ui8Mode = psSim->pui8Regs[FXOS_F_SETUP] & FXOS_F_MODE_MASK;
+
+    if (psSim->ui32FifoCount == FXOS_FIFO_DEPTH)
+    {
+        psSim->ui8Overflow = 1;
+        psSim->ui64Overruns++;
+
+        // Fill mode stops accepting data; circular mode drops the oldest
+        if (ui8Mode == FXOS_F_MODE_FILL)
+        {
+            return;
+        }
+        psSim->ui32FifoHead = (psSim->ui32FifoHead + 1) % FXOS_FIFO_DEPTH;
+        psSim->ui32FifoCount--;
+    }
+
+    ui32Tail = (psSim->ui32FifoHead + psSim->ui32FifoCount) % FXOS_FIFO_DEPTH;
+    memcpy(psSim->ppi16Fifo[ui32Tail], psSim->pi16Accel, sizeof(psSim->pi16Accel));
+    psSim->ui32FifoCount++;
+}
+
+// Generates every sample due up to ui64NowNs
+static void FXOSSimAdvance(tFXOSSim *psSim, uint64_t ui64NowNs)
+{
+    uint64_t ui64Period;
+    uint64_t ui64Due;
+
+    if (!FXOSSimActive(psSim))
+    {
+        return;
+    }
+
+    ui64Period = FXOSSimPeriodNs(psSim);
+
+    // Anything older than a full FIFO would be overwritten anyway
+    if (ui64NowNs > psSim->ui64NextSampleNs + ui64Period * 2 * FXOS_FIFO_DEPTH)
+    {
+        ui64Due = (ui64NowNs - psSim->ui64NextSampleNs) / ui64Period - 2 * FXOS_FIFO_DEPTH;
+        psSim->ui64NextSampleNs += ui64Due * ui64Period;
+        psSim->ui64Overruns += ui64Due;
+        if (FXOSSimFifoOn(psSim))
+        {
+            psSim->ui8Overflow = 1;
+        }
+    }
+
+    while (psSim->ui64NextSampleNs <= ui64NowNs)
+    {
+        psSim->pfnSource(psSim->pvSourceContext, psSim->ui64NextSampleNs,
+                         psSim->pi16Accel, psSim->pi16Mag);
+        psSim->ui64Samples++;
+
+        if (FXOSSimFifoOn(psSim))
+        {
+            FXOSSimPush(psSim);
+        }
+
+        psSim->pui8Regs[FXOS_STATUS] |= 0x0F;
+        psSim->pui8Regs[FXOS_M_DR_STATUS] |= 0x0F;
+        psSim->ui64NextSampleNs += ui64Period;
+    }
+}
+
+static uint8_t FXOSSimFifoStatus(tFXOSSim *psSim)
+{
+    uint8_t ui8Watermark = psSim->pui8Regs[FXOS_F_SETUP] & FXOS_F_WMRK_MASK;
+    uint8_t ui8Status = (uint8_t)psSim->ui32FifoCount;
+
+    if (ui8Watermark && psSim->ui32FifoCount >= ui8Watermark)
+    {
+        ui8Status |= FXOS_F_WMRK_FLAG;
+    }
+    if (psSim->ui8Overflow)
+    {
+        ui8Status |= FXOS_F_OVF;
+    }
+
+    return ui8Status;
+}
+
+static uint8_t FXOSSimIntSource(tFXOSSim *psSim)
+{
+    uint8_t ui8Enabled = psSim->pui8Regs[FXOS_CTRL_REG4];
+    uint8_t ui8Source = 0;
+
+    if ((ui8Enabled & FXOS_INT_FIFO) && (FXOSSimFifoStatus(psSim) & (FXOS_F_WMRK_FLAG | FXOS_F_OVF)))
+    {
+        ui8Source |= FXOS_INT_FIFO;
+    }
+    if ((ui8Enabled & FXOS_INT_DRDY) && (psSim->pui8Regs[FXOS_STATUS] & 0x08))
+    {
+        ui8Source |= FXOS_INT_DRDY;
+    }
+
+    return ui8Source;
+}
+
+static uint8_t FXOSSimSampleByte(const int16_t *pi16Sample, uint32_t ui32Byte, int bLeftJustify)
+{
+    uint16_t ui16Value = (uint16_t)pi16Sample[ui32Byte / 2];
+
+    if (bLeftJustify)
+    {
+        ui16Value = (uint16_t)(ui16Value << 2);
+    }
+
+    return (ui32Byte & 1) ? (uint8_t)(ui16Value & 0xFF) : (uint8_t)(ui16Value >> 8);
+}
+
+static uint8_t FXOSSimReadByte(tFXOSSim *psSim, uint8_t ui8Reg)
+{
+    uint8_t ui8Value;
+
+    if (ui8Reg == FXOS_STATUS)
+    {
+        if (FXOSSimFifoOn(psSim))
+        {
+            ui8Value = FXOSSimFifoStatus(psSim);
+            psSim->ui8Overflow = 0;
+            return ui8Value;
+        }
+        return psSim->pui8Regs[FXOS_STATUS];
+    }
+
+    if (ui8Reg >= FXOS_OUT_X_MSB && ui8Reg <= FXOS_OUT_Z_LSB)
+    {
+        uint32_t ui32Byte = ui8Reg - FXOS_OUT_X_MSB;
+
+        if (!FXOSSimFifoOn(psSim))
+        {
+            // Data ready clears once the sample has been read out
+            if (ui8Reg == FXOS_OUT_Z_LSB)
+            {
+                psSim->pui8Regs[FXOS_STATUS] = 0;
+            }
+            return FXOSSimSampleByte(psSim->pi16Accel, ui32Byte, 1);
+        }
+
+        // Reading through OUT_Z_LSB pops the FIFO; an empty FIFO reads 0
+        if (psSim->ui32FifoCount == 0)
+        {
+            return 0;
+        }
+        ui8Value = FXOSSimSampleByte(psSim->ppi16Fifo[psSim->ui32FifoHead], ui32Byte, 1);
+        if (ui8Reg == FXOS_OUT_Z_LSB)
+        {
+            psSim->ui32FifoHead = (psSim->ui32FifoHead + 1) % FXOS_FIFO_DEPTH;
+            psSim->ui32FifoCount--;
+        }
+        return ui8Value;
+    }
+
+    if (ui8Reg >= FXOS_M_OUT_X_MSB && ui8Reg <= FXOS_M_OUT_Z_LSB)
+    {
+        if (ui8Reg == FXOS_M_OUT_Z_LSB)
+        {
+            psSim->pui8Regs[FXOS_M_DR_STATUS] = 0;
+        }
+        return FXOSSimSampleByte(psSim->pi16Mag, ui8Reg - FXOS_M_OUT_X_MSB, 0);
+    }
+
+    if (ui8Reg == FXOS_INT_SOURCE)
+    {
+        return FXOSSimIntSource(psSim);
+    }
+
+    if (ui8Reg == FXOS_SYSMOD)
+    {
+        return FXOSSimActive(psSim) ? 0x01 : 0x00;
+    }
+
+    return psSim->pui8Regs[ui8Reg & 0x7F];
+}
+
+// Register address after ui8Reg during a burst
+static uint8_t FXOSSimNextReg(const tFXOSSim *psSim, uint8_t ui8Reg)
+{
+    if (ui8Reg == FXOS_OUT_Z_LSB)
+    {
+        if (FXOSSimFifoOn(psSim))
+        {
+            return FXOS_OUT_X_MSB;
+        }
+        if (psSim->pui8Regs[FXOS_M_CTRL_REG2] & FXOS_M_HYB_AUTOINC)
+        {
+            return FXOS_M_OUT_X_MSB;
+        }
+    }
+
+    if (ui8Reg == FXOS_M_OUT_Z_LSB && (psSim->pui8Regs[FXOS_M_CTRL_REG2] & FXOS_M_HYB_AUTOINC))
+    {
+        return FXOS_STATUS;
+    }
+
+    return (uint8_t)((ui8Reg + 1) & 0x7F);
+}
+
+static int FXOSSimRead(tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                       uint8_t ui8Reg, uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tFXOSSim *psSim = (tFXOSSim *)psDevice->pvContext;
+    uint32_t ui32Idx;
+
+    FXOSSimAdvance(psSim, ui64NowNs);
+
+    for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++)
+    {
+        pui8Data[ui32Idx] = FXOSSimReadByte(psSim, ui8Reg);
+        ui8Reg = FXOSSimNextReg(psSim, ui8Reg);
+    }
+
+    return 0;
+}
+
+static int FXOSSimWrite(tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                        uint8_t ui8Reg, const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tFXOSSim *psSim = (tFXOSSim *)psDevice->pvContext;
+    uint32_t ui32Idx;
+
+    FXOSSimAdvance(psSim, ui64NowNs);
+
+    for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++, ui8Reg = (uint8_t)((ui8Reg + 1) & 0x7F))
+    {
+        uint8_t ui8Value = pui8Data[ui32Idx];
+        int bWasActive = FXOSSimActive(psSim);
+
+        if (ui8Reg == FXOS_CTRL_REG2 && (ui8Value & FXOS_RST))
+        {
+            FXOSSimReset(psSim);
+            continue;
+        }
+
+        // Read-only registers
+        if (ui8Reg == FXOS_WHO_AM_I || ui8Reg == FXOS_INT_SOURCE || ui8Reg == FXOS_SYSMOD
+            || (ui8Reg <= FXOS_OUT_Z_LSB) || (ui8Reg >= FXOS_M_DR_STATUS && ui8Reg <= FXOS_M_OUT_Z_LSB))
+        {
+            continue;
+        }
+
+        // Like the part, most configuration only sticks in standby
+        if (bWasActive && ui8Reg != FXOS_CTRL_REG1)
+        {
+            continue;
+        }
+
+        if (ui8Reg == FXOS_F_SETUP
+            && (ui8Value & FXOS_F_MODE_MASK) != (psSim->pui8Regs[FXOS_F_SETUP] & FXOS_F_MODE_MASK))
+        {
+            psSim->ui32FifoHead = 0;
+            psSim->ui32FifoCount = 0;
+            psSim->ui8Overflow = 0;
+        }
+
+        psSim->pui8Regs[ui8Reg] = ui8Value;
+
+        if (ui8Reg == FXOS_CTRL_REG1 && !bWasActive && (ui8Value & FXOS_ACTIVE))
+        {
+            psSim->ui64NextSampleNs = ui64NowNs + FXOSSimPeriodNs(psSim);
+        }
+    }
+
+    return 0;
+}
+
+static int FXOSSimIrq(tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                      uint32_t ui32Line, uint64_t *pui64NextNs)
+{
+    tFXOSSim *psSim = (tFXOSSim *)psDevice->pvContext;
+    uint8_t ui8Source;
+    uint8_t ui8ToInt1;
+
+    FXOSSimAdvance(psSim, ui64NowNs);
+    *pui64NextNs = FXOSSimActive(psSim) ? psSim->ui64NextSampleNs : UINT64_MAX;
+
+    // CTRL_REG5 routes each source to INT1 when set, INT2 otherwise
+    ui8Source = FXOSSimIntSource(psSim);
+    ui8ToInt1 = psSim->pui8Regs[FXOS_CTRL_REG5];
+
+    return ui32Line == 1 ? (ui8Source & ui8ToInt1) != 0 : (ui8Source & ~ui8ToInt1) != 0;
+}
+
+void FXOSSimInit(tFXOSSim *psSim, uint8_t ui8Addr,
+                 tFXOSSimSource pfnSource, void *pvSourceContext)
+{
+    memset(psSim, 0, sizeof(*psSim));
+    FXOSSimReset(psSim);
+
+    psSim->sDevice.ui8Addr = ui8Addr;
+    psSim->sDevice.pfnRead = FXOSSimRead;
+    psSim->sDevice.pfnWrite = FXOSSimWrite;
+    psSim->sDevice.pfnIrq = FXOSSimIrq;
+    psSim->sDevice.pvContext = psSim;
+
+    psSim->pfnSource = pfnSource ? pfnSource : FXOSSimStationary;
+    psSim->pvSourceContext = pfnSource ? pvSourceContext : psSim;
+}
@@ -0,0 +1,61 @@
+//*****************************************************************************
+// FXOS8700CQ register-level simulator
+//
+// Models the register file, output data rate timing (including hybrid
+// mode halving), the 32-sample accelerometer FIFO with watermark and
+// overflow, and the auto-increment rules used by burst reads.
+//*****************************************************************************
+
+#ifndef FXOS8700CQ_SIM_H
+#define FXOS8700CQ_SIM_H
+
+#include <stdint.h>
+#include "i2c_sim.h"
+#include "fxos8700cq_regs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Supplies raw counts for the sample taken at ui64TimeNs.  Accelerometer
+// counts are 14-bit right-justified, magnetometer counts 16-bit.
+typedef void (*tFXOSSimSource)(void *pvContext, uint64_t ui64TimeNs,
+                               int16_t *pi16Accel, int16_t *pi16Mag);
+
+typedef struct
+{
+    tI2CSimDevice sDevice;
+
+    uint8_t pui8Regs[128];
+
+    int16_t ppi16Fifo[FXOS_FIFO_DEPTH][3];
+    uint32_t ui32FifoHead;
+    uint32_t ui32FifoCount;
+    uint32_t ui32FifoByte;
+    uint8_t ui8Overflow;
+
+    int16_t pi16Accel[3];
+    int16_t pi16Mag[3];
+    uint64_t ui64NextSampleNs;
+
+    tFXOSSimSource pfnSource;
+    void *pvSourceContext;
+
+    // Samples generated and lost to FIFO overflow
+    uint64_t ui64Samples;
+    uint64_t ui64Overruns;
+} tFXOSSim;
+
+// Sets up the model at ui8Addr with power-on register values.  A null
+// source produces a stationary sensor reading 1 g on Z.
+extern void FXOSSimInit(tFXOSSim *psSim, uint8_t ui8Addr,
+                        tFXOSSimSource pfnSource, void *pvSourceContext);
+
+// Accelerometer sample period for the current CTRL_REG1/M_CTRL_REG1 setup
+extern uint64_t FXOSSimPeriodNs(const tFXOSSim *psSim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FXOS8700CQ_SIM_H
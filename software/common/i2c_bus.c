@@ -0,0 +1,183 @@
+//*****************************************************************************
+// I2C bus transport
+//*****************************************************************************
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "i2c_bus.h"
+
+// Bit times for one transaction excluding payload: START, address+W,
+// register, repeated START, address+R, STOP.  Each byte is 9 bits with ACK.
+#define I2C_READ_OVERHEAD_BITS      (1 + 9 + 9 + 1 + 9 + 1)
+#define I2C_WRITE_OVERHEAD_BITS     (1 + 9 + 9 + 1)
+
+uint64_t I2CMonotonicNs(void)
+{
+    struct timespec sTs;
+
+    clock_gettime(CLOCK_MONOTONIC, &sTs);
+    return (uint64_t)sTs.tv_sec * 1000000000ULL + (uint64_t)sTs.tv_nsec;
+}
+
+void I2CMonotonicSleepUntil(tI2CBus *psBus, uint64_t ui64Ns)
+{
+    struct timespec sTs;
+
+    (void)psBus;
+    sTs.tv_sec = (time_t)(ui64Ns / 1000000000ULL);
+    sTs.tv_nsec = (long)(ui64Ns % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sTs, 0) == EINTR)
+    {
+    }
+}
+
+//*****************************************************************************
+// Linux i2c-dev backend
+//*****************************************************************************
+
+static int I2CLinuxRead(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                        uint8_t *pui8Data, uint32_t ui32Count)
+{
+    int iFd = (int)(intptr_t)psBus->pvContext;
+    struct i2c_msg psMsgs[2];
+    struct i2c_rdwr_ioctl_data sXfer;
+
+    // Register write and data read in one combined transaction so the
+    // device's auto-increment pointer isn't reset between them
+    psMsgs[0].addr = ui8Addr;
+    psMsgs[0].flags = 0;
+    psMsgs[0].len = 1;
+    psMsgs[0].buf = &ui8Reg;
+    psMsgs[1].addr = ui8Addr;
+    psMsgs[1].flags = I2C_M_RD;
+    psMsgs[1].len = (uint16_t)ui32Count;
+    psMsgs[1].buf = pui8Data;
+
+    sXfer.msgs = psMsgs;
+    sXfer.nmsgs = 2;
+
+    return ioctl(iFd, I2C_RDWR, &sXfer) < 0 ? -1 : 0;
+}
+
+static int I2CLinuxWrite(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                         const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    int iFd = (int)(intptr_t)psBus->pvContext;
+    uint8_t pui8Buf[33];
+    struct i2c_msg sMsg;
+    struct i2c_rdwr_ioctl_data sXfer;
+
+    if (ui32Count > sizeof(pui8Buf) - 1)
+    {
+        return -1;
+    }
+
+    pui8Buf[0] = ui8Reg;
+    memcpy(pui8Buf + 1, pui8Data, ui32Count);
+
+    sMsg.addr = ui8Addr;
+    sMsg.flags = 0;
+    sMsg.len = (uint16_t)(ui32Count + 1);
+    sMsg.buf = pui8Buf;
+
+    sXfer.msgs = &sMsg;
+    sXfer.nmsgs = 1;
+
+    return ioctl(iFd, I2C_RDWR, &sXfer) < 0 ? -1 : 0;
+}
+
+static uint64_t I2CLinuxNow(tI2CBus *psBus)
+{
+    (void)psBus;
+    return I2CMonotonicNs();
+}
+
+int I2CBusOpenLinux(tI2CBus *psBus, uint32_t ui32Adapter, uint32_t ui32BusHz)
+{
+    char pcPath[32];
+    int iFd;
+
+    snprintf(pcPath, sizeof(pcPath), "/dev/i2c-%u", ui32Adapter);
+    iFd = open(pcPath, O_RDWR);
+    if (iFd < 0)
+    {
+        return -1;
+    }
+
+    memset(psBus, 0, sizeof(*psBus));
+    psBus->pfnRead = I2CLinuxRead;
+    psBus->pfnWrite = I2CLinuxWrite;
+    psBus->pfnNow = I2CLinuxNow;
+    psBus->pfnSleepUntil = I2CMonotonicSleepUntil;
+    psBus->pvContext = (void *)(intptr_t)iFd;
+    psBus->ui32BusHz = ui32BusHz;
+
+    return 0;
+}
+
+void I2CBusCloseLinux(tI2CBus *psBus)
+{
+    close((int)(intptr_t)psBus->pvContext);
+}
+
+//*****************************************************************************
+// Accounting wrappers
+//*****************************************************************************
+
+int I2CBusRead(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+               uint8_t *pui8Data, uint32_t ui32Count)
+{
+    psBus->ui64Transactions++;
+    psBus->ui64Bytes += ui32Count;
+    psBus->ui64BitTimes += I2C_READ_OVERHEAD_BITS + 9ULL * ui32Count;
+
+    return psBus->pfnRead(psBus, ui8Addr, ui8Reg, pui8Data, ui32Count);
+}
+
+int I2CBusWrite(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    psBus->ui64Transactions++;
+    psBus->ui64Bytes += ui32Count;
+    psBus->ui64BitTimes += I2C_WRITE_OVERHEAD_BITS + 9ULL * ui32Count;
+
+    return psBus->pfnWrite(psBus, ui8Addr, ui8Reg, pui8Data, ui32Count);
+}
+
+void I2CBusSleepUntil(tI2CBus *psBus, uint64_t ui64Ns)
+{
+    psBus->pfnSleepUntil(psBus, ui64Ns);
+}
+
+int I2CBusWriteReg(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                   uint8_t ui8Value)
+{
+    return I2CBusWrite(psBus, ui8Addr, ui8Reg, &ui8Value, 1);
+}
+
+int I2CBusReadReg(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                  uint8_t *pui8Value)
+{
+    return I2CBusRead(psBus, ui8Addr, ui8Reg, pui8Value, 1);
+}
+
+double I2CBusUtilization(const tI2CBus *psBus, uint64_t ui64ElapsedNs)
+{
+    double dBusNs;
+
+    if (ui64ElapsedNs == 0 || psBus->ui32BusHz == 0)
+    {
+        return 0.0;
+    }
+
+    dBusNs = (double)psBus->ui64BitTimes * 1e9 / (double)psBus->ui32BusHz;
+    return dBusNs / (double)ui64ElapsedNs;
+}
@@ -0,0 +1,74 @@
+//*****************************************************************************
+// I2C bus transport
+//
+// Sensor code talks to the bus through tI2CBus so the same acquisition code
+// runs against /dev/i2c-N on the Dragonboard or a simulated device on a PC.
+//*****************************************************************************
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tI2CBus
+{
+    // Read ui32Count bytes starting at ui8Reg, relying on the device's
+    // register auto-increment.  Returns 0 on success.
+    int (*pfnRead)(struct tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                   uint8_t *pui8Data, uint32_t ui32Count);
+
+    // Write ui32Count bytes starting at ui8Reg.  Returns 0 on success.
+    int (*pfnWrite)(struct tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                    const uint8_t *pui8Data, uint32_t ui32Count);
+
+    // Monotonic time in nanoseconds as seen by this bus.  Simulated buses
+    // may run on a virtual clock.
+    uint64_t (*pfnNow)(struct tI2CBus *psBus);
+
+    // Blocks until pfnNow reaches ui64Ns.  A virtual clock just jumps there.
+    void (*pfnSleepUntil)(struct tI2CBus *psBus, uint64_t ui64Ns);
+
+    void *pvContext;
+
+    // Bus clock used for utilization accounting (100000 or 400000)
+    uint32_t ui32BusHz;
+
+    // Accounting, updated by I2CBusRead/I2CBusWrite
+    uint64_t ui64Transactions;
+    uint64_t ui64Bytes;
+    uint64_t ui64BitTimes;
+} tI2CBus;
+
+// Opens /dev/i2c-<ui32Adapter> as a bus.  Returns 0 on success.
+extern int I2CBusOpenLinux(tI2CBus *psBus, uint32_t ui32Adapter, uint32_t ui32BusHz);
+extern void I2CBusCloseLinux(tI2CBus *psBus);
+
+extern int I2CBusRead(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                      uint8_t *pui8Data, uint32_t ui32Count);
+extern int I2CBusWrite(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                       const uint8_t *pui8Data, uint32_t ui32Count);
+extern int I2CBusWriteReg(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                          uint8_t ui8Value);
+extern int I2CBusReadReg(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                         uint8_t *pui8Value);
+
+// Fraction of bus time consumed by the traffic so far, over ui64ElapsedNs
+extern double I2CBusUtilization(const tI2CBus *psBus, uint64_t ui64ElapsedNs);
+
+extern void I2CBusSleepUntil(tI2CBus *psBus, uint64_t ui64Ns);
+
+extern uint64_t I2CMonotonicNs(void);
+
+// clock_nanosleep on CLOCK_MONOTONIC, for buses on the real clock
+extern void I2CMonotonicSleepUntil(tI2CBus *psBus, uint64_t ui64Ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // I2C_BUS_H
@@ -0,0 +1,122 @@
+//*****************************************************************************
+// Simulated I2C bus
+//*****************************************************************************
+
+#include <string.h>
+#include "i2c_sim.h"
+
+static tI2CSimDevice *I2CSimFind(tI2CSim *psSim, uint8_t ui8Addr)
+{
+    uint32_t ui32Idx;
+
+    for (ui32Idx = 0; ui32Idx < psSim->ui32DeviceCount; ui32Idx++)
+    {
+        if (psSim->ppsDevices[ui32Idx]->ui8Addr == ui8Addr)
+        {
+            return psSim->ppsDevices[ui32Idx];
+        }
+    }
+
+    return 0;
+}
+
+// Time the device sees for the transaction.  On the virtual clock the bus
+// is then busy for the bit times I2CBusRead/I2CBusWrite just accounted.
+static uint64_t I2CSimTransfer(tI2CBus *psBus)
+{
+    tI2CSim *psSim = (tI2CSim *)psBus->pvContext;
+    uint64_t ui64Now = psBus->pfnNow(psBus);
+
+    if (psSim->bVirtual && psBus->ui32BusHz)
+    {
+        psSim->ui64VirtualNs += (psBus->ui64BitTimes - psSim->ui64BitTimesSeen) *
+                                1000000000ULL / psBus->ui32BusHz;
+        psSim->ui64BitTimesSeen = psBus->ui64BitTimes;
+    }
+
+    return ui64Now;
+}
+
+static int I2CSimRead(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                      uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tI2CSimDevice *psDevice = I2CSimFind((tI2CSim *)psBus->pvContext, ui8Addr);
+
+    // No ACK from an absent device
+    if (!psDevice)
+    {
+        return -1;
+    }
+
+    return psDevice->pfnRead(psDevice, I2CSimTransfer(psBus), ui8Reg,
+                             pui8Data, ui32Count);
+}
+
+static int I2CSimWrite(tI2CBus *psBus, uint8_t ui8Addr, uint8_t ui8Reg,
+                       const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tI2CSimDevice *psDevice = I2CSimFind((tI2CSim *)psBus->pvContext, ui8Addr);
+
+    if (!psDevice)
+    {
+        return -1;
+    }
+
+    return psDevice->pfnWrite(psDevice, I2CSimTransfer(psBus), ui8Reg,
+                              pui8Data, ui32Count);
+}
+
+static uint64_t I2CSimNow(tI2CBus *psBus)
+{
+    (void)psBus;
+    return I2CMonotonicNs();
+}
+
+static uint64_t I2CSimVirtualNow(tI2CBus *psBus)
+{
+    return ((tI2CSim *)psBus->pvContext)->ui64VirtualNs;
+}
+
+static void I2CSimVirtualSleepUntil(tI2CBus *psBus, uint64_t ui64Ns)
+{
+    tI2CSim *psSim = (tI2CSim *)psBus->pvContext;
+
+    if (ui64Ns > psSim->ui64VirtualNs)
+    {
+        psSim->ui64VirtualNs = ui64Ns;
+    }
+}
+
+void I2CSimInit(tI2CSim *psSim, tI2CBus *psBus, uint32_t ui32BusHz)
+{
+    memset(psSim, 0, sizeof(*psSim));
+    memset(psBus, 0, sizeof(*psBus));
+
+    psBus->pfnRead = I2CSimRead;
+    psBus->pfnWrite = I2CSimWrite;
+    psBus->pfnNow = I2CSimNow;
+    psBus->pfnSleepUntil = I2CMonotonicSleepUntil;
+    psBus->pvContext = psSim;
+    psBus->ui32BusHz = ui32BusHz;
+}
+
+int I2CSimAddDevice(tI2CSim *psSim, tI2CSimDevice *psDevice)
+{
+    if (psSim->ui32DeviceCount >= I2C_SIM_MAX_DEVICES)
+    {
+        return -1;
+    }
+
+    psSim->ppsDevices[psSim->ui32DeviceCount++] = psDevice;
+    return 0;
+}
+
+void I2CSimUseVirtualClock(tI2CSim *psSim, tI2CBus *psBus, uint64_t ui64StartNs)
+{
+    psSim->bVirtual = 1;
+    psSim->ui64VirtualNs = ui64StartNs;
+    psSim->ui64BitTimesSeen = psBus->ui64BitTimes;
+
+    psBus->pfnNow = I2CSimVirtualNow;
+    psBus->pfnSleepUntil = I2CSimVirtualSleepUntil;
+}
@@ -0,0 +1,67 @@
+//*****************************************************************************
+// Simulated I2C bus
+//
+// Routes tI2CBus transactions to register-level device models by slave
+// address.  Devices see the bus clock, so they produce samples at their
+// configured output data rate exactly as the real parts would.
+//
+// The clock is CLOCK_MONOTONIC unless I2CSimUseVirtualClock is called.  On
+// the virtual clock every transaction takes its wire time at the bus rate
+// and sleeps return at once, so acquisition code runs as fast as the host
+// allows while seeing the same timing the hardware would give it.  The
+// virtual clock belongs to the one thread that drives the bus.
+//*****************************************************************************
+
+#ifndef I2C_SIM_H
+#define I2C_SIM_H
+
+#include "i2c_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define I2C_SIM_MAX_DEVICES     4
+
+typedef struct tI2CSimDevice
+{
+    uint8_t ui8Addr;
+
+    int (*pfnRead)(struct tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                   uint8_t ui8Reg, uint8_t *pui8Data, uint32_t ui32Count);
+    int (*pfnWrite)(struct tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                    uint8_t ui8Reg, const uint8_t *pui8Data, uint32_t ui32Count);
+
+    // Optional.  Returns 1 while interrupt output ui32Line (1 = INT1,
+    // 2 = INT2) is asserted and sets *pui64NextNs to the next time its state
+    // can change.
+    int (*pfnIrq)(struct tI2CSimDevice *psDevice, uint64_t ui64NowNs,
+                  uint32_t ui32Line, uint64_t *pui64NextNs);
+
+    void *pvContext;
+} tI2CSimDevice;
+
+typedef struct
+{
+    tI2CSimDevice *ppsDevices[I2C_SIM_MAX_DEVICES];
+    uint32_t ui32DeviceCount;
+
+    int bVirtual;
+    uint64_t ui64VirtualNs;
+    uint64_t ui64BitTimesSeen;
+} tI2CSim;
+
+// Initializes psBus as a simulated bus backed by psSim
+extern void I2CSimInit(tI2CSim *psSim, tI2CBus *psBus, uint32_t ui32BusHz);
+
+extern int I2CSimAddDevice(tI2CSim *psSim, tI2CSimDevice *psDevice);
+
+// Switches psBus to a virtual clock starting at ui64StartNs.  Call before
+// any device is configured.
+extern void I2CSimUseVirtualClock(tI2CSim *psSim, tI2CBus *psBus, uint64_t ui64StartNs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // I2C_SIM_H
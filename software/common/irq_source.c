@@ -0,0 +1,203 @@
+//*****************************************************************************
+// Sensor interrupt source
+//*****************************************************************************
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "irq_source.h"
+
+static int IrqGpioAsserted(tIrqSource *psSource)
+{
+    struct gpiohandle_data sData;
+
+    if (ioctl(psSource->iFd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &sData) < 0)
+    {
+        return -1;
+    }
+
+    return psSource->bActiveLow ? sData.values[0] == 0 : sData.values[0] != 0;
+}
+
+static int IrqGpioWait(tIrqSource *psSource, uint64_t ui64TimeoutNs,
+                       uint64_t *pui64TimeNs)
+{
+    struct pollfd sPoll;
+    struct gpioevent_data sEvent;
+    uint64_t ui64Now;
+    int iAsserted;
+    int iRet;
+
+    // The INT pins are level outputs.  If the line is already asserted no
+    // edge will come, so check before sleeping; any queued edge is stale
+    // by then and gets read off below.
+    iAsserted = IrqGpioAsserted(psSource);
+    if (iAsserted < 0)
+    {
+        return -1;
+    }
+
+    sPoll.fd = psSource->iFd;
+    sPoll.events = POLLIN;
+    sPoll.revents = 0;
+
+    if (iAsserted)
+    {
+        while (poll(&sPoll, 1, 0) > 0 && read(psSource->iFd, &sEvent, sizeof(sEvent)) == sizeof(sEvent))
+        {
+        }
+        *pui64TimeNs = I2CMonotonicNs();
+        psSource->ui64Events++;
+        return 1;
+    }
+
+    iRet = poll(&sPoll, 1, (int)((ui64TimeoutNs + 999999) / 1000000));
+    if (iRet < 0)
+    {
+        return -1;
+    }
+    if (iRet == 0)
+    {
+        psSource->ui64Timeouts++;
+        return 0;
+    }
+
+    if (read(psSource->iFd, &sEvent, sizeof(sEvent)) != sizeof(sEvent))
+    {
+        return -1;
+    }
+
+    // Kernels since 5.7 stamp events with CLOCK_MONOTONIC in the interrupt
+    // handler, older ones with CLOCK_REALTIME; only trust a stamp that
+    // lands just before now on our clock
+    ui64Now = I2CMonotonicNs();
+    if (sEvent.timestamp <= ui64Now && ui64Now - sEvent.timestamp < 100000000ULL)
+    {
+        *pui64TimeNs = sEvent.timestamp;
+    }
+    else
+    {
+        *pui64TimeNs = ui64Now;
+    }
+
+    psSource->ui64Events++;
+    return 1;
+}
+
+static void IrqGpioClose(tIrqSource *psSource)
+{
+    if (psSource->iFd >= 0)
+    {
+        close(psSource->iFd);
+        psSource->iFd = -1;
+    }
+}
+
+int IrqOpenGpio(tIrqSource *psSource, const char *pcChip,
+                uint32_t ui32Line, int bActiveLow)
+{
+    struct gpioevent_request sRequest;
+    int iChip;
+    int iErr;
+
+    memset(psSource, 0, sizeof(*psSource));
+    psSource->iFd = -1;
+
+    iChip = open(pcChip, O_RDONLY | O_CLOEXEC);
+    if (iChip < 0)
+    {
+        return -errno;
+    }
+
+    memset(&sRequest, 0, sizeof(sRequest));
+    sRequest.lineoffset = ui32Line;
+    sRequest.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    sRequest.eventflags = bActiveLow ? GPIOEVENT_REQUEST_FALLING_EDGE : GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(sRequest.consumer_label, "visor-imu", sizeof(sRequest.consumer_label) - 1);
+
+    if (ioctl(iChip, GPIO_GET_LINEEVENT_IOCTL, &sRequest) < 0)
+    {
+        iErr = errno;
+        close(iChip);
+        return -iErr;
+    }
+    close(iChip);
+
+    psSource->pfnWait = IrqGpioWait;
+    psSource->pfnClose = IrqGpioClose;
+    psSource->iFd = sRequest.fd;
+    psSource->ui32Line = ui32Line;
+    psSource->bActiveLow = bActiveLow;
+
+    return 0;
+}
+
+static int IrqSimWait(tIrqSource *psSource, uint64_t ui64TimeoutNs,
+                      uint64_t *pui64TimeNs)
+{
+    tI2CSimDevice *psDevice = (tI2CSimDevice *)psSource->pvContext;
+    tI2CBus *psBus = psSource->psBus;
+    uint64_t ui64Now = psBus->pfnNow(psBus);
+    uint64_t ui64Deadline = ui64Now + ui64TimeoutNs;
+
+    for (;;)
+    {
+        uint64_t ui64Next;
+
+        if (psDevice->pfnIrq(psDevice, ui64Now, psSource->ui32Line, &ui64Next))
+        {
+            *pui64TimeNs = ui64Now;
+            psSource->ui64Events++;
+            return 1;
+        }
+
+        if (ui64Next >= ui64Deadline)
+        {
+            I2CBusSleepUntil(psBus, ui64Deadline);
+            psSource->ui64Timeouts++;
+            return 0;
+        }
+
+        // Nothing changes on the pin before the model's next sample
+        I2CBusSleepUntil(psBus, ui64Next);
+        ui64Now = psBus->pfnNow(psBus);
+    }
+}
+
+int IrqOpenSim(tIrqSource *psSource, tI2CBus *psBus,
+               tI2CSimDevice *psDevice, uint32_t ui32Line)
+{
+    memset(psSource, 0, sizeof(*psSource));
+    psSource->iFd = -1;
+
+    // The model has no interrupt output to follow
+    if (!psDevice->pfnIrq)
+    {
+        return -ENODEV;
+    }
+
+    psSource->pfnWait = IrqSimWait;
+    psSource->pvContext = psDevice;
+    psSource->psBus = psBus;
+    psSource->ui32Line = ui32Line;
+
+    return 0;
+}
+
+int IrqWait(tIrqSource *psSource, uint64_t ui64TimeoutNs, uint64_t *pui64TimeNs)
+{
+    return psSource->pfnWait(psSource, ui64TimeoutNs, pui64TimeNs);
+}
+
+void IrqClose(tIrqSource *psSource)
+{
+    if (psSource->pfnClose)
+    {
+        psSource->pfnClose(psSource);
+    }
+}
@@ -0,0 +1,60 @@
+//*****************************************************************************
+// Sensor interrupt source
+//
+// Lets the acquisition loops block on a sensor's INT pin instead of
+// sleeping on a timer.  On the Dragonboard the pin is a line on a GPIO
+// character device; with a simulated bus the device model's interrupt
+// output is polled at its own state-change times.
+//*****************************************************************************
+
+#ifndef IRQ_SOURCE_H
+#define IRQ_SOURCE_H
+
+#include <stdint.h>
+#include "i2c_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tIrqSource
+{
+    // Blocks until the line is asserted or ui64TimeoutNs passes.  Returns 1
+    // with *pui64TimeNs set to when the line was seen asserted, 0 on
+    // timeout, -1 on error.  A line that is already asserted returns at once.
+    int (*pfnWait)(struct tIrqSource *psSource, uint64_t ui64TimeoutNs,
+                   uint64_t *pui64TimeNs);
+
+    void (*pfnClose)(struct tIrqSource *psSource);
+
+    void *pvContext;
+    tI2CBus *psBus;             // simulated sources only
+    int iFd;
+    uint32_t ui32Line;
+    int bActiveLow;
+
+    uint64_t ui64Events;
+    uint64_t ui64Timeouts;
+} tIrqSource;
+
+// Requests edge events on ui32Line of pcChip (e.g. /dev/gpiochip0).  The
+// sensors drive INT open-drain, active low, so bActiveLow is normally set.
+// Returns 0 on success, or the negated errno of the call that failed.
+extern int IrqOpenGpio(tIrqSource *psSource, const char *pcChip,
+                       uint32_t ui32Line, int bActiveLow);
+
+// Follows interrupt output ui32Line (1 = INT1, 2 = INT2) of a simulated
+// device on psBus.  Returns 0, or -ENODEV if the model has no interrupt
+// output.
+extern int IrqOpenSim(tIrqSource *psSource, tI2CBus *psBus,
+                      tI2CSimDevice *psDevice, uint32_t ui32Line);
+
+extern int IrqWait(tIrqSource *psSource, uint64_t ui64TimeoutNs, uint64_t *pui64TimeNs);
+
+extern void IrqClose(tIrqSource *psSource);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IRQ_SOURCE_H
@@ -0,0 +1,266 @@
+//*****************************************************************************
+// Motion profiles for the simulated sensors
+//*****************************************************************************
+
+#include <math.h>
+#include <string.h>
+#include "sim_motion.h"
+
+#define SIM_PI  3.14159265358979f
+
+void SimMotionInit(tSimMotion *psMotion, uint32_t ui32Kind)
+{
+    memset(psMotion, 0, sizeof(*psMotion));
+
+    psMotion->ui32Kind = ui32Kind;
+    psMotion->ui32Axis = ui32Kind == SIM_MOTION_IMPACTS ? 1 : 2;
+    psMotion->fSwingDeg = 45.0f;
+    psMotion->fSwingHz = 0.5f;
+    psMotion->fImpactG = 40.0f;
+    psMotion->fImpactDps = 1500.0f;
+    psMotion->fImpactMs = 10.0f;
+    psMotion->fImpactEveryS = 3.0f;
+
+    psMotion->pfField[0] = 22.0f;
+    psMotion->pfField[1] = 0.0f;
+    psMotion->pfField[2] = -43.0f;
+
+    psMotion->fAccelNoiseG = 0.0025f;
+    psMotion->fMagNoiseUt = 0.5f;
+    psMotion->fGyroNoiseDps = 0.3f;
+    psMotion->pfGyroBiasDps[0] = 0.5f;
+    psMotion->pfGyroBiasDps[1] = -0.3f;
+    psMotion->pfGyroBiasDps[2] = 0.2f;
+
+    psMotion->ui32Seed = 0x2545f491;
+}
+
+// Body-frame view of an earth-frame vector after turning fAngle radians
+// about ui32Axis
+static void SimMotionRotate(uint32_t ui32Axis, float fAngle, const float *pfIn,
+                            float *pfOut)
+{
+    uint32_t ui32I = (ui32Axis + 1) % 3;
+    uint32_t ui32J = (ui32Axis + 2) % 3;
+    float fC = cosf(fAngle);
+    float fS = sinf(fAngle);
+
+    pfOut[ui32Axis] = pfIn[ui32Axis];
+    pfOut[ui32I] = pfIn[ui32I] * fC + pfIn[ui32J] * fS;
+    pfOut[ui32J] = -pfIn[ui32I] * fS + pfIn[ui32J] * fC;
+}
+
+static void SimMotionRecorded(const tSimMotion *psMotion, uint64_t ui64T,
+                              tSimMotionSample *psSample)
+{
+    uint64_t ui64Step = ui64T / psMotion->ui64RecordedPeriodNs;
+    float fFrac = (float)(ui64T % psMotion->ui64RecordedPeriodNs) /
+                  (float)psMotion->ui64RecordedPeriodNs;
+    const float *pfA = psMotion->psRecorded[ui64Step % psMotion->ui32RecordedCount].pfAccel;
+    const float *pfB = psMotion->psRecorded[(ui64Step + 1) % psMotion->ui32RecordedCount].pfAccel;
+    float *pfOut = psSample->pfAccel;
+    uint32_t ui32Idx;
+
+    // The three vectors are contiguous, so interpolate all nine at once
+    for (ui32Idx = 0; ui32Idx < 9; ui32Idx++)
+    {
+        pfOut[ui32Idx] = pfA[ui32Idx] + (pfB[ui32Idx] - pfA[ui32Idx]) * fFrac;
+    }
+}
+
+void SimMotionEvaluate(const tSimMotion *psMotion, uint64_t ui64TimeNs,
+                       tSimMotionSample *psSample)
+{
+    static const float pfGravity[3] = { 0.0f, 0.0f, 1.0f };
+    uint64_t ui64T = ui64TimeNs > psMotion->ui64StartNs ? ui64TimeNs - psMotion->ui64StartNs : 0;
+    double dSeconds = (double)ui64T / 1e9;
+    uint32_t ui32Axis = psMotion->ui32Axis % 3;
+    float fAngle = 0.0f;
+    float fRate = 0.0f;
+    float fLinear = 0.0f;
+
+    memset(psSample, 0, sizeof(*psSample));
+
+    switch (psMotion->ui32Kind)
+    {
+        case SIM_MOTION_RECORDED:
+        {
+            if (psMotion->psRecorded && psMotion->ui32RecordedCount &&
+                psMotion->ui64RecordedPeriodNs)
+            {
+                SimMotionRecorded(psMotion, ui64T, psSample);
+                return;
+            }
+            break;
+        }
+
+        case SIM_MOTION_SWING:
+        {
+            float fW = 2.0f * SIM_PI * psMotion->fSwingHz;
+            float fPhase = (float)fmod(dSeconds * psMotion->fSwingHz, 1.0) * 2.0f * SIM_PI;
+
+            fAngle = psMotion->fSwingDeg * SIM_PI / 180.0f * sinf(fPhase);
+            fRate = psMotion->fSwingDeg * fW * cosf(fPhase);
+            break;
+        }
+
+        case SIM_MOTION_IMPACTS:
+        {
+            double dEvery = psMotion->fImpactEveryS;
+            double dPulse = psMotion->fImpactMs / 1e3;
+            uint64_t ui64Done = SimMotionImpactsBefore(psMotion, ui64TimeNs);
+            float fStep = psMotion->fImpactDps * (float)dPulse * 2.0f / SIM_PI;
+            double dSince;
+
+            // Each blow leaves the head turned by the integral of its pulse
+            fAngle = (float)ui64Done * fStep;
+
+            dSince = dSeconds - dEvery * (double)(ui64Done + 1);
+            if (dEvery > 0.0 && dSince >= 0.0 && dSince < dPulse)
+            {
+                float fX = SIM_PI * (float)(dSince / dPulse);
+
+                fRate = psMotion->fImpactDps * sinf(fX);
+                fAngle += fStep * 0.5f * (1.0f - cosf(fX));
+                fLinear = psMotion->fImpactG * sinf(fX);
+            }
+
+            fAngle *= SIM_PI / 180.0f;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    SimMotionRotate(ui32Axis, fAngle, pfGravity, psSample->pfAccel);
+    SimMotionRotate(ui32Axis, fAngle, psMotion->pfField, psSample->pfMag);
+    psSample->pfAccel[(ui32Axis + 2) % 3] += fLinear;
+    psSample->pfGyro[ui32Axis] = fRate;
+}
+
+uint64_t SimMotionImpactsBefore(const tSimMotion *psMotion, uint64_t ui64TimeNs)
+{
+    uint64_t ui64Every = (uint64_t)((double)psMotion->fImpactEveryS * 1e9);
+    uint64_t ui64Pulse = (uint64_t)((double)psMotion->fImpactMs * 1e6);
+    uint64_t ui64T;
+
+    if (psMotion->ui32Kind != SIM_MOTION_IMPACTS || ui64Every == 0 ||
+        ui64TimeNs < psMotion->ui64StartNs)
+    {
+        return 0;
+    }
+
+    ui64T = ui64TimeNs - psMotion->ui64StartNs;
+    if (ui64T < ui64Every + ui64Pulse)
+    {
+        return 0;
+    }
+
+    return (ui64T - ui64Pulse) / ui64Every;
+}
+
+//*****************************************************************************
+// Sources for the register models
+//*****************************************************************************
+
+// Standard normal deviate from the profile's xorshift state
+static float SimMotionNoise(tSimMotion *psMotion)
+{
+    float fU1;
+    float fU2;
+    uint32_t ui32X;
+
+    ui32X = psMotion->ui32Seed;
+    ui32X ^= ui32X << 13;
+    ui32X ^= ui32X >> 17;
+    ui32X ^= ui32X << 5;
+    fU1 = ((float)(ui32X >> 8) + 1.0f) / 16777217.0f;
+    ui32X ^= ui32X << 13;
+    ui32X ^= ui32X >> 17;
+    ui32X ^= ui32X << 5;
+    fU2 = (float)(ui32X >> 8) / 16777216.0f;
+    psMotion->ui32Seed = ui32X;
+
+    return sqrtf(-2.0f * logf(fU1)) * cosf(2.0f * SIM_PI * fU2);
+}
+
+static int16_t SimMotionCounts(float fValue, float fCountsPerUnit, int32_t i32Limit)
+{
+    float fCounts = fValue * fCountsPerUnit;
+    int32_t i32Counts = (int32_t)(fCounts < 0.0f ? fCounts - 0.5f : fCounts + 0.5f);
+
+    // The parts clip at full scale rather than wrapping
+    if (i32Counts > i32Limit - 1)
+    {
+        i32Counts = i32Limit - 1;
+    }
+    if (i32Counts < -i32Limit)
+    {
+        i32Counts = -i32Limit;
+    }
+    return (int16_t)i32Counts;
+}
+
+static void SimMotionFXOSSource(void *pvContext, uint64_t ui64TimeNs,
+                                int16_t *pi16Accel, int16_t *pi16Mag)
+{
+    tSimMotion *psMotion = (tSimMotion *)pvContext;
+    tSimMotionSample sSample;
+    float fPerG;
+    uint32_t ui32Idx;
+
+    SimMotionEvaluate(psMotion, ui64TimeNs, &sSample);
+
+    // 14-bit accelerometer: 4096 counts/g at ±2 g, halved per range step;
+    // magnetometer 0.1 uT/LSB
+    fPerG = (float)(4096 >> (psMotion->psFXOS->pui8Regs[FXOS_XYZ_DATA_CFG] & FXOS_FS_MASK));
+    for (ui32Idx = 0; ui32Idx < 3; ui32Idx++)
+    {
+        float fA = sSample.pfAccel[ui32Idx] + psMotion->fAccelNoiseG * SimMotionNoise(psMotion);
+        float fM = sSample.pfMag[ui32Idx] + psMotion->fMagNoiseUt * SimMotionNoise(psMotion);
+
+        pi16Accel[ui32Idx] = SimMotionCounts(fA, fPerG, 8192);
+        pi16Mag[ui32Idx] = SimMotionCounts(fM, 10.0f, 32768);
+    }
+}
+
+static void SimMotionFXASSource(void *pvContext, uint64_t ui64TimeNs,
+                                int16_t *pi16Rate)
+{
+    tSimMotion *psMotion = (tSimMotion *)pvContext;
+    tSimMotionSample sSample;
+    float fPerDps;
+    uint32_t ui32Idx;
+
+    SimMotionEvaluate(psMotion, ui64TimeNs, &sSample);
+
+    // 0.0625 dps/LSB at ±2000 dps, halved per range step
+    fPerDps = (float)(16 << (psMotion->psFXAS->pui8Regs[FXAS_CTRL_REG0] & FXAS_FS_MASK));
+    for (ui32Idx = 0; ui32Idx < 3; ui32Idx++)
+    {
+        float fG = sSample.pfGyro[ui32Idx] + psMotion->pfGyroBiasDps[ui32Idx] +
+                   psMotion->fGyroNoiseDps * SimMotionNoise(psMotion);
+
+        pi16Rate[ui32Idx] = SimMotionCounts(fG, fPerDps, 32768);
+    }
+}
+
+void SimMotionAttach(tSimMotion *psMotion, tFXOSSim *psFXOS,
+                     tFXASSim *psFXAS, uint64_t ui64StartNs)
+{
+    psMotion->ui64StartNs = ui64StartNs;
+    psMotion->psFXOS = psFXOS;
+    psMotion->psFXAS = psFXAS;
+
+    if (psFXOS)
+    {
+        psFXOS->pfnSource = SimMotionFXOSSource;
+        psFXOS->pvSourceContext = psMotion;
+    }
+    if (psFXAS)
+    {
+        psFXAS->pfnSource = SimMotionFXASSource;
+        psFXAS->pvSourceContext = psMotion;
+    }
+}
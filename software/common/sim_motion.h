@@ -0,0 +1,97 @@
+//*****************************************************************************
+// Motion profiles for the simulated sensors
+//
+// Produces what the FXOS8700CQ and FXAS21002C would measure on a moving head
+// in physical units, and feeds it to the register models as raw counts at
+// whatever range the acquisition code has configured, saturating as the
+// parts do.  Profiles are either synthetic (still, a sinusoidal swing about
+// one axis, a train of impacts) or a recording played back in a loop.
+//*****************************************************************************
+
+#ifndef SIM_MOTION_H
+#define SIM_MOTION_H
+
+#include <stdint.h>
+#include "fxos8700cq_sim.h"
+#include "fxas21002c_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_MOTION_STILL        0
+#define SIM_MOTION_SWING        1
+#define SIM_MOTION_IMPACTS      2
+#define SIM_MOTION_RECORDED     3
+
+// Sensor-frame measurement: g, microtesla, degrees/s
+typedef struct
+{
+    float pfAccel[3];
+    float pfMag[3];
+    float pfGyro[3];
+} tSimMotionSample;
+
+typedef struct
+{
+    uint32_t ui32Kind;
+
+    // Swing and impacts rotate about this sensor axis (0 = X, 1 = Y, 2 = Z)
+    uint32_t ui32Axis;
+
+    // SIM_MOTION_SWING: angle = amplitude * sin(2 pi f t)
+    float fSwingDeg;
+    float fSwingHz;
+
+    // SIM_MOTION_IMPACTS: a half-sine angular velocity pulse about the
+    // axis with a half-sine linear pulse along the axis before it (X for a
+    // blow about Y), every fImpactEveryS seconds starting one interval in
+    float fImpactG;
+    float fImpactDps;
+    float fImpactMs;
+    float fImpactEveryS;
+
+    // SIM_MOTION_RECORDED: samples at a fixed period, looped
+    const tSimMotionSample *psRecorded;
+    uint32_t ui32RecordedCount;
+    uint64_t ui64RecordedPeriodNs;
+
+    // Earth field in the level frame, x towards magnetic north
+    float pfField[3];
+
+    // White noise added to every reading and a constant gyro offset
+    float fAccelNoiseG;
+    float fMagNoiseUt;
+    float fGyroNoiseDps;
+    float pfGyroBiasDps[3];
+
+    uint64_t ui64StartNs;
+    uint32_t ui32Seed;
+
+    // Set by SimMotionAttach so the sources can read the configured ranges
+    tFXOSSim *psFXOS;
+    tFXASSim *psFXAS;
+} tSimMotion;
+
+// Fills psMotion with defaults for ui32Kind: a level head, a 45 degree
+// 0.5 Hz swing about Z, or 40 g / 1500 dps 10 ms impacts every 3 s about Y,
+// all with typical sensor noise and a small gyro offset
+extern void SimMotionInit(tSimMotion *psMotion, uint32_t ui32Kind);
+
+// Noise-free measurement at ui64TimeNs
+extern void SimMotionEvaluate(const tSimMotion *psMotion, uint64_t ui64TimeNs,
+                              tSimMotionSample *psSample);
+
+// Installs psMotion as the data source of either or both models.  Time
+// zero of the profile is ui64StartNs on the bus clock.
+extern void SimMotionAttach(tSimMotion *psMotion, tFXOSSim *psFXOS,
+                            tFXASSim *psFXAS, uint64_t ui64StartNs);
+
+// Impacts whose pulse has completed by ui64TimeNs
+extern uint64_t SimMotionImpactsBefore(const tSimMotion *psMotion, uint64_t ui64TimeNs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIM_MOTION_H
@@ -20,25 +20,134 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <linux/i2c-dev.h>
-#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
-#include "gy/fxas21002c_proc.h"
-#include "gy/fxas21002c.h" 
+#include <time.h>
+#include "../common/i2c_sim.h"
+#include "../common/irq_source.h"
+#include "../common/fxas21002c_sim.h"
+#include "../common/fxas21002c_i2c.h"
 
 // Define FXAS21002C I2C address, determined by PCB layout with pins SA0=0
 #define GYRO_SLAVE_ADDR       0x20
 
-tRawData g_tGyroData;      // Gyroscope data
+// Low-speed expansion I2C0 on the Dragonboard 410c, shared with the FXOS8700CQ
+#define GYRO_I2C_ADAPTER      0
+#define GYRO_I2C_HZ           400000
+
+// FXAS21002C INT1 as wired to the low-speed expansion header (GPIO-B);
+// match board wiring, or override with -g chip:line
+#define GYRO_INT_CHIP         "/dev/gpiochip0"
+#define GYRO_INT_LINE         12
+
+// 250 dps full scale is 7.8125 mdps per count
+#define GYRO_MDPS_PER_COUNT   7.8125
+
+typedef struct
+{
+    uint64_t ui64TimeNs;
+    int16_t pi16Rate[3];        // 16-bit counts
+} tGyroSample;
+
+// Output data rates in Hz, indexed by FXAS_DR_*
+static const double g_pdODRHz[8] = { 800.0, 400.0, 200.0, 100.0, 50.0, 25.0, 12.5, 12.5 };
+
+tI2CBus g_sBus;
+tI2CSim g_sSim;
+tFXASSim g_sFXASSim;
+tIrqSource g_sIrq;
+tGyroSample g_psSamples[FXAS_FIFO_DEPTH];   // One FIFO batch
+
+static void SleepNs(uint64_t ui64Ns)
+{
+    struct timespec sTs;
+
+    sTs.tv_sec = (time_t)(ui64Ns / 1000000000ULL);
+    sTs.tv_nsec = (long)(ui64Ns % 1000000000ULL);
+    nanosleep(&sTs, 0);
+}
 
 //*****************************************************************************
-// I2C Functions
+// Configures 250 dps at the given rate with the FIFO watermark on INT1
 //*****************************************************************************
+static int GyroConfigure(tI2CBus *psBus, uint8_t ui8DataRate, uint8_t ui8Watermark)
+{
+    int iErr = 0;
+
+    // Put the device into standby before changing register values
+    iErr |= I2CBusWriteReg(psBus, GYRO_SLAVE_ADDR, FXAS_CTRL_REG1, 0);
 
-// see fxas21002c.c for accelerometer and magnetometer functions
+    // Choose the range of the gyroscope (2000 dps, 1000 dps, 500 dps, 250 dps)
+    iErr |= I2CBusWriteReg(psBus, GYRO_SLAVE_ADDR, FXAS_CTRL_REG0, FXAS_FS_250DPS);
 
-int main()
+    // Circular FIFO so an overrun keeps the newest samples, and bursts that
+    // wrap OUT_Z_LSB back to OUT_X_MSB so one read drains a whole batch
+    iErr |= I2CBusWriteReg(psBus, GYRO_SLAVE_ADDR, FXAS_F_SETUP, FXAS_F_MODE_CIRCULAR | ui8Watermark);
+    iErr |= I2CBusWriteReg(psBus, GYRO_SLAVE_ADDR, FXAS_CTRL_REG3, FXAS_WRAPTOONE);
+
+    // Watermark interrupt routed to INT1, open-drain active low into the
+    // board's pull-up: one interrupt per batch rather than per sample
+    iErr |= I2CBusWriteReg(psBus, GYRO_SLAVE_ADDR, FXAS_CTRL_REG2,
+                           FXAS_INT_CFG_FIFO | FXAS_INT_EN_FIFO | FXAS_PP_OD);
+
+    // Choose the output data rate (800 Hz, 400 Hz, 200 Hz, 100 Hz,
+    //  50 Hz, 25 Hz, 12.5 Hz) and activate the device
+    iErr |= I2CBusWriteReg(psBus, GYRO_SLAVE_ADDR, FXAS_CTRL_REG1,
+                           (uint8_t)(((ui8DataRate & 7) << FXAS_DR_SHIFT) | FXAS_ACTIVE));
+
+    return iErr ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
 {
+    int iOpt;
+    int bSimulate = 0;
+    int bPoll = 0;
+    uint8_t ui8DataRate = FXAS_DR_800HZ;
+    uint8_t ui8Watermark = 16;
+    char pcChip[64] = GYRO_INT_CHIP;
+    uint32_t ui32Line = GYRO_INT_LINE;
+    uint64_t ui64PeriodNs;
+    uint64_t ui64Start;
+    uint64_t ui64NextReport;
+    uint64_t ui64Samples = 0;
+    uint64_t ui64Overruns = 0;
+    int16_t pi16Rate[3] = { 0, 0, 0 };
+    uint32_t ui32Backlog = 0;
+    uint64_t ui64LastDrain;
+    uint8_t ui8Data[1];
+    char *pcColon;
+
+    while ((iOpt = getopt(argc, argv, "sr:w:g:p")) != -1)
+    {
+        switch (iOpt)
+        {
+            case 's':
+                bSimulate = 1;
+                break;
+            case 'r':
+                ui8DataRate = (uint8_t)atoi(optarg);
+                break;
+            case 'w':
+                ui8Watermark = (uint8_t)atoi(optarg);
+                break;
+            case 'g':
+                pcColon = strchr(optarg, ':');
+                if (pcColon)
+                {
+                    snprintf(pcChip, sizeof(pcChip), "%.*s", (int)(pcColon - optarg), optarg);
+                    ui32Line = (uint32_t)atoi(pcColon + 1);
+                }
+                break;
+            case 'p':
+                bPoll = 1;
+                break;
+            default:
+                printf("usage: %s [-s] [-r data-rate-code] [-w watermark] [-g gpiochip:line] [-p]\r\n", argv[0]);
+                return 1;
+        }
+    }
 
     //*****************************************************************************
     // Main Code
@@ -48,11 +157,24 @@ int main()
     printf("\033[2J\033[;H");
     printf("Verifying connection");
 
-    uint8_t ui8Data[1];
+    // -s swaps the hardware for a register-level model of the part
+    if (bSimulate)
+    {
+        I2CSimInit(&g_sSim, &g_sBus, GYRO_I2C_HZ);
+        FXASSimInit(&g_sFXASSim, GYRO_SLAVE_ADDR, 0, 0);
+        I2CSimAddDevice(&g_sSim, &g_sFXASSim.sDevice);
+    }
+    else if (I2CBusOpenLinux(&g_sBus, GYRO_I2C_ADAPTER, GYRO_I2C_HZ))
+    {
+        printf("\r\n... cannot open /dev/i2c-%d", GYRO_I2C_ADAPTER);
+        printf("\r\n");
+        return 0;
+    }
+    I2CGyroBind(&g_sBus);
 
-    // Get WHO_AM_I register, return should be 0x0C
-    I2CGyroReceive(GYRO_SLAVE_ADDR, GYRO_WHO_AM_I, ui8Data, sizeof(ui8Data));
-    if ( 0xD7 == ui8Data[0] )
+    // Get WHO_AM_I register, return should be 0xD7
+    if (I2CGyroReceive(GYRO_SLAVE_ADDR, FXAS_WHO_AM_I, ui8Data, sizeof(ui8Data)) == 0
+        && FXAS_WHO_AM_I_VALUE == ui8Data[0])
     {
         printf(" ... FXAS21002C is alive!!!");
     }
@@ -63,40 +185,133 @@ int main()
         return 0;
     }
 
-    // ***********************Print register values for testing feedback
-    I2CGyroReceive(GYRO_SLAVE_ADDR, GYRO_CTRL_REG0, ui8Data, sizeof(ui8Data));
-    printf("\r\nGYRO_CTRL_REG0 = 0x%02x",ui8Data[0]);
+    if (ui8Watermark == 0 || ui8Watermark >= FXAS_FIFO_DEPTH)
+    {
+        ui8Watermark = FXAS_FIFO_DEPTH / 2;
+    }
+
+    if (GyroConfigure(&g_sBus, ui8DataRate, ui8Watermark))
+    {
+        printf("\r\n... FXAS21002C configuration failed");
+        printf("\r\n");
+        return 0;
+    }
 
-    I2CGyroReceive(GYRO_SLAVE_ADDR, GYRO_CTRL_REG1, ui8Data, sizeof(ui8Data));
-    printf("\r\nGYRO_CTRL_REG1 = 0x%02x",ui8Data[0]);
     // ***********************Print register values for testing feedback
+    I2CGyroReceive(GYRO_SLAVE_ADDR, FXAS_CTRL_REG0, ui8Data, sizeof(ui8Data));
+    printf("\r\nGYRO_CTRL_REG0 = 0x%02x", ui8Data[0]);
 
-    // Put the device into standby before changing register values
-    GyroStandby(GYRO_SLAVE_ADDR);
+    I2CGyroReceive(GYRO_SLAVE_ADDR, FXAS_CTRL_REG1, ui8Data, sizeof(ui8Data));
+    printf("\r\nGYRO_CTRL_REG1 = 0x%02x", ui8Data[0]);
 
-    // Choose the range of the accelerometer (2000 dps, 1000 dps, 500 dps, 250 dps)
-    GyroRange(GYRO_SLAVE_ADDR, GFSR_250PS);
+    // Block on the watermark rather than sleeping; -p falls back to a
+    // timer for boards without the line wired up
+    if (!bPoll)
+    {
+        int iErr = bSimulate ? IrqOpenSim(&g_sIrq, &g_sBus, &g_sFXASSim.sDevice, 1)
+                             : IrqOpenGpio(&g_sIrq, pcChip, ui32Line, 1);
+        if (iErr)
+        {
+            printf("\r\n... cannot wait on %s line %u, polling instead", pcChip, ui32Line);
+            bPoll = 1;
+        }
+    }
 
-    // Choose the output data rate (800 Hz, 400 Hz, 200 Hz, 100 Hz,
-    //  50 Hz, 25 Hz, 12.5 Hz)
-    GyroOutputDataRate(GYRO_SLAVE_ADDR, ODR_12_5HZ);
+    ui64PeriodNs = (uint64_t)(1e9 / g_pdODRHz[ui8DataRate & 7]);
+    ui64Start = g_sBus.pfnNow(&g_sBus);
+    ui64LastDrain = ui64Start;
+    ui64NextReport = ui64Start + 1000000000ULL;
 
-    // Activate the data device
-    GyroActive(GYRO_SLAVE_ADDR);
+    while(1)
+    {
+        // F_STATUS followed by up to a full FIFO; each 6 bytes pops a sample
+        uint8_t pui8Burst[1 + 6 * FXAS_FIFO_DEPTH];
+        uint64_t ui64Now;
+        uint32_t ui32Count;
+        uint32_t ui32Idx;
+        uint32_t ui32Axis;
 
-    // ***********************Print register values for testing feedback
-    I2CGyroReceive(GYRO_SLAVE_ADDR, GYRO_CTRL_REG0, ui8Data, sizeof(ui8Data));
-    printf("\r\nGYRO_CTRL_REG0 = 0x%02x",ui8Data[0]);
+        if (bPoll)
+        {
+            uint64_t ui64Due = ui64LastDrain + ui64PeriodNs * (ui8Watermark - (ui32Backlog < ui8Watermark ? ui32Backlog : ui8Watermark));
 
-    I2CGyroReceive(GYRO_SLAVE_ADDR, GYRO_CTRL_REG1, ui8Data, sizeof(ui8Data));
-    printf("\r\nGYRO_CTRL_REG1 = 0x%02x",ui8Data[0]);
+            ui64Now = g_sBus.pfnNow(&g_sBus);
+            if (ui64Due > ui64Now)
+            {
+                SleepNs(ui64Due - ui64Now);
+            }
+        }
+        else
+        {
+            uint64_t ui64IrqNs;
 
-    while(1)
-    {
-        GyroGetData(GYRO_SLAVE_ADDR, &g_tGyroData );
+            // The timeout covers a missed edge: two batches late, the
+            // FIFO is drained anyway
+            if (IrqWait(&g_sIrq, 2 * ui64PeriodNs * ui8Watermark, &ui64IrqNs) < 0)
+            {
+                printf("\r\nGPIO wait failed");
+                bPoll = 1;
+            }
+        }
+
+        // The watermark's worth in one burst; anything beyond it stays in
+        // the FIFO for the next batch.  Draining below the watermark
+        // releases the interrupt line.
+        if (I2CBusRead(&g_sBus, GYRO_SLAVE_ADDR, FXAS_STATUS, pui8Burst, 1 + 6 * (uint32_t)ui8Watermark))
+        {
+            printf("\r\nI2C read failed");
+            continue;
+        }
+        ui64Now = g_sBus.pfnNow(&g_sBus);
+        ui64LastDrain = ui64Now;
+
+        if (pui8Burst[0] & FXAS_F_OVF)
+        {
+            ui64Overruns++;
+        }
+
+        // f_cnt is latched when the status byte is read, so only that many
+        // of the burst's samples are real
+        ui32Count = pui8Burst[0] & FXAS_F_CNT_MASK;
+        ui32Backlog = 0;
+        if (ui32Count > ui8Watermark)
+        {
+            ui32Backlog = ui32Count - ui8Watermark;
+            ui32Count = ui8Watermark;
+        }
+
+        for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++)
+        {
+            const uint8_t *pui8Sample = pui8Burst + 1 + 6 * ui32Idx;
+
+            // The newest sample in the FIFO was taken about now; anything
+            // left behind is newer than what was read
+            g_psSamples[ui32Idx].ui64TimeNs = ui64Now - (uint64_t)(ui32Backlog + ui32Count - 1 - ui32Idx) * ui64PeriodNs;
+            for (ui32Axis = 0; ui32Axis < 3; ui32Axis++)
+            {
+                g_psSamples[ui32Idx].pi16Rate[ui32Axis] =
+                    (int16_t)((pui8Sample[2 * ui32Axis] << 8) | pui8Sample[2 * ui32Axis + 1]);
+            }
+        }
+        if (ui32Count > 0)
+        {
+            memcpy(pi16Rate, g_psSamples[ui32Count - 1].pi16Rate, sizeof(pi16Rate));
+        }
+        ui64Samples += ui32Count;
 
-        printf("\r\nGYRO X:%6d Y:%6d Z:%6d",
-            g_tGyroData.x,g_tGyroData.y,g_tGyroData.z);
-        sleep(1);
+        if (ui64Now >= ui64NextReport)
+        {
+            printf("\r\nGYRO X:%8.3f Y:%8.3f Z:%8.3f dps  %7.1f Hz  bus %5.1f%%  ovf %llu  irq %llu/%llu",
+                   pi16Rate[0] * GYRO_MDPS_PER_COUNT / 1000.0,
+                   pi16Rate[1] * GYRO_MDPS_PER_COUNT / 1000.0,
+                   pi16Rate[2] * GYRO_MDPS_PER_COUNT / 1000.0,
+                   (double)ui64Samples * 1e9 / (double)(ui64Now - ui64Start),
+                   I2CBusUtilization(&g_sBus, ui64Now - ui64Start) * 100.0,
+                   (unsigned long long)ui64Overruns,
+                   (unsigned long long)g_sIrq.ui64Events,
+                   (unsigned long long)g_sIrq.ui64Timeouts);
+            fflush(stdout);
+            ui64NextReport += 1000000000ULL;
+        }
     }
 }